@@ -0,0 +1,326 @@
+// times the hot paths of the volume class for a sweep of volume sizes and thread counts and
+// reports the achieved bandwidth (GB/s) and throughput (voxels/s)
+//
+// usage: CVolumeBench [options]
+//   -s, --sizes <n,...>     edge lengths of the cubic volumes, default 64,128,256
+//   -t, --threads <n,...>   thread counts, default 1 and powers of two up to the processors
+//   -r, --repeats <n>       runs per case, the median is reported, default 5
+//   -f, --filter <text>     only run cases whose name contains text
+//   -d, --dir <path>        directory for the file format cases, default temp directory
+//   -j, --json <path>       write results as JSON
+//
+// bytes are counted as the data a case has to touch at least (e.g. read and write for
+// in place operators), file reads are served from the page cache
+
+#include "volume.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct benchCase {
+	std::string name;
+	std::string group;
+	double bytes = 0; // bytes touched per run
+	double voxels = 0; // voxels processed per run
+	std::function<void()> setup; // untimed preparation before each run
+	std::function<void()> run;
+};
+
+struct benchResult {
+	std::string name;
+	std::string group;
+	std::size_t size = 0;
+	int threads = 0;
+	std::size_t repeats = 0;
+	double median = 0; // seconds
+	double best = 0; // seconds
+	double bytes = 0;
+	double voxels = 0;
+};
+
+struct benchOptions {
+	std::vector<std::size_t> sizes = {64, 128, 256};
+	std::vector<int> threads;
+	std::size_t repeats = 5;
+	std::string filter;
+	fs::path dir = fs::temp_directory_path() / "cvolume_bench";
+	std::string jsonPath;
+};
+
+static void print_usage() {
+	std::cout << "Usage: CVolumeBench [options]" << std::endl
+		<< "  -s, --sizes <n,...>     edge lengths of the cubic volumes, default 64,128,256" << std::endl
+		<< "  -t, --threads <n,...>   thread counts, default 1 and powers of two up to the processors" << std::endl
+		<< "  -r, --repeats <n>       runs per case, the median is reported, default 5" << std::endl
+		<< "  -f, --filter <text>     only run cases whose name contains text" << std::endl
+		<< "  -d, --dir <path>        directory for the file format cases" << std::endl
+		<< "  -j, --json <path>       write results as JSON" << std::endl;
+}
+
+static std::vector<std::size_t> parse_list(const std::string& text) {
+	std::vector<std::size_t> values;
+	std::stringstream stream(text);
+	std::string entry;
+	while (std::getline(stream, entry, ',')) {
+		const long value = std::atol(entry.c_str());
+		if (value <= 0) {
+			std::cerr << "Invalid list entry: " << entry << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		values.push_back(value);
+	}
+	return values;
+}
+
+static std::vector<int> get_defaultThreads() {
+	const int nProcessors = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<int> threads;
+	for (int nThreads = 1; nThreads < nProcessors; nThreads *= 2)
+		threads.push_back(nThreads);
+	threads.push_back(nProcessors);
+	return threads;
+}
+
+static std::string get_cpuName() {
+	std::ifstream cpuInfo("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(cpuInfo, line)) {
+		if (line.rfind("model name", 0) == 0) {
+			const std::size_t pos = line.find(':');
+			if (pos != std::string::npos)
+				return line.substr(line.find_first_not_of(" \t", pos + 1));
+		}
+	}
+	return "unknown";
+}
+
+// runs a case repeatedly and returns the sorted run times in seconds
+static std::vector<double> time_case(const benchCase& curr, const std::size_t repeats) {
+	std::vector<double> times;
+	for (std::size_t iRun = 0; iRun < repeats; iRun++) {
+		if (curr.setup) curr.setup();
+		const auto tStart = std::chrono::steady_clock::now();
+		curr.run();
+		const auto tStop = std::chrono::steady_clock::now();
+		times.push_back(std::chrono::duration<double>(tStop - tStart).count());
+	}
+	std::sort(times.begin(), times.end());
+	return times;
+}
+
+// all cases for a single volume size, the volumes use nThreads for parallel operations
+static std::vector<benchCase> get_cases(volume& volA, volume& volB, volume& volC,
+	const fs::path& dir)
+{
+	const double n = volA.get_nElements();
+	const double nBytes = n * sizeof(float);
+	std::vector<benchCase> cases;
+	const auto add = [&](const std::string& name, const std::string& group, const double bytes,
+		const double voxels, const std::function<void()>& run,
+		const std::function<void()>& setup = nullptr) {
+		benchCase curr;
+		curr.name = name;
+		curr.group = group;
+		curr.bytes = bytes;
+		curr.voxels = voxels;
+		curr.run = run;
+		curr.setup = setup;
+		cases.push_back(curr);
+	};
+
+	// element wise operators with a scalar read and write every voxel once
+	add("mult_scalar", "elementwise", 2 * nBytes, n, [&]() { volA *= 1.0001f; });
+	add("div_scalar", "elementwise", 2 * nBytes, n, [&]() { volA /= 1.0001f; });
+	add("add_scalar", "elementwise", 2 * nBytes, n, [&]() { volA += 0.5f; });
+	add("sub_scalar", "elementwise", 2 * nBytes, n, [&]() { volA -= 0.5f; });
+
+	// volume volume operators read both volumes and write one
+	add("mult_volume", "volume", 3 * nBytes, n, [&]() { volA *= volB; });
+	add("div_volume", "volume", 3 * nBytes, n, [&]() { volA /= volB; });
+	add("add_volume", "volume", 3 * nBytes, n, [&]() { volA += volB; });
+	add("sub_volume", "volume", 3 * nBytes, n, [&]() { volA -= volB; });
+
+	// reductions and projections
+	add("calcMinMax", "analysis", nBytes, n, [&]() { volA.calcMinMax(); });
+	add("calcMips", "analysis", nBytes, n, [&]() { volA.calcMips(); });
+	float cropRange[6];
+	for (uint8_t iDim = 0; iDim < 3; iDim++) {
+		const std::size_t nDim = volA.get_dim(iDim);
+		cropRange[2 * iDim] = volA.get_pos(nDim / 4, iDim);
+		cropRange[2 * iDim + 1] = volA.get_pos((3 * nDim) / 4, iDim);
+	}
+	add("calcCroppedMips", "analysis", nBytes / 8, n / 8,
+		[&, cropRange]() { volA.calcCroppedMips(cropRange); });
+	add("normalize", "analysis", 3 * nBytes, n, [&]() { volA.normalize(); });
+	add("fill_rand", "analysis", nBytes, n, [&]() { volA.fill_rand(-1.0f, 1.0f); });
+
+	// all slices along an axis, level 0 is cached after the first run so we start at 1
+	const auto add_slices = [&](const std::string& name, const uint8_t iDim,
+		const std::function<void(std::size_t)>& get) {
+		add(name, "slices", 2 * nBytes, n, [&, iDim, get]() {
+			const std::size_t nLevels = volA.get_dim(iDim);
+			for (std::size_t iLevel = 1; iLevel <= nLevels; iLevel++)
+				get(iLevel % nLevels);
+		});
+	};
+	add_slices("get_psliceX", 0, [&](const std::size_t iLevel) { (void) volA.get_psliceX(iLevel); });
+	add_slices("get_psliceY", 1, [&](const std::size_t iLevel) { (void) volA.get_psliceY(iLevel); });
+	add_slices("get_psliceZ", 2, [&](const std::size_t iLevel) { (void) volA.get_psliceZ(iLevel); });
+
+	// crop the central half of a fresh copy
+	std::size_t startIdx[3], stopIdx[3];
+	for (uint8_t iDim = 0; iDim < 3; iDim++) {
+		startIdx[iDim] = volA.get_dim(iDim) / 4;
+		stopIdx[iDim] = (3 * volA.get_dim(iDim)) / 4 - 1;
+	}
+	add("crop", "analysis", 2 * nBytes / 8, n / 8,
+		[&, startIdx, stopIdx]() { volC.crop(startIdx, stopIdx); },
+		[&]() { volC = volB; });
+
+	// each format is saved and read back, reads come from the page cache
+	for (const std::string ext : {"h5", "nii", "nii.gz", "cvol", "zarr"}) {
+		const std::string filePath = (dir / ("bench." + ext)).string();
+		add("save_" + ext, "io", nBytes, n, [&, filePath]() { volB.saveToFile(filePath); });
+		add("read_" + ext, "io", nBytes, n, [&, filePath]() { volC.readFromFile(filePath); },
+			[&]() { volC.set_mapFiles(false); });
+	}
+	const std::string cvolPath = (dir / "bench.cvol").string();
+	add("read_cvol_mapped", "io", nBytes, n, [&, cvolPath]() { volC.readFromFile(cvolPath); },
+		[&]() { volC.set_mapFiles(true); });
+
+	return cases;
+}
+
+static void write_json(std::ostream& out, const std::vector<benchResult>& results,
+	const benchOptions& opt)
+{
+	char timeStamp[32];
+	const std::time_t now = std::time(nullptr);
+	std::strftime(timeStamp, sizeof(timeStamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+	out << "{" << std::endl
+		<< "  \"version\": \"" << CVOLUME_VERSION << "\"," << std::endl
+		<< "  \"timestamp\": \"" << timeStamp << "\"," << std::endl
+		<< "  \"cpu\": \"" << get_cpuName() << "\"," << std::endl
+		<< "  \"processors\": " << std::thread::hardware_concurrency() << "," << std::endl
+		<< "  \"repeats\": " << opt.repeats << "," << std::endl
+		<< "  \"results\": [" << std::endl;
+	for (std::size_t iResult = 0; iResult < results.size(); iResult++) {
+		const benchResult& curr = results[iResult];
+		out << "    {\"name\": \"" << curr.name << "\", \"group\": \"" << curr.group
+			<< "\", \"size\": " << curr.size << ", \"threads\": " << curr.threads
+			<< ", \"seconds_median\": " << curr.median << ", \"seconds_min\": " << curr.best
+			<< ", \"bytes\": " << curr.bytes << ", \"voxels\": " << curr.voxels
+			<< ", \"gb_per_s\": " << curr.bytes / curr.median * 1e-9
+			<< ", \"voxels_per_s\": " << curr.voxels / curr.median << "}"
+			<< ((iResult + 1 < results.size()) ? "," : "") << std::endl;
+	}
+	out << "  ]" << std::endl << "}" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	benchOptions opt;
+	opt.threads = get_defaultThreads();
+	for (int iArg = 1; iArg < argc; iArg++) {
+		const std::string arg = argv[iArg];
+		const bool flagValue = (iArg + 1 < argc);
+		if ((arg == "-h") || (arg == "--help")) {
+			print_usage();
+			return EXIT_SUCCESS;
+		} else if (((arg == "-s") || (arg == "--sizes")) && flagValue) {
+			opt.sizes = parse_list(argv[++iArg]);
+		} else if (((arg == "-t") || (arg == "--threads")) && flagValue) {
+			opt.threads.clear();
+			for (const std::size_t nThreads : parse_list(argv[++iArg]))
+				opt.threads.push_back(nThreads);
+		} else if (((arg == "-r") || (arg == "--repeats")) && flagValue) {
+			opt.repeats = parse_list(argv[++iArg])[0];
+		} else if (((arg == "-f") || (arg == "--filter")) && flagValue) {
+			opt.filter = argv[++iArg];
+		} else if (((arg == "-d") || (arg == "--dir")) && flagValue) {
+			opt.dir = argv[++iArg];
+		} else if (((arg == "-j") || (arg == "--json")) && flagValue) {
+			opt.jsonPath = argv[++iArg];
+		} else {
+			std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+			print_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	char line[256];
+	snprintf(line, sizeof(line), "%-18s %-12s %6s %8s %12s %10s %12s",
+		"case", "group", "size", "threads", "median [ms]", "GB/s", "Mvoxels/s");
+	std::cout << line << std::endl;
+
+	std::vector<benchResult> results;
+	for (const std::size_t size : opt.sizes) {
+		// files of the previous size must not be read
+		fs::remove_all(opt.dir);
+		fs::create_directories(opt.dir);
+		volume volA(size, size, size);
+		volume volB(size, size, size);
+		volume volC(size, size, size);
+		volA.fill_rand(1.0f, 2.0f);
+		volB.fill_rand(1.0f, 2.0f);
+		volB.set_zarrCompressionLevel(1);
+		const std::vector<benchCase> cases = get_cases(volA, volB, volC, opt.dir);
+
+		for (const int nThreads : opt.threads) {
+			volA.set_nThreads(nThreads);
+			volB.set_nThreads(nThreads);
+			volC.set_nThreads(nThreads);
+			for (const benchCase& curr : cases) {
+				if (!opt.filter.empty() && (curr.name.find(opt.filter) == std::string::npos))
+					continue;
+				// reads need the file of the matching save, which may have been filtered out
+				if (curr.name.rfind("read_", 0) == 0) {
+					const std::string ext = curr.name.substr(5, curr.name.find("_mapped") - 5);
+					const fs::path filePath = opt.dir / ("bench." + ext);
+					if (!fs::exists(filePath))
+						volB.saveToFile(filePath.string());
+				}
+
+				const std::vector<double> times = time_case(curr, opt.repeats);
+				benchResult result;
+				result.name = curr.name;
+				result.group = curr.group;
+				result.size = size;
+				result.threads = nThreads;
+				result.repeats = opt.repeats;
+				result.median = times[times.size() / 2];
+				result.best = times[0];
+				result.bytes = curr.bytes;
+				result.voxels = curr.voxels;
+				results.push_back(result);
+
+				snprintf(line, sizeof(line), "%-18s %-12s %6lu %8d %12.3f %10.2f %12.1f",
+					result.name.c_str(), result.group.c_str(), size, nThreads, result.median * 1e3,
+					result.bytes / result.median * 1e-9, result.voxels / result.median * 1e-6);
+				std::cout << line << std::endl;
+			}
+		}
+	}
+
+	if (!opt.jsonPath.empty()) {
+		std::ofstream out(opt.jsonPath);
+		write_json(out, results, opt);
+		if (!out) {
+			std::cerr << "Error writing " << opt.jsonPath << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	fs::remove_all(opt.dir);
+	return EXIT_SUCCESS;
+}
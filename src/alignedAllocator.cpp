@@ -0,0 +1,105 @@
+#include "alignedAllocator.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <sys/mman.h>
+#include <unordered_map>
+
+static std::atomic<HugePages> hugePageMode{HugePages::TRANSPARENT};
+static std::atomic<std::size_t> hugeThreshold{alignedMemory::HUGE_PAGE_SIZE};
+static std::atomic<uint64_t> nAllocations{0};
+static std::atomic<uint64_t> nTransparent{0};
+static std::atomic<uint64_t> nExplicit{0};
+
+// blocks mapped from hugetlbfs need munmap instead of free, never destroyed so that buffers
+// released during static destruction still find their entry
+static std::mutex& get_mappedMutex() {
+  static std::mutex* mappedMutex = new std::mutex();
+  return *mappedMutex;
+}
+
+static std::unordered_map<void*, std::size_t>& get_mapped() {
+  static auto* mapped = new std::unordered_map<void*, std::size_t>();
+  return *mapped;
+}
+
+static std::size_t round_up(const std::size_t nBytes, const std::size_t multiple) {
+  return (nBytes + multiple - 1) / multiple * multiple;
+}
+
+void alignedMemory::set_hugePages(const HugePages _mode) { hugePageMode.store(_mode); }
+
+HugePages alignedMemory::get_hugePages() { return hugePageMode.load(); }
+
+void alignedMemory::set_hugeThreshold(const std::size_t _nBytes) { hugeThreshold.store(_nBytes); }
+
+void* alignedMemory::allocate(const std::size_t nBytes) {
+  nAllocations++;
+  const HugePages mode = hugePageMode.load(std::memory_order_relaxed);
+  const bool flagHuge = (mode != HugePages::NONE) && (nBytes >= hugeThreshold.load());
+
+#ifdef MAP_HUGETLB
+  if (flagHuge && (mode == HugePages::EXPLICIT)) {
+    const std::size_t length = round_up(nBytes, HUGE_PAGE_SIZE);
+    void* ptr =
+        mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+      {
+        std::lock_guard<std::mutex> lock(get_mappedMutex());
+        get_mapped()[ptr] = length;
+      }
+      nExplicit++;
+      return ptr;
+    }
+    // pool empty or not configured: continue with transparent huge pages
+  }
+#endif
+
+  const std::size_t alignment = flagHuge ? HUGE_PAGE_SIZE : ALIGNMENT;
+  void* ptr = std::aligned_alloc(alignment, round_up(std::max<std::size_t>(nBytes, 1), alignment));
+  if (ptr == nullptr) throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+  if (flagHuge && (madvise(ptr, round_up(nBytes, HUGE_PAGE_SIZE), MADV_HUGEPAGE) == 0))
+    nTransparent++;
+#endif
+  return ptr;
+}
+
+void alignedMemory::deallocate(void* ptr, const std::size_t nBytes) noexcept {
+  if (ptr == nullptr) return;
+  if (nExplicit.load(std::memory_order_relaxed) > 0) {
+    std::size_t length = 0;
+    {
+      std::lock_guard<std::mutex> lock(get_mappedMutex());
+      auto entry = get_mapped().find(ptr);
+      if (entry != get_mapped().end()) {
+        length = entry->second;
+        get_mapped().erase(entry);
+      }
+    }
+    if (length > 0) {
+      munmap(ptr, length);
+      return;
+    }
+  }
+  (void)nBytes;
+  std::free(ptr);
+}
+
+alignedMemoryStats alignedMemory::get_stats() {
+  alignedMemoryStats stats;
+  stats.nAllocations = nAllocations.load();
+  stats.nTransparent = nTransparent.load();
+  stats.nExplicit = nExplicit.load();
+  return stats;
+}
+
+std::size_t alignedMemory::get_alignment(const void* ptr, const std::size_t maxAlignment) {
+  const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+  std::size_t alignment = 1;
+  while ((alignment < maxAlignment) && (address % (alignment * 2) == 0))
+    alignment *= 2;
+  return alignment;
+}
@@ -0,0 +1,89 @@
+/*
+  File: alignedAllocator.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: allocator for the voxel arrays of volumes. Every block starts on
+  a cache line (64 bytes) so vector loads never straddle two lines. Blocks of
+  at least the huge page threshold are aligned to 2 MiB and backed by huge
+  pages to cut TLB misses in strided slice and projection code: either
+  transparent huge pages requested through madvise or, if asked for, pages
+  from the hugetlbfs pool. Whatever the kernel refuses falls back to the next
+  weaker mode, down to normal pages.
+*/
+
+#ifndef ALIGNEDALLOCATOR_H
+#define ALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+enum class HugePages {
+  NONE,        // normal pages only
+  TRANSPARENT, // madvise(MADV_HUGEPAGE), default
+  EXPLICIT     // mmap(MAP_HUGETLB) from the reserved pool, transparent if the pool is empty
+};
+
+struct alignedMemoryStats {
+  uint64_t nAllocations = 0;
+  uint64_t nTransparent = 0; // blocks the kernel accepted the huge page advice for
+  uint64_t nExplicit = 0;    // blocks mapped from hugetlbfs
+};
+
+class alignedMemory {
+public:
+  static constexpr std::size_t ALIGNMENT = 64;                  // guaranteed for every block
+  static constexpr std::size_t HUGE_PAGE_SIZE = std::size_t(2) << 20;
+
+  static void set_hugePages(const HugePages _mode);
+  [[nodiscard]] static HugePages get_hugePages();
+
+  /// \brief blocks of at least this many bytes are backed by huge pages (default 2 MiB)
+  static void set_hugeThreshold(const std::size_t _nBytes);
+
+  [[nodiscard]] static void* allocate(const std::size_t nBytes);
+  static void deallocate(void* ptr, const std::size_t nBytes) noexcept;
+
+  [[nodiscard]] static alignedMemoryStats get_stats();
+
+  /// \brief largest power of two up to maxAlignment which divides the address
+  [[nodiscard]] static std::size_t get_alignment(const void* ptr, const std::size_t maxAlignment);
+};
+
+template <typename T> class alignedAllocator {
+public:
+  using value_type = T;
+
+  alignedAllocator() noexcept = default;
+  template <typename U> alignedAllocator(const alignedAllocator<U>&) noexcept {}
+
+  [[nodiscard]] T* allocate(const std::size_t n) {
+    return static_cast<T*>(alignedMemory::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, const std::size_t n) noexcept {
+    alignedMemory::deallocate(ptr, n * sizeof(T));
+  }
+
+  // default initialization: resize() leaves new floats uninitialized, owners zero them only
+  // where the content is not overwritten anyway
+  template <typename U>
+  void construct(U* ptr) noexcept(std::is_nothrow_default_constructible<U>::value) {
+    ::new (static_cast<void*>(ptr)) U;
+  }
+  template <typename U, typename... Args> void construct(U* ptr, Args&&... args) {
+    ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U> bool operator==(const alignedAllocator<U>&) const noexcept { return true; }
+  template <typename U> bool operator!=(const alignedAllocator<U>&) const noexcept { return false; }
+};
+
+// voxel array owned by a volume, see volumeStorage
+using floatBuffer = std::vector<float, alignedAllocator<float>>;
+
+#endif
@@ -0,0 +1,136 @@
+#include "bufferPool.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+struct poolState {
+  std::mutex mutex;
+  std::unordered_map<std::size_t, std::vector<floatBuffer>> buffers; // by nElements
+  bool flagEnabled = false;
+  std::size_t maxBytes = std::size_t(1) << 30;
+  std::size_t maxPerSize = 4;
+  std::size_t minBytes = std::size_t(1) << 18;
+  bufferPoolStats stats;
+};
+
+// never destroyed, volumes with static lifetime still hand their buffers back at exit
+static poolState& get_state() {
+  static poolState* state = new poolState();
+  return *state;
+}
+
+void bufferPool::set_enabled(const bool _flagEnabled) {
+  poolState& state = get_state();
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.flagEnabled = _flagEnabled;
+  }
+  if (!_flagEnabled) trim();
+}
+
+bool bufferPool::is_enabled() {
+  poolState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.flagEnabled;
+}
+
+void bufferPool::set_maxBytes(const std::size_t _maxBytes) {
+  poolState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.maxBytes = _maxBytes;
+}
+
+void bufferPool::set_maxPerSize(const std::size_t _maxPerSize) {
+  poolState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.maxPerSize = _maxPerSize;
+}
+
+void bufferPool::set_minBytes(const std::size_t _minBytes) {
+  poolState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.minBytes = _minBytes;
+}
+
+floatBuffer bufferPool::acquire(const std::size_t nElements, const bool flagZero) {
+  poolState& state = get_state();
+  floatBuffer buffer;
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.stats.nAcquired++;
+    auto entry = state.buffers.find(nElements);
+    if ((entry != state.buffers.end()) && !entry->second.empty()) {
+      buffer = std::move(entry->second.back());
+      entry->second.pop_back();
+      state.stats.nHits++;
+      state.stats.bytesRetained -= nElements * sizeof(float);
+    }
+  }
+
+  if (buffer.size() == nElements) {
+    // pages are already faulted in, only clear them if the caller relies on zeros
+    if (flagZero) memset(buffer.data(), 0, nElements * sizeof(float));
+  } else {
+    buffer.resize(nElements); // the allocator leaves fresh memory uninitialized
+    if (flagZero) memset(buffer.data(), 0, nElements * sizeof(float));
+  }
+  return buffer;
+}
+
+void bufferPool::recycle(floatBuffer&& buffer) noexcept {
+  poolState& state = get_state();
+  const std::size_t nElements = buffer.size();
+  const std::size_t nBytes = nElements * sizeof(float);
+  floatBuffer dropped; // freed outside of the lock
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (!state.flagEnabled || (nBytes < state.minBytes) || (nBytes == 0)) {
+      dropped.swap(buffer);
+    } else {
+      try {
+        std::vector<floatBuffer>& bucket = state.buffers[nElements];
+        if ((bucket.size() >= state.maxPerSize) ||
+            (state.stats.bytesRetained + nBytes > state.maxBytes)) {
+          state.stats.nDropped++;
+          dropped.swap(buffer);
+        } else {
+          bucket.push_back(std::move(buffer));
+          state.stats.nRecycled++;
+          state.stats.bytesRetained += nBytes;
+          state.stats.peakBytesRetained =
+              std::max(state.stats.peakBytesRetained, state.stats.bytesRetained);
+        }
+      } catch (const std::bad_alloc&) {
+        // called from destructors, running out of memory for the bookkeeping just frees it
+        state.stats.nDropped++;
+        dropped.swap(buffer);
+      }
+    }
+  }
+  buffer.clear();
+}
+
+void bufferPool::trim() {
+  poolState& state = get_state();
+  std::unordered_map<std::size_t, std::vector<floatBuffer>> dropped;
+  std::lock_guard<std::mutex> lock(state.mutex);
+  dropped.swap(state.buffers);
+  state.stats.bytesRetained = 0;
+}
+
+bufferPoolStats bufferPool::get_stats() {
+  poolState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.stats;
+}
+
+void bufferPool::reset_stats() {
+  poolState& state = get_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  const std::size_t bytesRetained = state.stats.bytesRetained;
+  state.stats = bufferPoolStats();
+  state.stats.bytesRetained = bytesRetained;
+  state.stats.peakBytesRetained = bytesRetained;
+}
@@ -0,0 +1,56 @@
+/*
+  File: bufferPool.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: process wide pool of float buffers keyed by their number of
+  elements. Loops which create and destroy volumes of the same shape get the
+  memory of the previous iteration back instead of mapping, faulting in and
+  zeroing fresh pages. The pool is off by default, retention is limited by a
+  total byte budget and a number of buffers per size. Buffers below a minimum
+  size are never pooled, malloc serves those well enough.
+*/
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include "alignedAllocator.h"
+#include <cstddef>
+#include <cstdint>
+
+struct bufferPoolStats {
+  uint64_t nAcquired = 0;        // buffers handed out by acquire
+  uint64_t nHits = 0;            // of those served from the pool
+  uint64_t nRecycled = 0;        // buffers taken back into the pool
+  uint64_t nDropped = 0;         // buffers freed because a retention limit was reached
+  std::size_t bytesRetained = 0; // bytes currently held by the pool
+  std::size_t peakBytesRetained = 0;
+};
+
+class bufferPool {
+public:
+  static void set_enabled(const bool _flagEnabled);
+  [[nodiscard]] static bool is_enabled();
+
+  /// \brief upper limit for the bytes kept by the pool over all sizes (default 1 GiB)
+  static void set_maxBytes(const std::size_t _maxBytes);
+  /// \brief upper limit for the number of buffers kept per size (default 4)
+  static void set_maxPerSize(const std::size_t _maxPerSize);
+  /// \brief buffers smaller than this are never pooled (default 256 kiB)
+  static void set_minBytes(const std::size_t _minBytes);
+
+  /// \brief returns a buffer of nElements
+  /// \param flagZero zero fill reused buffers, fresh ones are always zero
+  [[nodiscard]] static floatBuffer acquire(const std::size_t nElements, const bool flagZero);
+
+  /// \brief hands a buffer back, it is kept for the next acquire of its size or freed
+  static void recycle(floatBuffer&& buffer) noexcept;
+
+  /// \brief frees all buffers held by the pool
+  static void trim();
+
+  [[nodiscard]] static bufferPoolStats get_stats();
+  static void reset_stats();
+};
+
+#endif
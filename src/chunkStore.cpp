@@ -0,0 +1,454 @@
+#include "chunkStore.h"
+#include "internalHelpers.h"
+#include "typeConversion.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <zlib.h>
+
+// partial chunk updates of a process are serialized through a fixed set of locks
+#define CHUNKSTORE_LOCKS 64
+static std::mutex chunkLocks[CHUNKSTORE_LOCKS];
+static std::atomic<std::size_t> tmpCounter{0};
+
+// writes a file under a temporary name and renames it, readers never see half a file
+static void write_atomic(const std::string& filePath, const void* buffer, const std::size_t nBytes) {
+  const std::string tmpPath =
+      filePath + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(tmpCounter++);
+  FILE* fp = fopen(tmpPath.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error opening file %s for write\n", tmpPath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  const bool flagWritten = (fwrite(buffer, 1, nBytes, fp) == nBytes);
+  if ((fclose(fp) != 0) || !flagWritten) {
+    std::filesystem::remove(tmpPath);
+    printf("Error writing to %s\n", tmpPath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tmpPath, filePath, error);
+  if (error) {
+    std::filesystem::remove(tmpPath);
+    printf("Error moving %s into place\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
+
+// reads a whole file, returns false if it does not exist
+static bool read_whole(const std::string& filePath, std::vector<unsigned char>& content) {
+  FILE* fp = fopen(filePath.c_str(), "rb");
+  if (fp == nullptr) {
+    if (!std::filesystem::exists(filePath)) return false;
+    printf("Error opening file %s for read\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  fseek(fp, 0, SEEK_END);
+  const long nBytes = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  content.resize((nBytes > 0) ? nBytes : 0);
+  const bool flagRead = (fread(content.data(), 1, content.size(), fp) == content.size());
+  fclose(fp);
+  if ((nBytes < 0) || !flagRead) {
+    printf("Error reading %s\n", filePath.c_str());
+    throw std::runtime_error("ReadError");
+  }
+  return true;
+}
+
+// position right after "key": in a json text, npos if the key is missing
+static std::size_t find_value(const std::string& json, const std::string& key) {
+  std::size_t pos = json.find("\"" + key + "\"");
+  if (pos == std::string::npos) return pos;
+  pos = json.find(':', pos + key.length() + 2);
+  if (pos == std::string::npos) return pos;
+  return json.find_first_not_of(" \t\r\n", pos + 1);
+}
+
+static std::vector<double> get_numbers(const std::string& json, const std::string& key) {
+  std::vector<double> numbers;
+  const std::size_t pos = find_value(json, key);
+  if ((pos == std::string::npos) || (json[pos] != '[')) return numbers;
+
+  const char* ptr = json.c_str() + pos + 1;
+  while (true) {
+    while ((*ptr == ' ') || (*ptr == ',') || (*ptr == '\n') || (*ptr == '\t') || (*ptr == '\r'))
+      ptr++;
+    if ((*ptr == ']') || (*ptr == '\0')) break;
+    char* end;
+    numbers.push_back(strtod(ptr, &end));
+    if (end == ptr) break;
+    ptr = end;
+  }
+  return numbers;
+}
+
+static bool get_number(const std::string& json, const std::string& key, double& value) {
+  const std::size_t pos = find_value(json, key);
+  if (pos == std::string::npos) return false;
+  char* end;
+  value = strtod(json.c_str() + pos, &end);
+  return end != json.c_str() + pos;
+}
+
+// value of a string entry, empty if missing or null
+static std::string get_string(const std::string& json, const std::string& key) {
+  const std::size_t pos = find_value(json, key);
+  if ((pos == std::string::npos) || (json[pos] != '"')) return "";
+  return json.substr(pos + 1, json.find('"', pos + 1) - pos - 1);
+}
+
+// copies the box [srcStart, srcStart + count) of one array into another
+static void copy_box(const float* src,
+                     const std::size_t* srcDim,
+                     const std::size_t* srcStart,
+                     float* dst,
+                     const std::size_t* dstDim,
+                     const std::size_t* dstStart,
+                     const std::size_t* count) {
+  for (std::size_t i2 = 0; i2 < count[2]; i2++) {
+    for (std::size_t i1 = 0; i1 < count[1]; i1++) {
+      const float* srcRow = src + srcStart[0] + srcDim[0] * (srcStart[1] + i1 + srcDim[1] * (srcStart[2] + i2));
+      float* dstRow = dst + dstStart[0] + dstDim[0] * (dstStart[1] + i1 + dstDim[1] * (dstStart[2] + i2));
+      memcpy(dstRow, srcRow, count[0] * sizeof(float));
+    }
+  }
+}
+
+std::size_t chunkStore::get_nChunks(const uint8_t iDim) const {
+  return (dim[iDim] + chunkDim[iDim] - 1) / chunkDim[iDim];
+}
+
+std::size_t chunkStore::get_chunkElements() const {
+  return chunkDim[0] * chunkDim[1] * chunkDim[2];
+}
+
+std::string chunkStore::get_chunkPath(const std::size_t* chunkIdx) const {
+  const std::string key = std::to_string(chunkIdx[2]) + separator + std::to_string(chunkIdx[1]) +
+                          separator + std::to_string(chunkIdx[0]);
+  return (std::filesystem::path(path) / key).string();
+}
+
+void chunkStore::check_box(const std::size_t* startIdx, const std::size_t* blockDim) const {
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if (startIdx[iDim] + blockDim[iDim] > dim[iDim]) {
+      printf("Box is exceeding the store along dim %d (%lu of %lu)\n",
+             iDim,
+             startIdx[iDim] + blockDim[iDim],
+             dim[iDim]);
+      throw std::runtime_error("InvalidValue");
+    }
+  }
+}
+
+void chunkStore::create(const std::string& dirPath,
+                        const std::size_t* _dim,
+                        const std::size_t* _chunkDim,
+                        const float* _res,
+                        const float* _origin,
+                        const int _compressionLevel) {
+  if ((_compressionLevel < 0) || (_compressionLevel > 9)) {
+    printf("Compression level needs to be between 0 and 9\n");
+    throw std::runtime_error("InvalidValue");
+  }
+
+  path = dirPath;
+  compressionLevel = _compressionLevel;
+  fillValue = 0.0f;
+  flagSwap = false;
+  separator = '.';
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    dim[iDim] = _dim[iDim];
+    const std::size_t requested = (_chunkDim[iDim] == 0) ? CHUNKSTORE_DEFAULT_CHUNK : _chunkDim[iDim];
+    chunkDim[iDim] = std::max<std::size_t>(1, std::min(requested, dim[iDim]));
+    res[iDim] = _res[iDim];
+    origin[iDim] = _origin[iDim];
+  }
+
+  // chunks of an earlier store would show through where the new one is not written, they are
+  // only cleared if the directory really is a store, any other content is left alone
+  if (std::filesystem::exists(std::filesystem::path(path) / ".zarray")) {
+    for (const auto& entry : std::filesystem::directory_iterator(path)) {
+      const std::string name = entry.path().filename().string();
+      if (!name.empty() && isdigit(name[0])) std::filesystem::remove_all(entry.path());
+    }
+  } else if (std::filesystem::is_directory(path) && !std::filesystem::is_empty(path)) {
+    printf("Directory %s is not empty and not a zarr array, refusing to write into it\n",
+           path.c_str());
+    throw std::runtime_error("FileError");
+  }
+  std::filesystem::create_directories(path);
+
+  const char* dtype = typeConversion::is_littleEndian() ? "<f4" : ">f4";
+  char compressor[64] = "null";
+  if (compressionLevel > 0)
+    snprintf(compressor, sizeof(compressor), "{\"id\": \"zlib\", \"level\": %d}", compressionLevel);
+
+  char zarray[1024];
+  const int nArray = snprintf(zarray,
+                              sizeof(zarray),
+                              "{\n"
+                              "  \"zarr_format\": 2,\n"
+                              "  \"shape\": [%lu, %lu, %lu],\n"
+                              "  \"chunks\": [%lu, %lu, %lu],\n"
+                              "  \"dtype\": \"%s\",\n"
+                              "  \"compressor\": %s,\n"
+                              "  \"fill_value\": 0.0,\n"
+                              "  \"order\": \"C\",\n"
+                              "  \"filters\": null,\n"
+                              "  \"dimension_separator\": \".\"\n"
+                              "}\n",
+                              dim[2],
+                              dim[1],
+                              dim[0],
+                              chunkDim[2],
+                              chunkDim[1],
+                              chunkDim[0],
+                              dtype,
+                              compressor);
+  write_atomic((std::filesystem::path(path) / ".zarray").string(), zarray, nArray);
+
+  char zattrs[512];
+  const int nAttrs = snprintf(zattrs,
+                              sizeof(zattrs),
+                              "{\n"
+                              "  \"res\": [%.9g, %.9g, %.9g],\n"
+                              "  \"origin\": [%.9g, %.9g, %.9g]\n"
+                              "}\n",
+                              res[0],
+                              res[1],
+                              res[2],
+                              origin[0],
+                              origin[1],
+                              origin[2]);
+  write_atomic((std::filesystem::path(path) / ".zattrs").string(), zattrs, nAttrs);
+}
+
+void chunkStore::open(const std::string& dirPath) {
+  path = dirPath;
+  std::vector<unsigned char> content;
+  if (!read_whole((std::filesystem::path(path) / ".zarray").string(), content)) {
+    printf("%s is not a chunk store (no .zarray)\n", path.c_str());
+    throw std::runtime_error("FileError");
+  }
+  const std::string zarray(content.begin(), content.end());
+
+  double format = 0;
+  const std::vector<double> shape = get_numbers(zarray, "shape");
+  const std::vector<double> chunks = get_numbers(zarray, "chunks");
+  if (!get_number(zarray, "zarr_format", format) || (format != 2) || (shape.size() != 3) ||
+      (chunks.size() != 3)) {
+    printf("%s is not a three dimensional zarr v2 array\n", path.c_str());
+    throw std::runtime_error("InvalidType");
+  }
+
+  const std::string dtype = get_string(zarray, "dtype");
+  if (((dtype != "<f4") && (dtype != ">f4")) || (get_string(zarray, "order") == "F")) {
+    printf("Only float32 arrays in C order are supported (%s)\n", dtype.c_str());
+    throw std::runtime_error("InvalidType");
+  }
+  flagSwap = ((dtype[0] == '<') != typeConversion::is_littleEndian());
+
+  const std::size_t filterPos = find_value(zarray, "filters");
+  if ((filterPos != std::string::npos) && (zarray.compare(filterPos, 4, "null") != 0)) {
+    printf("Filters of %s are not supported\n", path.c_str());
+    throw std::runtime_error("InvalidType");
+  }
+
+  compressionLevel = 0;
+  const std::size_t compPos = find_value(zarray, "compressor");
+  if ((compPos != std::string::npos) && (zarray.compare(compPos, 4, "null") != 0)) {
+    const std::string compressor = zarray.substr(compPos, zarray.find('}', compPos) - compPos);
+    if (get_string(compressor, "id") != "zlib") {
+      printf("Compressor %s is not supported\n", get_string(compressor, "id").c_str());
+      throw std::runtime_error("InvalidType");
+    }
+    double level = 1;
+    get_number(compressor, "level", level);
+    compressionLevel = std::max(1, (int)level);
+  }
+
+  double fill = 0;
+  fillValue = get_number(zarray, "fill_value", fill) ? (float)fill : 0.0f;
+  separator = (get_string(zarray, "dimension_separator") == "/") ? '/' : '.';
+
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    dim[iDim] = (std::size_t)shape[2 - iDim];
+    chunkDim[iDim] = std::max<std::size_t>(1, (std::size_t)chunks[2 - iDim]);
+    res[iDim] = 1.0f;
+    origin[iDim] = 0.0f;
+  }
+
+  // resolution and origin are optional attributes
+  if (read_whole((std::filesystem::path(path) / ".zattrs").string(), content)) {
+    const std::string zattrs(content.begin(), content.end());
+    const std::vector<double> attrRes = get_numbers(zattrs, "res");
+    const std::vector<double> attrOrigin = get_numbers(zattrs, "origin");
+    for (uint8_t iDim = 0; iDim < 3; iDim++) {
+      if (attrRes.size() == 3) res[iDim] = attrRes[iDim];
+      if (attrOrigin.size() == 3) origin[iDim] = attrOrigin[iDim];
+    }
+  }
+}
+
+void chunkStore::write_chunk(const std::size_t* chunkIdx, const float* chunk) const {
+  const std::size_t nBytes = get_chunkElements() * sizeof(float);
+  std::vector<float> swapped;
+  if (flagSwap) {
+    swapped.resize(get_chunkElements());
+    typeConversion::swapCopy(chunk, swapped.data(), swapped.size(), sizeof(float), 1);
+    chunk = swapped.data();
+  }
+
+  // nested keys need their directories
+  if (separator == '/')
+    std::filesystem::create_directories(std::filesystem::path(get_chunkPath(chunkIdx)).parent_path());
+
+  if (compressionLevel == 0) {
+    write_atomic(get_chunkPath(chunkIdx), chunk, nBytes);
+    return;
+  }
+
+  uLongf nOut = compressBound(nBytes);
+  std::vector<unsigned char> compressed(nOut);
+  if (compress2(compressed.data(), &nOut, reinterpret_cast<const Bytef*>(chunk), nBytes, compressionLevel) !=
+      Z_OK) {
+    printf("Error compressing chunk %s\n", get_chunkPath(chunkIdx).c_str());
+    throw std::runtime_error("CompressionError");
+  }
+  write_atomic(get_chunkPath(chunkIdx), compressed.data(), nOut);
+}
+
+void chunkStore::read_chunk(const std::size_t* chunkIdx, float* chunk) const {
+  const std::size_t nElements = get_chunkElements();
+  const std::size_t nBytes = nElements * sizeof(float);
+  const std::string chunkPath = get_chunkPath(chunkIdx);
+  std::vector<unsigned char> content;
+  if (!read_whole(chunkPath, content)) {
+    std::fill(chunk, chunk + nElements, fillValue);
+    return;
+  }
+
+  if (compressionLevel == 0) {
+    if (content.size() != nBytes) {
+      printf("Chunk %s holds %lu instead of %lu bytes\n", chunkPath.c_str(), content.size(), nBytes);
+      throw std::runtime_error("ReadError");
+    }
+    memcpy(chunk, content.data(), nBytes);
+  } else {
+    uLongf nOut = nBytes;
+    if ((uncompress(reinterpret_cast<Bytef*>(chunk), &nOut, content.data(), content.size()) != Z_OK) ||
+        (nOut != nBytes)) {
+      printf("Error decompressing chunk %s\n", chunkPath.c_str());
+      throw std::runtime_error("CompressionError");
+    }
+  }
+
+  if (flagSwap) typeConversion::swapCopy(chunk, chunk, nElements, sizeof(float), 1);
+}
+
+// runs func(chunkIdx, chunkStart, boxStart, count) for all chunks touched by a box in parallel,
+// chunkStart and boxStart give the first voxel of the overlap within chunk and box
+template <typename F>
+static void for_chunks(const std::size_t* chunkDim,
+                       const std::size_t* startIdx,
+                       const std::size_t* blockDim,
+                       const std::size_t nThreads,
+                       const F& func) {
+  if ((blockDim[0] == 0) || (blockDim[1] == 0) || (blockDim[2] == 0)) return;
+
+  std::size_t firstChunk[3];
+  std::size_t nTouched[3];
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    firstChunk[iDim] = startIdx[iDim] / chunkDim[iDim];
+    nTouched[iDim] = (startIdx[iDim] + blockDim[iDim] - 1) / chunkDim[iDim] - firstChunk[iDim] + 1;
+  }
+
+  run_parallel(nTouched[0] * nTouched[1] * nTouched[2], nThreads, [&](const std::size_t iJob) {
+    const std::size_t jobIdx[3] = {
+        iJob % nTouched[0], (iJob / nTouched[0]) % nTouched[1], iJob / (nTouched[0] * nTouched[1])};
+    std::size_t chunkIdx[3], chunkStart[3], boxStart[3], count[3];
+    for (uint8_t iDim = 0; iDim < 3; iDim++) {
+      chunkIdx[iDim] = firstChunk[iDim] + jobIdx[iDim];
+      const std::size_t chunkOffset = chunkIdx[iDim] * chunkDim[iDim];
+      const std::size_t overlapStart = std::max(chunkOffset, startIdx[iDim]);
+      const std::size_t overlapStop =
+          std::min(chunkOffset + chunkDim[iDim], startIdx[iDim] + blockDim[iDim]);
+      chunkStart[iDim] = overlapStart - chunkOffset;
+      boxStart[iDim] = overlapStart - startIdx[iDim];
+      count[iDim] = overlapStop - overlapStart;
+    }
+    func(chunkIdx, chunkStart, boxStart, count);
+  });
+}
+
+void chunkStore::write_block(const float* block,
+                             const std::size_t* startIdx,
+                             const std::size_t* blockDim,
+                             const std::size_t nThreads) const {
+  check_box(startIdx, blockDim);
+  for_chunks(chunkDim,
+             startIdx,
+             blockDim,
+             nThreads,
+             [&](const std::size_t* chunkIdx,
+                 const std::size_t* chunkStart,
+                 const std::size_t* boxStart,
+                 const std::size_t* count) {
+               // chunks are full if the box covers everything of them inside the volume
+               bool flagFull = true;
+               for (uint8_t iDim = 0; iDim < 3; iDim++) {
+                 const std::size_t inside =
+                     std::min(chunkDim[iDim], dim[iDim] - chunkIdx[iDim] * chunkDim[iDim]);
+                 flagFull = flagFull && (chunkStart[iDim] == 0) && (count[iDim] == inside);
+               }
+
+               std::vector<float> chunk(get_chunkElements(), fillValue);
+               if (flagFull) {
+                 // replaced as a whole by an atomic rename, no lock needed
+                 copy_box(block, blockDim, boxStart, chunk.data(), chunkDim, chunkStart, count);
+                 write_chunk(chunkIdx, chunk.data());
+                 return;
+               }
+
+               // read, merge and write back must not interleave with other partial updates
+               const std::string chunkPath = get_chunkPath(chunkIdx);
+               std::lock_guard<std::mutex> lock(
+                   chunkLocks[std::hash<std::string>{}(chunkPath) % CHUNKSTORE_LOCKS]);
+               read_chunk(chunkIdx, chunk.data());
+               copy_box(block, blockDim, boxStart, chunk.data(), chunkDim, chunkStart, count);
+               write_chunk(chunkIdx, chunk.data());
+             });
+}
+
+void chunkStore::read_block(float* block,
+                            const std::size_t* startIdx,
+                            const std::size_t* blockDim,
+                            const std::size_t nThreads) const {
+  check_box(startIdx, blockDim);
+  for_chunks(chunkDim,
+             startIdx,
+             blockDim,
+             nThreads,
+             [&](const std::size_t* chunkIdx,
+                 const std::size_t* chunkStart,
+                 const std::size_t* boxStart,
+                 const std::size_t* count) {
+               std::vector<float> chunk(get_chunkElements());
+               read_chunk(chunkIdx, chunk.data());
+               copy_box(chunk.data(), chunkDim, chunkStart, block, blockDim, boxStart, count);
+             });
+}
@@ -0,0 +1,87 @@
+/*
+  File: chunkStore.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: volume stored as a directory of independently compressed chunk
+  files following the layout of a local Zarr (v2) array. The directory holds
+  .zarray with shape, chunk shape, dtype and compressor and .zattrs with
+  resolution and origin. Arrays are indexed [dim2, dim1, dim0] in C order like
+  our h5 datasets, a chunk lives in a file named "k2.k1.k0". Every chunk is a
+  file of its own, so any number of threads can write different chunks at the
+  same time. Chunk files are replaced atomically through a rename, missing
+  chunks read as the fill value.
+*/
+
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define CHUNKSTORE_DEFAULT_CHUNK 64 // default chunk edge length along each dimension
+
+class chunkStore {
+public:
+  /// \brief creates an empty store, chunks of an existing store at the same path are removed
+  /// \param chunkDim chunk shape in volume order, zeros select CHUNKSTORE_DEFAULT_CHUNK
+  /// \param compressionLevel zlib level (1 ... 9) of the chunk files, 0 stores them raw
+  void create(const std::string& dirPath,
+              const std::size_t* dim,
+              const std::size_t* chunkDim,
+              const float* res,
+              const float* origin,
+              const int compressionLevel);
+
+  /// \brief opens an existing store, float32 arrays in either byte order are supported
+  void open(const std::string& dirPath);
+
+  /// \brief writes a single chunk, safe to call from many threads for different chunks
+  /// \param chunkIdx index of the chunk along each dimension (volume order)
+  /// \param chunk values of the full chunk, indexing i0 + chunkDim0 * (i1 + chunkDim1 * i2),
+  /// parts outside of the volume are ignored
+  void write_chunk(const std::size_t* chunkIdx, const float* chunk) const;
+
+  /// \brief reads a single chunk, missing chunks are filled with the fill value
+  void read_chunk(const std::size_t* chunkIdx, float* chunk) const;
+
+  /// \brief writes a box of the volume, chunks touched by the box are written in parallel
+  /// \details partially covered chunks are read, merged and written back under a lock, so
+  /// threads of the same process may write neighbouring boxes at the same time
+  /// \param block values of the box, indexing i0 + blockDim0 * (i1 + blockDim1 * i2)
+  void write_block(const float* block,
+                   const std::size_t* startIdx,
+                   const std::size_t* blockDim,
+                   const std::size_t nThreads) const;
+
+  /// \brief reads a box of the volume, only the chunks touched by it are read (in parallel)
+  void read_block(float* block,
+                  const std::size_t* startIdx,
+                  const std::size_t* blockDim,
+                  const std::size_t nThreads) const;
+
+  [[nodiscard]] const std::size_t* get_dim() const { return dim; }
+  [[nodiscard]] const std::size_t* get_chunkDim() const { return chunkDim; }
+  [[nodiscard]] const float* get_res() const { return res; }
+  [[nodiscard]] const float* get_origin() const { return origin; }
+  [[nodiscard]] std::size_t get_nChunks(const uint8_t iDim) const;
+  [[nodiscard]] std::size_t get_chunkElements() const;
+
+private:
+  [[nodiscard]] std::string get_chunkPath(const std::size_t* chunkIdx) const;
+  void check_box(const std::size_t* startIdx, const std::size_t* blockDim) const;
+
+  std::string path;
+  std::size_t dim[3] = {0, 0, 0};
+  std::size_t chunkDim[3] = {1, 1, 1};
+  float res[3] = {1.0f, 1.0f, 1.0f};
+  float origin[3] = {0.0f, 0.0f, 0.0f};
+  int compressionLevel = 0;
+  float fillValue = 0.0f; // value of voxels in missing chunks
+  bool flagSwap = false; // stored values are in opposite byte order
+  char separator = '.';  // dimension separator of the chunk keys
+};
+
+#endif
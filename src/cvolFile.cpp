@@ -0,0 +1,335 @@
+#include "cvolFile.h"
+#include "internalHelpers.h"
+#include "../lib/nifti/niftilib/nifti1.h"
+#include "typeConversion.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <zlib.h>
+
+static const char cvolMagic[8] = {'C', 'V', 'O', 'L', 'U', 'M', 'E', '\0'};
+static const uint32_t cvolByteOrder = 0x01020304;
+static const std::size_t cvolMaxChunk = 1 << 30; // crc32 takes 32 bit lengths
+
+static uint32_t get_crc(const void* bytes, const std::size_t nBytes, uint32_t crc = 0) {
+  return crc32(crc, static_cast<const Bytef*>(bytes), nBytes);
+}
+
+static void pread_bytes(const int fd,
+                        void* buffer,
+                        std::size_t nBytes,
+                        off_t offset,
+                        const std::string& path) {
+  unsigned char* ptr = static_cast<unsigned char*>(buffer);
+  while (nBytes > 0) {
+    const ssize_t ret = pread(fd, ptr, nBytes, offset);
+    if (ret <= 0) {
+      printf("Error reading %lu bytes at %ld from %s\n", nBytes, (long)offset, path.c_str());
+      throw std::runtime_error("ReadError");
+    }
+    ptr += ret;
+    offset += ret;
+    nBytes -= ret;
+  }
+}
+
+// layout of the projections following the checksums
+static std::size_t get_mipElements(const uint64_t* dim) {
+  return dim[1] * dim[2] + dim[0] * dim[2] + dim[0] * dim[1];
+}
+
+void cvolWriter::set_chunkSize(const std::size_t _chunkSize) {
+  if ((_chunkSize == 0) || (_chunkSize > cvolMaxChunk)) {
+    printf("Chunk size needs to be between 1 and %lu bytes\n", cvolMaxChunk);
+    throw std::runtime_error("InvalidValue");
+  }
+  chunkSize = _chunkSize;
+}
+
+void cvolWriter::set_nThreads(const std::size_t _nThreads) {
+  nThreads = std::max<std::size_t>(1, _nThreads);
+}
+
+void cvolWriter::write(const std::string& filePath,
+                       const float* data,
+                       const std::size_t* dim,
+                       const float* res,
+                       const float* origin) const {
+  cvolHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, cvolMagic, sizeof(cvolMagic));
+  header.version = 1;
+  header.byteOrder = cvolByteOrder;
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    header.dim[iDim] = dim[iDim];
+    header.res[iDim] = res[iDim];
+    header.origin[iDim] = origin[iDim];
+  }
+  header.datatype = DT_FLOAT32;
+
+  const std::size_t nElements = dim[0] * dim[1] * dim[2];
+  const std::size_t nBytes = nElements * sizeof(float);
+  header.chunkSize = chunkSize;
+  header.nChunks = (nBytes + chunkSize - 1) / chunkSize;
+  header.tableOffset = sizeof(cvolHeader);
+  header.mipOffset = header.tableOffset + header.nChunks * sizeof(uint32_t);
+  const std::size_t mipElements = flagMips ? get_mipElements(header.dim) : 0;
+  const std::size_t mipEnd = header.mipOffset + mipElements * sizeof(float);
+  header.dataOffset = ((mipEnd + CVOL_ALIGNMENT - 1) / CVOL_ALIGNMENT) * CVOL_ALIGNMENT;
+
+  // checksums and value range in a single pass over the chunks
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  std::vector<uint32_t> checksums(header.nChunks);
+  std::vector<float> chunkMin(header.nChunks);
+  std::vector<float> chunkMax(header.nChunks);
+  run_parallel(header.nChunks, nThreads, [&](const std::size_t iChunk) {
+    const std::size_t offset = iChunk * chunkSize;
+    const std::size_t n = std::min(chunkSize, nBytes - offset);
+    checksums[iChunk] = get_crc(bytes + offset, n);
+
+    // values crossing a chunk border are counted in the chunk they start in
+    const std::size_t startIdx = (offset + sizeof(float) - 1) / sizeof(float);
+    const std::size_t stopIdx = std::min(nElements, (offset + n + sizeof(float) - 1) / sizeof(float));
+    float minVal = INFINITY;
+    float maxVal = -INFINITY;
+    for (std::size_t iElem = startIdx; iElem < stopIdx; iElem++) {
+      minVal = std::min(minVal, data[iElem]);
+      maxVal = std::max(maxVal, data[iElem]);
+    }
+    chunkMin[iChunk] = minVal;
+    chunkMax[iChunk] = maxVal;
+  });
+
+  if (nElements > 0) {
+    header.flags |= CVOL_HAS_STATS;
+    header.minVal = *std::min_element(chunkMin.begin(), chunkMin.end());
+    header.maxVal = *std::max_element(chunkMax.begin(), chunkMax.end());
+    header.maxAbsVal = std::max(std::fabs(header.minVal), std::fabs(header.maxVal));
+  }
+
+  // projections of the absolute values, slabs along dim2 are split over the threads
+  std::vector<float> mipData(mipElements, 0.0f);
+  if (flagMips) {
+    header.flags |= CVOL_HAS_MIPS;
+    float* along0 = mipData.data();
+    float* along1 = along0 + dim[1] * dim[2];
+    float* along2 = along1 + dim[0] * dim[2];
+    const std::size_t nSlabs = std::max<std::size_t>(1, std::min(nThreads, dim[2]));
+    std::vector<std::vector<float>> partial2(nSlabs);
+    run_parallel(nSlabs, nThreads, [&](const std::size_t iSlab) {
+      std::vector<float>& local2 = partial2[iSlab];
+      local2.assign(dim[0] * dim[1], 0.0f);
+      for (std::size_t i2 = iSlab * dim[2] / nSlabs; i2 < (iSlab + 1) * dim[2] / nSlabs; i2++) {
+        for (std::size_t i1 = 0; i1 < dim[1]; i1++) {
+          const float* row = data + dim[0] * (i1 + dim[1] * i2);
+          float rowMax = 0.0f;
+          for (std::size_t i0 = 0; i0 < dim[0]; i0++) {
+            const float absVal = std::fabs(row[i0]);
+            rowMax = std::max(rowMax, absVal);
+            along1[i0 + dim[0] * i2] = std::max(along1[i0 + dim[0] * i2], absVal);
+            local2[i0 + dim[0] * i1] = std::max(local2[i0 + dim[0] * i1], absVal);
+          }
+          along0[i1 + dim[1] * i2] = rowMax;
+        }
+      }
+    });
+
+    for (const auto& local2 : partial2)
+      for (std::size_t iElem = 0; iElem < local2.size(); iElem++)
+        along2[iElem] = std::max(along2[iElem], local2[iElem]);
+    header.mipChecksum = get_crc(mipData.data(), mipData.size() * sizeof(float));
+  }
+
+  header.headerChecksum = get_crc(&header, offsetof(cvolHeader, headerChecksum));
+
+  FILE* fp = fopen(filePath.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error opening file %s for write\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  try {
+    write_bytes(fp, &header, sizeof(header), filePath);
+    write_bytes(fp, checksums.data(), checksums.size() * sizeof(uint32_t), filePath);
+    write_bytes(fp, mipData.data(), mipData.size() * sizeof(float), filePath);
+    const std::vector<unsigned char> padding(header.dataOffset - mipEnd, 0);
+    write_bytes(fp, padding.data(), padding.size(), filePath);
+    write_bytes(fp, data, nBytes, filePath);
+  } catch (...) {
+    fclose(fp);
+    throw;
+  }
+
+  if (fclose(fp) != 0) {
+    printf("Error closing %s\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
+
+cvolReader::~cvolReader() { close(); }
+
+void cvolReader::close() {
+  if (fd >= 0) ::close(fd);
+  fd = -1;
+}
+
+void cvolReader::open(const std::string& filePath) {
+  close();
+  path = filePath;
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    printf("Error opening file %s for read\n", path.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  pread_bytes(fd, &header, sizeof(header), 0, path);
+  if (memcmp(header.magic, cvolMagic, sizeof(cvolMagic)) != 0) {
+    printf("%s is not a cvol file\n", path.c_str());
+    throw std::runtime_error("InvalidType");
+  }
+
+  // checksums are computed over the bytes as stored, swapping happens afterwards
+  const uint32_t headerCrc = get_crc(&header, offsetof(cvolHeader, headerChecksum));
+  uint32_t byteOrder = header.byteOrder;
+  typeConversion::swapValue(byteOrder);
+  flagSwap = (byteOrder == cvolByteOrder);
+  if (flagSwap) {
+    typeConversion::swapValue(header.version);
+    typeConversion::swapValue(header.byteOrder);
+    typeConversion::swapCopy(header.dim, header.dim, 3, sizeof(uint64_t), 1);
+    typeConversion::swapCopy(header.res, header.res, 3, sizeof(float), 1);
+    typeConversion::swapCopy(header.origin, header.origin, 3, sizeof(float), 1);
+    typeConversion::swapValue(header.datatype);
+    typeConversion::swapValue(header.flags);
+    typeConversion::swapValue(header.minVal);
+    typeConversion::swapValue(header.maxVal);
+    typeConversion::swapValue(header.maxAbsVal);
+    typeConversion::swapValue(header.mipChecksum);
+    typeConversion::swapValue(header.chunkSize);
+    typeConversion::swapValue(header.nChunks);
+    typeConversion::swapValue(header.tableOffset);
+    typeConversion::swapValue(header.mipOffset);
+    typeConversion::swapValue(header.dataOffset);
+    typeConversion::swapValue(header.headerChecksum);
+  }
+
+  if ((header.byteOrder != cvolByteOrder) || (header.headerChecksum != headerCrc)) {
+    printf("Header of %s is damaged\n", path.c_str());
+    throw std::runtime_error("ChecksumError");
+  }
+
+  if (header.version != 1) {
+    printf("Unsupported cvol version %u in %s\n", header.version, path.c_str());
+    throw std::runtime_error("InvalidType");
+  }
+
+  bytesPerVoxel = typeConversion::get_bytesPerVoxel(header.datatype);
+  if (bytesPerVoxel == 0) {
+    printf("Unsupported datatype %d in %s\n", header.datatype, path.c_str());
+    throw std::runtime_error("InvalidType");
+  }
+
+  const std::size_t nBytes = get_nElements() * bytesPerVoxel;
+  if ((header.chunkSize == 0) || (header.chunkSize > cvolMaxChunk) ||
+      (header.nChunks != (nBytes + header.chunkSize - 1) / header.chunkSize)) {
+    printf("Invalid checksum chunks in %s\n", path.c_str());
+    throw std::runtime_error("InvalidValue");
+  }
+
+  struct stat fileStat;
+  if ((fstat(fd, &fileStat) != 0) ||
+      (static_cast<std::size_t>(fileStat.st_size) < header.dataOffset + nBytes)) {
+    printf("File %s is too small to contain %lu voxels\n", path.c_str(), get_nElements());
+    throw std::runtime_error("ReadError");
+  }
+
+  checksums.resize(header.nChunks);
+  pread_bytes(fd, checksums.data(), checksums.size() * sizeof(uint32_t), header.tableOffset, path);
+  if (flagSwap)
+    typeConversion::swapCopy(checksums.data(), checksums.data(), checksums.size(), sizeof(uint32_t), 1);
+
+  mips = cvolMips();
+  if (has_mips()) {
+    std::vector<float> mipData(get_mipElements(header.dim));
+    pread_bytes(fd, mipData.data(), mipData.size() * sizeof(float), header.mipOffset, path);
+    if (get_crc(mipData.data(), mipData.size() * sizeof(float)) != header.mipChecksum) {
+      printf("Projections stored in %s are damaged\n", path.c_str());
+      throw std::runtime_error("ChecksumError");
+    }
+    if (flagSwap)
+      typeConversion::swapCopy(mipData.data(), mipData.data(), mipData.size(), sizeof(float), 1);
+
+    const uint64_t* dim = header.dim;
+    const auto start = mipData.begin();
+    mips.along0.assign(start, start + dim[1] * dim[2]);
+    mips.along1.assign(start + dim[1] * dim[2], start + dim[1] * dim[2] + dim[0] * dim[2]);
+    mips.along2.assign(start + dim[1] * dim[2] + dim[0] * dim[2], mipData.end());
+  }
+}
+
+std::size_t cvolReader::get_nElements() const {
+  return header.dim[0] * header.dim[1] * header.dim[2];
+}
+
+bool cvolReader::is_mappable() const {
+  return !flagSwap && (header.datatype == DT_FLOAT32) && (header.dataOffset % sizeof(float) == 0);
+}
+
+void cvolReader::read_data(float* out, const std::size_t nThreads, const bool flagVerify) const {
+  if (fd < 0) {
+    printf("No cvol file opened\n");
+    throw std::runtime_error("InvalidOperation");
+  }
+
+  // floats are read in place, other types go through a buffer for the conversion
+  const std::size_t nElements = get_nElements();
+  const std::size_t nBytes = nElements * bytesPerVoxel;
+  const bool flagDirect = (header.datatype == DT_FLOAT32);
+  std::vector<unsigned char> buffer(flagDirect ? 0 : nBytes);
+  unsigned char* bytes = flagDirect ? reinterpret_cast<unsigned char*>(out) : buffer.data();
+
+  run_parallel(header.nChunks, nThreads, [&](const std::size_t iChunk) {
+    const std::size_t offset = iChunk * header.chunkSize;
+    const std::size_t n = std::min<std::size_t>(header.chunkSize, nBytes - offset);
+    pread_bytes(fd, bytes + offset, n, header.dataOffset + offset, path);
+    if (flagVerify && (get_crc(bytes + offset, n) != checksums[iChunk])) {
+      printf("Checksum mismatch in chunk %lu of %s\n", iChunk, path.c_str());
+      throw std::runtime_error("ChecksumError");
+    }
+  });
+
+  if (!flagDirect)
+    typeConversion::toFloat(bytes, out, nElements, header.datatype, 1.0f, 0.0f, nThreads, flagSwap);
+  else if (flagSwap)
+    typeConversion::swapCopy(out, out, nElements, sizeof(float), nThreads);
+}
+
+void cvolReader::verify(const void* bytes,
+                        const std::size_t startByte,
+                        const std::size_t stopByte,
+                        const std::size_t nThreads) const {
+  if (stopByte <= startByte) return;
+
+  const unsigned char* ptr = static_cast<const unsigned char*>(bytes);
+  const std::size_t nBytes = get_nElements() * bytesPerVoxel;
+  const std::size_t firstChunk = startByte / header.chunkSize;
+  const std::size_t stopChunk = std::min<std::size_t>(
+      header.nChunks, (stopByte + header.chunkSize - 1) / header.chunkSize);
+  run_parallel(stopChunk - firstChunk, nThreads, [&](const std::size_t iJob) {
+    const std::size_t iChunk = firstChunk + iJob;
+    const std::size_t offset = iChunk * header.chunkSize;
+    const std::size_t n = std::min<std::size_t>(header.chunkSize, nBytes - offset);
+    if (get_crc(ptr + offset, n) != checksums[iChunk]) {
+      printf("Checksum mismatch in chunk %lu of %s\n", iChunk, path.c_str());
+      throw std::runtime_error("ChecksumError");
+    }
+  });
+}
@@ -0,0 +1,128 @@
+/*
+  File: cvolFile.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: native CVolume container (.cvol). A fixed 256 byte header holds
+  dim, res, origin and the datatype, followed by a crc32 per chunk of voxel
+  bytes, optional maximum intensity projections and the voxels themselves at a
+  page aligned offset, so that the data can be mapped straight into a volume.
+  Values are stored in the byte order of the writing machine, readers swap if
+  needed. Checksums cover the voxel bytes as stored and are verified in
+  parallel, chunk by chunk.
+*/
+
+#ifndef CVOLFILE_H
+#define CVOLFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define CVOL_ALIGNMENT 4096 // voxel data starts at a multiple of this offset
+#define CVOL_CHUNK_SIZE (4 * 1024 * 1024) // bytes covered by each checksum
+
+// flags of a cvol header
+#define CVOL_HAS_STATS 1 // minVal, maxVal and maxAbsVal are valid
+#define CVOL_HAS_MIPS 2 // projections along all three axes follow the checksums
+
+// on disk header, all offsets are absolute byte positions in the file
+struct cvolHeader {
+  char magic[8];          // "CVOLUME" followed by a zero
+  uint32_t version;       // format version, currently 1
+  uint32_t byteOrder;     // 0x01020304 written in the order of the machine
+  uint64_t dim[3];        // number of voxels along each axis
+  float res[3];           // resolution along each axis
+  float origin[3];        // position of the first voxel
+  int32_t datatype;       // NIfTI datatype code of the voxels
+  uint32_t flags;         // CVOL_HAS_STATS | CVOL_HAS_MIPS
+  float minVal;           // smallest voxel value
+  float maxVal;           // largest voxel value
+  float maxAbsVal;        // largest absolute voxel value
+  uint32_t mipChecksum;   // crc32 of the stored projections
+  uint64_t chunkSize;     // voxel bytes covered by each checksum
+  uint64_t nChunks;       // number of checksums
+  uint64_t tableOffset;   // position of the checksums (uint32 each)
+  uint64_t mipOffset;     // position of the projections
+  uint64_t dataOffset;    // position of the voxels, multiple of CVOL_ALIGNMENT
+  uint8_t reserved[124];  // zero, room for later versions
+  uint32_t headerChecksum; // crc32 of all bytes above
+};
+
+static_assert(sizeof(cvolHeader) == 256, "cvol header needs to be 256 bytes");
+
+// absolute maximum projections along each axis of a volume
+struct cvolMips {
+  std::vector<float> along0; // indexing [i1 + dim1 * i2]
+  std::vector<float> along1; // indexing [i0 + dim0 * i2]
+  std::vector<float> along2; // indexing [i0 + dim0 * i1]
+};
+
+class cvolWriter {
+public:
+  /// \brief voxel bytes covered by each checksum
+  void set_chunkSize(const std::size_t _chunkSize);
+  /// \brief number of threads computing checksums, statistics and projections
+  void set_nThreads(const std::size_t _nThreads);
+  /// \brief embed projections along all axes so that readers do not need to compute them
+  void set_flagMips(const bool _flagMips) { flagMips = _flagMips; }
+
+  /// \brief writes a float volume including its statistics
+  /// \param data volume data, indexing i0 + dim0 * (i1 + dim1 * i2)
+  void write(const std::string& filePath,
+             const float* data,
+             const std::size_t* dim,
+             const float* res,
+             const float* origin) const;
+
+private:
+  std::size_t chunkSize = CVOL_CHUNK_SIZE;
+  std::size_t nThreads = 1;
+  bool flagMips = true;
+};
+
+class cvolReader {
+public:
+  cvolReader() = default;
+  ~cvolReader();
+
+  cvolReader(const cvolReader&) = delete;
+  cvolReader& operator=(const cvolReader&) = delete;
+
+  /// \brief reads and checks the header, the checksums and the projections
+  void open(const std::string& filePath);
+  void close();
+
+  /// \brief reads all voxels into out as float using nThreads parallel reads
+  /// \param flagVerify check every chunk against its checksum before converting
+  void read_data(float* out, const std::size_t nThreads, const bool flagVerify) const;
+
+  /// \brief checks the stored voxel bytes between startByte and stopByte (exclusive)
+  /// \details all chunks touching the range are verified, throws on a mismatch
+  /// \param bytes stored voxel bytes, e.g. a mapping of the file starting at dataOffset
+  void verify(const void* bytes,
+              const std::size_t startByte,
+              const std::size_t stopByte,
+              const std::size_t nThreads) const;
+
+  [[nodiscard]] const cvolHeader& get_header() const { return header; }
+  [[nodiscard]] std::size_t get_nElements() const;
+  [[nodiscard]] std::size_t get_bytesPerVoxel() const { return bytesPerVoxel; }
+  /// \brief true if the voxels are native floats which can be mapped without conversion
+  [[nodiscard]] bool is_mappable() const;
+  [[nodiscard]] bool has_stats() const { return header.flags & CVOL_HAS_STATS; }
+  [[nodiscard]] bool has_mips() const { return header.flags & CVOL_HAS_MIPS; }
+  [[nodiscard]] const cvolMips& get_mips() const { return mips; }
+
+private:
+  std::string path;
+  int fd = -1;
+  cvolHeader header;
+  bool flagSwap = false;
+  std::size_t bytesPerVoxel = 0;
+  std::vector<uint32_t> checksums;
+  cvolMips mips;
+};
+
+#endif
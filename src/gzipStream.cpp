@@ -0,0 +1,318 @@
+#include "gzipStream.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <zlib.h>
+
+static const std::size_t DICT_SIZE = 32768; // deflate window size
+
+gzipWriter::~gzipWriter() {
+  if (fp != nullptr) {
+    // never throw from the destructor, but do not leave a truncated stream silently
+    try {
+      close();
+    } catch (...) {
+      printf("Error finishing gzip stream %s\n", path.c_str());
+    }
+  }
+}
+
+void gzipWriter::open(const std::string& filePath, const int _level, const std::size_t _nThreads) {
+  if (fp != nullptr) close();
+
+  fp = fopen(filePath.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error opening file %s for write\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  path = filePath;
+  level = _level;
+  nThreads = (_nThreads == 0) ? std::max<std::size_t>(1, std::thread::hardware_concurrency())
+                              : _nThreads;
+  blockSize = std::max<std::size_t>(blockSize, 2 * DICT_SIZE);
+  pending.clear();
+  dictionary.clear();
+  crc = crc32(0L, Z_NULL, 0);
+  totalIn = 0;
+
+  // gzip member header: magic, deflate, no flags, no mtime, no extra flags, unix
+  const unsigned char header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+  write_raw(header, sizeof(header));
+}
+
+void gzipWriter::write(const void* buffer, std::size_t nBytes) {
+  const unsigned char* ptr = static_cast<const unsigned char*>(buffer);
+  while (nBytes > 0) {
+    if (pending.empty() || (pending.back().in.size() == blockSize)) {
+      // all threads have a full block to work on, compress them now
+      if (pending.size() == nThreads) flush_blocks(false);
+      pending.emplace_back();
+      pending.back().in.reserve(blockSize);
+    }
+
+    std::vector<unsigned char>& in = pending.back().in;
+    const std::size_t nCopy = std::min(nBytes, blockSize - in.size());
+    in.insert(in.end(), ptr, ptr + nCopy);
+    ptr += nCopy;
+    nBytes -= nCopy;
+  }
+}
+
+void gzipWriter::close() {
+  if (fp == nullptr) return;
+
+  flush_blocks(true);
+
+  // trailer: crc32 and input size modulo 2^32, both little endian
+  unsigned char trailer[8];
+  for (uint8_t iByte = 0; iByte < 4; iByte++) {
+    trailer[iByte] = (crc >> (8 * iByte)) & 0xff;
+    trailer[iByte + 4] = (totalIn >> (8 * iByte)) & 0xff;
+  }
+  write_raw(trailer, sizeof(trailer));
+
+  const int ret = fclose(fp);
+  fp = nullptr;
+  if (ret != 0) {
+    printf("Error closing file %s\n", path.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
+
+// deflates a single block as raw deflate data ending on a byte boundary
+static void deflate_block(const unsigned char* in,
+                          const std::size_t nIn,
+                          const unsigned char* dict,
+                          const std::size_t nDict,
+                          const int level,
+                          const bool flagFinal,
+                          std::vector<unsigned char>* out,
+                          uint32_t* crc,
+                          bool* flagSuccess) {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  *flagSuccess = false;
+  if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+
+  if ((nDict > 0) && (deflateSetDictionary(&strm, dict, nDict) != Z_OK)) {
+    deflateEnd(&strm);
+    return;
+  }
+
+  // sync flush adds an empty stored block, reserve some bytes on top of the bound
+  out->resize(deflateBound(&strm, nIn) + 64);
+  strm.next_in = const_cast<unsigned char*>(in);
+  strm.avail_in = nIn;
+  strm.next_out = out->data();
+  strm.avail_out = out->size();
+  const int ret = deflate(&strm, flagFinal ? Z_FINISH : Z_SYNC_FLUSH);
+  *flagSuccess = flagFinal ? (ret == Z_STREAM_END) : ((ret == Z_OK) && (strm.avail_in == 0));
+  out->resize(strm.total_out);
+  deflateEnd(&strm);
+
+  *crc = crc32(0L, in, nIn);
+}
+
+// compresses all pending blocks in parallel and writes them in order
+void gzipWriter::flush_blocks(const bool flagFinal) {
+  if (flagFinal && pending.empty()) pending.emplace_back(); // empty final block
+
+  const std::size_t nBlocks = pending.size();
+  std::vector<std::thread> workers;
+  std::unique_ptr<bool[]> success(new bool[nBlocks]());
+  for (std::size_t iBlock = 0; iBlock < nBlocks; iBlock++) {
+    // prime each block with the tail of its predecessor
+    const unsigned char* dict = dictionary.data();
+    std::size_t nDict = dictionary.size();
+    if (iBlock > 0) {
+      const std::vector<unsigned char>& prev = pending[iBlock - 1].in;
+      nDict = std::min(prev.size(), DICT_SIZE);
+      dict = prev.data() + prev.size() - nDict;
+    }
+
+    block& currBlock = pending[iBlock];
+    workers.push_back(std::thread(&deflate_block,
+                                  currBlock.in.data(),
+                                  currBlock.in.size(),
+                                  dict,
+                                  nDict,
+                                  level,
+                                  flagFinal && (iBlock == nBlocks - 1),
+                                  &currBlock.out,
+                                  &currBlock.crc,
+                                  &success[iBlock]));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+
+  for (std::size_t iBlock = 0; iBlock < nBlocks; iBlock++) {
+    if (!success[iBlock]) {
+      printf("Error compressing data for %s\n", path.c_str());
+      throw std::runtime_error("CompressionError");
+    }
+
+    const block& currBlock = pending[iBlock];
+    write_raw(currBlock.out.data(), currBlock.out.size());
+    crc = crc32_combine(crc, currBlock.crc, currBlock.in.size());
+    totalIn += currBlock.in.size();
+  }
+
+  // keep the last 32 kB of input as dictionary for the next batch
+  std::vector<unsigned char> newDict;
+  const std::vector<unsigned char>& last = pending.back().in;
+  if (last.size() < DICT_SIZE) {
+    const std::size_t nOld = std::min(dictionary.size(), DICT_SIZE - last.size());
+    newDict.insert(newDict.end(), dictionary.end() - nOld, dictionary.end());
+  }
+  newDict.insert(newDict.end(), last.end() - std::min(last.size(), DICT_SIZE), last.end());
+  dictionary.swap(newDict);
+
+  pending.clear();
+}
+
+void gzipWriter::write_raw(const void* buffer, const std::size_t nBytes) {
+  if ((nBytes > 0) && (fwrite(buffer, 1, nBytes, fp) != nBytes)) {
+    printf("Error writing to file %s\n", path.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
+
+gzipReader::~gzipReader() { close(); }
+
+void gzipReader::open(const std::string& filePath) {
+  close();
+
+  fp = fopen(filePath.c_str(), "rb");
+  if (fp == nullptr) {
+    printf("Error opening file %s\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  path = filePath;
+  flagDone = false;
+  flagStop = false;
+  workerError = nullptr;
+  queue.clear();
+  current.clear();
+  currentPos = 0;
+  worker = std::thread(&gzipReader::inflate_worker, this);
+}
+
+// inflates the file chunk by chunk and hands the chunks over to the reading thread
+void gzipReader::inflate_worker() {
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+
+  try {
+    // 15 + 32: detect gzip or zlib header automatically
+    if (inflateInit2(&strm, 15 + 32) != Z_OK) throw std::runtime_error("DecompressionError");
+
+    std::vector<unsigned char> in(1 << 20);
+    std::vector<unsigned char> out(chunkSize);
+    std::size_t nOut = 0;
+    bool flagEnd = false;
+
+    while (!flagEnd) {
+      if (strm.avail_in == 0) {
+        strm.avail_in = fread(in.data(), 1, in.size(), fp);
+        strm.next_in = in.data();
+        if (strm.avail_in == 0) {
+          printf("Unexpected end of compressed file %s\n", path.c_str());
+          throw std::runtime_error("ReadError");
+        }
+      }
+
+      strm.next_out = out.data() + nOut;
+      strm.avail_out = out.size() - nOut;
+      const int ret = inflate(&strm, Z_NO_FLUSH);
+      nOut = out.size() - strm.avail_out;
+
+      if (ret == Z_STREAM_END) {
+        // concatenated gzip members are valid gzip files, continue if more data follows
+        if (strm.avail_in == 0) {
+          strm.avail_in = fread(in.data(), 1, in.size(), fp);
+          strm.next_in = in.data();
+        }
+
+        if (strm.avail_in == 0)
+          flagEnd = true;
+        else
+          inflateReset(&strm);
+      } else if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+        printf("Error decompressing file %s (%d)\n", path.c_str(), ret);
+        throw std::runtime_error("DecompressionError");
+      }
+
+      if ((nOut == out.size()) || (flagEnd && (nOut > 0))) {
+        out.resize(nOut);
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueCond.wait(lock, [this] { return (queue.size() < queueLimit) || flagStop; });
+        if (flagStop) break;
+        queue.push_back(std::move(out));
+        queueCond.notify_all();
+        out = std::vector<unsigned char>(chunkSize);
+        nOut = 0;
+      }
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    workerError = std::current_exception();
+  }
+
+  inflateEnd(&strm);
+  std::lock_guard<std::mutex> lock(queueMutex);
+  flagDone = true;
+  queueCond.notify_all();
+}
+
+std::size_t gzipReader::read(void* buffer, const std::size_t nBytes) {
+  unsigned char* ptr = static_cast<unsigned char*>(buffer);
+  std::size_t nRead = 0;
+  while (nRead < nBytes) {
+    if (currentPos == current.size()) {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueCond.wait(lock, [this] { return !queue.empty() || flagDone; });
+      if (queue.empty()) {
+        if (workerError) std::rethrow_exception(workerError);
+        break; // end of stream
+      }
+      current = std::move(queue.front());
+      queue.pop_front();
+      currentPos = 0;
+      queueCond.notify_all();
+    }
+
+    const std::size_t nCopy = std::min(nBytes - nRead, current.size() - currentPos);
+    if (ptr != nullptr) memcpy(ptr + nRead, current.data() + currentPos, nCopy);
+    currentPos += nCopy;
+    nRead += nCopy;
+  }
+  return nRead;
+}
+
+void gzipReader::skip(const std::size_t nBytes) {
+  if (read(nullptr, nBytes) != nBytes) {
+    printf("Unexpected end of compressed file %s\n", path.c_str());
+    throw std::runtime_error("ReadError");
+  }
+}
+
+void gzipReader::close() {
+  if (worker.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      flagStop = true;
+    }
+    queueCond.notify_all();
+    worker.join();
+  }
+
+  if (fp != nullptr) {
+    fclose(fp);
+    fp = nullptr;
+  }
+  queue.clear();
+}
@@ -0,0 +1,112 @@
+/*
+  File: gzipStream.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: gzip compatible file streams which do not stall at single core
+  zlib speed.
+    - gzipWriter splits the stream into blocks which are deflated in parallel and
+      stitched together into a single gzip member (same approach as pigz). Each
+      block is primed with the last 32 kB of its predecessor to keep the ratio.
+    - gzipReader inflates on a background thread into a small queue of chunks, so
+      decompression overlaps with whatever the caller does with the data.
+*/
+
+#ifndef GZIPSTREAM_H
+#define GZIPSTREAM_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class gzipWriter {
+public:
+  gzipWriter() = default;
+  ~gzipWriter();
+
+  gzipWriter(const gzipWriter&) = delete;
+  gzipWriter& operator=(const gzipWriter&) = delete;
+
+  /// \brief open a file for writing
+  /// \param filePath path to the output file
+  /// \param level zlib compression level (1 ... 9)
+  /// \param nThreads number of blocks compressed at the same time (0: all cores)
+  void open(const std::string& filePath, const int level = 6, const std::size_t nThreads = 0);
+
+  /// \brief append bytes to the stream
+  void write(const void* buffer, std::size_t nBytes);
+
+  /// \brief compress everything pending and write the gzip trailer
+  void close();
+
+  void set_blockSize(const std::size_t _blockSize) { blockSize = _blockSize; }
+
+private:
+  struct block {
+    std::vector<unsigned char> in;
+    std::vector<unsigned char> out;
+    uint32_t crc = 0;
+  };
+
+  void flush_blocks(const bool flagFinal);
+  void write_raw(const void* buffer, const std::size_t nBytes);
+
+  FILE* fp = nullptr;
+  std::string path;
+  int level = 6;
+  std::size_t nThreads = 1;
+  std::size_t blockSize = 1 << 20; // 1 MB per block
+
+  std::vector<block> pending;           // blocks waiting for compression
+  std::vector<unsigned char> dictionary; // last 32 kB of uncompressed input
+  uint32_t crc = 0;                     // crc32 over all uncompressed input
+  uint64_t totalIn = 0;
+};
+
+class gzipReader {
+public:
+  gzipReader() = default;
+  ~gzipReader();
+
+  gzipReader(const gzipReader&) = delete;
+  gzipReader& operator=(const gzipReader&) = delete;
+
+  /// \brief open a gzip file and start inflating in the background
+  void open(const std::string& filePath);
+
+  /// \brief read up to nBytes of uncompressed data
+  /// \returns number of bytes read, smaller than nBytes only at the end of the stream
+  std::size_t read(void* buffer, std::size_t nBytes);
+
+  /// \brief skip nBytes of uncompressed data
+  void skip(std::size_t nBytes);
+
+  void close();
+
+private:
+  void inflate_worker();
+
+  FILE* fp = nullptr;
+  std::string path;
+  std::thread worker;
+
+  std::mutex queueMutex;
+  std::condition_variable queueCond;
+  std::deque<std::vector<unsigned char>> queue; // inflated chunks ready for reading
+  std::size_t queueLimit = 4;                  // number of chunks inflated ahead
+  std::size_t chunkSize = 4 << 20;             // 4 MB of uncompressed data per chunk
+  bool flagDone = false;                       // worker reached end of stream
+  bool flagStop = false;                       // reader is closed before end of stream
+  std::exception_ptr workerError = nullptr;
+
+  std::vector<unsigned char> current; // chunk currently consumed by read
+  std::size_t currentPos = 0;
+};
+
+#endif
@@ -0,0 +1,463 @@
+#include "h5Chunks.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+// direct chunk access is part of the library since 1.10.3, older versions compress in the pipeline
+#if H5_VERSION_GE(1, 10, 3)
+#define H5CHUNKS_DIRECT 1
+#else
+#define H5CHUNKS_DIRECT 0
+#endif
+
+static const std::size_t CHUNK_TARGET_SIZE = 1 << 20; // automatic chunks hold about 1 MB
+static const std::size_t CHUNK_MAX_ELEMENTS = 1 << 28; // h5 limits chunks to 4 GB
+static const std::size_t SLAB_TARGET_SIZE = 16 << 20;  // library transfers with progress reports
+
+void h5Chunks::get_chunkDim(const std::size_t* dim,
+                            const std::size_t* requested,
+                            std::size_t* chunkDim) {
+  // whole slices along dim2, only split if a single slice would exceed the chunk limit
+  std::size_t autoDim[3];
+  autoDim[0] = std::min(dim[0], CHUNK_MAX_ELEMENTS);
+  autoDim[1] = std::min(dim[1], std::max<std::size_t>(1, CHUNK_MAX_ELEMENTS / autoDim[0]));
+  const std::size_t sliceBytes = autoDim[0] * autoDim[1] * sizeof(float);
+  autoDim[2] = std::min(dim[2], std::max<std::size_t>(1, CHUNK_TARGET_SIZE / sliceBytes));
+
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    chunkDim[iDim] = (requested[iDim] == 0) ? autoDim[iDim] : requested[iDim];
+    chunkDim[iDim] = std::max<std::size_t>(1, std::min(chunkDim[iDim], dim[iDim]));
+  }
+}
+
+// position of a chunk in the volume, chunks are numbered with dim0 running fastest
+static void get_chunkStart(const std::size_t iChunk,
+                           const std::size_t* nChunks,
+                           const std::size_t* chunkDim,
+                           std::size_t* start) {
+  start[0] = (iChunk % nChunks[0]) * chunkDim[0];
+  start[1] = ((iChunk / nChunks[0]) % nChunks[1]) * chunkDim[1];
+  start[2] = (iChunk / (nChunks[0] * nChunks[1])) * chunkDim[2];
+}
+
+// copies the part of the volume covered by a chunk into a full size chunk buffer
+static void gather_chunk(const float* data,
+                         const std::size_t* dim,
+                         const std::size_t* chunkDim,
+                         const std::size_t* start,
+                         float* chunk) {
+  const std::size_t n0 = std::min(chunkDim[0], dim[0] - start[0]);
+  const std::size_t n1 = std::min(chunkDim[1], dim[1] - start[1]);
+  const std::size_t n2 = std::min(chunkDim[2], dim[2] - start[2]);
+  if ((n0 < chunkDim[0]) || (n1 < chunkDim[1]) || (n2 < chunkDim[2]))
+    std::fill(chunk, chunk + chunkDim[0] * chunkDim[1] * chunkDim[2], 0.0f);
+
+  for (std::size_t j2 = 0; j2 < n2; j2++) {
+    for (std::size_t j1 = 0; j1 < n1; j1++) {
+      const float* src = data + start[0] + dim[0] * (start[1] + j1 + dim[1] * (start[2] + j2));
+      memcpy(chunk + chunkDim[0] * (j1 + chunkDim[1] * j2), src, n0 * sizeof(float));
+    }
+  }
+}
+
+// copies the valid part of a full size chunk buffer back into the volume
+static void scatter_chunk(const float* chunk,
+                          const std::size_t* dim,
+                          const std::size_t* chunkDim,
+                          const std::size_t* start,
+                          float* data) {
+  const std::size_t n0 = std::min(chunkDim[0], dim[0] - start[0]);
+  const std::size_t n1 = std::min(chunkDim[1], dim[1] - start[1]);
+  const std::size_t n2 = std::min(chunkDim[2], dim[2] - start[2]);
+  for (std::size_t j2 = 0; j2 < n2; j2++) {
+    for (std::size_t j1 = 0; j1 < n1; j1++) {
+      float* dest = data + start[0] + dim[0] * (start[1] + j1 + dim[1] * (start[2] + j2));
+      memcpy(dest, chunk + chunkDim[0] * (j1 + chunkDim[1] * j2), n0 * sizeof(float));
+    }
+  }
+}
+
+// same byte reordering as the h5 shuffle filter: all first bytes, then all second bytes, ...
+static void shuffle_bytes(const unsigned char* in, unsigned char* out, const std::size_t nElem) {
+  for (std::size_t iByte = 0; iByte < sizeof(float); iByte++)
+    for (std::size_t iElem = 0; iElem < nElem; iElem++)
+      out[iByte * nElem + iElem] = in[iElem * sizeof(float) + iByte];
+}
+
+static void unshuffle_bytes(const unsigned char* in, unsigned char* out, const std::size_t nElem) {
+  for (std::size_t iByte = 0; iByte < sizeof(float); iByte++)
+    for (std::size_t iElem = 0; iElem < nElem; iElem++)
+      out[iElem * sizeof(float) + iByte] = in[iByte * nElem + iElem];
+}
+
+// a chunk as it is stored in the file, together with its position
+struct rawChunk {
+  std::vector<unsigned char> bytes;
+  hsize_t offset[4];       // h5 order: frame, dim2, dim1, dim0, frame is unused for 3D sets
+  uint32_t filterMask = 0; // filters skipped for this chunk
+  bool flagSuccess = false;
+};
+
+// runs func(iChunk, scratch) for all chunks of a batch, spread over nThreads threads
+template <typename F>
+static void run_batch(const std::size_t batchSize, const int nThreads, const F& func) {
+  std::vector<std::thread> workers;
+  const std::size_t nWorkers = std::min<std::size_t>(std::max(nThreads, 1), batchSize);
+  for (std::size_t iThread = 0; iThread < nWorkers; iThread++) {
+    workers.push_back(std::thread([&, iThread]() {
+      std::vector<float> chunk;
+      std::vector<unsigned char> shuffled;
+      for (std::size_t iChunk = iThread; iChunk < batchSize; iChunk += nWorkers)
+        func(iChunk, chunk, shuffled);
+    }));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+// reads or writes a 3D dataset through the library, slab by slab along dim2 if progress is
+// reported and in a single call otherwise
+static void transfer_slabs(H5::DataSet& dataset,
+                           float* readData,
+                           const float* writeData,
+                           const std::size_t* dim,
+                           const h5Progress& progress) {
+  if (!progress) {
+    if (readData != nullptr)
+      dataset.read(readData, H5::PredType::NATIVE_FLOAT);
+    else
+      dataset.write(writeData, H5::PredType::NATIVE_FLOAT);
+    return;
+  }
+
+  const std::size_t sliceSize = dim[0] * dim[1];
+  const std::size_t depth =
+      std::max<std::size_t>(1, SLAB_TARGET_SIZE / std::max<std::size_t>(1, sliceSize * sizeof(float)));
+  for (std::size_t start2 = 0; start2 < dim[2]; start2 += depth) {
+    const hsize_t start[3] = {start2, 0, 0};
+    const hsize_t count[3] = {std::min(depth, dim[2] - start2), dim[1], dim[0]};
+    H5::DataSpace filespace = dataset.getSpace();
+    filespace.selectHyperslab(H5S_SELECT_SET, count, start);
+    H5::DataSpace mspace(3, count);
+    if (readData != nullptr)
+      dataset.read(readData + start2 * sliceSize, H5::PredType::NATIVE_FLOAT, mspace, filespace);
+    else
+      dataset.write(writeData + start2 * sliceSize, H5::PredType::NATIVE_FLOAT, mspace, filespace);
+    progress(start2 + count[0], dim[2]);
+  }
+}
+
+H5::DataSet h5Chunks::create(H5::H5File& file,
+                             const std::string& name,
+                             const std::size_t* dim,
+                             const std::size_t* chunkDim,
+                             const int level,
+                             const bool flagShuffle,
+                             const H5::PredType& type) {
+  const hsize_t fileDim[3] = {dim[2], dim[1], dim[0]};
+  H5::DataSpace fileSpace(3, fileDim);
+
+  // empty volumes cannot be chunked
+  if (dim[0] * dim[1] * dim[2] == 0) return file.createDataSet(name, type, fileSpace);
+
+  const hsize_t fileChunk[3] = {chunkDim[2], chunkDim[1], chunkDim[0]};
+  H5::DSetCreatPropList plist;
+  plist.setChunk(3, fileChunk);
+  if (level > 0) {
+    if (flagShuffle) plist.setShuffle();
+    plist.setDeflate(level);
+  }
+  return file.createDataSet(name, type, fileSpace, plist);
+}
+
+void h5Chunks::write(H5::H5File& file,
+                     const std::string& name,
+                     const float* data,
+                     const std::size_t* dim,
+                     const std::size_t* chunkDim,
+                     const int level,
+                     const bool flagShuffle,
+                     const int nThreads,
+                     const h5Progress& progress) {
+  H5::DataSet dataset = create(file, name, dim, chunkDim, level, flagShuffle);
+  if (dim[0] * dim[1] * dim[2] == 0) {
+    dataset.close();
+    return;
+  }
+
+  if ((level <= 0) || !H5CHUNKS_DIRECT) {
+    transfer_slabs(dataset, nullptr, data, dim, progress);
+  } else {
+    write_chunks(dataset, data, dim, chunkDim, level, flagShuffle, nThreads, -1, progress);
+  }
+  dataset.close();
+}
+
+bool h5Chunks::has_directChunks() { return H5CHUNKS_DIRECT; }
+
+void h5Chunks::write_chunks(H5::DataSet& dataset,
+                            const float* data,
+                            const std::size_t* dim,
+                            const std::size_t* chunkDim,
+                            const int level,
+                            const bool flagShuffle,
+                            const int nThreads,
+                            const int64_t iFrame,
+                            const h5Progress& progress,
+                            const std::size_t offset2,
+                            const h5Section& section) {
+#if H5CHUNKS_DIRECT
+  const std::size_t nChunks[3] = {(dim[0] + chunkDim[0] - 1) / chunkDim[0],
+                                  (dim[1] + chunkDim[1] - 1) / chunkDim[1],
+                                  (dim[2] + chunkDim[2] - 1) / chunkDim[2]};
+  const std::size_t nChunksTotal = nChunks[0] * nChunks[1] * nChunks[2];
+  const std::size_t chunkElements = chunkDim[0] * chunkDim[1] * chunkDim[2];
+  const std::size_t batchLength = 4 * std::max(nThreads, 1);
+  const uint8_t iFirst = (iFrame < 0) ? 1 : 0; // first used entry of the chunk offsets
+
+  // compresses chunks [batchStart, batchStart + batch.size()) in parallel
+  const auto compress_batch = [&](const std::size_t batchStart, std::vector<rawChunk>& batch) {
+    run_batch(batch.size(),
+              nThreads,
+              [&](const std::size_t iChunk,
+                  std::vector<float>& chunk,
+                  std::vector<unsigned char>& shuffled) {
+                rawChunk& curr = batch[iChunk];
+                std::size_t start[3];
+                get_chunkStart(batchStart + iChunk, nChunks, chunkDim, start);
+                curr.offset[0] = (iFrame < 0) ? 0 : iFrame;
+                curr.offset[1] = start[2] + offset2;
+                curr.offset[2] = start[1];
+                curr.offset[3] = start[0];
+
+                chunk.resize(chunkElements);
+                gather_chunk(data, dim, chunkDim, start, chunk.data());
+                const unsigned char* src = reinterpret_cast<const unsigned char*>(chunk.data());
+                if (flagShuffle) {
+                  shuffled.resize(chunkElements * sizeof(float));
+                  shuffle_bytes(src, shuffled.data(), chunkElements);
+                  src = shuffled.data();
+                }
+
+                uLongf nOut = compressBound(chunkElements * sizeof(float));
+                curr.bytes.resize(nOut);
+                curr.flagSuccess = (compress2(curr.bytes.data(),
+                                              &nOut,
+                                              src,
+                                              chunkElements * sizeof(float),
+                                              level) == Z_OK);
+                curr.bytes.resize(nOut);
+              });
+  };
+
+  // the next batch is compressed while the current one is written
+  std::vector<rawChunk> batches[2];
+  batches[0].resize(std::min(batchLength, nChunksTotal));
+  compress_batch(0, batches[0]);
+  for (std::size_t batchStart = 0; batchStart < nChunksTotal; batchStart += batchLength) {
+    const uint8_t iCurr = (batchStart / batchLength) % 2;
+    const std::size_t nextStart = batchStart + batchLength;
+    std::thread compressor;
+    if (nextStart < nChunksTotal) {
+      batches[1 - iCurr].resize(std::min(batchLength, nChunksTotal - nextStart));
+      compressor = std::thread(compress_batch, nextStart, std::ref(batches[1 - iCurr]));
+    }
+
+    bool flagSuccess = true;
+    const auto store_batch = [&]() {
+      for (const rawChunk& curr : batches[iCurr]) {
+        flagSuccess = curr.flagSuccess &&
+                      (H5Dwrite_chunk(dataset.getId(),
+                                      H5P_DEFAULT,
+                                      0,
+                                      curr.offset + iFirst,
+                                      curr.bytes.size(),
+                                      curr.bytes.data()) >= 0);
+        if (!flagSuccess) break;
+      }
+    };
+    try {
+      if (section)
+        section(store_batch);
+      else
+        store_batch();
+    } catch (...) {
+      if (compressor.joinable()) compressor.join();
+      throw;
+    }
+
+    if (compressor.joinable()) compressor.join();
+    if (!flagSuccess) {
+      printf("Error writing compressed chunk to dataset\n");
+      throw std::runtime_error("CompressionError");
+    }
+    if (progress) progress(std::min(nextStart, nChunksTotal), nChunksTotal);
+  }
+#else
+  printf("Direct chunk writes require hdf5 1.10.3 or newer\n");
+  throw std::runtime_error("InvalidOperation");
+#endif
+}
+
+void h5Chunks::read(H5::DataSet& dataset,
+                    float* data,
+                    const std::size_t* dim,
+                    const int nThreads,
+                    const h5Progress& progress) {
+  H5::DataSpace fileSpace = dataset.getSpace();
+  hsize_t fileDim[3];
+  if ((fileSpace.getSimpleExtentNdims() != 3) || (fileSpace.getSimpleExtentDims(fileDim) != 3) ||
+      (fileDim[0] != dim[2]) || (fileDim[1] != dim[1]) || (fileDim[2] != dim[0])) {
+    printf("Dataset shape does not match the volume dimensions\n");
+    throw std::runtime_error("InvalidSize");
+  }
+
+  // parallel decompression only handles float chunks going through shuffle and deflate
+  H5::DSetCreatPropList plist = dataset.getCreatePlist();
+  bool flagDirect = H5CHUNKS_DIRECT && (plist.getLayout() == H5D_CHUNKED) &&
+                    (dataset.getDataType() == H5::PredType::NATIVE_FLOAT);
+  int iShuffle = -1;
+  int iDeflate = -1;
+  const int nFilters = flagDirect ? H5Pget_nfilters(plist.getId()) : 0;
+  for (int iFilter = 0; iFilter < nFilters; iFilter++) {
+    unsigned int flags;
+    size_t nValues = 8;
+    unsigned int values[8];
+    unsigned int config;
+    const H5Z_filter_t filter =
+        H5Pget_filter2(plist.getId(), iFilter, &flags, &nValues, values, 0, nullptr, &config);
+    if ((filter == H5Z_FILTER_SHUFFLE) && (iShuffle < 0) && (iDeflate < 0))
+      iShuffle = iFilter;
+    else if ((filter == H5Z_FILTER_DEFLATE) && (iDeflate < 0))
+      iDeflate = iFilter;
+    else
+      flagDirect = false;
+  }
+
+  // uncompressed data is not worth the detour
+  if (!flagDirect || (iDeflate < 0)) {
+    transfer_slabs(dataset, data, nullptr, dim, progress);
+    return;
+  }
+
+#if H5CHUNKS_DIRECT
+  hsize_t fileChunk[3];
+  plist.getChunk(3, fileChunk);
+  const std::size_t chunkDim[3] = {fileChunk[2], fileChunk[1], fileChunk[0]};
+  const std::size_t nChunks[3] = {(dim[0] + chunkDim[0] - 1) / chunkDim[0],
+                                  (dim[1] + chunkDim[1] - 1) / chunkDim[1],
+                                  (dim[2] + chunkDim[2] - 1) / chunkDim[2]};
+  const std::size_t nChunksTotal = nChunks[0] * nChunks[1] * nChunks[2];
+  const std::size_t chunkElements = chunkDim[0] * chunkDim[1] * chunkDim[2];
+  const std::size_t batchLength = 4 * std::max(nThreads, 1);
+
+  // chunks which were never written hold the fill value
+  float fillValue = 0.0f;
+  H5Pget_fill_value(plist.getId(), H5T_NATIVE_FLOAT, &fillValue);
+
+  // reads the stored bytes of a batch, the library is only called from one thread at a time
+  const auto read_batch = [&](const std::size_t batchStart, std::vector<rawChunk>& batch) {
+    for (std::size_t iChunk = 0; iChunk < batch.size(); iChunk++) {
+      rawChunk& curr = batch[iChunk];
+      std::size_t start[3];
+      get_chunkStart(batchStart + iChunk, nChunks, chunkDim, start);
+      curr.offset[0] = 0;
+      curr.offset[1] = start[2];
+      curr.offset[2] = start[1];
+      curr.offset[3] = start[0];
+
+      hsize_t nBytes = 0;
+      curr.flagSuccess = true;
+      if ((H5Dget_chunk_storage_size(dataset.getId(), curr.offset + 1, &nBytes) < 0) || (nBytes == 0)) {
+        curr.bytes.clear();
+        continue;
+      }
+
+      curr.bytes.resize(nBytes);
+      curr.flagSuccess = (H5Dread_chunk(dataset.getId(),
+                                        H5P_DEFAULT,
+                                        curr.offset + 1,
+                                        &curr.filterMask,
+                                        curr.bytes.data()) >= 0);
+    }
+  };
+
+  // undoes the filters of a batch in parallel and places the chunks in the volume
+  const auto decompress_batch = [&](std::vector<rawChunk>& batch) {
+    run_batch(batch.size(),
+              nThreads,
+              [&](const std::size_t iChunk,
+                  std::vector<float>& chunk,
+                  std::vector<unsigned char>& shuffled) {
+                rawChunk& curr = batch[iChunk];
+                if (!curr.flagSuccess) return;
+
+                const std::size_t start[3] = {curr.offset[3], curr.offset[2], curr.offset[1]};
+                const std::size_t chunkBytes = chunkElements * sizeof(float);
+                chunk.resize(chunkElements);
+                if (curr.bytes.empty()) {
+                  std::fill(chunk.begin(), chunk.end(), fillValue);
+                  scatter_chunk(chunk.data(), dim, chunkDim, start, data);
+                  return;
+                }
+
+                // a set bit in the mask marks a filter which was skipped for this chunk
+                const bool flagInflate = !(curr.filterMask & (1u << iDeflate));
+                const bool flagUnshuffle = (iShuffle >= 0) && !(curr.filterMask & (1u << iShuffle));
+                unsigned char* dest = reinterpret_cast<unsigned char*>(chunk.data());
+                if (flagUnshuffle) {
+                  shuffled.resize(chunkBytes);
+                  dest = shuffled.data();
+                }
+
+                if (flagInflate) {
+                  uLongf nOut = chunkBytes;
+                  curr.flagSuccess =
+                      (uncompress(dest, &nOut, curr.bytes.data(), curr.bytes.size()) == Z_OK) &&
+                      (nOut == chunkBytes);
+                } else {
+                  curr.flagSuccess = (curr.bytes.size() == chunkBytes);
+                  if (curr.flagSuccess) memcpy(dest, curr.bytes.data(), chunkBytes);
+                }
+                if (!curr.flagSuccess) return;
+
+                if (flagUnshuffle)
+                  unshuffle_bytes(
+                      shuffled.data(), reinterpret_cast<unsigned char*>(chunk.data()), chunkElements);
+                scatter_chunk(chunk.data(), dim, chunkDim, start, data);
+              });
+  };
+
+  // the next batch is read from disk while the current one is decompressed
+  std::vector<rawChunk> batches[2];
+  batches[0].resize(std::min(batchLength, nChunksTotal));
+  read_batch(0, batches[0]);
+  for (std::size_t batchStart = 0; batchStart < nChunksTotal; batchStart += batchLength) {
+    const uint8_t iCurr = (batchStart / batchLength) % 2;
+    std::thread decompressor(decompress_batch, std::ref(batches[iCurr]));
+
+    const std::size_t nextStart = batchStart + batchLength;
+    if (nextStart < nChunksTotal) {
+      batches[1 - iCurr].resize(std::min(batchLength, nChunksTotal - nextStart));
+      read_batch(nextStart, batches[1 - iCurr]);
+    }
+    decompressor.join();
+
+    for (const rawChunk& curr : batches[iCurr]) {
+      if (!curr.flagSuccess) {
+        printf("Error reading compressed chunk at %llu, %llu, %llu\n",
+               curr.offset[1],
+               curr.offset[2],
+               curr.offset[3]);
+        throw std::runtime_error("DecompressionError");
+      }
+    }
+    if (progress) progress(std::min(nextStart, nChunksTotal), nChunksTotal);
+  }
+#endif
+}
@@ -0,0 +1,108 @@
+/*
+  File: h5Chunks.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: reading and writing of chunked 3D float datasets in h5 files.
+  The dataset is stored as [dim2, dim1, dim0] so that the h5 row major order
+  matches the memory layout of our volumes. Deflate compression (optionally
+  preceded by the shuffle filter) is done by us chunk by chunk in parallel and
+  the compressed chunks are handed to the library directly, so compression does
+  not run on a single core inside the hdf5 filter pipeline. Reading works the
+  other way around as long as the file only uses shuffle and deflate.
+*/
+
+#ifndef H5CHUNKS_H
+#define H5CHUNKS_H
+
+#include <H5Cpp.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/// \brief called with the amount of work done and in total after each batch of chunks or slices
+using h5Progress = std::function<void(std::size_t, std::size_t)>;
+
+/// \brief runs the library calls passed to it, lets callers serialize them (locks, io slots)
+/// without holding those across the compression around them
+using h5Section = std::function<void(const std::function<void()>&)>;
+
+class h5Chunks {
+public:
+  /// \brief chunk shape used for a volume, given in volume order (dim0, dim1, dim2)
+  /// \param dim dimensions of the volume
+  /// \param requested requested chunk shape, zero entries are chosen automatically: whole
+  /// slices along dim2, stacked until a chunk holds about 1 MB
+  /// \param chunkDim resulting chunk shape, clipped to the volume dimensions
+  static void get_chunkDim(const std::size_t* dim,
+                           const std::size_t* requested,
+                           std::size_t* chunkDim);
+
+  /// \brief creates and writes a chunked 3D float dataset
+  /// \param file h5 file to create the dataset in
+  /// \param name name of the dataset
+  /// \param data volume data, indexing i0 + dim0 * (i1 + dim1 * i2)
+  /// \param dim dimensions of the volume
+  /// \param chunkDim chunk shape in volume order
+  /// \param level deflate level (1 ... 9), 0 writes the chunks uncompressed
+  /// \param flagShuffle apply the shuffle filter before deflate
+  /// \param nThreads number of chunks compressed at the same time
+  /// \param progress optional progress report, may throw to abort the operation
+  static void write(H5::H5File& file,
+                    const std::string& name,
+                    const float* data,
+                    const std::size_t* dim,
+                    const std::size_t* chunkDim,
+                    const int level,
+                    const bool flagShuffle,
+                    const int nThreads,
+                    const h5Progress& progress = nullptr);
+
+  /// \brief creates an empty 3D dataset of shape [dim2, dim1, dim0] with the given storage
+  /// options, empty volumes get a contiguous dataset since they cannot be chunked
+  /// \param type element type stored in the file, conversion from float is left to the library
+  static H5::DataSet create(H5::H5File& file,
+                            const std::string& name,
+                            const std::size_t* dim,
+                            const std::size_t* chunkDim,
+                            const int level,
+                            const bool flagShuffle,
+                            const H5::PredType& type = H5::PredType::NATIVE_FLOAT);
+
+  /// \brief compresses the chunks of a volume in parallel and stores them in an existing dataset
+  /// \param dataset chunked dataset using deflate and (if flagShuffle) shuffle
+  /// \param iFrame frame index for 4D datasets of shape [frame, dim2, dim1, dim0] with one frame
+  /// per chunk, -1 for 3D datasets
+  /// \param offset2 slice of the dataset the data starts at, lets a volume be written as slabs
+  /// along dim2, must be a multiple of chunkDim[2]
+  /// \param section optional wrapper around the raw chunk writes of each batch, compression
+  /// runs outside of it
+  static void write_chunks(H5::DataSet& dataset,
+                           const float* data,
+                           const std::size_t* dim,
+                           const std::size_t* chunkDim,
+                           const int level,
+                           const bool flagShuffle,
+                           const int nThreads,
+                           const int64_t iFrame = -1,
+                           const h5Progress& progress = nullptr,
+                           const std::size_t offset2 = 0,
+                           const h5Section& section = nullptr);
+
+  /// \brief true if the hdf5 library supports writing and reading chunks directly
+  [[nodiscard]] static bool has_directChunks();
+
+  /// \brief reads a full 3D float dataset, decompressing chunks in parallel if possible
+  /// \param dataset dataset of rank 3 with shape [dim2, dim1, dim0]
+  /// \param data output array holding dim0 * dim1 * dim2 elements
+  /// \param dim dimensions of the volume
+  /// \param nThreads number of chunks decompressed at the same time
+  /// \param progress optional progress report, may throw to abort the operation
+  static void read(H5::DataSet& dataset,
+                   float* data,
+                   const std::size_t* dim,
+                   const int nThreads,
+                   const h5Progress& progress = nullptr);
+};
+
+#endif
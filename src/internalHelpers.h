@@ -0,0 +1,84 @@
+/*
+  File: internalHelpers.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: small helpers shared by the translation units of the library and
+  its tools: thread fan out over jobs or element ranges, checked file writes and
+  file name matching. Not part of the public interface.
+*/
+
+#ifndef INTERNALHELPERS_H
+#define INTERNALHELPERS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// runs func(iJob) for all jobs, spread round robin over up to nThreads threads
+template <typename F>
+inline void run_parallel(const std::size_t nJobs, const std::size_t nThreads, const F& func) {
+  const std::size_t nWorkers = std::max<std::size_t>(1, std::min(nThreads, nJobs));
+  std::vector<std::exception_ptr> errors(nWorkers);
+  std::vector<std::thread> workers;
+  for (std::size_t iWorker = 0; iWorker < nWorkers; iWorker++) {
+    workers.push_back(std::thread([&, iWorker]() {
+      try {
+        for (std::size_t iJob = iWorker; iJob < nJobs; iJob += nWorkers)
+          func(iJob);
+      } catch (...) {
+        errors[iWorker] = std::current_exception();
+      }
+    }));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+  for (const auto& error : errors)
+    if (error) std::rethrow_exception(error);
+}
+
+// splits the range 0 ... nElements over threads, func is called with start and stop index
+template <typename F>
+inline void runParallel(const std::size_t nElements, const std::size_t nThreads, const F& func) {
+  // small arrays are not worth the thread startup
+  const std::size_t nThreadsUsed =
+      std::max<std::size_t>(1, std::min<std::size_t>(nThreads, nElements / (1 << 16)));
+  if (nThreadsUsed == 1) {
+    func(0, nElements);
+    return;
+  }
+
+  const std::size_t nElementsThread = nElements / nThreadsUsed;
+  std::vector<std::thread> workers;
+  for (std::size_t iThread = 0; iThread < nThreadsUsed; iThread++) {
+    const std::size_t startIdx = iThread * nElementsThread;
+    const std::size_t stopIdx =
+        (iThread < (nThreadsUsed - 1)) ? (iThread + 1) * nElementsThread : nElements;
+    workers.push_back(std::thread(func, startIdx, stopIdx));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+// writes nBytes or throws, path is only used for the error message
+inline void write_bytes(FILE* fp, const void* buffer, const std::size_t nBytes, const std::string& path) {
+  if (fwrite(buffer, 1, nBytes, fp) != nBytes) {
+    printf("Error writing to %s\n", path.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
+
+// returns true if the path ends with the given ending
+inline bool hasEnding(const std::string& _filePath, const std::string& _ending) {
+  if (_filePath.length() < _ending.length()) return false;
+  return (_filePath.compare(_filePath.length() - _ending.length(), _ending.length(), _ending) == 0);
+}
+
+#endif
@@ -0,0 +1,357 @@
+#include "isoSurface.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+
+// Corners of a cell are numbered c = di + 2 dj + 4 dk. Edges 0-3 run along dim0 at
+// (dj, dk) = (e & 1, e >> 1), edges 4-7 along dim1 at (di, dk) and edges 8-11 along dim2 at
+// (di, dj), so every edge maps directly onto the vertex arrays of a plane or layer.
+struct mcCase {
+  uint8_t nTriangles = 0;
+  uint8_t edges[30]; // up to 10 triangles for a loop through all 12 edges
+};
+
+static uint8_t get_edge(const uint8_t a, const uint8_t b) {
+  const uint8_t low = std::min(a, b);
+  const uint8_t diff = a ^ b;
+  if (diff == 1) return 0 + ((low >> 1) & 1) + 2 * ((low >> 2) & 1);
+  if (diff == 2) return 4 + (low & 1) + 2 * ((low >> 2) & 1);
+  return 8 + (low & 1) + 2 * ((low >> 1) & 1);
+}
+
+// The table is derived instead of typed in: on every face the surface crosses the edges between
+// inside and outside corners. Walking around a face counterclockwise (seen from outside) each
+// crossing into the inside is joined with the next crossing out of it, so ambiguous faces always
+// separate their inside corners. Neighbouring cells see the same face in opposite direction and
+// join the same crossings, which keeps the mesh free of cracks. The segments form closed loops
+// around the cell which are triangulated as fans. A fan diagonal between two vertices on the same
+// face could also be chosen by the neighbouring cell and would then belong to four triangles, so
+// each fan starts at a vertex which shares no face with the vertices it connects to.
+static mcCase* build_table() {
+  static mcCase table[256];
+  const uint8_t faces[6][4] = {
+      {0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}};
+  uint8_t edgeFaces[12] = {0};
+  for (uint8_t iFace = 0; iFace < 6; iFace++)
+    for (uint8_t iSide = 0; iSide < 4; iSide++)
+      edgeFaces[get_edge(faces[iFace][iSide], faces[iFace][(iSide + 1) % 4])] |= (1 << iFace);
+
+  for (uint16_t config = 0; config < 256; config++) {
+    int8_t next[12];
+    std::fill(next, next + 12, -1);
+    for (uint8_t iFace = 0; iFace < 6; iFace++) {
+      uint8_t crossEdge[4];
+      bool crossIn[4];
+      uint8_t nCross = 0;
+      for (uint8_t iSide = 0; iSide < 4; iSide++) {
+        const uint8_t a = faces[iFace][iSide];
+        const uint8_t b = faces[iFace][(iSide + 1) % 4];
+        const bool flagA = (config >> a) & 1;
+        const bool flagB = (config >> b) & 1;
+        if (flagA != flagB) {
+          crossEdge[nCross] = get_edge(a, b);
+          crossIn[nCross] = flagB;
+          nCross++;
+        }
+      }
+
+      for (uint8_t iCross = 0; iCross < nCross; iCross++) {
+        if (!crossIn[iCross]) continue;
+        for (uint8_t iNext = 1; iNext < nCross; iNext++) {
+          const uint8_t idx = (iCross + iNext) % nCross;
+          if (!crossIn[idx]) {
+            next[crossEdge[iCross]] = crossEdge[idx];
+            break;
+          }
+        }
+      }
+    }
+
+    mcCase& curr = table[config];
+    bool visited[12] = {false};
+    for (uint8_t iEdge = 0; iEdge < 12; iEdge++) {
+      if ((next[iEdge] < 0) || visited[iEdge]) continue;
+
+      uint8_t loop[12];
+      uint8_t nLoop = 0;
+      for (int8_t edge = iEdge; !visited[edge]; edge = next[edge]) {
+        visited[edge] = true;
+        loop[nLoop++] = edge;
+      }
+
+      uint8_t start = 0;
+      for (uint8_t iStart = 0; iStart < nLoop; iStart++) {
+        bool flagValid = true;
+        for (uint8_t iCorner = 2; iCorner + 1 < nLoop; iCorner++)
+          if (edgeFaces[loop[iStart]] & edgeFaces[loop[(iStart + iCorner) % nLoop]])
+            flagValid = false;
+        if (flagValid) {
+          start = iStart;
+          break;
+        }
+      }
+
+      for (uint8_t iCorner = 1; iCorner + 1 < nLoop; iCorner++) {
+        curr.edges[3 * curr.nTriangles] = loop[start];
+        curr.edges[3 * curr.nTriangles + 1] = loop[(start + iCorner) % nLoop];
+        curr.edges[3 * curr.nTriangles + 2] = loop[(start + iCorner + 1) % nLoop];
+        curr.nTriangles++;
+      }
+    }
+  }
+  return table;
+}
+
+static const mcCase* get_table() {
+  static const mcCase* table = build_table();
+  return table;
+}
+
+// everything a slab needs to know about the volume
+struct isoGrid {
+  const float* data;
+  std::size_t dim[3];
+  float res[3];
+  float origin[3];
+  float isoValue;
+
+  [[nodiscard]] bool is_inside(const std::size_t i0, const std::size_t i1, const std::size_t i2) const {
+    return data[i0 + dim[0] * (i1 + dim[1] * i2)] >= isoValue;
+  }
+
+  [[nodiscard]] uint8_t get_config(const std::size_t i0, const std::size_t i1, const std::size_t i2) const {
+    uint8_t config = 0;
+    for (uint8_t iCorner = 0; iCorner < 8; iCorner++)
+      if (is_inside(i0 + (iCorner & 1), i1 + ((iCorner >> 1) & 1), i2 + (iCorner >> 2)))
+        config |= (1 << iCorner);
+    return config;
+  }
+};
+
+// vertex ids of the edges along dim0 and dim1 within a plane of constant i2
+struct planeIds {
+  std::vector<uint32_t> edges0;
+  std::vector<uint32_t> edges1;
+};
+
+// assigns ids to the crossed edges along dim0 and dim1 of a plane, in the same order in which
+// the first pass counted them, and stores the vertices if the slab owns the plane
+static void assign_plane(const isoGrid& grid,
+                         const std::size_t i2,
+                         planeIds& ids,
+                         uint32_t& counter,
+                         float* x,
+                         float* y,
+                         float* z) {
+  const std::size_t* dim = grid.dim;
+  for (std::size_t i1 = 0; i1 < dim[1]; i1++) {
+    for (std::size_t i0 = 0; i0 + 1 < dim[0]; i0++) {
+      if (grid.is_inside(i0, i1, i2) == grid.is_inside(i0 + 1, i1, i2)) continue;
+      const std::size_t idx = i0 + dim[0] * (i1 + dim[1] * i2);
+      ids.edges0[i0 + dim[0] * i1] = counter;
+      if (x != nullptr) {
+        const float t = (grid.isoValue - grid.data[idx]) / (grid.data[idx + 1] - grid.data[idx]);
+        x[counter] = grid.origin[0] + grid.res[0] * ((float)i0 + t);
+        y[counter] = grid.origin[1] + grid.res[1] * (float)i1;
+        z[counter] = grid.origin[2] + grid.res[2] * (float)i2;
+      }
+      counter++;
+    }
+  }
+
+  for (std::size_t i1 = 0; i1 + 1 < dim[1]; i1++) {
+    for (std::size_t i0 = 0; i0 < dim[0]; i0++) {
+      if (grid.is_inside(i0, i1, i2) == grid.is_inside(i0, i1 + 1, i2)) continue;
+      const std::size_t idx = i0 + dim[0] * (i1 + dim[1] * i2);
+      ids.edges1[i0 + dim[0] * i1] = counter;
+      if (x != nullptr) {
+        const float t =
+            (grid.isoValue - grid.data[idx]) / (grid.data[idx + dim[0]] - grid.data[idx]);
+        x[counter] = grid.origin[0] + grid.res[0] * (float)i0;
+        y[counter] = grid.origin[1] + grid.res[1] * ((float)i1 + t);
+        z[counter] = grid.origin[2] + grid.res[2] * (float)i2;
+      }
+      counter++;
+    }
+  }
+}
+
+// assigns ids to the crossed edges along dim2 between the planes i2 and i2 + 1
+static void assign_layer(const isoGrid& grid,
+                         const std::size_t i2,
+                         std::vector<uint32_t>& ids,
+                         uint32_t& counter,
+                         float* x,
+                         float* y,
+                         float* z) {
+  const std::size_t* dim = grid.dim;
+  const std::size_t sliceSize = dim[0] * dim[1];
+  for (std::size_t i1 = 0; i1 < dim[1]; i1++) {
+    for (std::size_t i0 = 0; i0 < dim[0]; i0++) {
+      if (grid.is_inside(i0, i1, i2) == grid.is_inside(i0, i1, i2 + 1)) continue;
+      const std::size_t idx = i0 + dim[0] * (i1 + dim[1] * i2);
+      ids[i0 + dim[0] * i1] = counter;
+      const float t =
+          (grid.isoValue - grid.data[idx]) / (grid.data[idx + sliceSize] - grid.data[idx]);
+      x[counter] = grid.origin[0] + grid.res[0] * (float)i0;
+      y[counter] = grid.origin[1] + grid.res[1] * (float)i1;
+      z[counter] = grid.origin[2] + grid.res[2] * ((float)i2 + t);
+      counter++;
+    }
+  }
+}
+
+// number of crossed edges along dim0 and dim1 in a plane and along dim2 in the layer above it
+static std::size_t count_vertices(const isoGrid& grid, const std::size_t i2, const bool flagLayer) {
+  const std::size_t* dim = grid.dim;
+  std::size_t nVertices = 0;
+  for (std::size_t i1 = 0; i1 < dim[1]; i1++) {
+    for (std::size_t i0 = 0; i0 < dim[0]; i0++) {
+      const bool flagInside = grid.is_inside(i0, i1, i2);
+      if ((i0 + 1 < dim[0]) && (flagInside != grid.is_inside(i0 + 1, i1, i2))) nVertices++;
+      if ((i1 + 1 < dim[1]) && (flagInside != grid.is_inside(i0, i1 + 1, i2))) nVertices++;
+      if (flagLayer && (flagInside != grid.is_inside(i0, i1, i2 + 1))) nVertices++;
+    }
+  }
+  return nVertices;
+}
+
+void isoSurface::extract(const float* data,
+                         const std::size_t* dim,
+                         const float* res,
+                         const float* origin,
+                         const float isoValue,
+                         const std::size_t nThreads) {
+  x.clear();
+  y.clear();
+  z.clear();
+  ids.clear();
+  if ((dim[0] < 2) || (dim[1] < 2) || (dim[2] < 2)) return;
+
+  isoGrid grid;
+  grid.data = data;
+  grid.isoValue = isoValue;
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    grid.dim[iDim] = dim[iDim];
+    grid.res[iDim] = res[iDim];
+    grid.origin[iDim] = origin[iDim];
+  }
+  const mcCase* table = get_table();
+
+  // slabs of cell layers, the last slab also owns the last plane
+  const std::size_t nLayers = dim[2] - 1;
+  const std::size_t nSlabs = std::max<std::size_t>(1, std::min(nThreads, nLayers));
+  std::vector<std::size_t> slabStart(nSlabs + 1);
+  for (std::size_t iSlab = 0; iSlab <= nSlabs; iSlab++)
+    slabStart[iSlab] = (iSlab * nLayers) / nSlabs;
+
+  const auto run_slabs = [&](const auto& func) {
+    std::vector<std::thread> workers;
+    for (std::size_t iSlab = 1; iSlab < nSlabs; iSlab++)
+      workers.push_back(std::thread(func, iSlab));
+    func(0);
+    for (auto& worker : workers)
+      worker.join();
+  };
+
+  // first pass: count vertices and triangles of each slab
+  std::vector<std::size_t> nVertices(nSlabs + 1, 0);
+  std::vector<std::size_t> nTriangles(nSlabs + 1, 0);
+  run_slabs([&](const std::size_t iSlab) {
+    for (std::size_t i2 = slabStart[iSlab]; i2 < slabStart[iSlab + 1]; i2++) {
+      nVertices[iSlab + 1] += count_vertices(grid, i2, true);
+      for (std::size_t i1 = 0; i1 + 1 < dim[1]; i1++)
+        for (std::size_t i0 = 0; i0 + 1 < dim[0]; i0++)
+          nTriangles[iSlab + 1] += table[grid.get_config(i0, i1, i2)].nTriangles;
+    }
+    if (iSlab == nSlabs - 1) nVertices[iSlab + 1] += count_vertices(grid, nLayers, false);
+  });
+
+  // prefix sums give each slab the first id of its vertices and triangles
+  for (std::size_t iSlab = 0; iSlab < nSlabs; iSlab++) {
+    nVertices[iSlab + 1] += nVertices[iSlab];
+    nTriangles[iSlab + 1] += nTriangles[iSlab];
+  }
+  if ((nVertices[nSlabs] > UINT32_MAX) || (nTriangles[nSlabs] > UINT32_MAX)) {
+    printf("Isosurface is too large for 32 bit ids (%lu vertices)\n", nVertices[nSlabs]);
+    throw std::runtime_error("InvalidSize");
+  }
+  x.resize(nVertices[nSlabs]);
+  y.resize(nVertices[nSlabs]);
+  z.resize(nVertices[nSlabs]);
+  ids.resize(3 * nTriangles[nSlabs]);
+
+  // second pass: assign ids in the counted order and fill vertices and triangles
+  run_slabs([&](const std::size_t iSlab) {
+    const std::size_t sliceSize = dim[0] * dim[1];
+    planeIds planes[2];
+    for (planeIds& plane : planes) {
+      plane.edges0.resize(sliceSize);
+      plane.edges1.resize(sliceSize);
+    }
+    std::vector<uint32_t> layer(sliceSize);
+
+    uint32_t counter = nVertices[iSlab];
+    std::size_t iTriangle = nTriangles[iSlab];
+    const std::size_t start2 = slabStart[iSlab];
+    const std::size_t stop2 = slabStart[iSlab + 1];
+    assign_plane(grid, start2, planes[0], counter, x.data(), y.data(), z.data());
+    for (std::size_t i2 = start2; i2 < stop2; i2++) {
+      planeIds& lower = planes[(i2 - start2) % 2];
+      planeIds& upper = planes[(i2 - start2 + 1) % 2];
+      assign_layer(grid, i2, layer, counter, x.data(), y.data(), z.data());
+      if ((i2 + 1 < stop2) || (iSlab == nSlabs - 1)) {
+        assign_plane(grid, i2 + 1, upper, counter, x.data(), y.data(), z.data());
+      } else {
+        // the next slab owns this plane, only recover the ids it gives to the vertices
+        uint32_t nextCounter = nVertices[iSlab + 1];
+        assign_plane(grid, i2 + 1, upper, nextCounter, nullptr, nullptr, nullptr);
+      }
+
+      for (std::size_t i1 = 0; i1 + 1 < dim[1]; i1++) {
+        for (std::size_t i0 = 0; i0 + 1 < dim[0]; i0++) {
+          const mcCase& curr = table[grid.get_config(i0, i1, i2)];
+          for (uint8_t iEntry = 0; iEntry < 3 * curr.nTriangles; iEntry++) {
+            const uint8_t edge = curr.edges[iEntry];
+            const uint8_t a = edge & 1;
+            const uint8_t b = (edge >> 1) & 1;
+            uint32_t id;
+            if (edge < 4)
+              id = (b ? upper : lower).edges0[i0 + dim[0] * (i1 + a)];
+            else if (edge < 8)
+              id = (b ? upper : lower).edges1[i0 + a + dim[0] * i1];
+            else
+              id = layer[i0 + a + dim[0] * (i1 + b)];
+            ids[3 * iTriangle + iEntry] = id;
+          }
+          iTriangle += curr.nTriangles;
+        }
+      }
+    }
+  });
+}
+
+polydata isoSurface::get_polydata() {
+  polydata mesh;
+  mesh.nPoints = x.size();
+  mesh.xPoints = x.data();
+  mesh.yPoints = y.data();
+  mesh.zPoints = z.data();
+  mesh.nPolygons = ids.size() / 3;
+  mesh.dimPolygon = 3;
+  mesh.idPolygons = ids.data();
+  return mesh;
+}
+
+void isoSurface::exportVtk(const std::string& filePath) {
+  polydata mesh = get_polydata();
+  vtkwriter outputter;
+  outputter.set_title("isoSurface");
+  outputter.set_type("POLYDATA");
+  outputter.set_outputPath(filePath);
+  outputter.set_polydata(&mesh);
+  outputter.set_binary();
+  outputter.write();
+}
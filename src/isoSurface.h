@@ -0,0 +1,61 @@
+/*
+  File: isoSurface.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: triangle mesh of an isosurface extracted with marching cubes.
+  Every edge of the grid crossed by the surface holds exactly one vertex which
+  is shared by all triangles touching it. Extraction runs in parallel over
+  slabs of cell layers along dim2: a first pass counts vertices and triangles
+  of each slab, a prefix sum over the counts gives every slab its range of ids
+  and a second pass fills vertices and triangles straight into the shared
+  arrays. The mesh is handed to vtkwriter as polydata.
+*/
+
+#ifndef ISOSURFACE_H
+#define ISOSURFACE_H
+
+#include "vtkwriter.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class isoSurface {
+public:
+  /// \brief extracts the surface at which the volume crosses isoValue
+  /// \details voxels with values >= isoValue are inside, triangles are oriented so that their
+  /// normals point away from the inside
+  /// \param data volume data, indexing i0 + dim0 * (i1 + dim1 * i2)
+  /// \param dim dimensions of the volume
+  /// \param res resolution of the volume
+  /// \param origin position of voxel [0, 0, 0], vertices are given in world coordinates
+  /// \param nThreads number of slabs processed at the same time
+  void extract(const float* data,
+               const std::size_t* dim,
+               const float* res,
+               const float* origin,
+               const float isoValue,
+               const std::size_t nThreads);
+
+  [[nodiscard]] std::size_t get_nVertices() const { return x.size(); }
+  [[nodiscard]] std::size_t get_nTriangles() const { return ids.size() / 3; }
+  [[nodiscard]] const std::vector<float>& get_x() const { return x; }
+  [[nodiscard]] const std::vector<float>& get_y() const { return y; }
+  [[nodiscard]] const std::vector<float>& get_z() const { return z; }
+  /// \brief vertex ids of the triangles, [iCorner + 3 * iTriangle]
+  [[nodiscard]] const std::vector<unsigned int>& get_ids() const { return ids; }
+
+  /// \brief polydata pointing into our arrays, valid until the next extract
+  [[nodiscard]] polydata get_polydata();
+
+  /// \brief writes the mesh as binary vtk polydata
+  void exportVtk(const std::string& filePath);
+
+private:
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<unsigned int> ids;
+};
+
+#endif
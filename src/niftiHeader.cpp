@@ -0,0 +1,163 @@
+#include "niftiHeader.h"
+#include "typeConversion.h"
+#include <cstring>
+
+bool niftiHeader::needs_swap(const nifti_1_header& hdr) {
+  if (hdr.sizeof_hdr == 348) return false;
+
+  int sizeofHdr = hdr.sizeof_hdr;
+  typeConversion::swapValue(sizeofHdr);
+  if (sizeofHdr == 348) return true;
+
+  // header size is not conclusive, the number of dimensions must be within 1 ... 7
+  short nDims = hdr.dim[0];
+  typeConversion::swapValue(nDims);
+  return ((hdr.dim[0] < 1) || (hdr.dim[0] > 7)) && ((nDims >= 1) && (nDims <= 7));
+}
+
+template <typename T>
+static void swapArray(T* values, const int nValues) {
+  for (int iValue = 0; iValue < nValues; iValue++)
+    typeConversion::swapValue(values[iValue]);
+}
+
+void niftiHeader::swap(nifti_1_header& hdr) {
+  typeConversion::swapValue(hdr.sizeof_hdr);
+  typeConversion::swapValue(hdr.extents);
+  typeConversion::swapValue(hdr.session_error);
+  swapArray(hdr.dim, 8);
+  typeConversion::swapValue(hdr.intent_p1);
+  typeConversion::swapValue(hdr.intent_p2);
+  typeConversion::swapValue(hdr.intent_p3);
+  typeConversion::swapValue(hdr.intent_code);
+  typeConversion::swapValue(hdr.datatype);
+  typeConversion::swapValue(hdr.bitpix);
+  typeConversion::swapValue(hdr.slice_start);
+  swapArray(hdr.pixdim, 8);
+  typeConversion::swapValue(hdr.vox_offset);
+  typeConversion::swapValue(hdr.scl_slope);
+  typeConversion::swapValue(hdr.scl_inter);
+  typeConversion::swapValue(hdr.slice_end);
+  typeConversion::swapValue(hdr.cal_max);
+  typeConversion::swapValue(hdr.cal_min);
+  typeConversion::swapValue(hdr.slice_duration);
+  typeConversion::swapValue(hdr.toffset);
+  typeConversion::swapValue(hdr.glmax);
+  typeConversion::swapValue(hdr.glmin);
+  typeConversion::swapValue(hdr.qform_code);
+  typeConversion::swapValue(hdr.sform_code);
+  typeConversion::swapValue(hdr.quatern_b);
+  typeConversion::swapValue(hdr.quatern_c);
+  typeConversion::swapValue(hdr.quatern_d);
+  typeConversion::swapValue(hdr.qoffset_x);
+  typeConversion::swapValue(hdr.qoffset_y);
+  typeConversion::swapValue(hdr.qoffset_z);
+  swapArray(hdr.srow_x, 4);
+  swapArray(hdr.srow_y, 4);
+  swapArray(hdr.srow_z, 4);
+}
+
+bool niftiHeader::needs_swap(const nifti_2_header& hdr) {
+  if (hdr.sizeof_hdr == NII2_HEADER_SIZE) return false;
+
+  int32_t sizeofHdr = hdr.sizeof_hdr;
+  typeConversion::swapValue(sizeofHdr);
+  if (sizeofHdr == NII2_HEADER_SIZE) return true;
+
+  int64_t nDims = hdr.dim[0];
+  typeConversion::swapValue(nDims);
+  return ((hdr.dim[0] < 1) || (hdr.dim[0] > 7)) && ((nDims >= 1) && (nDims <= 7));
+}
+
+void niftiHeader::swap(nifti_2_header& hdr) {
+  typeConversion::swapValue(hdr.sizeof_hdr);
+  typeConversion::swapValue(hdr.datatype);
+  typeConversion::swapValue(hdr.bitpix);
+  swapArray(hdr.dim, 8);
+  typeConversion::swapValue(hdr.intent_p1);
+  typeConversion::swapValue(hdr.intent_p2);
+  typeConversion::swapValue(hdr.intent_p3);
+  swapArray(hdr.pixdim, 8);
+  typeConversion::swapValue(hdr.vox_offset);
+  typeConversion::swapValue(hdr.scl_slope);
+  typeConversion::swapValue(hdr.scl_inter);
+  typeConversion::swapValue(hdr.cal_max);
+  typeConversion::swapValue(hdr.cal_min);
+  typeConversion::swapValue(hdr.slice_duration);
+  typeConversion::swapValue(hdr.toffset);
+  typeConversion::swapValue(hdr.slice_start);
+  typeConversion::swapValue(hdr.slice_end);
+  typeConversion::swapValue(hdr.qform_code);
+  typeConversion::swapValue(hdr.sform_code);
+  typeConversion::swapValue(hdr.quatern_b);
+  typeConversion::swapValue(hdr.quatern_c);
+  typeConversion::swapValue(hdr.quatern_d);
+  typeConversion::swapValue(hdr.qoffset_x);
+  typeConversion::swapValue(hdr.qoffset_y);
+  typeConversion::swapValue(hdr.qoffset_z);
+  swapArray(hdr.srow_x, 4);
+  swapArray(hdr.srow_y, 4);
+  swapArray(hdr.srow_z, 4);
+  typeConversion::swapValue(hdr.slice_code);
+  typeConversion::swapValue(hdr.xyzt_units);
+  typeConversion::swapValue(hdr.intent_code);
+}
+
+int niftiHeader::get_version(const int32_t sizeofHdr) {
+  int32_t sizeofHdrSwapped = sizeofHdr;
+  typeConversion::swapValue(sizeofHdrSwapped);
+
+  if ((sizeofHdr == 348) || (sizeofHdrSwapped == 348)) return 1;
+  if ((sizeofHdr == NII2_HEADER_SIZE) || (sizeofHdrSwapped == NII2_HEADER_SIZE)) return 2;
+  return 0;
+}
+
+// converts the header of a NIfTI-1 file into an equivalent NIfTI-2 header
+nifti_2_header niftiHeader::to_nifti2(const nifti_1_header& hdr1) {
+  nifti_2_header hdr2 = {};
+  hdr2.sizeof_hdr = NII2_HEADER_SIZE;
+  memcpy(hdr2.magic, "n+2\0\r\n\032\n", 8);
+  hdr2.datatype = hdr1.datatype;
+  hdr2.bitpix = hdr1.bitpix;
+  for (uint8_t iDim = 0; iDim < 8; iDim++) {
+    hdr2.dim[iDim] = hdr1.dim[iDim];
+    hdr2.pixdim[iDim] = hdr1.pixdim[iDim];
+  }
+  hdr2.intent_p1 = hdr1.intent_p1;
+  hdr2.intent_p2 = hdr1.intent_p2;
+  hdr2.intent_p3 = hdr1.intent_p3;
+  hdr2.vox_offset = static_cast<int64_t>(hdr1.vox_offset);
+  hdr2.scl_slope = hdr1.scl_slope;
+  hdr2.scl_inter = hdr1.scl_inter;
+  hdr2.cal_max = hdr1.cal_max;
+  hdr2.cal_min = hdr1.cal_min;
+  hdr2.slice_duration = hdr1.slice_duration;
+  hdr2.toffset = hdr1.toffset;
+  hdr2.slice_start = hdr1.slice_start;
+  hdr2.slice_end = hdr1.slice_end;
+  memcpy(hdr2.descrip, hdr1.descrip, sizeof(hdr1.descrip));
+  memcpy(hdr2.aux_file, hdr1.aux_file, sizeof(hdr1.aux_file));
+  hdr2.qform_code = hdr1.qform_code;
+  hdr2.sform_code = hdr1.sform_code;
+  hdr2.quatern_b = hdr1.quatern_b;
+  hdr2.quatern_c = hdr1.quatern_c;
+  hdr2.quatern_d = hdr1.quatern_d;
+  hdr2.qoffset_x = hdr1.qoffset_x;
+  hdr2.qoffset_y = hdr1.qoffset_y;
+  hdr2.qoffset_z = hdr1.qoffset_z;
+  for (uint8_t iCol = 0; iCol < 4; iCol++) {
+    hdr2.srow_x[iCol] = hdr1.srow_x[iCol];
+    hdr2.srow_y[iCol] = hdr1.srow_y[iCol];
+    hdr2.srow_z[iCol] = hdr1.srow_z[iCol];
+  }
+  hdr2.slice_code = hdr1.slice_code;
+  hdr2.xyzt_units = hdr1.xyzt_units;
+  hdr2.intent_code = hdr1.intent_code;
+  memcpy(hdr2.intent_name, hdr1.intent_name, sizeof(hdr1.intent_name));
+  hdr2.dim_info = hdr1.dim_info;
+  return hdr2;
+}
+
+bool niftiHeader::needs_nifti2(const std::size_t* dim) {
+  return (dim[0] > NII1_MAX_DIM) || (dim[1] > NII1_MAX_DIM) || (dim[2] > NII1_MAX_DIM);
+}
@@ -0,0 +1,90 @@
+/*
+  File: niftiHeader.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: NIfTI-2 header definition and helper functions to handle NIfTI
+  headers written on machines with opposite byte order
+*/
+
+#ifndef NIFTIHEADER_H
+#define NIFTIHEADER_H
+
+#include "../lib/nifti/niftilib/nifti1.h"
+#include <cstddef>
+#include <cstdint>
+
+#define MIN_HEADER_SIZE 348 // NIfTI-1 header
+#define NII_HEADER_SIZE 352 // NIfTI-1 header plus 4 byte extender
+#define NII2_HEADER_SIZE 540
+#define NII2_DATA_OFFSET 544 // header plus 4 byte extender
+#define NII1_MAX_DIM 32767   // largest dimension a 16 bit dim[] entry can hold
+
+// NIfTI-2 header as defined in nifti2.h: 64 bit dims and offsets, double precision fields
+#pragma pack(push, 1)
+struct nifti_2_header {
+  int32_t sizeof_hdr; //!< must be 540
+  char magic[8];      //!< "n+2\0\r\n\032\n" for single files
+  int16_t datatype;
+  int16_t bitpix;
+  int64_t dim[8];
+  double intent_p1;
+  double intent_p2;
+  double intent_p3;
+  double pixdim[8];
+  int64_t vox_offset;
+  double scl_slope;
+  double scl_inter;
+  double cal_max;
+  double cal_min;
+  double slice_duration;
+  double toffset;
+  int64_t slice_start;
+  int64_t slice_end;
+  char descrip[80];
+  char aux_file[24];
+  int32_t qform_code;
+  int32_t sform_code;
+  double quatern_b;
+  double quatern_c;
+  double quatern_d;
+  double qoffset_x;
+  double qoffset_y;
+  double qoffset_z;
+  double srow_x[4];
+  double srow_y[4];
+  double srow_z[4];
+  int32_t slice_code;
+  int32_t xyzt_units;
+  int32_t intent_code;
+  char intent_name[16];
+  char dim_info;
+  char unused_str[15];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(nifti_2_header) == NII2_HEADER_SIZE, "NIfTI-2 header must be 540 bytes");
+
+class niftiHeader {
+public:
+  /// \brief checks if a header was written in opposite byte order
+  /// \details sizeof_hdr is used first, dim[0] (must be 1 ... 7) resolves the rest
+  [[nodiscard]] static bool needs_swap(const nifti_1_header& hdr);
+  [[nodiscard]] static bool needs_swap(const nifti_2_header& hdr);
+
+  /// \brief reverses the byte order of all numeric header fields
+  static void swap(nifti_1_header& hdr);
+  static void swap(nifti_2_header& hdr);
+
+  /// \brief returns the NIfTI version (1 or 2) a header starting with sizeof_hdr belongs to
+  /// \returns 0 if sizeof_hdr does not match any version in either byte order
+  [[nodiscard]] static int get_version(const int32_t sizeofHdr);
+
+  /// \brief converts a NIfTI-1 header into the equivalent NIfTI-2 header
+  [[nodiscard]] static nifti_2_header to_nifti2(const nifti_1_header& hdr1);
+
+  /// \brief true if any of the three dimensions exceeds the 16 bit range of NIfTI-1
+  [[nodiscard]] static bool needs_nifti2(const std::size_t* dim);
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "niiFile.h"
+#include "typeConversion.h"
+#include <cstring>
+#include <stdexcept>
+
+static bool is_gz(const std::string& _path) {
+  return (_path.length() >= 3) && (_path.compare(_path.length() - 3, 3, ".gz") == 0);
+}
+
+niiSource::niiSource(const std::string& _path) : flagGz(is_gz(_path)), path(_path) {
+  if (flagGz) {
+    gzIn.open(path); // starts inflating in the background
+  } else {
+    fp = fopen(path.c_str(), "r");
+    if (fp == NULL) {
+      printf("Error opening header file %s\n", path.c_str());
+      throw std::runtime_error("FileError");
+    }
+  }
+}
+
+niiSource::~niiSource() {
+  if (fp != NULL) fclose(fp);
+}
+
+void niiSource::read(void* buffer, const std::size_t nBytes) {
+  const std::size_t ret = flagGz ? gzIn.read(buffer, nBytes) : fread(buffer, 1, nBytes, fp);
+  if (ret != nBytes) {
+    printf("Error reading %lu bytes from %s (%lu)\n", nBytes, path.c_str(), ret);
+    throw std::runtime_error("ReadError");
+  }
+}
+
+void niiSource::seek(const std::size_t currPos, const std::size_t newPos) {
+  if (newPos < currPos) {
+    printf("Error seeking backwards in %s\n", path.c_str());
+    throw std::runtime_error("InvalidOperation");
+  }
+
+  if (flagGz) {
+    gzIn.skip(newPos - currPos);
+  } else if (fseek(fp, (long)newPos, SEEK_SET) != 0) {
+    printf("Error doing fseek() to %ld in data file %s\n", (long)newPos, path.c_str());
+    throw std::runtime_error("InvalidOperation");
+  }
+}
+
+niiInfo niiSource::read_header(nifti_1_header& hdr) {
+  niiInfo info;
+  int32_t sizeofHdr = 0;
+  read(&sizeofHdr, sizeof(sizeofHdr));
+  const int niiVersion = niftiHeader::get_version(sizeofHdr);
+
+  if (niiVersion == 2) {
+    nifti_2_header hdr2;
+    hdr2.sizeof_hdr = sizeofHdr;
+    read(reinterpret_cast<char*>(&hdr2) + sizeof(sizeofHdr),
+                NII2_HEADER_SIZE - sizeof(sizeofHdr));
+
+    // files from machines with opposite byte order are swapped while reading
+    info.flagSwap = niftiHeader::needs_swap(hdr2);
+    if (info.flagSwap) niftiHeader::swap(hdr2);
+
+    for (uint8_t iDim = 0; iDim < 3; iDim++) {
+      if (hdr2.dim[iDim + 1] <= 0) {
+        printf("Invalid dimension %ld in %s\n", (long)hdr2.dim[iDim + 1], path.c_str());
+        throw std::runtime_error("InvalidSize");
+      }
+      info.dim[iDim] = hdr2.dim[iDim + 1];
+      info.res[iDim] = hdr2.pixdim[iDim + 1];
+    }
+    info.voxOffset = hdr2.vox_offset;
+    info.headerSize = NII2_HEADER_SIZE;
+    info.datatype = hdr2.datatype;
+    info.sclSlope = hdr2.scl_slope;
+    info.sclInter = hdr2.scl_inter;
+  } else {
+    hdr.sizeof_hdr = sizeofHdr;
+    read(reinterpret_cast<char*>(&hdr) + sizeof(sizeofHdr),
+                MIN_HEADER_SIZE - sizeof(sizeofHdr));
+
+    // files from machines with opposite byte order are swapped while reading
+    info.flagSwap = niftiHeader::needs_swap(hdr);
+    if (info.flagSwap) niftiHeader::swap(hdr);
+
+    // a corrupt header would otherwise turn into a huge allocation
+    for (uint8_t iDim = 0; iDim < 3; iDim++) {
+      if (hdr.dim[iDim + 1] <= 0) {
+        printf("Invalid dimension %d in %s\n", (int)hdr.dim[iDim + 1], path.c_str());
+        throw std::runtime_error("InvalidSize");
+      }
+      info.dim[iDim] = hdr.dim[iDim + 1];
+      info.res[iDim] = hdr.pixdim[iDim + 1];
+    }
+    info.voxOffset = static_cast<std::size_t>(hdr.vox_offset);
+    info.headerSize = MIN_HEADER_SIZE;
+    info.datatype = hdr.datatype;
+    info.sclSlope = hdr.scl_slope;
+    info.sclInter = hdr.scl_inter;
+  }
+
+  if (typeConversion::get_bytesPerVoxel(info.datatype) == 0) {
+    printf("Data type %d requires implementation!\n", info.datatype);
+    throw std::runtime_error("InvalidValue");
+  }
+  return info;
+}
+
+niiSink::niiSink(const std::string& _path, const int compressionLevel)
+    : flagGz(is_gz(_path)), path(_path) {
+  if (flagGz) {
+    gzOut.open(path, compressionLevel);
+  } else {
+    fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+      printf("Error opening header file %s for write\n", path.c_str());
+      throw std::runtime_error("FileError");
+    }
+  }
+}
+
+niiSink::~niiSink() {
+  if (fp != NULL) fclose(fp);
+}
+
+void niiSink::write(const void* buffer, const std::size_t nBytes) {
+  if (flagGz) {
+    gzOut.write(buffer, nBytes);
+  } else if (fwrite(buffer, 1, nBytes, fp) != nBytes) {
+    printf("Error writing to %s\n", path.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
+
+void niiSink::close() {
+  if (flagGz) {
+    gzOut.close();
+  } else {
+    const int ret = fclose(fp);
+    fp = NULL;
+    if (ret != 0) {
+      printf("Error closing %s\n", path.c_str());
+      throw std::runtime_error("FileError");
+    }
+  }
+}
+
+void niiSink::write_header(nifti_1_header hdr,
+                           const std::size_t* dim,
+                           const float* res,
+                           const int datatype,
+                           const float slope,
+                           const float inter,
+                           const bool flagSwap) {
+  nifti1_extender pad = {0, 0, 0, 0};
+
+  hdr.datatype = datatype;
+  hdr.bitpix = 8 * typeConversion::get_bytesPerVoxel(datatype);
+  hdr.vox_offset = (float)NII_HEADER_SIZE;
+  hdr.sizeof_hdr = MIN_HEADER_SIZE;
+  hdr.dim[0] = 3;
+  hdr.dim[1] = dim[0];
+  hdr.dim[2] = dim[1];
+  hdr.dim[3] = dim[2];
+
+  hdr.pixdim[1] = res[0];
+  hdr.pixdim[2] = res[1];
+  hdr.pixdim[3] = res[2];
+
+  hdr.scl_slope = slope;
+  hdr.scl_inter = inter;
+  memcpy(hdr.magic, "n+1\0", 4);
+
+  if (niftiHeader::needs_nifti2(dim)) {
+    // dimensions do not fit into the 16 bit fields of NIfTI-1, use 64 bit NIfTI-2 header
+    nifti_2_header hdr2 = niftiHeader::to_nifti2(hdr);
+    hdr2.dim[1] = dim[0];
+    hdr2.dim[2] = dim[1];
+    hdr2.dim[3] = dim[2];
+    hdr2.vox_offset = NII2_DATA_OFFSET;
+    if (flagSwap) niftiHeader::swap(hdr2);
+    write(&hdr2, NII2_HEADER_SIZE);
+  } else {
+    if (flagSwap) niftiHeader::swap(hdr);
+    write(&hdr, MIN_HEADER_SIZE);
+  }
+  write(&pad, 4);
+}
@@ -0,0 +1,89 @@
+/*
+  File: niiFile.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: sequential access to nii files, plain or gzip compressed.
+  niiSource parses NIfTI-1 and NIfTI-2 headers in either byte order and hands
+  out the raw voxel bytes, niiSink writes a header of the right version followed
+  by the voxel bytes. Conversion of the voxel bytes is left to typeConversion.
+*/
+
+#ifndef NIIFILE_H
+#define NIIFILE_H
+
+#include "../lib/nifti/niftilib/nifti1.h"
+#include "gzipStream.h"
+#include "niftiHeader.h"
+#include <cstdio>
+#include <string>
+
+// fields of a nii header needed to locate and convert the data, filled from either version
+struct niiInfo {
+  std::size_t dim[3] = {0, 0, 0};
+  float res[3] = {1.0f, 1.0f, 1.0f};
+  std::size_t voxOffset = 0;
+  std::size_t headerSize = 0;
+  int datatype = 0;
+  float sclSlope = 0.0f;
+  float sclInter = 0.0f;
+  bool flagSwap = false;
+
+  // slope and intercept of 1 and 0 do not change anything, skip the pass
+  [[nodiscard]] bool needs_scale() const {
+    return (sclSlope != 0) && ((sclSlope != 1.0f) || (sclInter != 0.0f));
+  }
+};
+
+// sequential byte source for nii files, either plain or gzip compressed
+struct niiSource {
+  FILE* fp = nullptr;
+  gzipReader gzIn;
+  bool flagGz = false;
+  std::string path;
+
+  explicit niiSource(const std::string& _path);
+  ~niiSource();
+
+  niiSource(const niiSource&) = delete;
+  niiSource& operator=(const niiSource&) = delete;
+
+  // reads exactly nBytes or throws
+  void read(void* buffer, const std::size_t nBytes);
+
+  // moves forward to an absolute position in the uncompressed stream
+  void seek(const std::size_t currPos, const std::size_t newPos);
+
+  // reads the header, the leading sizeof_hdr tells NIfTI-1 and NIfTI-2 apart, a NIfTI-1 header
+  // is also returned in hdr (byte order corrected)
+  niiInfo read_header(nifti_1_header& hdr);
+};
+
+// sequential byte sink for nii files, either plain or gzip compressed
+struct niiSink {
+  FILE* fp = nullptr;
+  gzipWriter gzOut;
+  bool flagGz = false;
+  std::string path;
+
+  niiSink(const std::string& _path, const int compressionLevel);
+  ~niiSink();
+
+  niiSink(const niiSink&) = delete;
+  niiSink& operator=(const niiSink&) = delete;
+
+  void write(const void* buffer, const std::size_t nBytes);
+  void close();
+
+  // writes header and extender, NIfTI-2 is used if a dimension exceeds the NIfTI-1 range
+  // \param hdr template for all fields not derived from the other arguments
+  void write_header(nifti_1_header hdr,
+                    const std::size_t* dim,
+                    const float* res,
+                    const int datatype,
+                    const float slope,
+                    const float inter,
+                    const bool flagSwap);
+};
+
+#endif
@@ -0,0 +1,571 @@
+#include "slabVolume.h"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+slabVolume::slabVolume()
+    : baseClass("slabVolume"), processor_count(std::thread::hardware_concurrency()) {}
+
+slabVolume::~slabVolume() { close(); }
+
+// returns the file extension of a given path
+static std::string getSlabFileExt(const std::string& _filePath) {
+  const std::size_t i = _filePath.rfind('.', _filePath.length());
+  if (i != std::string::npos) return _filePath.substr(i + 1, _filePath.length() - i);
+
+  return "";
+}
+
+void slabVolume::open(const std::string& _filePath, const bool _flagWritable) {
+  close();
+  const std::string ext = getSlabFileExt(_filePath);
+
+  if (ext == "nii") {
+    const int fd = ::open(_filePath.c_str(), _flagWritable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+      printf("Error opening file %s\n", _filePath.c_str());
+      throw std::runtime_error("FileError");
+    }
+
+    // native NIfTI-1 and NIfTI-2 headers are both reduced to the fields needed here
+    int32_t sizeofHdr = 0;
+    nifti_1_header hdr1;
+    nifti_2_header hdr2;
+    bool flagValid = (pread(fd, &sizeofHdr, sizeof(sizeofHdr), 0) == sizeof(sizeofHdr));
+    if (flagValid && (sizeofHdr == MIN_HEADER_SIZE))
+      flagValid = (pread(fd, &hdr1, MIN_HEADER_SIZE, 0) == MIN_HEADER_SIZE);
+    else if (flagValid && (sizeofHdr == NII2_HEADER_SIZE))
+      flagValid = (pread(fd, &hdr2, NII2_HEADER_SIZE, 0) == NII2_HEADER_SIZE);
+    else
+      flagValid = false;
+
+    if (!flagValid) {
+      ::close(fd);
+      printf("Out-of-core processing requires a native byte order nii file\n");
+      throw std::runtime_error("InvalidValue");
+    }
+
+    const bool flagNifti2 = (sizeofHdr == NII2_HEADER_SIZE);
+    const int datatype = flagNifti2 ? hdr2.datatype : hdr1.datatype;
+    if (datatype != DT_FLOAT) {
+      ::close(fd);
+      printf("Out-of-core processing requires a native float nii file\n");
+      throw std::runtime_error("InvalidValue");
+    }
+
+    std::size_t _dim[3];
+    for (uint8_t iDim = 0; iDim < 3; iDim++) {
+      _dim[iDim] = flagNifti2 ? static_cast<std::size_t>(hdr2.dim[iDim + 1])
+                              : static_cast<std::size_t>(hdr1.dim[iDim + 1]);
+    }
+    const std::size_t voxOffset = flagNifti2 ? static_cast<std::size_t>(hdr2.vox_offset)
+                                             : static_cast<std::size_t>(hdr1.vox_offset);
+    ::close(fd);
+    open_raw(_filePath, _dim, voxOffset, _flagWritable);
+
+    for (uint8_t iDim = 0; iDim < 3; iDim++)
+      res[iDim] = flagNifti2 ? hdr2.pixdim[iDim + 1] : hdr1.pixdim[iDim + 1];
+
+    const float slope = flagNifti2 ? hdr2.scl_slope : hdr1.scl_slope;
+    const float inter = flagNifti2 ? hdr2.scl_inter : hdr1.scl_inter;
+    if ((slope != 0) && ((slope != 1.0f) || (inter != 0.0f))) {
+      sclSlope = slope;
+      sclInter = inter;
+    }
+  } else if (ext == "h5") {
+    std::lock_guard<std::mutex> lock(h5Mutex);
+    h5File = std::make_unique<H5::H5File>(_filePath, _flagWritable ? H5F_ACC_RDWR : H5F_ACC_RDONLY);
+
+    const hsize_t col_dims = 3;
+    H5::DataSpace mspace(1, &col_dims);
+    H5::DataSet resDataset = h5File->openDataSet("dr");
+    resDataset.read(res, H5::PredType::NATIVE_FLOAT, mspace, resDataset.getSpace());
+    H5::DataSet originDataset = h5File->openDataSet("origin");
+    originDataset.read(origin, H5::PredType::NATIVE_FLOAT, mspace, originDataset.getSpace());
+    H5::DataSet dimDataset = h5File->openDataSet("dim");
+    dimDataset.read(dim, H5::PredType::NATIVE_UINT64, mspace, dimDataset.getSpace());
+
+    h5Data = std::make_unique<H5::DataSet>(h5File->openDataSet("vol"));
+
+    // slabs rarely end on chunk boundaries, keep one layer of chunks in the cache so that
+    // chunks shared by neighbouring slabs are only decompressed once
+    H5::DSetCreatPropList plist = h5Data->getCreatePlist();
+    if ((h5Data->getSpace().getSimpleExtentNdims() == 3) && (plist.getLayout() == H5D_CHUNKED)) {
+      hsize_t chunk[3];
+      plist.getChunk(3, chunk);
+      const std::size_t layerBytes = ((dim[0] + chunk[2] - 1) / chunk[2]) * chunk[2] *
+                                     ((dim[1] + chunk[1] - 1) / chunk[1]) * chunk[1] * chunk[0] *
+                                     sizeof(float);
+      H5::DSetAccPropList dapl;
+      dapl.setChunkCache(10007, std::min(layerBytes, memoryBudget / 4), 1.0);
+      h5Data = std::make_unique<H5::DataSet>(h5File->openDataSet("vol", dapl));
+    }
+    backend = SlabBackend::H5;
+    filePath = _filePath;
+    flagWritable = _flagWritable;
+  } else {
+    printf("I do not support out-of-core processing of this file type.\n");
+    throw std::runtime_error("InvalidType");
+  }
+}
+
+void slabVolume::open_raw(const std::string& _filePath,
+                          const std::size_t* _dim,
+                          const std::size_t _byteOffset,
+                          const bool _flagWritable) {
+  close();
+
+  fileDesc = ::open(_filePath.c_str(), _flagWritable ? O_RDWR : O_RDONLY);
+  if (fileDesc < 0) {
+    printf("Error opening file %s\n", _filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  struct stat fileStat;
+  const std::size_t nBytes = _byteOffset + _dim[0] * _dim[1] * _dim[2] * sizeof(float);
+  if ((fstat(fileDesc, &fileStat) != 0) || (static_cast<std::size_t>(fileStat.st_size) < nBytes)) {
+    close();
+    printf("File %s is too small for the requested dimensions\n", _filePath.c_str());
+    throw std::runtime_error("ReadError");
+  }
+
+  for (uint8_t iDim = 0; iDim < 3; iDim++)
+    dim[iDim] = _dim[iDim];
+
+  byteOffset = _byteOffset;
+  backend = SlabBackend::RAW;
+  filePath = _filePath;
+  flagWritable = _flagWritable;
+}
+
+void slabVolume::close() {
+  if (fileDesc >= 0) {
+    ::close(fileDesc);
+    fileDesc = -1;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(h5Mutex);
+    h5Data.reset();
+    h5File.reset();
+  }
+
+  backend = SlabBackend::NONE;
+  sclSlope = 1.0f;
+  sclInter = 0.0f;
+  byteOffset = 0;
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    dim[iDim] = 0;
+    origin[iDim] = 0.0f;
+    res[iDim] = 1.0f;
+  }
+}
+
+void slabVolume::set_memoryBudget(const std::size_t _memoryBudget) {
+  if (_memoryBudget == 0) {
+    printf("Memory budget needs to be bigger then 0\n");
+    throw std::runtime_error("InvalidValue");
+  }
+  memoryBudget = _memoryBudget;
+}
+
+std::size_t slabVolume::get_slabDepth() const { return get_slabDepth(2); }
+
+std::size_t slabVolume::get_slabDepth(const std::size_t nBuffers) const {
+  const std::size_t sliceBytes = dim[0] * dim[1] * sizeof(float);
+  if ((sliceBytes == 0) || (dim[2] == 0)) return 1;
+
+  // we always need at least one slice per buffer, even if this exceeds the budget
+  const std::size_t depth = memoryBudget / (nBuffers * sliceBytes);
+  return std::clamp<std::size_t>(depth, 1, dim[2]);
+}
+
+std::size_t slabVolume::get_nSlabs() const {
+  const std::size_t depth = get_slabDepth();
+  return (dim[2] + depth - 1) / depth;
+}
+
+// reads n2 slices starting at start2 into slab
+void slabVolume::read_slab(float* slab, const std::size_t start2, const std::size_t n2) const {
+  const std::size_t sliceSize = dim[0] * dim[1];
+
+  if (backend == SlabBackend::RAW) {
+    char* ptr = reinterpret_cast<char*>(slab);
+    std::size_t nBytes = n2 * sliceSize * sizeof(float);
+    off_t offset = byteOffset + start2 * sliceSize * sizeof(float);
+    while (nBytes > 0) {
+      const ssize_t ret = pread(fileDesc, ptr, nBytes, offset);
+      if (ret <= 0) {
+        printf("Error reading slab from %s\n", filePath.c_str());
+        throw std::runtime_error("ReadError");
+      }
+      ptr += ret;
+      offset += ret;
+      nBytes -= ret;
+    }
+
+    if ((sclSlope != 1.0f) || (sclInter != 0.0f)) {
+      for (std::size_t iElem = 0; iElem < n2 * sliceSize; iElem++)
+        slab[iElem] = slab[iElem] * sclSlope + sclInter;
+    }
+  } else if (backend == SlabBackend::H5) {
+    std::lock_guard<std::mutex> lock(h5Mutex);
+    H5::DataSpace filespace;
+    H5::DataSpace mspace;
+    select_h5Slab(start2, n2, filespace, mspace);
+    h5Data->read(slab, H5::PredType::NATIVE_FLOAT, mspace, filespace);
+  } else {
+    printf("No file opened for out-of-core processing\n");
+    throw std::runtime_error("InvalidOperation");
+  }
+}
+
+// writes n2 slices starting at start2 from slab back to file
+void slabVolume::write_slab(const float* slab, const std::size_t start2, const std::size_t n2) {
+  check_writable();
+  const std::size_t sliceSize = dim[0] * dim[1];
+
+  if (backend == SlabBackend::RAW) {
+    std::vector<float> unscaled;
+    if ((sclSlope != 1.0f) || (sclInter != 0.0f)) {
+      // file holds unscaled values, invert the scaling applied during reading
+      unscaled.resize(n2 * sliceSize);
+      const float iSlope = 1.0f / sclSlope;
+      for (std::size_t iElem = 0; iElem < unscaled.size(); iElem++)
+        unscaled[iElem] = (slab[iElem] - sclInter) * iSlope;
+      slab = unscaled.data();
+    }
+
+    const char* ptr = reinterpret_cast<const char*>(slab);
+    std::size_t nBytes = n2 * sliceSize * sizeof(float);
+    off_t offset = byteOffset + start2 * sliceSize * sizeof(float);
+    while (nBytes > 0) {
+      const ssize_t ret = pwrite(fileDesc, ptr, nBytes, offset);
+      if (ret <= 0) {
+        printf("Error writing slab to %s\n", filePath.c_str());
+        throw std::runtime_error("FileError");
+      }
+      ptr += ret;
+      offset += ret;
+      nBytes -= ret;
+    }
+  } else if (backend == SlabBackend::H5) {
+    std::lock_guard<std::mutex> lock(h5Mutex);
+    H5::DataSpace filespace;
+    H5::DataSpace mspace;
+    select_h5Slab(start2, n2, filespace, mspace);
+    h5Data->write(slab, H5::PredType::NATIVE_FLOAT, mspace, filespace);
+  }
+}
+
+// selects the slices [start2, start2 + n2) of the h5 dataset, which is either a flat 1D array
+// or a 3D array of shape [dim2, dim1, dim0]
+void slabVolume::select_h5Slab(const std::size_t start2,
+                               const std::size_t n2,
+                               H5::DataSpace& filespace,
+                               H5::DataSpace& mspace) const {
+  filespace = h5Data->getSpace();
+  if (filespace.getSimpleExtentNdims() == 3) {
+    const hsize_t start[3] = {start2, 0, 0};
+    const hsize_t count[3] = {n2, dim[1], dim[0]};
+    filespace.selectHyperslab(H5S_SELECT_SET, count, start);
+    mspace = H5::DataSpace(3, count);
+  } else {
+    const hsize_t start = start2 * dim[0] * dim[1];
+    const hsize_t count = n2 * dim[0] * dim[1];
+    filespace.selectHyperslab(H5S_SELECT_SET, &count, &start);
+    mspace = H5::DataSpace(1, &count);
+  }
+}
+
+void slabVolume::check_writable() const {
+  if (!flagWritable) {
+    printf("File %s was not opened as writable\n", filePath.c_str());
+    throw std::runtime_error("InvalidOperation");
+  }
+}
+
+// splits the range 0 ... nElem into one chunk per processor
+void slabVolume::run_parallel(const std::size_t nElem,
+                              const std::function<void(std::size_t, std::size_t)>& func) const {
+  const std::size_t nThreads = std::max<std::size_t>(1, std::min<std::size_t>(processor_count, nElem));
+  if (nThreads == 1) {
+    func(0, nElem);
+    return;
+  }
+
+  const std::size_t nElementsThread = nElem / nThreads;
+  std::vector<std::thread> workers;
+  for (std::size_t iThread = 0; iThread < nThreads; iThread++) {
+    const std::size_t startIdx = iThread * nElementsThread;
+    const std::size_t stopIdx = (iThread < (nThreads - 1)) ? (iThread + 1) * nElementsThread : nElem;
+    workers.push_back(std::thread(func, startIdx, stopIdx));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void slabVolume::process_slabs(
+    const std::function<void(float*, const float*, std::size_t, std::size_t)>& func,
+    const bool flagWriteBack,
+    const slabVolume* partner) {
+
+  if (backend == SlabBackend::NONE) {
+    printf("No file opened for out-of-core processing\n");
+    throw std::runtime_error("InvalidOperation");
+  }
+
+  if (flagWriteBack) check_writable();
+
+  // two buffers per volume, one being processed, one being read
+  const std::size_t depth = get_slabDepth((partner == nullptr) ? 2 : 4);
+  const std::size_t sliceSize = dim[0] * dim[1];
+  std::vector<float> slabs[2];
+  std::vector<float> partnerSlabs[2];
+  for (uint8_t iBuf = 0; iBuf < 2; iBuf++) {
+    slabs[iBuf].resize(depth * sliceSize);
+    if (partner != nullptr) partnerSlabs[iBuf].resize(depth * sliceSize);
+  }
+
+  std::exception_ptr readError = nullptr;
+  const auto fetch = [&](const uint8_t iBuf, const std::size_t start2, const std::size_t n2) {
+    try {
+      read_slab(slabs[iBuf].data(), start2, n2);
+      if (partner != nullptr) partner->read_slab(partnerSlabs[iBuf].data(), start2, n2);
+    } catch (...) {
+      readError = std::current_exception();
+    }
+  };
+
+  fetch(0, 0, std::min(depth, dim[2]));
+  for (std::size_t start2 = 0; start2 < dim[2]; start2 += depth) {
+    const uint8_t iCurr = (start2 / depth) % 2;
+    const std::size_t n2 = std::min(depth, dim[2] - start2);
+    if (readError) std::rethrow_exception(readError);
+
+    // read ahead the next slab while the current one is processed
+    std::thread reader;
+    const std::size_t nextStart2 = start2 + depth;
+    if (nextStart2 < dim[2])
+      reader = std::thread(fetch, 1 - iCurr, nextStart2, std::min(depth, dim[2] - nextStart2));
+
+    try {
+      func(slabs[iCurr].data(),
+           (partner == nullptr) ? nullptr : partnerSlabs[iCurr].data(),
+           start2,
+           n2);
+      if (flagWriteBack) write_slab(slabs[iCurr].data(), start2, n2);
+    } catch (...) {
+      if (reader.joinable()) reader.join();
+      throw;
+    }
+
+    if (reader.joinable()) reader.join();
+  }
+}
+
+void slabVolume::for_each_slab(const std::function<void(float*, std::size_t, std::size_t)>& func,
+                               const bool flagWriteBack) {
+  process_slabs([&](float* slab, const float*, const std::size_t start2, const std::size_t n2) {
+    func(slab, start2, n2);
+  }, flagWriteBack, nullptr);
+}
+
+slabVolume& slabVolume::operator*=(const float multVal) {
+  for_each_slab([&](float* slab, std::size_t, const std::size_t n2) {
+    run_parallel(n2 * dim[0] * dim[1], [&](const std::size_t start, const std::size_t stop) {
+      multiply(slab + start, multVal, stop - start);
+    });
+  }, true);
+  return *this;
+}
+
+slabVolume& slabVolume::operator/=(const float divVal) {
+  *this *= (1.0f / divVal);
+  return *this;
+}
+
+slabVolume& slabVolume::operator+=(const float addVal) {
+  for_each_slab([&](float* slab, std::size_t, const std::size_t n2) {
+    run_parallel(n2 * dim[0] * dim[1], [&](const std::size_t start, const std::size_t stop) {
+      add(slab + start, addVal, stop - start);
+    });
+  }, true);
+  return *this;
+}
+
+slabVolume& slabVolume::operator-=(const float subsVal) {
+  *this += (-subsVal);
+  return *this;
+}
+
+// applies an element wise operation between this volume and volumeB, slab by slab
+void slabVolume::combine(const slabVolume& volumeB,
+                         const std::function<void(float*, const float*, std::size_t)>& op) {
+  // slabs of both volumes are paired voxel by voxel, equal counts with another shape do not match
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if (volumeB.get_dim(iDim) != dim[iDim]) {
+      printf("Volumes differ along dim %d (%lu vs %lu elements)\n",
+             iDim,
+             dim[iDim],
+             volumeB.get_dim(iDim));
+      throw std::runtime_error("InvalidSize");
+    }
+  }
+
+  process_slabs([&](float* slab, const float* slabB, std::size_t, const std::size_t n2) {
+    run_parallel(n2 * dim[0] * dim[1], [&](const std::size_t start, const std::size_t stop) {
+      op(slab + start, slabB + start, stop - start);
+    });
+  }, true, &volumeB);
+}
+
+slabVolume& slabVolume::operator*=(const slabVolume& volumeB) {
+  combine(volumeB, [](float* a, const float* b, const std::size_t n) { multiply(a, b, n); });
+  return *this;
+}
+
+slabVolume& slabVolume::operator/=(const slabVolume& volumeB) {
+  combine(volumeB, [](float* a, const float* b, const std::size_t n) { divide(a, b, n); });
+  return *this;
+}
+
+slabVolume& slabVolume::operator+=(const slabVolume& volumeB) {
+  combine(volumeB, [](float* a, const float* b, const std::size_t n) { add(a, b, n); });
+  return *this;
+}
+
+slabVolume& slabVolume::operator-=(const slabVolume& volumeB) {
+  combine(volumeB, [](float* a, const float* b, const std::size_t n) { substract(a, b, n); });
+  return *this;
+}
+
+// calculates maximum and minimum value over all slabs
+void slabVolume::calcMinMax() {
+  bool flagFirst = true;
+  std::mutex minMaxMutex;
+  for_each_slab([&](float* slab, std::size_t, const std::size_t n2) {
+    run_parallel(n2 * dim[0] * dim[1], [&](const std::size_t start, const std::size_t stop) {
+      const float localMin = getMin(slab + start, stop - start);
+      const float localMax = getMax(slab + start, stop - start);
+
+      std::lock_guard<std::mutex> lock(minMaxMutex);
+      if (flagFirst || (minVal > localMin)) minVal = localMin;
+      if (flagFirst || (maxVal < localMax)) maxVal = localMax;
+      flagFirst = false;
+    });
+  });
+
+  maxAbsVal = std::max(std::abs(minVal), std::abs(maxVal));
+}
+
+float slabVolume::get_norm() {
+  double sumSq = 0.0;
+  std::mutex sumMutex;
+  for_each_slab([&](float* slab, std::size_t, const std::size_t n2) {
+    run_parallel(n2 * dim[0] * dim[1], [&](const std::size_t start, const std::size_t stop) {
+      double localSum = 0.0;
+      for (std::size_t iElem = start; iElem < stop; iElem++)
+        localSum += slab[iElem] * slab[iElem];
+
+      std::lock_guard<std::mutex> lock(sumMutex);
+      sumSq += localSum;
+    });
+  });
+  return static_cast<float>(std::sqrt(sumSq));
+}
+
+// calculates the maximum intensity projections slab by slab
+void slabVolume::calcMips() {
+  mipZ.assign(dim[1] * dim[2], 0.0f);
+  mipX.assign(dim[0] * dim[2], 0.0f);
+  mipY.assign(dim[0] * dim[1], 0.0f);
+
+  for_each_slab([&](float* slab, const std::size_t start2, const std::size_t n2) {
+    // projections along dim0 and dim1 are disjoint per slice, split over slices
+    run_parallel(n2, [&](const std::size_t startY, const std::size_t stopY) {
+      for (std::size_t iY = startY; iY < stopY; iY++) {
+        for (std::size_t iX = 0; iX < dim[1]; iX++) {
+          const float* row = slab + dim[0] * (iX + dim[1] * iY);
+          float* mipZVal = &mipZ[iX + (iY + start2) * dim[1]];
+          float* mipXRow = &mipX[(iY + start2) * dim[0]];
+          for (std::size_t iZ = 0; iZ < dim[0]; iZ++) {
+            const float currVal = std::abs(row[iZ]);
+            if (currVal > *mipZVal) *mipZVal = currVal;
+            if (currVal > mipXRow[iZ]) mipXRow[iZ] = currVal;
+          }
+        }
+      }
+    });
+
+    // projection along dim2 accumulates over slabs, split over dim1 instead
+    run_parallel(dim[1], [&](const std::size_t startX, const std::size_t stopX) {
+      for (std::size_t iY = 0; iY < n2; iY++) {
+        for (std::size_t iX = startX; iX < stopX; iX++) {
+          const float* row = slab + dim[0] * (iX + dim[1] * iY);
+          for (std::size_t iZ = 0; iZ < dim[0]; iZ++) {
+            const float currVal = std::abs(row[iZ]);
+            if (currVal > mipY[iX + dim[1] * iZ]) mipY[iX + dim[1] * iZ] = currVal;
+          }
+        }
+      }
+    });
+  });
+}
+
+// reads only the slabs touching the box and copies the box into volOut
+void slabVolume::crop(const std::size_t* startIdx, const std::size_t* stopIdx, volume& volOut) {
+  std::size_t dimNew[3];
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if (stopIdx[iDim] < startIdx[iDim]) {
+      printf("Stop index must be larger then start index\n");
+      throw std::runtime_error("InvalidValue");
+    }
+
+    if (stopIdx[iDim] >= dim[iDim]) {
+      printf("Cropping is exceeding array dimensions along dim %d (%lu of %lu)\n",
+             iDim,
+             stopIdx[iDim],
+             dim[iDim]);
+      throw std::runtime_error("InvalidValue");
+    }
+    dimNew[iDim] = stopIdx[iDim] - startIdx[iDim] + 1;
+  }
+
+  volOut.set_dim(dimNew);
+  volOut.alloc_memory();
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    volOut.set_res(iDim, res[iDim]);
+    volOut.set_origin(iDim, origin[iDim] + res[iDim] * static_cast<float>(startIdx[iDim]));
+  }
+
+  const std::size_t depth = get_slabDepth(1);
+  std::vector<float> slab(depth * dim[0] * dim[1]);
+  const storagePin pinOut = volOut.pin_data(); // pointer does not outlive this call
+  float* dataOut = pinOut.get_ptr();
+  for (std::size_t start2 = startIdx[2]; start2 <= stopIdx[2]; start2 += depth) {
+    const std::size_t n2 = std::min(depth, stopIdx[2] - start2 + 1);
+    read_slab(slab.data(), start2, n2);
+
+    run_parallel(n2, [&](const std::size_t startY, const std::size_t stopY) {
+      for (std::size_t iY = startY; iY < stopY; iY++) {
+        const std::size_t iYNew = iY + start2 - startIdx[2];
+        for (std::size_t iX = 0; iX < dimNew[1]; iX++) {
+          const float* rowIn = slab.data() + startIdx[0] + dim[0] * (iX + startIdx[1] + dim[1] * iY);
+          float* rowOut = dataOut + dimNew[0] * (iX + dimNew[1] * iYNew);
+          memcpy(rowOut, rowIn, dimNew[0] * sizeof(float));
+        }
+      }
+    });
+  }
+}
+
+void slabVolume::load(volume& volOut) {
+  const std::size_t startIdx[3] = {0, 0, 0};
+  const std::size_t stopIdx[3] = {dim[0] - 1, dim[1] - 1, dim[2] - 1};
+  crop(startIdx, stopIdx, volOut);
+}
@@ -0,0 +1,148 @@
+/*
+  File: slabVolume.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: out-of-core representation of a volume which remains on disk and
+  is processed slab by slab along dim[2]. Only two slabs are held in memory at
+  any time: the one being processed and the next one which is read ahead in the
+  background. The slab depth follows from a configurable memory budget.
+*/
+
+#ifndef SLABVOLUME_H
+#define SLABVOLUME_H
+
+#include "baseClass.h"
+#include "basicMathOp.h"
+#include "volume.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class SlabBackend { NONE, RAW, H5 };
+
+class slabVolume : public baseClass, public basicMathOp {
+
+public:
+  slabVolume();
+  ~slabVolume();
+
+  slabVolume(const slabVolume&) = delete;
+  slabVolume& operator=(const slabVolume&) = delete;
+
+  /// \brief open a nii or h5 file, type is distinguished by ending
+  /// \param _filePath path to the file
+  /// \param _flagWritable allow in place operations to write back to the file
+  void open(const std::string& _filePath, const bool _flagWritable = false);
+
+  /// \brief open a headerless file containing native float values
+  /// \param _filePath path to the file
+  /// \param _dim dimensions of the dataset
+  /// \param _byteOffset offset of the first element in the file
+  /// \param _flagWritable allow in place operations to write back to the file
+  void open_raw(const std::string& _filePath,
+                const std::size_t* _dim,
+                const std::size_t _byteOffset = 0,
+                const bool _flagWritable = false);
+  void close();
+
+  /// \brief define how many bytes the slab buffers may occupy in total
+  void set_memoryBudget(const std::size_t _memoryBudget);
+  [[nodiscard]] std::size_t get_memoryBudget() const { return memoryBudget; }
+
+  [[nodiscard]] std::size_t get_dim(const std::size_t _dim) const { return dim[_dim]; }
+  [[nodiscard]] std::size_t get_nElements() const { return dim[0] * dim[1] * dim[2]; }
+  [[nodiscard]] float get_res(const std::size_t _dim) const { return res[_dim]; }
+  [[nodiscard]] float get_origin(const std::size_t _dim) const { return origin[_dim]; }
+
+  /// \brief number of slices along dim[2] which are processed at once
+  [[nodiscard]] std::size_t get_slabDepth() const;
+  [[nodiscard]] std::size_t get_nSlabs() const;
+
+  /// \brief runs a function over all slabs, the next slab is read while the current one is
+  /// processed
+  /// \param func called with a pointer to the slab, its first index along dim[2] and its depth
+  /// \param flagWriteBack write the modified slab back to the file
+  void for_each_slab(const std::function<void(float*, std::size_t, std::size_t)>& func,
+                     const bool flagWriteBack = false);
+
+  // element wise in place operations, written back to the file
+  slabVolume& operator*=(const float multVal);
+  slabVolume& operator/=(const float divVal);
+  slabVolume& operator+=(const float addVal);
+  slabVolume& operator-=(const float subsVal);
+  slabVolume& operator*=(const slabVolume& volumeB);
+  slabVolume& operator/=(const slabVolume& volumeB);
+  slabVolume& operator+=(const slabVolume& volumeB);
+  slabVolume& operator-=(const slabVolume& volumeB);
+
+  // statistics
+  void calcMinMax();
+  [[nodiscard]] float get_minVal() const { return minVal; };
+  [[nodiscard]] float get_maxVal() const { return maxVal; };
+  [[nodiscard]] float get_maxAbsVal() const { return maxAbsVal; };
+  [[nodiscard]] float get_norm();
+
+  // maximum intensity projections, same indexing as in volume::calcMips
+  void calcMips();
+  [[nodiscard]] float* get_mipX() { return mipX.data(); };
+  [[nodiscard]] float* get_mipY() { return mipY.data(); };
+  [[nodiscard]] float* get_mipZ() { return mipZ.data(); };
+
+  /// \brief reads the box between startIdx and stopIdx (inclusive) into an in memory volume
+  void crop(const std::size_t* startIdx, const std::size_t* stopIdx, volume& volOut);
+
+  /// \brief reads the full dataset into an in memory volume
+  void load(volume& volOut);
+
+private:
+  void read_slab(float* slab, const std::size_t start2, const std::size_t n2) const;
+  void write_slab(const float* slab, const std::size_t start2, const std::size_t n2);
+  [[nodiscard]] std::size_t get_slabDepth(const std::size_t nBuffers) const;
+
+  // runs over all slabs of this volume and optionally the same slabs of a partner volume
+  void process_slabs(
+      const std::function<void(float*, const float*, std::size_t, std::size_t)>& func,
+      const bool flagWriteBack,
+      const slabVolume* partner);
+  void combine(const slabVolume& volumeB,
+               const std::function<void(float*, const float*, std::size_t)>& op);
+  void select_h5Slab(const std::size_t start2,
+                     const std::size_t n2,
+                     H5::DataSpace& filespace,
+                     H5::DataSpace& mspace) const;
+  void check_writable() const;
+  void run_parallel(const std::size_t nElem,
+                    const std::function<void(std::size_t, std::size_t)>& func) const;
+
+  std::string filePath;
+  SlabBackend backend = SlabBackend::NONE;
+  bool flagWritable = false;
+  int fileDesc = -1;           // file descriptor for raw and nii files
+  std::size_t byteOffset = 0;  // offset of first voxel for raw and nii files
+  float sclSlope = 1.0f;       // scaling applied to values of nii files
+  float sclInter = 0.0f;
+  std::unique_ptr<H5::H5File> h5File; // open h5 file and its data set
+  std::unique_ptr<H5::DataSet> h5Data;
+  mutable std::mutex h5Mutex;  // hdf5 is not thread safe
+
+  std::size_t dim[3] = {0, 0, 0};
+  float origin[3] = {0.0f, 0.0f, 0.0f};
+  float res[3] = {1.0f, 1.0f, 1.0f};
+  std::size_t memoryBudget = 1024 * 1024 * 1024; // 1 GB by default
+
+  float minVal = 0.0f;
+  float maxVal = 0.0f;
+  float maxAbsVal = 0.0f;
+
+  std::vector<float> mipZ; // indexing: [iX, iY], iX + nX * iY
+  std::vector<float> mipX; // indexing: [iZ, iY], iZ + nZ * iY
+  std::vector<float> mipY; // indexing: [iX, iZ], iX + nX * iZ
+
+  const int processor_count; //!< number of CPU processing units
+};
+
+#endif
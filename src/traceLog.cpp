@@ -0,0 +1,156 @@
+#include "traceLog.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+struct traceEvent {
+  const char* name;
+  const char* category;
+  uint64_t start;    // ns
+  uint64_t duration; // ns, spans only
+  double value;      // counters only
+  char phase;        // 'X' for spans, 'C' for counters
+};
+
+// events of a single thread, the lock is only contended while exporting
+struct traceBuffer {
+  std::mutex mutex;
+  std::vector<traceEvent> events;
+  uint32_t tid = 0;
+};
+
+std::atomic<bool> traceLog::flagEnabled{false};
+
+static const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+static std::mutex registryMutex;
+static std::vector<std::shared_ptr<traceBuffer>> registry; // buffers of all threads that traced
+static uint32_t nextTid = 1;
+
+static traceBuffer& get_buffer() {
+  // the registry keeps the buffer alive after the thread ended so its events can be exported
+  thread_local std::shared_ptr<traceBuffer> buffer = []() {
+    auto newBuffer = std::make_shared<traceBuffer>();
+    newBuffer->events.reserve(1024);
+    std::lock_guard<std::mutex> lock(registryMutex);
+    newBuffer->tid = nextTid++;
+    registry.push_back(newBuffer);
+    return newBuffer;
+  }();
+  return *buffer;
+}
+
+void traceLog::set_enabled(const bool _flagEnabled) { flagEnabled.store(_flagEnabled); }
+
+uint64_t traceLog::get_time() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                              traceEpoch)
+      .count();
+}
+
+void traceLog::add_span(const char* name, const char* category, const uint64_t start, const uint64_t stop) {
+  traceBuffer& buffer = get_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.events.push_back({name, category, start, stop - start, 0.0, 'X'});
+}
+
+void traceLog::add_counter(const char* name, const double value) {
+  const uint64_t now = get_time();
+  traceBuffer& buffer = get_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.events.push_back({name, "counter", now, 0, value, 'C'});
+}
+
+void traceLog::write_chrome(const std::string& filePath) {
+  FILE* fp = fopen(filePath.c_str(), "w");
+  if (fp == nullptr) {
+    printf("Error opening file %s for write\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  bool flagFirst = true;
+  std::lock_guard<std::mutex> registryLock(registryMutex);
+  for (const auto& buffer : registry) {
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    for (const traceEvent& event : buffer->events) {
+      fprintf(fp, "%s", flagFirst ? "" : ",\n");
+      flagFirst = false;
+      // Chrome expects microseconds
+      if (event.phase == 'X') {
+        fprintf(fp,
+                "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                "\"pid\": 1, \"tid\": %u}",
+                event.name,
+                event.category,
+                event.start * 1e-3,
+                event.duration * 1e-3,
+                buffer->tid);
+      } else {
+        fprintf(fp,
+                "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, "
+                "\"tid\": %u, \"args\": {\"value\": %.17g}}",
+                event.name,
+                event.category,
+                event.start * 1e-3,
+                buffer->tid,
+                event.value);
+      }
+    }
+  }
+  fprintf(fp, "\n]}\n");
+
+  if (fclose(fp) != 0) {
+    printf("Error closing %s\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
+
+void traceLog::clear() {
+  std::lock_guard<std::mutex> registryLock(registryMutex);
+  std::vector<std::shared_ptr<traceBuffer>> alive;
+  for (auto& buffer : registry) {
+    // only the registry holds buffers of threads which ended
+    if (buffer.use_count() == 1) continue;
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->events.clear();
+    alive.push_back(buffer);
+  }
+  registry.swap(alive);
+}
+
+std::size_t traceLog::get_nEvents() {
+  std::lock_guard<std::mutex> registryLock(registryMutex);
+  std::size_t nEvents = 0;
+  for (const auto& buffer : registry) {
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    nEvents += buffer->events.size();
+  }
+  return nEvents;
+}
+
+// CVOLUME_TRACE=<path> traces the whole run, defined after the registry so that it is
+// destroyed first
+static struct traceAtExit {
+  std::string path;
+
+  traceAtExit() {
+    const char* envPath = getenv("CVOLUME_TRACE");
+    if ((envPath != nullptr) && (envPath[0] != '\0')) {
+      path = envPath;
+      traceLog::set_enabled(true);
+    }
+  }
+
+  ~traceAtExit() {
+    if (path.empty()) return;
+    try {
+      traceLog::write_chrome(path);
+    } catch (...) {
+      // nothing left to report to at this point
+    }
+  }
+} atExit;
@@ -0,0 +1,86 @@
+/*
+  File: traceLog.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: lightweight tracing of the hot paths. TRACE_SCOPE records the
+  wall time of the enclosing scope, TRACE_COUNTER a value at the current time.
+  Events go into a buffer of the recording thread, so threads never wait for
+  each other, and can be exported as Chrome trace JSON (chrome://tracing or
+  ui.perfetto.dev). While tracing is disabled a scope costs a single relaxed
+  load, building with CVOLUME_NO_TRACE removes the scopes altogether.
+  Setting the environment variable CVOLUME_TRACE to a path enables tracing at
+  startup and writes the trace to that path when the program exits.
+*/
+
+#ifndef TRACELOG_H
+#define TRACELOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class traceLog {
+public:
+  static void set_enabled(const bool _flagEnabled);
+  [[nodiscard]] static bool is_enabled() { return flagEnabled.load(std::memory_order_relaxed); }
+
+  /// \brief nanoseconds since the start of the program (steady clock)
+  [[nodiscard]] static uint64_t get_time();
+
+  /// \brief records a completed span, name and category need to outlive the log (literals)
+  static void add_span(const char* name, const char* category, const uint64_t start, const uint64_t stop);
+
+  /// \brief records the value of a counter, name needs to outlive the log (literal)
+  static void add_counter(const char* name, const double value);
+
+  /// \brief writes all events recorded so far as Chrome trace JSON
+  static void write_chrome(const std::string& filePath);
+
+  /// \brief drops all recorded events
+  static void clear();
+
+  /// \brief number of events recorded by all threads
+  [[nodiscard]] static std::size_t get_nEvents();
+
+private:
+  static std::atomic<bool> flagEnabled;
+};
+
+// records the lifetime of the object as a span if tracing was enabled when it was created
+class traceScope {
+public:
+  traceScope(const char* _name, const char* _category)
+      : name(_name), category(_category), flagActive(traceLog::is_enabled()) {
+    if (flagActive) start = traceLog::get_time();
+  }
+
+  ~traceScope() {
+    if (flagActive) traceLog::add_span(name, category, start, traceLog::get_time());
+  }
+
+  traceScope(const traceScope&) = delete;
+  traceScope& operator=(const traceScope&) = delete;
+
+private:
+  const char* name;
+  const char* category;
+  bool flagActive;
+  uint64_t start = 0;
+};
+
+#ifndef CVOLUME_NO_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name, category) traceScope TRACE_CONCAT(traceScope_, __LINE__)(name, category)
+#define TRACE_COUNTER(name, value)                                                                 \
+  do {                                                                                             \
+    if (traceLog::is_enabled()) traceLog::add_counter(name, value);                               \
+  } while (0)
+#else
+#define TRACE_SCOPE(name, category)
+#define TRACE_COUNTER(name, value)
+#endif
+
+#endif
@@ -0,0 +1,335 @@
+#include "typeConversion.h"
+#include "internalHelpers.h"
+#include "../lib/nifti/niftilib/nifti1.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+std::size_t typeConversion::get_bytesPerVoxel(const int datatype) {
+  switch (datatype) {
+  case DT_UINT8:
+  case DT_INT8:
+    return 1;
+  case DT_INT16:
+  case DT_UINT16:
+    return 2;
+  case DT_INT32:
+  case DT_UINT32:
+  case DT_FLOAT32:
+    return 4;
+  case DT_FLOAT64:
+  case DT_INT64:
+  case DT_UINT64:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+bool typeConversion::is_littleEndian() {
+  const uint16_t testNumber = 1;
+  return *reinterpret_cast<const uint8_t*>(&testNumber) == 1;
+}
+
+bool typeConversion::needs_swap(const ByteOrder order) {
+  if (order == ByteOrder::NATIVE) return false;
+
+  return (order == ByteOrder::LITTLE) != is_littleEndian();
+}
+
+// loads a value, reversing its byte order if requested at compile time
+template <typename T, bool flagSwap>
+static inline T loadValue(const T* ptr) {
+  if constexpr (!flagSwap || (sizeof(T) == 1)) {
+    return *ptr;
+  } else {
+    // swap on the unsigned integer representation, compiles to bswap or vector shuffles
+    using U = std::conditional_t<sizeof(T) == 2,
+                                 uint16_t,
+                                 std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+    U bits;
+    memcpy(&bits, ptr, sizeof(T));
+    if constexpr (sizeof(T) == 2)
+      bits = __builtin_bswap16(bits);
+    else if constexpr (sizeof(T) == 4)
+      bits = __builtin_bswap32(bits);
+    else
+      bits = __builtin_bswap64(bits);
+
+    T value;
+    memcpy(&value, &bits, sizeof(T));
+    return value;
+  }
+}
+
+// swaps, converts and scales a contiguous range, kept branch free for vectorization
+template <typename T, bool flagSwap>
+static void convertRange(const T* in,
+                         float* out,
+                         const std::size_t nElements,
+                         const float slope,
+                         const float inter,
+                         const bool flagScale) {
+  if (flagScale) {
+    for (std::size_t iElem = 0; iElem < nElements; iElem++)
+      out[iElem] = static_cast<float>(loadValue<T, flagSwap>(in + iElem)) * slope + inter;
+  } else {
+    for (std::size_t iElem = 0; iElem < nElements; iElem++)
+      out[iElem] = static_cast<float>(loadValue<T, flagSwap>(in + iElem));
+  }
+}
+
+template <typename T>
+static void convertParallel(const void* in,
+                            float* out,
+                            const std::size_t nElements,
+                            const float slope,
+                            const float inter,
+                            const std::size_t nThreads,
+                            const bool flagSwap) {
+  const T* inTyped = static_cast<const T*>(in);
+  const bool flagScale = (slope != 1.0f) || (inter != 0.0f);
+
+  runParallel(nElements, nThreads, [&](const std::size_t startIdx, const std::size_t stopIdx) {
+    if (flagSwap)
+      convertRange<T, true>(
+          inTyped + startIdx, out + startIdx, stopIdx - startIdx, slope, inter, flagScale);
+    else
+      convertRange<T, false>(
+          inTyped + startIdx, out + startIdx, stopIdx - startIdx, slope, inter, flagScale);
+  });
+}
+
+template <typename U>
+static void swapRange(const U* in, U* out, const std::size_t nElements) {
+  for (std::size_t iElem = 0; iElem < nElements; iElem++)
+    out[iElem] = loadValue<U, true>(in + iElem);
+}
+
+template <typename U>
+static void swapParallel(const void* in,
+                         void* out,
+                         const std::size_t nElements,
+                         const std::size_t nThreads) {
+  const U* inTyped = static_cast<const U*>(in);
+  U* outTyped = static_cast<U*>(out);
+  runParallel(nElements, nThreads, [&](const std::size_t startIdx, const std::size_t stopIdx) {
+    swapRange(inTyped + startIdx, outTyped + startIdx, stopIdx - startIdx);
+  });
+}
+
+void typeConversion::swapCopy(const void* in,
+                              void* out,
+                              const std::size_t nElements,
+                              const std::size_t bytesPerElement,
+                              const std::size_t nThreads) {
+  switch (bytesPerElement) {
+  case 1:
+    if (in != out) memcpy(out, in, nElements);
+    break;
+  case 2:
+    swapParallel<uint16_t>(in, out, nElements, nThreads);
+    break;
+  case 4:
+    swapParallel<uint32_t>(in, out, nElements, nThreads);
+    break;
+  case 8:
+    swapParallel<uint64_t>(in, out, nElements, nThreads);
+    break;
+  default:
+    printf("Cannot swap elements of %lu bytes\n", bytesPerElement);
+    throw std::runtime_error("InvalidValue");
+  }
+}
+
+void typeConversion::toFloat(const void* in,
+                             float* out,
+                             const std::size_t nElements,
+                             const int datatype,
+                             const float slope,
+                             const float inter,
+                             const std::size_t nThreads,
+                             const bool flagSwap) {
+  switch (datatype) {
+  case DT_UINT8:
+    convertParallel<uint8_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_INT8:
+    convertParallel<int8_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_INT16:
+    convertParallel<int16_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_UINT16:
+    convertParallel<uint16_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_INT32:
+    convertParallel<int32_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_UINT32:
+    convertParallel<uint32_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_FLOAT32:
+    convertParallel<float>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_FLOAT64:
+    convertParallel<double>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_INT64:
+    convertParallel<int64_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_UINT64:
+    convertParallel<uint64_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  default:
+    printf("Data type %d requires implementation!\n", datatype);
+    throw std::runtime_error("InvalidValue");
+  }
+}
+
+// scales, rounds, clamps and stores a contiguous range, the inverse of convertRange
+template <typename T, bool flagSwap>
+static void storeRange(const float* in,
+                       T* out,
+                       const std::size_t nElements,
+                       const float slope,
+                       const float inter) {
+  const float iSlope = 1.0f / slope;
+  for (std::size_t iElem = 0; iElem < nElements; iElem++) {
+    T value;
+    if constexpr (std::is_floating_point_v<T>) {
+      value = static_cast<T>((in[iElem] - inter) * iSlope);
+    } else {
+      // clamp in double, float cannot represent the limits of 32 and 64 bit types exactly. NaN
+      // has no integer representation and would pass the clamp, it is stored as 0 (the intercept)
+      const double unscaled = std::nearbyint(((double)in[iElem] - inter) * iSlope);
+      const double scaled = std::isnan(unscaled) ? 0.0 : unscaled;
+      const double clamped = std::min<double>(
+          std::max<double>(scaled, (double)std::numeric_limits<T>::lowest()),
+          (double)std::numeric_limits<T>::max());
+      value = (clamped >= (double)std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max()
+                                                                 : static_cast<T>(clamped);
+    }
+    out[iElem] = loadValue<T, flagSwap>(&value);
+  }
+}
+
+template <typename T>
+static void storeParallel(const float* in,
+                          void* out,
+                          const std::size_t nElements,
+                          const float slope,
+                          const float inter,
+                          const std::size_t nThreads,
+                          const bool flagSwap) {
+  T* outTyped = static_cast<T*>(out);
+  runParallel(nElements, nThreads, [&](const std::size_t startIdx, const std::size_t stopIdx) {
+    if (flagSwap)
+      storeRange<T, true>(in + startIdx, outTyped + startIdx, stopIdx - startIdx, slope, inter);
+    else
+      storeRange<T, false>(in + startIdx, outTyped + startIdx, stopIdx - startIdx, slope, inter);
+  });
+}
+
+void typeConversion::fromFloat(const float* in,
+                               void* out,
+                               const std::size_t nElements,
+                               const int datatype,
+                               const float slope,
+                               const float inter,
+                               const std::size_t nThreads,
+                               const bool flagSwap) {
+  switch (datatype) {
+  case DT_UINT8:
+    storeParallel<uint8_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_INT8:
+    storeParallel<int8_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_INT16:
+    storeParallel<int16_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_UINT16:
+    storeParallel<uint16_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_INT32:
+    storeParallel<int32_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_UINT32:
+    storeParallel<uint32_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_FLOAT32:
+    storeParallel<float>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_FLOAT64:
+    storeParallel<double>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_INT64:
+    storeParallel<int64_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  case DT_UINT64:
+    storeParallel<uint64_t>(in, out, nElements, slope, inter, nThreads, flagSwap);
+    break;
+  default:
+    printf("Data type %d requires implementation!\n", datatype);
+    throw std::runtime_error("InvalidValue");
+  }
+}
+
+bool typeConversion::is_integer(const int datatype) {
+  return is_supported(datatype) && (datatype != DT_FLOAT32) && (datatype != DT_FLOAT64);
+}
+
+void typeConversion::get_limits(const int datatype, double* minVal, double* maxVal) {
+  switch (datatype) {
+  case DT_UINT8:
+    *minVal = std::numeric_limits<uint8_t>::lowest();
+    *maxVal = std::numeric_limits<uint8_t>::max();
+    break;
+  case DT_INT8:
+    *minVal = std::numeric_limits<int8_t>::lowest();
+    *maxVal = std::numeric_limits<int8_t>::max();
+    break;
+  case DT_INT16:
+    *minVal = std::numeric_limits<int16_t>::lowest();
+    *maxVal = std::numeric_limits<int16_t>::max();
+    break;
+  case DT_UINT16:
+    *minVal = std::numeric_limits<uint16_t>::lowest();
+    *maxVal = std::numeric_limits<uint16_t>::max();
+    break;
+  case DT_INT32:
+    *minVal = std::numeric_limits<int32_t>::lowest();
+    *maxVal = std::numeric_limits<int32_t>::max();
+    break;
+  case DT_UINT32:
+    *minVal = std::numeric_limits<uint32_t>::lowest();
+    *maxVal = std::numeric_limits<uint32_t>::max();
+    break;
+  case DT_INT64:
+    *minVal = (double)std::numeric_limits<int64_t>::lowest();
+    *maxVal = (double)std::numeric_limits<int64_t>::max();
+    break;
+  case DT_UINT64:
+    *minVal = 0.0;
+    *maxVal = (double)std::numeric_limits<uint64_t>::max();
+    break;
+  case DT_FLOAT32:
+    *minVal = std::numeric_limits<float>::lowest();
+    *maxVal = std::numeric_limits<float>::max();
+    break;
+  case DT_FLOAT64:
+    *minVal = std::numeric_limits<double>::lowest();
+    *maxVal = std::numeric_limits<double>::max();
+    break;
+  default:
+    printf("Data type %d requires implementation!\n", datatype);
+    throw std::runtime_error("InvalidValue");
+  }
+}
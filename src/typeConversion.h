@@ -0,0 +1,98 @@
+/*
+  File: typeConversion.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: conversion of the numeric NIfTI data types into our float arrays
+  and back.
+  Byte swapping, conversion and linear scaling happen in a single pass, split over
+  multiple threads. The inner loops are plain enough for the compiler to vectorize
+  them (byte swaps end up as vector shuffles).
+*/
+
+#ifndef TYPECONVERSION_H
+#define TYPECONVERSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class ByteOrder { NATIVE, LITTLE, BIG };
+
+class typeConversion {
+public:
+  /// \brief returns true if the machine we are running on is little endian
+  [[nodiscard]] static bool is_littleEndian();
+
+  /// \brief returns true if data in the given byte order needs swapping on this machine
+  [[nodiscard]] static bool needs_swap(const ByteOrder order);
+
+  /// \brief number of bytes a single voxel of a NIfTI datatype occupies
+  /// \param datatype NIfTI datatype code (DT_*)
+  /// \returns 0 if the datatype is not a supported scalar type
+  [[nodiscard]] static std::size_t get_bytesPerVoxel(const int datatype);
+
+  [[nodiscard]] static bool is_supported(const int datatype) {
+    return get_bytesPerVoxel(datatype) > 0;
+  }
+
+  /// \brief converts nElements voxels of a NIfTI datatype to float as out = in * slope + inter
+  /// \param in input array holding the voxels in native byte order
+  /// \param out output array
+  /// \param nElements number of voxels
+  /// \param datatype NIfTI datatype code of the input
+  /// \param slope scaling factor (1 and an intercept of 0 skip scaling)
+  /// \param inter scaling intercept
+  /// \param nThreads number of threads to split the work over
+  /// \param flagSwap input is in opposite byte order and gets swapped on the fly
+  static void toFloat(const void* in,
+                      float* out,
+                      const std::size_t nElements,
+                      const int datatype,
+                      const float slope,
+                      const float inter,
+                      const std::size_t nThreads,
+                      const bool flagSwap = false);
+
+  /// \brief converts nElements floats to a NIfTI datatype as out = (in - inter) / slope
+  /// \details integer types are rounded to the nearest value and clamped to their range
+  /// \param flagSwap output is written in opposite byte order
+  static void fromFloat(const float* in,
+                        void* out,
+                        const std::size_t nElements,
+                        const int datatype,
+                        const float slope,
+                        const float inter,
+                        const std::size_t nThreads,
+                        const bool flagSwap = false);
+
+  /// \brief returns true for the supported integer datatypes
+  [[nodiscard]] static bool is_integer(const int datatype);
+
+  /// \brief smallest and largest value a NIfTI datatype can hold
+  static void get_limits(const int datatype, double* minVal, double* maxVal);
+
+  /// \brief copies nElements elements of a given size while reversing their byte order
+  /// \param in input array
+  /// \param out output array (may be the same as in)
+  /// \param nElements number of elements
+  /// \param bytesPerElement size of each element (1, 2, 4 or 8)
+  /// \param nThreads number of threads to split the work over
+  static void swapCopy(const void* in,
+                       void* out,
+                       const std::size_t nElements,
+                       const std::size_t bytesPerElement,
+                       const std::size_t nThreads);
+
+  /// \brief reverses the byte order of a single value in place
+  template <typename T>
+  static void swapValue(T& value) {
+    unsigned char* bytes = reinterpret_cast<unsigned char*>(&value);
+    for (std::size_t iByte = 0; iByte < sizeof(T) / 2; iByte++) {
+      const unsigned char temp = bytes[iByte];
+      bytes[iByte] = bytes[sizeof(T) - 1 - iByte];
+      bytes[sizeof(T) - 1 - iByte] = temp;
+    }
+  }
+};
+
+#endif
@@ -1,9 +1,27 @@
 #include "volume.h"
+#include "internalHelpers.h"
+#include "traceLog.h"
 #include <cassert>
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <array>
+#include <future>
+#include <mutex>
+#include <unistd.h>
+#include <utility>
 
 // default empty constructor
 volume::volume() : baseClass("volume"), processor_count(std::thread::hardware_concurrency()) {}
 
+void volume::set_nThreads(const int _nThreads) {
+  if (_nThreads < 0) {
+    printf("Number of threads cannot be negative\n");
+    throw std::runtime_error("InvalidValue");
+  }
+  processor_count = (_nThreads == 0) ? std::thread::hardware_concurrency() : _nThreads;
+}
+
 // constructor to initialize volume with dimensions
 volume::volume(const std::size_t _dim0, const std::size_t _dim1, const std::size_t _dim2)
     : volume()
@@ -25,8 +43,8 @@ volume::volume(const volume& obj) : volume() {
   this->minVal = obj.minVal;
   this->maxVal = obj.maxVal;
 
+  this->data = obj.data; // shared until one of both volumes writes to it
   this->alloc_memory();
-  memcpy(this->data.data(), obj.get_pdata(), this->nElements * sizeof(float));
   return;
 }
 
@@ -52,23 +70,23 @@ bool volume::operator!=(const volume& volumeB) const {
 }
 
 void volume::operator=(const float setVal) {
-  for (std::size_t iElem = 0; iElem < this->nElements; iElem++) {
-    this->data[iElem] = setVal;
-  }
+  float* pData = data.data(); // copies shared memory once instead of checking per element
+  std::fill(pData, pData + nElements, setVal);
 }
 
-// assignment operator
+// assignment operator, the data array is shared until one of both volumes writes to it
 void volume::operator=(const volume& volumeB) {
   if (nElements == volumeB.get_nElements()) {
-    memcpy(this->data.data(), volumeB.get_pdata(), this->nElements * sizeof(float));
+    this->data = volumeB.data;
+    release_derived();
   } else // size is different, lets first resize output volume
   {
 #pragma unroll
     for (std::size_t iDim = 0; iDim < 3; iDim++) {
       this->set_dim(iDim, volumeB.get_dim(iDim));
     }
+    this->data = volumeB.data;
     this->alloc_memory();
-    memcpy(this->data.data(), volumeB.get_pdata(), this->nElements * sizeof(float));
   }
 
   // push resolution and origin over
@@ -94,6 +112,7 @@ void rangeMult(float* arrayIn,
 
 // multiplication operator
 volume& volume::operator*=(const float multVal) {
+  TRACE_SCOPE("operator*=", "volume");
   std::size_t nElementsThread = get_nElements() / processor_count;
   workers.clear();
 
@@ -118,7 +137,23 @@ volume volume::operator*(const float multVal) const {
   return retVol;
 }
 
-// TODO: push to multithread
+volume& volume::operator*=(const volume& volumeB) {
+  TRACE_SCOPE("operator*=", "volume");
+  if (volumeB.get_nElements() != this->get_nElements()) {
+    printf("Volumes need to have the same number of elements to be multiplied");
+    throw "InvalidSize";
+  }
+
+  float* pData = data.data(); // copies shared memory once instead of checking per element
+  const float* pDataB = volumeB.data.cdata(); // after the copy, volumeB may be this volume
+  const auto multiply = [&](const std::size_t startIdx, const std::size_t stopIdx) {
+    for (std::size_t iElem = startIdx; iElem < stopIdx; iElem++)
+      pData[iElem] = pData[iElem] * pDataB[iElem];
+  };
+  runParallel(nElements, processor_count, multiply);
+  return *this;
+}
+
 volume volume::operator*(const volume& volumeB) const {
   // check that both volumes have the same number
   if (volumeB.get_nElements() != this->get_nElements()) {
@@ -128,8 +163,11 @@ volume volume::operator*(const volume& volumeB) const {
 
   volume retVol(this->get_dim(0), this->get_dim(1), this->get_dim(2));
 
+  float* pRet = retVol.data.data();
+  const float* pData = data.cdata();
+  const float* pDataB = volumeB.data.cdata();
   for (std::size_t iElem = 0; iElem < this->get_nElements(); iElem++) {
-    retVol[iElem] = this->get_value(iElem) * volumeB.get_value(iElem);
+    pRet[iElem] = pData[iElem] * pDataB[iElem];
   }
 
   return retVol;
@@ -143,13 +181,16 @@ volume& volume::operator/=(const float divVal) {
 }
 
 volume& volume::operator/=(const volume& volumeB) {
+  TRACE_SCOPE("operator/=", "volume");
   if (volumeB.get_nElements() != this->get_nElements()) {
     printf("Volumes need to have the same number of elements to be multiplied");
     throw "InvalidSize";
   }
 
+  float* pData = data.data(); // copies shared memory once instead of checking per element
+  const float* pDataB = volumeB.get_pdata();
   for (std::size_t iElem = 0; iElem < this->nElements; iElem++) {
-    this->data[iElem] = this->data[iElem] / volumeB[iElem];
+    pData[iElem] = pData[iElem] / pDataB[iElem];
   }
   return *this;
 }
@@ -178,6 +219,7 @@ void rangeAdd(float* arrayIn,
 }
 
 volume& volume::operator+=(const float addVal) {
+  TRACE_SCOPE("operator+=", "volume");
   std::size_t nElementsThread = get_nElements() / processor_count;
   workers.clear();
 
@@ -198,13 +240,16 @@ volume& volume::operator+=(const float addVal) {
 
 // TODO: make this execution multithread
 volume& volume::operator+=(const volume& volumeB) {
+  TRACE_SCOPE("operator+=", "volume");
   if (this->nElements != volumeB.get_nElements()) {
     printf("Volumes must have the same number of elements for this\n");
     throw "InvalidSize";
   }
 
+  float* pData = data.data(); // copies shared memory once instead of checking per element
+  const float* pDataB = volumeB.get_pdata();
   for (std::size_t iElem = 0; iElem < this->nElements; iElem++) {
-    this->data[iElem] = this->data[iElem] + volumeB[iElem];
+    pData[iElem] = pData[iElem] + pDataB[iElem];
   }
 
   return *this;
@@ -225,13 +270,16 @@ volume volume::operator+(const volume& volumeB) const {
 
 // substraction operator
 volume& volume::operator-=(const volume& volumeB) {
+  TRACE_SCOPE("operator-=", "volume");
   if (this->nElements != volumeB.get_nElements()) {
     printf("Volumes must have the same number of elements for this\n");
     throw "InvalidSize";
   }
 
+  float* pData = data.data(); // copies shared memory once instead of checking per element
+  const float* pDataB = volumeB.get_pdata();
   for (std::size_t iElem = 0; iElem < this->nElements; iElem++) {
-    this->data[iElem] = this->data[iElem] - volumeB[iElem];
+    pData[iElem] = pData[iElem] - pDataB[iElem];
   }
 
   return *this;
@@ -254,6 +302,27 @@ volume volume::operator-(const volume& volumeB) const {
   return retVol;
 }
 
+// element wise operators with views, parallel over the rows of the view
+volume& volume::operator*=(const volumeView& viewB) {
+  volumeView(*this) *= viewB;
+  return *this;
+}
+
+volume& volume::operator/=(const volumeView& viewB) {
+  volumeView(*this) /= viewB;
+  return *this;
+}
+
+volume& volume::operator+=(const volumeView& viewB) {
+  volumeView(*this) += viewB;
+  return *this;
+}
+
+volume& volume::operator-=(const volumeView& viewB) {
+  volumeView(*this) -= viewB;
+  return *this;
+}
+
 // this version is used to set a value (therefore not labeled as const)
 float& volume::operator[](const std::size_t idx) { return data[idx]; }
 
@@ -266,7 +335,9 @@ float volume::operator()(const std::size_t ix, const std::size_t iy, const std::
 
 // get pointer to slice with z as normal
 float* volume::get_psliceZ(const std::size_t zLevel) {
-  if (zLevel != lastSliceZ) {
+  if (sliceZ.empty() || (zLevel != lastSliceZ)) {
+    TRACE_SCOPE("get_psliceZ", "volume");
+    sliceZ.resize(dim[0] * dim[1]);
     lastSliceZ = zLevel;
     // update slice
     for (std::size_t ix = 0; ix < dim[0]; ix++) {
@@ -282,7 +353,9 @@ float* volume::get_psliceZ(const std::size_t zLevel) {
 
 // get pointer to slice with x as normal
 float* volume::get_psliceX(const std::size_t xLevel) {
-  if (xLevel != lastSliceX) {
+  if (sliceX.empty() || (xLevel != lastSliceX)) {
+    TRACE_SCOPE("get_psliceX", "volume");
+    sliceX.resize(dim[1] * dim[2]);
     lastSliceX = xLevel;
     // update slice
     for (std::size_t iz = 0; iz < dim[2]; iz++) {
@@ -298,7 +371,9 @@ float* volume::get_psliceX(const std::size_t xLevel) {
 
 // get pointer to slice with y as normal
 float* volume::get_psliceY(const std::size_t yLevel) {
-  if (yLevel != lastSliceY) {
+  if (sliceY.empty() || (yLevel != lastSliceY)) {
+    TRACE_SCOPE("get_psliceY", "volume");
+    sliceY.resize(dim[0] * dim[2]);
     lastSliceY = yLevel;
     // update slice
     for (std::size_t iz = 0; iz < dim[2]; iz++) {
@@ -334,23 +409,27 @@ float volume::get_length(const std::size_t _dim) const {
 
 // allocate memory
 void volume::alloc_memory() {
-  // allocate memory for data array
-  data.resize(get_nElements());
+  // allocate memory for data array (a mapped array of matching size is kept as is)
+  if (data.size() != get_nElements()) data.resize(get_nElements());
 
-  // allocate memory for crosssections
-  sliceZ.resize(dim[0] * dim[1]);
-  sliceX.resize(dim[1] * dim[2]);
-  sliceY.resize(dim[0] * dim[2]);
+  // slices and projections of the previous shape are stale
+  release_derived();
+}
 
-  // allocate memory for mips
-  mipZ.resize(dim[0] * dim[1]);
-  mipX.resize(dim[1] * dim[2]);
-  mipY.resize(dim[0] * dim[2]);
+void volume::release_derived() {
+  for (std::vector<float>* buffer :
+       {&sliceZ, &sliceX, &sliceY, &mipZ, &mipX, &mipY, &croppedMipZ, &croppedMipX, &croppedMipY}) {
+    std::vector<float>().swap(*buffer);
+  }
+}
 
-  // allocate memory for cropped mips
-  croppedMipZ.resize(dim[0] * dim[1]);
-  croppedMipX.resize(dim[1] * dim[2]);
-  croppedMipY.resize(dim[0] * dim[2]);
+std::size_t volume::get_derivedBytes() const {
+  std::size_t nBytes = 0;
+  for (const std::vector<float>* buffer :
+       {&sliceZ, &sliceX, &sliceY, &mipZ, &mipX, &mipY, &croppedMipZ, &croppedMipX, &croppedMipY}) {
+    nBytes += buffer->capacity() * sizeof(float);
+  }
+  return nBytes;
 }
 
 // define dimensions of dataset
@@ -412,8 +491,8 @@ void volume::set_res(const std::size_t _dim, const float _res) {
 
 // sets whole array to a certain value
 void volume::set_value(const float value) {
-  for (unsigned int iElement = 0; iElement < get_nElements(); iElement++)
-    data[iElement] = value;
+  float* pData = data.data();
+  std::fill(pData, pData + nElements, value);
 }
 
 // set only one specific value in volume defined by index
@@ -494,6 +573,28 @@ string getFileExt(const std::string& _filePath) {
   return ("");
 }
 
+// checks a box against the dimensions stored in a file and returns the size of the box
+static void get_roiDim(const std::size_t* fileDim,
+                       const std::size_t* startIdx,
+                       const std::size_t* stopIdx,
+                       std::size_t* roiDim) {
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if (stopIdx[iDim] < startIdx[iDim]) {
+      printf("Stop index must be larger then start index\n");
+      throw std::runtime_error("InvalidValue");
+    }
+
+    if (stopIdx[iDim] >= fileDim[iDim]) {
+      printf("Region is exceeding array dimensions along dim %d (%lu of %lu)\n",
+             iDim,
+             stopIdx[iDim],
+             fileDim[iDim]);
+      throw std::runtime_error("InvalidValue");
+    }
+    roiDim[iDim] = stopIdx[iDim] - startIdx[iDim] + 1;
+  }
+}
+
 // saving and reading data from and to h5 file
 void volume::saveToFile(const std::string& _filePath) const {
   // requires implementation
@@ -502,12 +603,38 @@ void volume::saveToFile(const std::string& _filePath) const {
   if (!strcmp(ext.c_str(), "h5")) {
     printf("Saving to h5 file...\n");
     save_h5(_filePath);
-  } else if (!strcmp(ext.c_str(), "nii")) {
+  } else if (!strcmp(ext.c_str(), "nii") || hasEnding(_filePath, ".nii.gz")) {
     printf("Saving to nii file...\n");
     save_nii(_filePath);
+  } else if (!strcmp(ext.c_str(), "cvol")) {
+    save_cvol(_filePath);
+  } else if (!strcmp(ext.c_str(), "zarr")) {
+    save_zarr(_filePath);
   } else {
     throw "InvalidType";
   }
+  TRACE_COUNTER("bytesWritten", (double)(nElements * sizeof(float)));
+}
+
+// reads only the box between startIdx and stopIdx (inclusive), same semantics as crop
+void volume::readFromFile(const std::string& _filePath,
+                          const std::size_t* startIdx,
+                          const std::size_t* stopIdx) {
+  const string ext = getFileExt(_filePath);
+
+  if (!strcmp(ext.c_str(), "h5")) {
+    read_h5(_filePath, startIdx, stopIdx);
+  } else if (!strcmp(ext.c_str(), "nii") || hasEnding(_filePath, ".nii.gz")) {
+    read_nii(_filePath, startIdx, stopIdx);
+  } else if (!strcmp(ext.c_str(), "cvol")) {
+    read_cvol(_filePath, startIdx, stopIdx);
+  } else if (!strcmp(ext.c_str(), "zarr")) {
+    read_zarr(_filePath, startIdx, stopIdx);
+  } else {
+    printf("I do not support loading from this file type.\n");
+    throw "InvalidType";
+  }
+  TRACE_COUNTER("bytesRead", (double)(nElements * sizeof(float)));
 }
 
 void volume::readFromFile(const std::string& _filePath) {
@@ -518,126 +645,508 @@ void volume::readFromFile(const std::string& _filePath) {
   if (!strcmp(ext.c_str(), "h5")) {
     printf("Reading form h5 file...\n");
     read_h5(_filePath);
-  } else if (!strcmp(ext.c_str(), "nii")) {
+  } else if (!strcmp(ext.c_str(), "nii") || hasEnding(_filePath, ".nii.gz")) {
     printf("Reading form nii file...\n");
     read_nii(_filePath);
+  } else if (!strcmp(ext.c_str(), "cvol")) {
+    read_cvol(_filePath);
+  } else if (!strcmp(ext.c_str(), "zarr")) {
+    read_zarr(_filePath);
   } else {
     printf("I do not support loading from this file type.\n");
     throw "InvalidType";
   }
+  TRACE_COUNTER("bytesRead", (double)(nElements * sizeof(float)));
 }
 
-// saves our dataset to a nii file
-void volume::save_nii(const std::string& _filePath) const {
-  // outPath = _filePath;
+// background task of the calling thread, loads and saves report to it. Kept per thread rather
+// than per volume so concurrent loads and saves of one volume never see each others task
+static thread_local taskState* activeTask = nullptr;
+
+// installs the task for the lifetime of the operation on this thread
+class activeTaskScope {
+public:
+  explicit activeTaskScope(taskState* state) : previous(activeTask) { activeTask = state; }
+  activeTaskScope(const activeTaskScope&) = delete;
+  activeTaskScope& operator=(const activeTaskScope&) = delete;
+  ~activeTaskScope() { activeTask = previous; }
 
-  nifti1_extender pad = {0, 0, 0, 0};
-  int ret;
-  nifti_1_header hdr_cpy = hdr;
+private:
+  taskState* previous;
+};
 
-  hdr_cpy.datatype = DT_FLOAT;
-  hdr_cpy.vox_offset = (float)NII_HEADER_SIZE;
-  hdr_cpy.sizeof_hdr = MIN_HEADER_SIZE;
-  hdr_cpy.dim[0] = 3;
-  hdr_cpy.dim[1] = dim[0];
-  hdr_cpy.dim[2] = dim[1];
-  hdr_cpy.dim[3] = dim[2];
+volumeTask volume::readFromFileAsync(const std::string& _filePath,
+                                     const progressCallback& callback) {
+  auto state = std::make_shared<taskState>();
+  state->callback = callback;
+  std::future<void> future = std::async(std::launch::async, [this, _filePath, state]() {
+    {
+      activeTaskScope scope(state.get());
+      readFromFile(_filePath);
+    }
+    state->report(1, 1);
+  });
+  return volumeTask(state, std::move(future));
+}
+
+volumeTask volume::readFromFileAsync(const std::string& _filePath,
+                                     const std::size_t* startIdx,
+                                     const std::size_t* stopIdx,
+                                     const progressCallback& callback) {
+  auto state = std::make_shared<taskState>();
+  state->callback = callback;
+  const std::array<std::size_t, 3> start = {startIdx[0], startIdx[1], startIdx[2]};
+  const std::array<std::size_t, 3> stop = {stopIdx[0], stopIdx[1], stopIdx[2]};
+  std::future<void> future =
+      std::async(std::launch::async, [this, _filePath, start, stop, state]() {
+        {
+          activeTaskScope scope(state.get());
+          readFromFile(_filePath, start.data(), stop.data());
+        }
+        state->report(1, 1);
+      });
+  return volumeTask(state, std::move(future));
+}
+
+volumeTask volume::saveToFileAsync(const std::string& _filePath,
+                                   const progressCallback& callback) const {
+  auto state = std::make_shared<taskState>();
+  state->callback = callback;
+  std::future<void> future = std::async(std::launch::async, [this, _filePath, state]() {
+    try {
+      activeTaskScope scope(state.get());
+      saveToFile(_filePath);
+    } catch (...) {
+      if (state->flagCancel) std::filesystem::remove(_filePath); // never leave half a file
+      throw;
+    }
+    state->report(1, 1);
+  });
+  return volumeTask(state, std::move(future));
+}
+
+// forwards progress of a load or save to the background task, throws if it was cancelled
+void volume::report_progress(const std::size_t nDone, const std::size_t nTotal) const {
+  if (activeTask != nullptr) activeTask->report(nDone, nTotal);
+}
 
-  hdr_cpy.pixdim[1] = res[0];
-  hdr_cpy.pixdim[2] = res[1];
-  hdr_cpy.pixdim[3] = res[2];
+h5Progress volume::get_h5Progress() const {
+  if (activeTask == nullptr) return nullptr;
+  // the library may report from its own threads, they do not see our thread local task
+  taskState* task = activeTask;
+  return [task](const std::size_t nDone, const std::size_t nTotal) {
+    task->report(nDone, nTotal);
+  };
+}
 
-  hdr_cpy.bitpix = 32;
+// saves our dataset to a nii file, compressed if the path ends with .gz
+void volume::save_nii(const std::string& _filePath) const {
+  TRACE_SCOPE("save_nii", "io");
+  // outPath = _filePath;
 
-  FILE* fp = fopen(_filePath.c_str(), "w");
-  if (fp == NULL) {
-    printf("Error opening header file %s for write\n", _filePath.c_str());
-    throw "FileError";
+  // other byte order than ours: swap the header once and the data chunk by chunk while writing
+  const bool flagSwap = typeConversion::needs_swap(niiByteOrder);
+
+  // data is stored already scaled
+  niiSink sink(_filePath, niiCompressionLevel);
+  sink.write_header(hdr, dim, res, DT_FLOAT, 1.0f, 0.0f, flagSwap);
+
+  // chunk by chunk, swapped through a buffer if needed, progress is reported after each chunk
+  const std::size_t chunkElements = NII_CHUNK_SIZE / sizeof(float);
+  std::vector<float> buffer(flagSwap ? std::min(chunkElements, nElements) : 0);
+  for (std::size_t startIdx = 0; startIdx < nElements; startIdx += chunkElements) {
+    const std::size_t n = std::min(chunkElements, nElements - startIdx);
+    if (flagSwap) {
+      typeConversion::swapCopy(
+          data.data() + startIdx, buffer.data(), n, sizeof(float), processor_count);
+      sink.write(buffer.data(), sizeof(float) * n);
+    } else {
+      sink.write(data.data() + startIdx, sizeof(float) * n);
+    }
+    report_progress(startIdx + n, nElements);
   }
+  sink.close();
+}
 
-  ret = fwrite(&hdr_cpy, MIN_HEADER_SIZE, 1, fp);
-  if (ret != 1) {
-    printf("Error writing header file %s\n", _filePath.c_str());
-    throw "FileError";
-  }
+// saves the volume in our native format including statistics and projections
+void volume::save_cvol(const std::string& _filePath) const {
+  TRACE_SCOPE("save_cvol", "io");
+  cvolWriter writer;
+  writer.set_nThreads(processor_count);
+  writer.set_flagMips(flagCvolMips);
+  writer.write(_filePath, data.data(), dim, res, origin);
+  report_progress(nElements, nElements);
+}
 
-  ret = fwrite(&pad, 4, 1, fp);
-  if (ret != 1) {
-    printf("Error writing header file extension pad %s\n", _filePath.c_str());
-    throw "FileError";
+// takes over statistics and projections stored in a cvol file
+void volume::apply_cvolExtras(const cvolReader& reader) {
+  const cvolHeader& header = reader.get_header();
+  if (reader.has_stats()) {
+    minVal = header.minVal;
+    maxVal = header.maxVal;
+    maxAbsVal = header.maxAbsVal;
   }
 
-  ret = fwrite(data.data(), sizeof(float), nElements, fp);
-  if (ret != nElements) {
-    printf("Error writing data to %s\n", _filePath.c_str());
-    throw "FileError";
+  if (reader.has_mips()) {
+    const cvolMips& mips = reader.get_mips();
+    mipZ = mips.along0;
+    mipX = mips.along1;
+    // calcMips stores the projection along dim2 as [iX + nX * iZ]
+    mipY.resize(dim[0] * dim[1]);
+    for (std::size_t i1 = 0; i1 < dim[1]; i1++)
+      for (std::size_t i0 = 0; i0 < dim[0]; i0++)
+        mipY[i1 + dim[1] * i0] = mips.along2[i0 + dim[0] * i1];
   }
-  fclose(fp);
 }
 
-// reads the dataset from our nii file
-void volume::read_nii(const std::string& _filePath) {
+// reads a cvol file, pages are mapped instead of read if requested and possible
+void volume::read_cvol(const std::string& _filePath) {
+  TRACE_SCOPE("read_cvol", "io");
   inPath = _filePath;
-
-  // open and read header
-  FILE* fp = fopen(inPath.c_str(), "r");
-  if (fp == NULL) {
-    printf("Error opening header file %s\n", inPath.c_str());
-    throw std::runtime_error("FileError");
+  cvolReader reader;
+  reader.open(inPath);
+  const cvolHeader& header = reader.get_header();
+  set_dim(header.dim[0], header.dim[1], header.dim[2]);
+  set_res(header.res);
+  set_origin(header.origin);
+
+  if (flagMapFiles && reader.is_mappable()) {
+    data.map_file(inPath, header.dataOffset, nElements);
+    if (flagCvolVerify) reader.verify(data.data(), 0, nElements * sizeof(float), processor_count);
+    alloc_memory(); // keeps the mapping
+  } else {
+    alloc_memory();
+    reader.read_data(data.data(), processor_count, flagCvolVerify);
   }
 
-  int ret = fread(&hdr, MIN_HEADER_SIZE, 1, fp);
-  if (ret != 1) {
-    printf("Error reading header file %s\n", inPath.c_str());
-    throw std::runtime_error("OperationFailed");
+  apply_cvolExtras(reader);
+  report_progress(nElements, nElements);
+}
+
+// reads the box between startIdx and stopIdx (inclusive) from a cvol file, only the pages and
+// checksum chunks touched by the box are read
+void volume::read_cvol(const std::string& _filePath,
+                       const std::size_t* startIdx,
+                       const std::size_t* stopIdx) {
+  TRACE_SCOPE("read_cvol roi", "io");
+  cvolReader reader;
+  reader.open(_filePath);
+  const cvolHeader& header = reader.get_header();
+  const std::size_t fileDim[3] = {header.dim[0], header.dim[1], header.dim[2]};
+  std::size_t roiDim[3];
+  get_roiDim(fileDim, startIdx, stopIdx, roiDim);
+
+  if (!reader.is_mappable()) {
+    // converted or swapped data needs to pass through memory anyway
+    read_cvol(_filePath);
+    crop(startIdx, stopIdx);
+    return;
   }
 
-  ret = fseek(fp, (long)(hdr.vox_offset), SEEK_SET);
-  if (ret != 0) {
-    printf("Error doing fseek() to %ld in data file %s\n", (long)(hdr.vox_offset), inPath.c_str());
-    throw std::runtime_error("InvalidOperation");
+  inPath = _filePath;
+  volumeStorage fileData;
+  fileData.map_file(inPath, header.dataOffset, fileDim[0] * fileDim[1] * fileDim[2]);
+  const auto get_fileIdx = [&](const std::size_t i0, const std::size_t i1, const std::size_t i2) {
+    return i0 + fileDim[0] * (i1 + fileDim[1] * i2);
+  };
+  if (flagCvolVerify) {
+    reader.verify(fileData.data(),
+                  get_fileIdx(startIdx[0], startIdx[1], startIdx[2]) * sizeof(float),
+                  (get_fileIdx(stopIdx[0], stopIdx[1], stopIdx[2]) + 1) * sizeof(float),
+                  processor_count);
+  }
+
+  set_dim(roiDim[0], roiDim[1], roiDim[2]);
+  set_res(header.res);
+  for (uint8_t iDim = 0; iDim < 3; iDim++)
+    origin[iDim] = header.origin[iDim] + res[iDim] * (float)startIdx[iDim];
+  data.release();
+  alloc_memory();
+
+  for (std::size_t i2 = 0; i2 < roiDim[2]; i2++) {
+    for (std::size_t i1 = 0; i1 < roiDim[1]; i1++) {
+      memcpy(data.data() + roiDim[0] * (i1 + roiDim[1] * i2),
+             fileData.data() + get_fileIdx(startIdx[0], startIdx[1] + i1, startIdx[2] + i2),
+             roiDim[0] * sizeof(float));
+    }
   }
+  report_progress(nElements, nElements);
+}
+
+// saves the volume as a directory of chunk files, all chunks are written in parallel
+void volume::save_zarr(const std::string& _filePath) const {
+  TRACE_SCOPE("save_zarr", "io");
+  chunkStore store;
+  store.create(_filePath, dim, zarrChunkDim, res, origin, zarrCompressionLevel);
+  const std::size_t startIdx[3] = {0, 0, 0};
+  store.write_block(data.data(), startIdx, dim, processor_count);
+  report_progress(nElements, nElements);
+}
+
+void volume::read_zarr(const std::string& _filePath) {
+  TRACE_SCOPE("read_zarr", "io");
+  inPath = _filePath;
+  chunkStore store;
+  store.open(inPath);
+  set_dim(store.get_dim());
+  set_res(store.get_res());
+  set_origin(store.get_origin());
+  alloc_memory();
+
+  const std::size_t startIdx[3] = {0, 0, 0};
+  store.read_block(data.data(), startIdx, dim, processor_count);
+  report_progress(nElements, nElements);
+}
+
+// reads the box between startIdx and stopIdx (inclusive), only chunks touched by it are read
+void volume::read_zarr(const std::string& _filePath,
+                       const std::size_t* startIdx,
+                       const std::size_t* stopIdx) {
+  TRACE_SCOPE("read_zarr roi", "io");
+  inPath = _filePath;
+  chunkStore store;
+  store.open(inPath);
+
+  std::size_t roiDim[3];
+  get_roiDim(store.get_dim(), startIdx, stopIdx, roiDim);
+  set_dim(roiDim);
+  set_res(store.get_res());
+  for (uint8_t iDim = 0; iDim < 3; iDim++)
+    origin[iDim] = store.get_origin()[iDim] + res[iDim] * (float)startIdx[iDim];
+  alloc_memory();
+
+  store.read_block(data.data(), startIdx, roiDim, processor_count);
+  report_progress(nElements, nElements);
+}
+
+bool volume::needs_nifti2() const { return niftiHeader::needs_nifti2(dim); }
+
+// reads the dataset from our nii file, compressed files are inflated in the background
+void volume::read_nii(const std::string& _filePath) {
+  TRACE_SCOPE("read_nii", "io");
+  inPath = _filePath;
+
+  niiSource source(inPath);
+  const niiInfo info = source.read_header(hdr);
 
   // move dimensions from header struct to volume
-  set_dim(hdr.dim[1], hdr.dim[2], hdr.dim[3]);
-  set_res(hdr.pixdim[1], hdr.pixdim[2], hdr.pixdim[3]);
+  set_dim(info.dim[0], info.dim[1], info.dim[2]);
+  set_res(info.res[0], info.res[1], info.res[2]);
   // printf("Dataset dimensions: %lu x %lu x %lu",
   // 	hdr.dim[1], hdr.dim[2], hdr.dim[3]);
+
+  const bool flagScale = info.needs_scale();
+  const bool flagSwap = info.flagSwap;
+  const int datatype = info.datatype;
+
+  // zero copy path: view the pages of the file instead of reading them, only possible if
+  // the file is uncompressed and holds native floats at a float aligned offset. Scaled files
+  // are read: scaling would write every page of the private mapping and copy them all
+  if (flagMapFiles && !source.flagGz && !flagSwap && !flagScale && (datatype == DT_FLOAT) &&
+      (info.voxOffset % sizeof(float) == 0)) {
+    data.map_file(inPath, info.voxOffset, nElements);
+    alloc_memory(); // keeps the mapping
+    report_progress(nElements, nElements);
+    return;
+  }
+
+  const std::size_t bytesPerVoxel = typeConversion::get_bytesPerVoxel(datatype);
+  source.seek(info.headerSize, info.voxOffset);
   alloc_memory();
 
-  if (hdr.datatype == DT_FLOAT) {
-    ret = fread(data.data(), sizeof(float), nElements, fp);
-    if (ret != nElements) {
-      printf("Error reading volume 1 from %s (%d)\n", inPath.c_str(), ret);
-      exit(1);
+  // read chunk by chunk, the next chunk is read while the current one is swapped, converted and
+  // scaled in a single parallel pass straight into data
+  const float slope = flagScale ? info.sclSlope : 1.0f;
+  const float inter = flagScale ? info.sclInter : 0.0f;
+  const bool flagDirect = (datatype == DT_FLOAT); // floats are read into data and scaled there
+  const std::size_t chunkElements = NII_CHUNK_SIZE / bytesPerVoxel;
+  std::vector<unsigned char> buffers[2];
+  if (!flagDirect) {
+    buffers[0].resize(chunkElements * bytesPerVoxel);
+    buffers[1].resize(chunkElements * bytesPerVoxel);
+  }
+
+  std::exception_ptr readError = nullptr;
+  const auto fetch = [&](const uint8_t iBuf, const std::size_t startIdx, const std::size_t n) {
+    try {
+      void* dest = flagDirect ? static_cast<void*>(data.data() + startIdx) : buffers[iBuf].data();
+      source.read(dest, n * bytesPerVoxel);
+    } catch (...) {
+      readError = std::current_exception();
     }
-  } else if (hdr.datatype == DT_INT16) {
-    std::vector<int16_t> tempArray(hdr.dim[1] * hdr.dim[2] * hdr.dim[3]);
-    ret = fread(tempArray.data(), sizeof(int16_t), tempArray.size(), fp);
-    if (ret != nElements) {
-      printf("Error reading volume 1 from %s (%d)\n", inPath.c_str(), ret);
-      throw std::runtime_error("ReadError");
+  };
+
+  fetch(0, 0, std::min(chunkElements, nElements));
+  for (std::size_t startIdx = 0; startIdx < nElements; startIdx += chunkElements) {
+    const uint8_t iCurr = (startIdx / chunkElements) % 2;
+    const std::size_t n = std::min(chunkElements, nElements - startIdx);
+    if (readError) std::rethrow_exception(readError);
+
+    std::thread reader;
+    const std::size_t nextIdx = startIdx + chunkElements;
+    if (nextIdx < nElements)
+      reader = std::thread(fetch, 1 - iCurr, nextIdx, std::min(chunkElements, nElements - nextIdx));
+
+    float* dest = data.data() + startIdx;
+    if (!flagDirect || flagScale || flagSwap) {
+      const void* src = flagDirect ? static_cast<const void*>(dest) : buffers[iCurr].data();
+      typeConversion::toFloat(src, dest, n, datatype, slope, inter, processor_count, flagSwap);
     }
 
-    for (int iElem = 0; iElem < tempArray.size(); iElem++)
-      data[iElem] = static_cast<float>(tempArray[iElem]);
+    if (reader.joinable()) reader.join();
+    report_progress(startIdx + n, nElements);
+  }
+}
 
-  } else {
-    printf("Data type %d requires implementation!\n", hdr.datatype);
-    throw std::runtime_error("InvalidValue");
+// reads exactly nBytes at offset from a file descriptor
+static void pread_full(const int fd,
+                       unsigned char* buffer,
+                       std::size_t nBytes,
+                       off_t offset,
+                       const std::string& path) {
+  while (nBytes > 0) {
+    const ssize_t ret = pread(fd, buffer, nBytes, offset);
+    if (ret <= 0) {
+      printf("Error reading %lu bytes at %ld from %s\n", nBytes, (long)offset, path.c_str());
+      throw std::runtime_error("ReadError");
+    }
+    buffer += ret;
+    offset += ret;
+    nBytes -= ret;
   }
+}
+
+// read the box between startIdx and stopIdx (inclusive) from a nii file
+void volume::read_nii(const std::string& _filePath,
+                      const std::size_t* startIdx,
+                      const std::size_t* stopIdx) {
+  TRACE_SCOPE("read_nii roi", "io");
+  inPath = _filePath;
+
+  niiSource source(inPath);
+  const niiInfo info = source.read_header(hdr);
 
-  fclose(fp);
+  std::size_t roiDim[3];
+  get_roiDim(info.dim, startIdx, stopIdx, roiDim);
+  set_dim(roiDim[0], roiDim[1], roiDim[2]);
+  set_res(info.res[0], info.res[1], info.res[2]);
+  for (uint8_t iDim = 0; iDim < 3; iDim++)
+    origin[iDim] = res[iDim] * (float)startIdx[iDim]; // relative to first voxel of the file
+  alloc_memory();
 
-  // scale the data buffer
-  if (hdr.scl_slope != 0) {
-    for (int i = 0; i < data.size(); i++)
-      data[i] = (data[i] * hdr.scl_slope) + hdr.scl_inter;
+  const std::size_t bytesPerVoxel = typeConversion::get_bytesPerVoxel(info.datatype);
+  const bool flagScale = info.needs_scale();
+  const float slope = flagScale ? info.sclSlope : 1.0f;
+  const float inter = flagScale ? info.sclInter : 0.0f;
+
+  // the box consists of roiDim[1] * roiDim[2] rows of roiDim[0] voxels each
+  const std::size_t rowBytes = roiDim[0] * bytesPerVoxel;
+  const std::size_t nRows = roiDim[1] * roiDim[2];
+  const auto rowOffset = [&](const std::size_t iRow) -> std::size_t {
+    const std::size_t i1 = startIdx[1] + iRow % roiDim[1];
+    const std::size_t i2 = startIdx[2] + iRow / roiDim[1];
+    return info.voxOffset + bytesPerVoxel * (startIdx[0] + info.dim[0] * (i1 + info.dim[1] * i2));
+  };
+
+  if (source.flagGz) {
+    // compressed streams cannot seek, everything up to the last row is inflated but only the
+    // rows of the box are converted
+    std::vector<unsigned char> row(rowBytes);
+    std::size_t currPos = info.headerSize;
+    for (std::size_t iRow = 0; iRow < nRows; iRow++) {
+      source.seek(currPos, rowOffset(iRow));
+      source.read(row.data(), rowBytes);
+      currPos = rowOffset(iRow) + rowBytes;
+      typeConversion::toFloat(row.data(),
+                              data.data() + iRow * roiDim[0],
+                              roiDim[0],
+                              info.datatype,
+                              slope,
+                              inter,
+                              1,
+                              info.flagSwap);
+      // progress and cancellation once per slice of the box
+      if ((iRow + 1) % roiDim[1] == 0) report_progress((iRow + 1) * roiDim[0], nElements);
+    }
+    return;
+  }
+
+  // each thread reads its share of rows with pread, rows separated by small gaps are merged
+  // into a single read to keep the number of requests low. Workers do not see our thread
+  // local task, they report through the captured one after each merged read
+  const int fd = fileno(source.fp);
+  const h5Progress progress = get_h5Progress();
+  std::mutex progressMutex;
+  std::size_t nRowsDone = 0;
+  const auto read_rows = [&](const std::size_t rowStart, const std::size_t rowStop) {
+    std::vector<unsigned char> buffer;
+    std::size_t iRow = rowStart;
+    while (iRow < rowStop) {
+      const std::size_t spanRow = iRow;
+      const std::size_t spanStart = rowOffset(iRow);
+      std::size_t spanEnd = spanStart + rowBytes;
+      std::size_t iEnd = iRow + 1;
+      while (iEnd < rowStop) {
+        const std::size_t nextStart = rowOffset(iEnd);
+        if ((nextStart - spanEnd > NII_ROI_GAP) || (nextStart + rowBytes - spanStart > NII_CHUNK_SIZE))
+          break;
+        spanEnd = nextStart + rowBytes;
+        iEnd++;
+      }
+
+      buffer.resize(spanEnd - spanStart);
+      pread_full(fd, buffer.data(), buffer.size(), spanStart, inPath);
+      for (; iRow < iEnd; iRow++) {
+        typeConversion::toFloat(buffer.data() + rowOffset(iRow) - spanStart,
+                                data.data() + iRow * roiDim[0],
+                                roiDim[0],
+                                info.datatype,
+                                slope,
+                                inter,
+                                1,
+                                info.flagSwap);
+      }
+      if (progress) {
+        // one report at a time so the callback sees growing progress
+        std::lock_guard<std::mutex> lock(progressMutex);
+        nRowsDone += iEnd - spanRow;
+        progress(nRowsDone * roiDim[0], nElements);
+      }
+    }
+  };
+
+  const std::size_t nThreads = std::max<std::size_t>(1, std::min<std::size_t>(processor_count, nRows));
+  const std::size_t nRowsThread = nRows / nThreads;
+  std::vector<std::exception_ptr> errors(nThreads, nullptr);
+  workers.clear();
+  for (std::size_t iThread = 0; iThread < nThreads; iThread++) {
+    const std::size_t rowStart = iThread * nRowsThread;
+    const std::size_t rowStop = (iThread < (nThreads - 1)) ? (iThread + 1) * nRowsThread : nRows;
+    workers.push_back(std::thread([&, iThread, rowStart, rowStop]() {
+      try {
+        read_rows(rowStart, rowStop);
+      } catch (...) {
+        errors[iThread] = std::current_exception();
+      }
+    }));
   }
+
+  for (auto& worker : workers)
+    worker.join();
+
+  for (const auto& error : errors)
+    if (error) std::rethrow_exception(error);
+}
+
+void volume::set_h5ChunkDim(const std::size_t n0, const std::size_t n1, const std::size_t n2) {
+  h5ChunkDim[0] = n0;
+  h5ChunkDim[1] = n1;
+  h5ChunkDim[2] = n2;
 }
 
 // save fata to a h5 file
 void volume::save_h5(const std::string& _filePath) const {
+  TRACE_SCOPE("save_h5", "io");
   H5::H5File file(_filePath, H5F_ACC_TRUNC);
 
   // write resolutiion to file
@@ -660,21 +1169,24 @@ void volume::save_h5(const std::string& _filePath) const {
   dimDataset.write(dim, H5::PredType::NATIVE_UINT64);
   dimDataset.close();
 
-  // w4rite actual datamatrix to file
-  const hsize_t col_data = nElements;
-  H5::DataSpace mspaceData(1, &col_data);
-  H5::DataSet dataDataset = file.createDataSet("vol", H5::PredType::NATIVE_FLOAT, mspaceData);
-  dataDataset.write(data.data(), H5::PredType::NATIVE_FLOAT);
-  dataDataset.close();
+  // write actual datamatrix to file as chunked 3D dataset [dim2, dim1, dim0]
+  std::size_t chunkDim[3];
+  h5Chunks::get_chunkDim(dim, h5ChunkDim, chunkDim);
+  h5Chunks::write(file,
+                  "vol",
+                  data.data(),
+                  dim,
+                  chunkDim,
+                  h5CompressionLevel,
+                  flagH5Shuffle,
+                  processor_count,
+                  get_h5Progress());
 
   file.close();
 }
 
-// read data from a h5 file
-void volume::read_h5(const std::string& _filePath) {
-  inPath = _filePath;
-  H5::H5File file(_filePath, H5F_ACC_RDONLY); // open dataset as read only
-
+// reads resolution, origin and dimensions stored next to the volume in a h5 file
+static void read_h5Header(H5::H5File& file, float* res, float* origin, std::size_t* dim) {
   // load resolution from file
   H5::DataSet resDataset = file.openDataSet("dr"); // init dataset for res
   const hsize_t col_dims = 3;
@@ -693,17 +1205,74 @@ void volume::read_h5(const std::string& _filePath) {
   H5::DataSpace mspaceDim(1, &col_dims);
   filespace = dimDataset.getSpace();
   dimDataset.read(dim, H5::PredType::NATIVE_UINT64, mspaceDim, filespace);
+}
+
+// read data from a h5 file
+void volume::read_h5(const std::string& _filePath) {
+  TRACE_SCOPE("read_h5", "io");
+  inPath = _filePath;
+  H5::H5File file(_filePath, H5F_ACC_RDONLY); // open dataset as read only
+  read_h5Header(file, res, origin, dim);
   nElements = dim[0] * dim[1] * dim[2];
 
   // read actual datamatrix
   H5::DataSet dataDataset = file.openDataSet("vol"); // read actual dataset
-  const hsize_t col_dims_data = nElements;
-  H5::DataSpace mspaceData(1, &col_dims_data);
-  filespace = dataDataset.getSpace();
+  H5::DataSpace filespace = dataDataset.getSpace();
+
+  alloc_memory();
+
+  if (filespace.getSimpleExtentNdims() == 3) {
+    h5Chunks::read(dataDataset, data.data(), dim, processor_count, get_h5Progress());
+  } else {
+    // older files store the volume as flat 1D array
+    const hsize_t col_dims_data = nElements;
+    H5::DataSpace mspaceData(1, &col_dims_data);
+    dataDataset.read(data.data(), H5::PredType::NATIVE_FLOAT, mspaceData, filespace);
+  }
+
+  file.close();
+}
+
+// read the box between startIdx and stopIdx (inclusive) from a h5 file
+void volume::read_h5(const std::string& _filePath,
+                     const std::size_t* startIdx,
+                     const std::size_t* stopIdx) {
+  TRACE_SCOPE("read_h5 roi", "io");
+  inPath = _filePath;
+  H5::H5File file(_filePath, H5F_ACC_RDONLY);
+  std::size_t fileDim[3];
+  read_h5Header(file, res, origin, fileDim);
 
+  std::size_t roiDim[3];
+  get_roiDim(fileDim, startIdx, stopIdx, roiDim);
+  set_dim(roiDim[0], roiDim[1], roiDim[2]);
+  for (uint8_t iDim = 0; iDim < 3; iDim++)
+    origin[iDim] = origin[iDim] + res[iDim] * (float)startIdx[iDim];
   alloc_memory();
 
-  dataDataset.read(data.data(), H5::PredType::NATIVE_FLOAT, mspaceData, filespace);
+  // only the chunks touched by the selection are read and decompressed
+  H5::DataSet dataDataset = file.openDataSet("vol");
+  H5::DataSpace filespace = dataDataset.getSpace();
+  if (filespace.getSimpleExtentNdims() == 3) {
+    const hsize_t start[3] = {startIdx[2], startIdx[1], startIdx[0]};
+    const hsize_t count[3] = {roiDim[2], roiDim[1], roiDim[0]};
+    filespace.selectHyperslab(H5S_SELECT_SET, count, start);
+    H5::DataSpace mspaceData(3, count);
+    dataDataset.read(data.data(), H5::PredType::NATIVE_FLOAT, mspaceData, filespace);
+  } else {
+    // flat 1D array of older files: one strided selection of rows per slice
+    filespace.selectNone();
+    for (std::size_t i2 = 0; i2 < roiDim[2]; i2++) {
+      const hsize_t start = startIdx[0] + fileDim[0] * (startIdx[1] + fileDim[1] * (startIdx[2] + i2));
+      const hsize_t count = roiDim[1];
+      const hsize_t stride = fileDim[0];
+      const hsize_t block = roiDim[0];
+      filespace.selectHyperslab(H5S_SELECT_OR, &count, &start, &stride, &block);
+    }
+    const hsize_t col_dims_data = nElements;
+    H5::DataSpace mspaceData(1, &col_dims_data);
+    dataDataset.read(data.data(), H5::PredType::NATIVE_FLOAT, mspaceData, filespace);
+  }
 
   file.close();
 }
@@ -732,18 +1301,12 @@ float volume::getRangeLimitedPos(const float pos, const uint8_t _dim) const {
 }
 
 // get cropped volume, start and stopped passed as array
+// copies the box between startIdx and stopIdx (inclusive) into vol, rows in parallel
 void volume::get_croppedVolume(float* vol,
                                const uint64_t* startIdx,
                                const uint64_t* stopIdx) const {
-
-  const uint64_t start0 = startIdx[0];
-  const uint64_t stop0 = stopIdx[0];
-  const uint64_t start1 = startIdx[1];
-  const uint64_t stop1 = stopIdx[1];
-  const uint64_t start2 = startIdx[2];
-  const uint64_t stop2 = stopIdx[2];
-
-  getCroppedVolume(vol, start0, stop0, start1, stop1, start2, stop2);
+  TRACE_SCOPE("get_croppedVolume", "volume");
+  get_view(startIdx, stopIdx).copy_to(vol);
 }
 
 void volume::getCroppedVolume(float* vol, // array pointing to output volume
@@ -753,79 +1316,13 @@ void volume::getCroppedVolume(float* vol, // array pointing to output volume
                               const uint64_t stop1,
                               const uint64_t start2,
                               const uint64_t stop2) const {
-
-  // check that stop index is always bigger then start index
-  if (start0 >= stop0) {
-    printf("Stop index must be bigger then start index along dim0\n");
-    throw "invalidVal";
-  }
-
-  if (start1 >= stop1) {
-    printf("Stop index must be bigger then start index along dim1\n");
-    throw "invalidVal";
-  }
-
-  if (start2 >= stop2) {
-    printf("Stop index must be bigger then start index along dim2\n");
-    throw "invalidVal";
-  }
-
-  // calc number of elements in each dimension
-  const uint64_t n0 = stop0 - start0 + 1; // n along t/z
-  const uint64_t n1 = stop1 - start1 + 1; // n alonmg x
-  const uint64_t n2 = stop2 - start1 + 1; // n along y
-  const uint64_t nElements = n0 * n1 * n2;
-
-  // set all values in volume for now to 0
-  for (uint64_t idx = 0; idx < nElements; idx++)
-    vol[idx] = 0;
-
-  // check if all stop indices are within range
-  const uint64_t stopTrue0 = (stop0 >= dim[0]) ? (dim[0] - 1) : stop0;
-  if (stopTrue0 != stop0) printf("Cropping not doable in dim0\n");
-
-  const uint64_t stopTrue1 = (stop1 >= dim[1]) ? (dim[1] - 1) : stop1;
-  if (stopTrue1 != stop1) printf("Cropping not doable in dim1\n");
-
-  const uint64_t stopTrue2 = (stop2 >= dim[2]) ? (dim[2] - 1) : stop2;
-  if (stopTrue2 != stop2) printf("Cropping not doable in dim2\n");
-
-  // index in original data matrix
-  // idx = i0 + n0 * i1 + n0 * n1 * i2
-  uint64_t idx;              // index in original data matrix
-  uint64_t offset2, offset1; // offsets in original data matrix
-
-  // index in nnewly created data matrix
-  // idxOut = j0 + m0 * j1 + m0 * m1 * j2
-
-  // original --> new
-  // i0 --> i0 - start0
-  // i1 --> i1 - start1
-  // i2 --> i2 - start2
-
-  uint64_t idxOut;
-  uint64_t offset2Out, offset1Out; // offset in output data matrix
-#pragma unroll
-  for (uint64_t i2 = start2; i2 <= stopTrue2; i2++) {
-    offset2 = i2 * dim[0] * dim[1];
-    offset2Out = (i2 - start2) * n0 * n1;
-#pragma unroll
-    for (uint64_t i1 = start1; i1 <= stopTrue1; i1++) {
-      offset1 = i1 * dim[0];
-      offset1Out = (i1 - start1) * n0;
-#pragma unroll
-      for (unsigned int i0 = start0; i0 < stopTrue0; i0++) {
-        idx = offset2 + offset1 + i0;
-        idxOut = offset2Out + offset1Out + (i0 - start0);
-        vol[idxOut] = data[idx];
-      }
-    }
-  }
-
-  return;
+  const uint64_t startIdx[3] = {start0, start1, start2};
+  const uint64_t stopIdx[3] = {stop0, stop1, stop2};
+  get_croppedVolume(vol, startIdx, stopIdx);
 }
 
 void volume::crop(const uint64_t* startIdx, const uint64_t* stopIdx) {
+  TRACE_SCOPE("crop", "volume");
   uint64_t dimNew[3] = {0, 0, 0};
   for (uint8_t iDim = 0; iDim < 3; iDim++) {
     if (stopIdx[iDim] < startIdx[iDim]) {
@@ -833,7 +1330,7 @@ void volume::crop(const uint64_t* startIdx, const uint64_t* stopIdx) {
       throw "InvalidValue";
     }
 
-    if (stopIdx[iDim] > dim[iDim]) {
+    if (stopIdx[iDim] >= dim[iDim]) {
       printf("Cropping is exceeding array dimensions along dim %d (%lu of %lu)\n",
              iDim,
              stopIdx[iDim],
@@ -843,27 +1340,27 @@ void volume::crop(const uint64_t* startIdx, const uint64_t* stopIdx) {
     dimNew[iDim] = stopIdx[iDim] - startIdx[iDim] + 1;
   }
 
-  std::vector<float> newData(dimNew[0] * dimNew[1] * dimNew[2]);
-
-  for (uint64_t iz = 1; iz < dimNew[2]; iz++) {
-    const uint64_t izOld = iz + startIdx[2];
-    for (uint64_t iy = 0; iy < dimNew[1]; iy++) {
-      const uint64_t iyOld = iy + startIdx[1];
-      const uint64_t idxNew = dimNew[0] * (iy + dimNew[1] * iz);
-      const uint64_t idxOld = startIdx[0] + dim[0] * (iyOld + dim[1] * izOld);
-      memcpy(&newData[idxNew], &data[idxOld], dimNew[0] * sizeof(float));
-    }
-  }
+  // rows of the box are copied in parallel and overwrite every element
+  volumeStorage newData;
+  newData.resize(dimNew[0] * dimNew[1] * dimNew[2], false);
+  std::as_const(*this).get_view(startIdx, stopIdx).copy_to(newData.data());
 
   // update dimensions and origin of this volume
-  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+  for (uint8_t iDim = 0; iDim < 3; iDim++)
     origin[iDim] = origin[iDim] + res[iDim] * (float)startIdx[iDim];
-    set_dim(iDim, dim[iDim]);
-    dim[iDim] = dimNew[iDim];
-  }
+  set_dim(dimNew[0], dimNew[1], dimNew[2]);
 
   // now move the new data vector over
-  data = newData;
+  data.swap(newData);
+  release_derived();
+}
+
+volumeView volume::get_view(const std::size_t* startIdx, const std::size_t* stopIdx) {
+  return volumeView(*this, startIdx, stopIdx);
+}
+
+volumeView volume::get_view(const std::size_t* startIdx, const std::size_t* stopIdx) const {
+  return volumeView(*this, startIdx, stopIdx);
 }
 
 void rangeMinMax(const float* data,
@@ -883,6 +1380,7 @@ void rangeMinMax(const float* data,
 
 // calculates maximum and minimum value in matrix
 void volume::calcMinMax() {
+  TRACE_SCOPE("calcMinMax", "volume");
 
   const std::size_t nElementsThread = get_nElements() / processor_count;
   workers.clear();
@@ -896,7 +1394,7 @@ void volume::calcMinMax() {
                                     ? (iThread + 1) * nElementsThread - 1
                                     : get_nElements() - 1;
     thread currThread(
-        &rangeMinMax, data.data(), startIdx, stopIdx, &localMin[iThread], &localMax[iThread]);
+        &rangeMinMax, data.cdata(), startIdx, stopIdx, &localMin[iThread], &localMax[iThread]);
     workers.push_back(std::move(currThread));
   }
 
@@ -920,6 +1418,7 @@ void volume::calcMinMax() {
 }
 
 void volume::exportVtk(const std::string& filePath) {
+  TRACE_SCOPE("exportVtk", "io");
 
   vtkwriter outputter;            // prepare output pipeline
   const string title("reconVol"); // generate title
@@ -930,7 +1429,7 @@ void volume::exportVtk(const std::string& filePath) {
   outputter.set_outputPath(outputPath);
 
   griddedData myData;
-  myData.data = data.data();
+  myData.data = const_cast<float*>(data.cdata()); // only read by the writer
   for (uint8_t iDim = 0; iDim < 3; iDim++) {
     myData.origin[iDim] = origin[iDim];
     myData.res[iDim] = res[iDim];
@@ -942,28 +1441,38 @@ void volume::exportVtk(const std::string& filePath) {
   outputter.write();
 }
 
-// calculates the maximum intensity projections over the full volume
-void volume::calcMips() {
-  // set all elements of z mip to 0
-  for (uint64_t iX = 0; iX < dim[1]; iX++)
-    for (uint64_t iY = 0; iY < dim[2]; iY++)
-      mipZ[iX + iY * dim[1]] = 0;
+void volume::exportVti(const std::string& filePath,
+                       const int compressionLevel,
+                       const std::size_t nPieces) const {
+  TRACE_SCOPE("exportVti", "io");
+  vtiWriter writer;
+  writer.set_compressionLevel(compressionLevel);
+  writer.set_nThreads(processor_count);
+  if (hasEnding(filePath, ".pvti")) {
+    const std::size_t _nPieces = (nPieces == 0) ? processor_count : nPieces;
+    writer.write_pvti(filePath, data.data(), dim, res, origin, _nPieces);
+  } else {
+    writer.write_vti(filePath, data.data(), dim, res, origin);
+  }
+}
 
-  // set all elements of x mip to 0
-  for (uint64_t iZ = 0; iZ < dim[0]; iZ++)
-    for (uint64_t iY = 0; iY < dim[2]; iY++)
-      mipX[iZ + iY * dim[0]] = 0;
+void volume::extractIsoSurface(const float isoValue, isoSurface& surface) const {
+  TRACE_SCOPE("extractIsoSurface", "volume");
+  surface.extract(data.data(), dim, res, origin, isoValue, processor_count);
+}
 
-  // set all elements of y mip to 0
-  for (uint64_t iZ = 0; iZ < dim[0]; iZ++)
-    for (uint64_t iX = 0; iX < dim[1]; iX++)
-      mipY[iZ + dim[0] * iX] = 0;
+// calculates the maximum intensity projections over the full volume
+void volume::calcMips() {
+  TRACE_SCOPE("calcMips", "volume");
+  mipZ.assign(dim[1] * dim[2], 0.0f);
+  mipX.assign(dim[0] * dim[2], 0.0f);
+  mipY.assign(dim[0] * dim[1], 0.0f);
 
   // go through all elements and check the maximum value
   for (uint64_t iZ = 0; iZ < dim[0]; iZ++) {
     for (uint64_t iX = 0; iX < dim[1]; iX++) {
       for (uint64_t iY = 0; iY < dim[2]; iY++) {
-        const float currVal = abs(data[iZ + dim[0] * (iX + dim[1] * iY)]);
+        const float currVal = abs(data.cdata()[iZ + dim[0] * (iX + dim[1] * iY)]);
         // update z mip
         if (currVal > mipZ[iX + iY * dim[1]]) {
           mipZ[iX + iY * dim[1]] = currVal;
@@ -1001,7 +1510,7 @@ struct thread_data {
   float* ptrMipY;
   float* ptrMipZ;
   uint64_t dim[3];
-  float* data;
+  const float* data;
 };
 
 void* CalcSubMips(void* threadarg) {
@@ -1038,16 +1547,10 @@ void* CalcSubMips(void* threadarg) {
 
 // calculates the maximum intensity projections over a cropped range
 void volume::calcCroppedMips() {
-  clock_t tStart = clock();
-  // set all elements of mips to 0
-  for (uint64_t iElem = 0; iElem < (dim[1] * dim[2]); iElem++)
-    croppedMipZ[iElem] = 0;
-
-  for (uint64_t iElem = 0; iElem < (dim[0] * dim[2]); iElem++)
-    croppedMipX[iElem] = 0;
-
-  for (uint64_t iElem = 0; iElem < (dim[0] * dim[1]); iElem++)
-    croppedMipY[iElem] = 0;
+  TRACE_SCOPE("calcCroppedMips", "volume");
+  croppedMipZ.assign(dim[1] * dim[2], 0.0f);
+  croppedMipX.assign(dim[0] * dim[2], 0.0f);
+  croppedMipY.assign(dim[0] * dim[1], 0.0f);
 
   const uint64_t idxCropRange[6] = {get_idx0(cropRange[0]),
                                     get_idx0(cropRange[1]),
@@ -1105,7 +1608,7 @@ void volume::calcCroppedMips() {
     td[iProcessor].cropX[0] = idxCropRange[2];
     td[iProcessor].cropX[1] = idxCropRange[3];
 
-    td[iProcessor].data = data.data();
+    td[iProcessor].data = data.cdata();
 
     // printf("worker %d runs from %d to %d\n", iProcessor, td[iProcessor].startY, td[iProcessor].stopY);
 
@@ -1142,8 +1645,8 @@ void volume::calcCroppedMips() {
 
   // set min and max val of cropping to the very first element
   const uint64_t startIdx = idxCropRange[0] + dim[0] * (idxCropRange[2] + dim[1] * idxCropRange[4]);
-  maxValCrop = abs(data[startIdx]);
-  minValCrop = abs(data[startIdx]);
+  maxValCrop = abs(data.cdata()[startIdx]);
+  minValCrop = abs(data.cdata()[startIdx]);
 
   // for maximum value it is sufficient to compare against one mip
   for (uint64_t iElem = 0; iElem < (dim[1] * dim[2]); iElem++) {
@@ -1161,14 +1664,37 @@ void volume::calcCroppedMips() {
   }
 
   updatedCropRange = false;
-  printf("Time taken: %.2fs\n", (double)(clock() - tStart) / CLOCKS_PER_SEC);
 }
 
-float* volume::get_croppedMipX() { return croppedMipX.data(); }
+float* volume::get_mipX() {
+  if (mipX.empty()) calcMips();
+  return mipX.data();
+}
 
-float* volume::get_croppedMipY() { return croppedMipY.data(); }
+float* volume::get_mipY() {
+  if (mipY.empty()) calcMips();
+  return mipY.data();
+}
 
-float* volume::get_croppedMipZ() { return croppedMipZ.data(); }
+float* volume::get_mipZ() {
+  if (mipZ.empty()) calcMips();
+  return mipZ.data();
+}
+
+float* volume::get_croppedMipX() {
+  if (croppedMipX.empty()) calcCroppedMips();
+  return croppedMipX.data();
+}
+
+float* volume::get_croppedMipY() {
+  if (croppedMipY.empty()) calcCroppedMips();
+  return croppedMipY.data();
+}
+
+float* volume::get_croppedMipZ() {
+  if (croppedMipZ.empty()) calcCroppedMips();
+  return croppedMipZ.data();
+}
 
 float* volume::get_croppedMipX(const float* _cropX) {
   bool flagChanged = 0;
@@ -1180,7 +1706,7 @@ float* volume::get_croppedMipX(const float* _cropX) {
   }
 
   // if any cropping range is actually new here, lets update the mips
-  if (flagChanged) calcCroppedMips();
+  if (flagChanged || croppedMipX.empty()) calcCroppedMips();
 
   return croppedMipX.data();
 }
@@ -1194,7 +1720,7 @@ float* volume::get_croppedMipZ(const float* _cropZ) {
     }
   }
 
-  if (flagChanged) calcCroppedMips();
+  if (flagChanged || croppedMipZ.empty()) calcCroppedMips();
 
   return croppedMipZ.data();
 }
@@ -1208,7 +1734,7 @@ float* volume::get_croppedMipY(const float* _cropY) {
     }
   }
 
-  if (flagChanged) calcCroppedMips();
+  if (flagChanged || croppedMipY.empty()) calcCroppedMips();
 
   return croppedMipY.data();
 }
@@ -1245,11 +1771,13 @@ void volume::set_cropRangeY(const float* _cropY) {
 
 // normalize the entire array
 void volume::normalize() {
+  TRACE_SCOPE("normalize", "volume");
   const float normVal = getNorm(data.data(), nElements);
   if (normVal > 0) {
     const float rnormVal = 1.0f / normVal;
+    float* pData = data.data();
     for (uint64_t iElem = 0; iElem < nElements; iElem++) {
-      data[iElem] = data[iElem] * rnormVal;
+      pData[iElem] = pData[iElem] * rnormVal;
     }
   }
 }
@@ -1264,11 +1792,13 @@ void volume::fill_rand(const float maxVal) { fill_rand(0.0f, maxVal); }
 
 // fills volume with random numbers between minVal and maxVal
 void volume::fill_rand(const float minVal, const float maxVal) {
+  TRACE_SCOPE("fill_rand", "volume");
   srand(time(0));
   const float irmax = 1.0f / ((float)RAND_MAX);
+  float* pData = data.data();
 #pragma unroll
   for (uint64_t iElem = 0; iElem < nElements; iElem++) {
     const float randVal = ((float)rand()) * irmax;
-    data[iElem] = (randVal * (maxVal - minVal)) + minVal;
+    pData[iElem] = (randVal * (maxVal - minVal)) + minVal;
   }
 }
\ No newline at end of file
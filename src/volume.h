@@ -20,7 +20,19 @@
 #include "../lib/nifti/niftilib/nifti1.h"
 #include "baseClass.h"
 #include "basicMathOp.h"
+#include "chunkStore.h"
+#include "cvolFile.h"
+#include "gzipStream.h"
+#include "h5Chunks.h"
+#include "niftiHeader.h"
+#include "niiFile.h"
+#include "typeConversion.h"
 #include "griddedData.h"
+#include "volumeStorage.h"
+#include "volumeTask.h"
+#include "volumeView.h"
+#include "vtiWriter.h"
+#include "isoSurface.h"
 #include "vtkwriter.h"
 #include <H5Cpp.h>
 #include <cstdlib>
@@ -30,8 +42,8 @@
 #include <time.h>
 #include <vector>
 
-#define MIN_HEADER_SIZE 348
-#define NII_HEADER_SIZE 352
+#define NII_CHUNK_SIZE (16 * 1024 * 1024) // bytes read from nii files at once
+#define NII_ROI_GAP (16 * 1024) // gaps up to this size are read to merge neighbouring rows
 
 using namespace std;
 
@@ -82,6 +94,12 @@ public:
   volume operator-(float subsVal) const;
   volume operator-(const volume& volumeB) const;
 
+  // element wise with a view of the same dimensions, e.g. a box of another volume
+  volume& operator*=(const volumeView& viewB);
+  volume& operator/=(const volumeView& viewB);
+  volume& operator+=(const volumeView& viewB);
+  volume& operator-=(const volumeView& viewB);
+
   [[nodiscard]] float& operator[](std::size_t idx);
   [[nodiscard]] float operator[](std::size_t idx) const;
 
@@ -147,21 +165,118 @@ public:
   // returns length of dataset along a certain dimension
 
   [[nodiscard]] std::size_t get_nElements() const;
-  void alloc_memory(); // allocates the memory of our array and slices
+  void alloc_memory(); // allocates the data array, slices and projections follow on request
+
+  /// \brief frees slices and projections, they are recomputed on the next request
+  void release_derived();
+
+  /// \brief bytes currently held by slices and projections next to the data array
+  [[nodiscard]] std::size_t get_derivedBytes() const;
 
   void readFromFile(const std::string& _filePath);     // read from file, distinguish type by ending
+
+  /// \brief reads only the box between startIdx and stopIdx (inclusive) from a h5 or nii file
+  /// \details same result as readFromFile followed by crop, but only the box is read from disk
+  void readFromFile(const std::string& _filePath,
+                    const std::size_t* startIdx,
+                    const std::size_t* stopIdx);
   void saveToFile(const std::string& _filePath) const; // save to file, distinguish type by ending
 
+  /// \brief reads a file in the background, the volume must not be used until the task is done
+  /// \param callback optional progress report, called from the worker thread
+  volumeTask readFromFileAsync(const std::string& _filePath,
+                               const progressCallback& callback = nullptr);
+
+  /// \brief reads the box startIdx ... stopIdx (inclusive) of a file in the background
+  volumeTask readFromFileAsync(const std::string& _filePath,
+                               const std::size_t* startIdx,
+                               const std::size_t* stopIdx,
+                               const progressCallback& callback = nullptr);
+
+  /// \brief saves to a file in the background, the volume must not be modified until the task
+  /// is done, a cancelled save removes the incomplete file
+  volumeTask saveToFileAsync(const std::string& _filePath,
+                             const progressCallback& callback = nullptr) const;
+
   // reading and writing from and to h5
   void read_h5(const std::string& _filePath);
+  void read_h5(const std::string& _filePath, const std::size_t* startIdx, const std::size_t* stopIdx);
   void save_h5(const std::string& _filePath) const;
 
+  /// \brief chunk shape of the h5 dataset in volume order, zeros select whole slices along dim2
+  void set_h5ChunkDim(const std::size_t n0, const std::size_t n1, const std::size_t n2);
+  [[nodiscard]] std::size_t get_h5ChunkDim(const uint8_t _dim) const { return h5ChunkDim[_dim]; }
+
+  /// \brief deflate level (1 ... 9) used when saving to h5, 0 disables compression
+  void set_h5CompressionLevel(const int _level) { h5CompressionLevel = _level; }
+
+  /// \brief apply the shuffle filter before deflate, usually improves the ratio for floats
+  void set_h5Shuffle(const bool _flagShuffle) { flagH5Shuffle = _flagShuffle; }
+
   // read and save from and to nii
   void read_nii(const std::string& _filePath);
+  void read_nii(const std::string& _filePath,
+                const std::size_t* startIdx,
+                const std::size_t* stopIdx);
   void save_nii(const std::string& _filePath) const;
 
+  /// \brief native format: mapped if set_mapFiles is enabled, embedded statistics and
+  /// projections replace calcMinMax and calcMips
+  void read_cvol(const std::string& _filePath);
+  void read_cvol(const std::string& _filePath,
+                 const std::size_t* startIdx,
+                 const std::size_t* stopIdx);
+  void save_cvol(const std::string& _filePath) const;
+
+  /// \brief verify the checksums of all chunks read from cvol files (on by default)
+  void set_cvolVerify(const bool _flagVerify) { flagCvolVerify = _flagVerify; }
+
+  /// \brief embed maximum intensity projections when saving to cvol (on by default)
+  void set_cvolMips(const bool _flagMips) { flagCvolMips = _flagMips; }
+
+  /// \brief directory of zlib compressed chunk files in the layout of a Zarr v2 array, chunks
+  /// are written and read in parallel
+  void read_zarr(const std::string& _filePath);
+  void read_zarr(const std::string& _filePath,
+                 const std::size_t* startIdx,
+                 const std::size_t* stopIdx);
+  void save_zarr(const std::string& _filePath) const;
+
+  /// \brief chunk shape of saved zarr stores in volume order, zeros select 64
+  void set_zarrChunkDim(const std::size_t n0, const std::size_t n1, const std::size_t n2) {
+    zarrChunkDim[0] = n0;
+    zarrChunkDim[1] = n1;
+    zarrChunkDim[2] = n2;
+  }
+
+  /// \brief zlib level (1 ... 9) of the chunk files of saved zarr stores, 0 stores them raw
+  void set_zarrCompressionLevel(const int _level) { zarrCompressionLevel = _level; }
+
+  /// \brief true if a dimension exceeds the NIfTI-1 limit, save_nii then writes NIfTI-2
+  [[nodiscard]] bool needs_nifti2() const;
+
+  /// \brief byte order used when saving to nii, files are read in either order
+  void set_niiByteOrder(const ByteOrder _order) { niiByteOrder = _order; }
+  [[nodiscard]] ByteOrder get_niiByteOrder() const { return niiByteOrder; }
+
+  /// \brief zlib level (1 ... 9) used when saving to .nii.gz
+  void set_niiCompressionLevel(const int _level) { niiCompressionLevel = _level; }
+
+  /// \brief if enabled, uncompressed native float nii files are memory mapped instead of read
+  /// \details files with scl_slope / scl_inter are always read and scaled on the fly
+  /// \param _flagMapFiles enable or disable mapping
+  void set_mapFiles(const bool _flagMapFiles) { flagMapFiles = _flagMapFiles; }
+  [[nodiscard]] bool get_mapFiles() const { return flagMapFiles; }
+
+  /// \brief returns true if the data array currently views the pages of a mapped file
+  [[nodiscard]] bool get_isMapped() const { return data.is_mapped(); }
+
   void print_information() const;
 
+  /// \brief number of threads used by parallel operations, 0 selects one per processor
+  void set_nThreads(const int _nThreads);
+  [[nodiscard]] int get_nThreads() const { return processor_count; }
+
   /// \brief returns minimum position along dimension
   /// \param _dim the dimension along which we want to receive the min position
   [[nodiscard]] float get_minPos(const uint8_t _dim) const;
@@ -172,6 +287,8 @@ public:
 
   [[nodiscard]] float getRangeLimitedPos(const float pos, const uint8_t _dim) const;
 
+  /// \brief copies the box between start and stop (inclusive) into vol
+  /// \details throws if the box exceeds the volume, see get_croppedVolume
   void getCroppedVolume(float* vol, // array containing cropped volume
                         const std::size_t start0,
                         const std::size_t stop0,
@@ -180,14 +297,35 @@ public:
                         const std::size_t start2,
                         const std::size_t stop2) const;
 
+  /// \brief copies the box between startIdx and stopIdx (inclusive) into vol, which needs to
+  /// hold all of its elements, the rows are copied in parallel through get_view(). Use the
+  /// view itself to avoid the copy, e.g. for statistics or arithmetic on the box
   void get_croppedVolume(float* vol, // array containing cropped volume
                          const std::size_t* startIdx,
                          const std::size_t* stopIdx) const;
 
   void crop(const std::size_t* startIdx, const std::size_t* stopIdx);
 
+  /// \brief view of the box between startIdx and stopIdx (inclusive) without copying it
+  /// \details same box as crop, the view of a non const volume can modify its voxels
+  [[nodiscard]] volumeView get_view(const std::size_t* startIdx, const std::size_t* stopIdx);
+  [[nodiscard]] volumeView get_view(const std::size_t* startIdx,
+                                    const std::size_t* stopIdx) const;
+
   void exportVtk(const std::string& filePath);
 
+  /// \brief export as VTK XML image data with raw appended values
+  /// \param filePath .vti for a single file, .pvti for pieces along dim2 written in parallel
+  /// \param compressionLevel zlib level applied to blocks of the data, 0 disables compression
+  /// \param nPieces number of pieces of a .pvti file, 0 uses one piece per processor
+  void exportVti(const std::string& filePath,
+                 const int compressionLevel = 0,
+                 const std::size_t nPieces = 0) const;
+
+  /// \brief extracts the isosurface at isoValue with marching cubes on all processors
+  /// \details vertices are given in world coordinates, normals point away from voxels >= isoValue
+  void extractIsoSurface(const float isoValue, isoSurface& surface) const;
+
   void calcMinMax();
   void calcMips();
 
@@ -209,13 +347,29 @@ public:
   float get_maxValCrop() const { return maxValCrop; }
 
   /// \brief get a pointer to the data array
+  /// \details copies of a volume share their data array, write access through this pointer,
+  /// operator[], set_value or the in place operators copies it first (copy on write). Once
+  /// the pointer was handed out, copies of this volume always copy the array right away, so
+  /// writes through the pointer never reach them
   /// \returns a pointer to the data array
-  [[nodiscard]] float* get_pdata() { return data.data(); }
+  [[nodiscard]] float* get_pdata() { return data.leak(); }
+
+  /// \brief write access to the data array that copies made meanwhile do not share
+  /// \details the array is detached from other copies now and every copy made while the pin
+  /// exists gets its own array, used by writable views
+  [[nodiscard]] storagePin pin_data() { return data.pin(); }
 
   /// \brief return a pointer to the const data array
   /// \returns a pointer to the const data array
   [[nodiscard]] const float* get_pdata() const { return data.data(); }
 
+  /// \brief alignment in bytes of the data array, kernels may use aligned loads up to this width
+  /// \returns 64 for arrays in memory, less for some mapped files
+  [[nodiscard]] std::size_t get_dataAlignment() const { return data.get_alignment(); }
+
+  /// \brief true while the data array is shared with a copy of this volume
+  [[nodiscard]] bool is_dataShared() const { return data.is_shared(); }
+
   // get slices of volume
   [[nodiscard]] float* get_psliceZ(const std::size_t zLevel);
   [[nodiscard]] float* get_psliceX(const std::size_t xLevel);
@@ -224,9 +378,10 @@ public:
   [[nodiscard]] float* get_psliceX(const float xPos);
   [[nodiscard]] float* get_psliceY(const float yPos);
 
-  [[nodiscard]] float* get_mipX() { return mipX.data(); };
-  [[nodiscard]] float* get_mipY() { return mipY.data(); };
-  [[nodiscard]] float* get_mipZ() { return mipZ.data(); };
+  // projections are calculated on the first request, calcMips updates them
+  [[nodiscard]] float* get_mipX();
+  [[nodiscard]] float* get_mipY();
+  [[nodiscard]] float* get_mipZ();
 
   void normalize();
   [[nodiscard]] float get_norm() const;
@@ -236,6 +391,10 @@ public:
                  const float maxVal); // fill array with random values
 
 private:
+  void report_progress(const std::size_t nDone, const std::size_t nTotal) const;
+  [[nodiscard]] h5Progress get_h5Progress() const;
+  void apply_cvolExtras(const cvolReader& reader);
+
   std::string inPath; // path pointing to our input file
 
   std::size_t dim[3] = {0, 0, 0};       // dimensionailty of volume
@@ -247,25 +406,35 @@ private:
   float maxVal = 0.0f;    // maximum value in full dataset
   float maxAbsVal = 0.0f; // absolute maximum value in full dataset
 
-  std::vector<float> data; // matrix containing data
-
-  // z slice array which will be only updated if new slice is requested
-  std::vector<float> sliceZ; // indexing [iX, iY]
+  volumeStorage data; // matrix containing data (owned or mapped from file)
+  bool flagMapFiles = false; // map nii files instead of reading them
+  int niiCompressionLevel = 6; // zlib level for .nii.gz files
+  ByteOrder niiByteOrder = ByteOrder::NATIVE; // byte order of saved nii files
+  std::size_t h5ChunkDim[3] = {0, 0, 0}; // requested chunk shape of saved h5 files
+  int h5CompressionLevel = 0;              // deflate level of saved h5 files, 0: uncompressed
+  bool flagH5Shuffle = true;               // shuffle bytes before deflate
+  bool flagCvolVerify = true;              // check chunk checksums of cvol files on load
+  bool flagCvolMips = true;                // embed projections in saved cvol files
+  std::size_t zarrChunkDim[3] = {0, 0, 0}; // requested chunk shape of saved zarr stores
+  int zarrCompressionLevel = 1;            // zlib level of saved zarr chunks
+
+  // slice arrays, allocated on the first request and only updated if a new slice is requested
+  std::vector<float> sliceZ; // indexing [i0 + dim0 * i1]
   std::size_t lastSliceZ = 0;
-  std::vector<float> sliceX; // indexing [iZ, iY]
+  std::vector<float> sliceX; // indexing [i2 + dim2 * i1]
   std::size_t lastSliceX = 0;
-  std::vector<float> sliceY; // indexing [iX, iZ]
+  std::vector<float> sliceY; // indexing [i0 + dim0 * i2]
   std::size_t lastSliceY = 0;
 
-  // maximum intensity projections
-  std::vector<float> mipZ; // indexing: [iX, iY], iX + nX * iY
-  std::vector<float> mipX; // indexing: [iZ, iY], iZ + nZ * iY
-  std::vector<float> mipY; // indexing: [iX, iZ], iX + nX * iZ
+  // maximum intensity projections, allocated on the first request
+  std::vector<float> mipZ; // along dim0, indexing: [i1 + dim1 * i2]
+  std::vector<float> mipX; // along dim1, indexing: [i0 + dim0 * i2]
+  std::vector<float> mipY; // along dim2, indexing: [i1 + dim1 * i0]
 
-  // maximum intensity projections (cropped)
-  std::vector<float> croppedMipZ; // indexing: [iX, iY], iX + nX * iY
-  std::vector<float> croppedMipX; // indexing: [iZ, iY], iZ + nZ * iY
-  std::vector<float> croppedMipY; // indexing: [iX, iZ], iX + nX * iZ
+  // maximum intensity projections (cropped), same layout as above
+  std::vector<float> croppedMipZ;
+  std::vector<float> croppedMipX;
+  std::vector<float> croppedMipY;
 
   // crop range for submips
   float cropRange[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
@@ -275,10 +444,10 @@ private:
   float minValCrop = 0.0f;
   float maxValCrop = 0.0f;
 
-  const int processor_count; //!< number of CPU processing units
+  int processor_count; //!< number of threads used by parallel operations
   std::vector<std::thread> workers;
 
-  nifti_1_header hdr;
+  nifti_1_header hdr = {};
 };
 
 #endif
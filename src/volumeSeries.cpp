@@ -0,0 +1,261 @@
+#include "volumeSeries.h"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+volumeSeries::volumeSeries()
+    : baseClass("volumeSeries"), processor_count(std::thread::hardware_concurrency()) {}
+
+volumeSeries::~volumeSeries() {
+  // never throw from the destructor, but report if cached frames could not be written
+  try {
+    close();
+  } catch (...) {
+    printf("Error closing volume series %s\n", filePath.c_str());
+  }
+}
+
+void volumeSeries::create(const std::string& _filePath,
+                          const std::size_t* _dim,
+                          const float* _res,
+                          const float* _origin) {
+  close();
+
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if (_dim[iDim] == 0) {
+      printf("Frames of a volume series cannot be empty\n");
+      throw std::runtime_error("InvalidSize");
+    }
+    dim[iDim] = _dim[iDim];
+    res[iDim] = _res[iDim];
+    origin[iDim] = _origin[iDim];
+  }
+
+  std::lock_guard<std::mutex> lock(h5Mutex);
+  h5File = std::make_unique<H5::H5File>(_filePath, H5F_ACC_TRUNC);
+
+  // same meta information as a single volume saved by volume::save_h5
+  const hsize_t col_dims = 3;
+  H5::DataSpace mspace(1, &col_dims);
+  H5::DataSet resDataset = h5File->createDataSet("dr", H5::PredType::NATIVE_FLOAT, mspace);
+  resDataset.write(res, H5::PredType::NATIVE_FLOAT);
+  H5::DataSet originDataset = h5File->createDataSet("origin", H5::PredType::NATIVE_FLOAT, mspace);
+  originDataset.write(origin, H5::PredType::NATIVE_FLOAT);
+  H5::DataSet dimDataset = h5File->createDataSet("dim", H5::PredType::NATIVE_UINT64, mspace);
+  dimDataset.write(dim, H5::PredType::NATIVE_UINT64);
+
+  // empty 4D dataset which grows along the frame dimension
+  h5Chunks::get_chunkDim(dim, requestedChunkDim, chunkDim);
+  const hsize_t fileDim[4] = {0, dim[2], dim[1], dim[0]};
+  const hsize_t maxDim[4] = {H5S_UNLIMITED, dim[2], dim[1], dim[0]};
+  const hsize_t fileChunk[4] = {framesPerChunk, chunkDim[2], chunkDim[1], chunkDim[0]};
+  H5::DataSpace fileSpace(4, fileDim, maxDim);
+  H5::DSetCreatPropList plist;
+  plist.setChunk(4, fileChunk);
+  if (compressionLevel > 0) {
+    if (flagShuffle) plist.setShuffle();
+    plist.setDeflate(compressionLevel);
+  }
+  h5File->createDataSet("frames", H5::PredType::NATIVE_FLOAT, fileSpace, plist);
+
+  filePath = _filePath;
+  flagWritable = true;
+  nFrames = 0;
+  open_dataset();
+}
+
+void volumeSeries::create(const std::string& _filePath, const volume& _template) {
+  const std::size_t _dim[3] = {_template.get_dim(0), _template.get_dim(1), _template.get_dim(2)};
+  const float _res[3] = {_template.get_res(0), _template.get_res(1), _template.get_res(2)};
+  const float _origin[3] = {
+      _template.get_origin(0), _template.get_origin(1), _template.get_origin(2)};
+  create(_filePath, _dim, _res, _origin);
+}
+
+void volumeSeries::open(const std::string& _filePath, const bool _flagWritable) {
+  close();
+
+  std::lock_guard<std::mutex> lock(h5Mutex);
+  h5File = std::make_unique<H5::H5File>(_filePath, _flagWritable ? H5F_ACC_RDWR : H5F_ACC_RDONLY);
+
+  const hsize_t col_dims = 3;
+  H5::DataSpace mspace(1, &col_dims);
+  H5::DataSet resDataset = h5File->openDataSet("dr");
+  resDataset.read(res, H5::PredType::NATIVE_FLOAT, mspace, resDataset.getSpace());
+  H5::DataSet originDataset = h5File->openDataSet("origin");
+  originDataset.read(origin, H5::PredType::NATIVE_FLOAT, mspace, originDataset.getSpace());
+  H5::DataSet dimDataset = h5File->openDataSet("dim");
+  dimDataset.read(dim, H5::PredType::NATIVE_UINT64, mspace, dimDataset.getSpace());
+
+  filePath = _filePath;
+  flagWritable = _flagWritable;
+  open_dataset();
+}
+
+// opens the frame dataset and reads its storage options, the chunk cache holds all chunks of
+// framesPerChunk frames so that chunks spanning several frames are completed in memory
+void volumeSeries::open_dataset() {
+  h5Data = std::make_unique<H5::DataSet>(h5File->openDataSet("frames"));
+  H5::DataSpace fileSpace = h5Data->getSpace();
+  hsize_t fileDim[4];
+  if ((fileSpace.getSimpleExtentNdims() != 4) || (fileSpace.getSimpleExtentDims(fileDim) != 4) ||
+      (fileDim[1] != dim[2]) || (fileDim[2] != dim[1]) || (fileDim[3] != dim[0])) {
+    printf("Frames in %s do not match the stored dimensions\n", filePath.c_str());
+    throw std::runtime_error("InvalidSize");
+  }
+  nFrames = fileDim[0];
+
+  H5::DSetCreatPropList plist = h5Data->getCreatePlist();
+  hsize_t fileChunk[4];
+  plist.getChunk(4, fileChunk);
+  framesPerChunk = fileChunk[0];
+  chunkDim[0] = fileChunk[3];
+  chunkDim[1] = fileChunk[2];
+  chunkDim[2] = fileChunk[1];
+
+  // filters decide if frames can be compressed by us in parallel
+  compressionLevel = 0;
+  flagShuffle = false;
+  const int nFilters = H5Pget_nfilters(plist.getId());
+  for (int iFilter = 0; iFilter < nFilters; iFilter++) {
+    unsigned int flags;
+    size_t nValues = 8;
+    unsigned int values[8] = {0};
+    unsigned int config;
+    const H5Z_filter_t filter =
+        H5Pget_filter2(plist.getId(), iFilter, &flags, &nValues, values, 0, nullptr, &config);
+    if (filter == H5Z_FILTER_SHUFFLE)
+      flagShuffle = true;
+    else if (filter == H5Z_FILTER_DEFLATE)
+      compressionLevel = (nValues > 0) ? std::max<int>(1, values[0]) : 6;
+    else
+      compressionLevel = -1; // unknown filters, leave everything to the library
+  }
+
+  std::size_t nChunksFrame = 1;
+  for (uint8_t iDim = 0; iDim < 3; iDim++)
+    nChunksFrame *= (dim[iDim] + chunkDim[iDim] - 1) / chunkDim[iDim];
+  const std::size_t cacheBytes =
+      nChunksFrame * chunkDim[0] * chunkDim[1] * chunkDim[2] * framesPerChunk * sizeof(float);
+  H5::DSetAccPropList dapl;
+  dapl.setChunkCache(std::max<std::size_t>(10007, 100 * nChunksFrame), cacheBytes, 1.0);
+  h5Data = std::make_unique<H5::DataSet>(h5File->openDataSet("frames", dapl));
+}
+
+void volumeSeries::close() {
+  std::lock_guard<std::mutex> lock(h5Mutex);
+  if (h5File != nullptr) h5File->flush(H5F_SCOPE_LOCAL);
+  h5Data.reset();
+  h5File.reset();
+  nFrames = 0;
+  flagWritable = false;
+}
+
+void volumeSeries::flush() {
+  std::lock_guard<std::mutex> lock(h5Mutex);
+  check_open();
+  h5File->flush(H5F_SCOPE_LOCAL);
+}
+
+void volumeSeries::append_frame(const volume& frame) {
+  std::lock_guard<std::mutex> lock(h5Mutex);
+  check_open();
+  check_frame(frame);
+  if (!flagWritable) {
+    printf("Volume series %s was not opened as writable\n", filePath.c_str());
+    throw std::runtime_error("InvalidOperation");
+  }
+
+  const hsize_t newDim[4] = {nFrames + 1, dim[2], dim[1], dim[0]};
+  h5Data->extend(newDim);
+
+  // frames filling their own chunks are compressed by us in parallel and stored directly
+  if ((compressionLevel > 0) && (framesPerChunk == 1) && h5Chunks::has_directChunks()) {
+    h5Chunks::write_chunks(*h5Data,
+                           frame.get_pdata(),
+                           dim,
+                           chunkDim,
+                           compressionLevel,
+                           flagShuffle,
+                           processor_count,
+                           nFrames);
+  } else {
+    H5::DataSpace filespace = h5Data->getSpace();
+    const hsize_t start[4] = {nFrames, 0, 0, 0};
+    const hsize_t count[4] = {1, dim[2], dim[1], dim[0]};
+    filespace.selectHyperslab(H5S_SELECT_SET, count, start);
+    H5::DataSpace mspace(4, count);
+    h5Data->write(frame.get_pdata(), H5::PredType::NATIVE_FLOAT, mspace, filespace);
+  }
+  nFrames++;
+}
+
+void volumeSeries::read_frame(const std::size_t iFrame, volume& frame) {
+  std::lock_guard<std::mutex> lock(h5Mutex);
+  check_open();
+  if (iFrame >= nFrames) {
+    printf("Frame %lu is out of range (%lu frames)\n", iFrame, nFrames);
+    throw std::runtime_error("InvalidValue");
+  }
+
+  frame.set_dim(dim[0], dim[1], dim[2]);
+  frame.set_res(res);
+  frame.set_origin(origin);
+  frame.alloc_memory();
+
+  H5::DataSpace filespace = h5Data->getSpace();
+  const hsize_t start[4] = {iFrame, 0, 0, 0};
+  const hsize_t count[4] = {1, dim[2], dim[1], dim[0]};
+  filespace.selectHyperslab(H5S_SELECT_SET, count, start);
+  H5::DataSpace mspace(4, count);
+  h5Data->read(frame.pin_data().get_ptr(), H5::PredType::NATIVE_FLOAT, mspace, filespace);
+}
+
+void volumeSeries::read_frames(const std::size_t startFrame,
+                               const std::size_t _nFrames,
+                               std::vector<volume>& frames) {
+  if (startFrame + _nFrames > nFrames) {
+    printf("Frames %lu to %lu are out of range (%lu frames)\n",
+           startFrame,
+           startFrame + _nFrames,
+           nFrames);
+    throw std::runtime_error("InvalidValue");
+  }
+
+  frames.resize(_nFrames);
+  for (std::size_t iFrame = 0; iFrame < _nFrames; iFrame++)
+    read_frame(startFrame + iFrame, frames[iFrame]);
+}
+
+void volumeSeries::set_framesPerChunk(const std::size_t _framesPerChunk) {
+  if (_framesPerChunk == 0) {
+    printf("Chunks need to hold at least one frame\n");
+    throw std::runtime_error("InvalidValue");
+  }
+  framesPerChunk = _framesPerChunk;
+}
+
+void volumeSeries::set_chunkDim(const std::size_t n0, const std::size_t n1, const std::size_t n2) {
+  requestedChunkDim[0] = n0;
+  requestedChunkDim[1] = n1;
+  requestedChunkDim[2] = n2;
+}
+
+void volumeSeries::check_open() const {
+  if (h5Data == nullptr) {
+    printf("No volume series opened\n");
+    throw std::runtime_error("InvalidOperation");
+  }
+}
+
+void volumeSeries::check_frame(const volume& frame) const {
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if (frame.get_dim(iDim) != dim[iDim]) {
+      printf("Frame dimensions do not match the series along dim %d (%lu vs %lu)\n",
+             iDim,
+             frame.get_dim(iDim),
+             dim[iDim]);
+      throw std::runtime_error("InvalidSize");
+    }
+  }
+}
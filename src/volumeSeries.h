@@ -0,0 +1,107 @@
+/*
+  File: volumeSeries.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: time series of volumes stored in a single h5 file. The frames
+  live in a 4D dataset of shape [frame, dim2, dim1, dim0] whose frame dimension
+  is unlimited, so frames can be appended while the file stays open. Each chunk
+  holds a configurable number of frames and the chunk cache covers that many
+  frames, so appending never reads back partially written chunks. Resolution,
+  origin and dimensions are stored once in the same datasets used by
+  volume::save_h5.
+*/
+
+#ifndef VOLUMESERIES_H
+#define VOLUMESERIES_H
+
+#include "baseClass.h"
+#include "volume.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class volumeSeries : public baseClass {
+
+public:
+  volumeSeries();
+  ~volumeSeries();
+
+  volumeSeries(const volumeSeries&) = delete;
+  volumeSeries& operator=(const volumeSeries&) = delete;
+
+  /// \brief create a new, empty series, an existing file is overwritten
+  /// \param _filePath path to the h5 file
+  /// \param _dim dimensions of each frame
+  /// \param _res resolution of each frame
+  /// \param _origin origin of each frame
+  void create(const std::string& _filePath,
+              const std::size_t* _dim,
+              const float* _res,
+              const float* _origin);
+
+  /// \brief create a new series with dimensions, resolution and origin of a template volume
+  void create(const std::string& _filePath, const volume& _template);
+
+  /// \brief open an existing series
+  /// \param _flagWritable allow appending frames
+  void open(const std::string& _filePath, const bool _flagWritable = false);
+
+  /// \brief writes everything cached to disk and closes the file
+  void close();
+
+  /// \brief writes everything cached to disk, the file remains open
+  void flush();
+
+  /// \brief appends a frame at the end of the series
+  void append_frame(const volume& frame);
+
+  /// \brief reads a single frame into a volume
+  void read_frame(const std::size_t iFrame, volume& frame);
+
+  /// \brief reads nFrames consecutive frames starting at startFrame
+  void read_frames(const std::size_t startFrame,
+                   const std::size_t nFrames,
+                   std::vector<volume>& frames);
+
+  [[nodiscard]] std::size_t get_nFrames() const { return nFrames; }
+  [[nodiscard]] std::size_t get_dim(const std::size_t _dim) const { return dim[_dim]; }
+  [[nodiscard]] float get_res(const std::size_t _dim) const { return res[_dim]; }
+  [[nodiscard]] float get_origin(const std::size_t _dim) const { return origin[_dim]; }
+
+  // storage options, only used by create
+  /// \brief number of frames stored in each chunk
+  void set_framesPerChunk(const std::size_t _framesPerChunk);
+  /// \brief chunk shape within a frame in volume order, zeros select whole slices along dim2
+  void set_chunkDim(const std::size_t n0, const std::size_t n1, const std::size_t n2);
+  /// \brief deflate level (1 ... 9), 0 disables compression
+  void set_compressionLevel(const int _level) { compressionLevel = _level; }
+  void set_shuffle(const bool _flagShuffle) { flagShuffle = _flagShuffle; }
+
+private:
+  void open_dataset(); // opens the frame dataset with a chunk cache sized for our chunks
+  void check_open() const;
+  void check_frame(const volume& frame) const;
+
+  std::string filePath;
+  std::unique_ptr<H5::H5File> h5File;
+  std::unique_ptr<H5::DataSet> h5Data;
+  mutable std::mutex h5Mutex; // hdf5 is not thread safe
+  bool flagWritable = false;
+
+  std::size_t dim[3] = {0, 0, 0};
+  float origin[3] = {0.0f, 0.0f, 0.0f};
+  float res[3] = {1.0f, 1.0f, 1.0f};
+  std::size_t nFrames = 0;
+
+  std::size_t framesPerChunk = 1;
+  std::size_t requestedChunkDim[3] = {0, 0, 0};
+  std::size_t chunkDim[3] = {0, 0, 0}; // chunk shape within a frame in volume order
+  int compressionLevel = 0;
+  bool flagShuffle = true;
+
+  const int processor_count; //!< number of CPU processing units
+};
+
+#endif
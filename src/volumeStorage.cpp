@@ -0,0 +1,143 @@
+#include "volumeStorage.h"
+#include "bufferPool.h"
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+storageBlock::~storageBlock() {
+  if (mapBase != nullptr) munmap(mapBase, mapLength);
+  bufferPool::recycle(std::move(owned));
+}
+
+storagePin::storagePin(std::shared_ptr<storageBlock> _block, float* _ptr)
+    : block(std::move(_block)), ptr(_ptr) {
+  if (block) block->nPins++;
+}
+
+storagePin& storagePin::operator=(const storagePin& obj) {
+  if (block == obj.block) {
+    ptr = obj.ptr;
+    return *this;
+  }
+
+  if (block) block->nPins--;
+  block = obj.block;
+  ptr = obj.ptr;
+  if (block) block->nPins++;
+  return *this;
+}
+
+storagePin::~storagePin() {
+  if (block) block->nPins--;
+}
+
+volumeStorage::volumeStorage(const volumeStorage& obj) { *this = obj; }
+
+volumeStorage& volumeStorage::operator=(const volumeStorage& obj) {
+  if (this == &obj) return *this;
+
+  block = obj.block;
+  ptr = obj.ptr;
+  nElements = obj.nElements;
+  if (!is_shareable()) unshare();
+  return *this;
+}
+
+// mappings stay private to one store, pinned or leaked memory is written through pointers we
+// cannot see and sharing it would pass those writes on to the copy
+bool volumeStorage::is_shareable() const {
+  if (!block) return true;
+  return !is_mapped() && (block->nPins.load() == 0) && !block->flagLeaked.load();
+}
+
+void volumeStorage::resize(const std::size_t _nElements, const bool flagZero) {
+  const std::size_t nKeep = (_nElements < nElements) ? _nElements : nElements;
+  if (block && !is_mapped() && !is_shared() && !block->owned.empty()) {
+    block->owned.resize(_nElements);
+  } else {
+    // a new block: either nothing to keep or the content moves out of a mapping or shared
+    // memory, a pooled buffer of the same size avoids fresh pages
+    auto newBlock = std::make_shared<storageBlock>();
+    newBlock->owned = bufferPool::acquire(_nElements, false);
+    if (nKeep > 0) memcpy(newBlock->owned.data(), ptr, nKeep * sizeof(float));
+    block = std::move(newBlock);
+  }
+  if (flagZero && (_nElements > nKeep))
+    memset(block->owned.data() + nKeep, 0, (_nElements - nKeep) * sizeof(float));
+  nElements = _nElements;
+  ptr = block->owned.data();
+}
+
+void volumeStorage::unshare() {
+  // every element is overwritten, the buffer does not need to be cleared first
+  auto newBlock = std::make_shared<storageBlock>();
+  newBlock->owned = bufferPool::acquire(nElements, false);
+  if (nElements > 0) memcpy(newBlock->owned.data(), ptr, nElements * sizeof(float));
+  block = std::move(newBlock);
+  ptr = block->owned.data();
+}
+
+storagePin volumeStorage::pin() {
+  if (is_shared()) unshare();
+  return storagePin(block, ptr);
+}
+
+float* volumeStorage::leak() {
+  if (is_shared()) unshare();
+  if (block) block->flagLeaked = true;
+  return ptr;
+}
+
+void volumeStorage::map_file(const std::string& filePath,
+                             const std::size_t byteOffset,
+                             const std::size_t _nElements) {
+  if (byteOffset % sizeof(float) != 0) {
+    printf("Data offset %lu is not aligned to float boundaries\n", byteOffset);
+    throw std::runtime_error("InvalidValue");
+  }
+
+  const int fd = open(filePath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    printf("Error opening file %s for mapping\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  struct stat fileStat;
+  const std::size_t length = byteOffset + _nElements * sizeof(float);
+  if ((fstat(fd, &fileStat) != 0) || (static_cast<std::size_t>(fileStat.st_size) < length)) {
+    close(fd);
+    printf("File %s is too small to contain %lu elements\n", filePath.c_str(), _nElements);
+    throw std::runtime_error("ReadError");
+  }
+
+  // private and writable: modifications are copy on write and never reach the file
+  void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps its own reference to the file
+  if (base == MAP_FAILED) {
+    printf("Error mapping file %s\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  auto newBlock = std::make_shared<storageBlock>();
+  newBlock->mapBase = base;
+  newBlock->mapLength = length;
+  block = std::move(newBlock);
+  nElements = _nElements;
+  ptr = reinterpret_cast<float*>(static_cast<char*>(base) + byteOffset);
+}
+
+void volumeStorage::release() {
+  block.reset();
+  nElements = 0;
+  ptr = nullptr;
+}
+
+void volumeStorage::swap(volumeStorage& obj) noexcept {
+  block.swap(obj.block);
+  std::swap(ptr, obj.ptr);
+  std::swap(nElements, obj.nElements);
+}
@@ -0,0 +1,138 @@
+/*
+  File: volumeStorage.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: backing store for the voxel array of a volume. The store either
+  owns its memory or views the pages of a memory mapped file. Mappings are
+  private, so the kernel copies a page only once it is written to and untouched
+  pages stay shared with the page cache of all other processes. Owned memory is
+  cache line aligned and large arrays sit on huge pages, see alignedAllocator.
+  Copies of a store share its memory until one of them asks for write access
+  through a non const accessor, only then the array is copied (copy on write).
+  Copies of a mapping own their memory right away and never keep the file open.
+  The same holds for copies of a store that is pinned or leaked: pins are taken
+  by writers holding raw pointers into the array for a while (volumeView), a
+  leaked array had a raw pointer handed out for good (volume::get_pdata). Writes
+  through such pointers never reach a copy made after the pointer was handed out.
+*/
+
+#ifndef VOLUMESTORAGE_H
+#define VOLUMESTORAGE_H
+
+#include "alignedAllocator.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// memory behind one or more stores, either owned or a file mapping
+struct storageBlock {
+  storageBlock() = default;
+  storageBlock(const storageBlock&) = delete;
+  storageBlock& operator=(const storageBlock&) = delete;
+  ~storageBlock();
+
+  floatBuffer owned;       //!< memory owned by the block
+  void* mapBase = nullptr; //!< start of the mapping (page aligned)
+  std::size_t mapLength = 0;
+  std::atomic<std::size_t> nPins{0}; //!< writers holding raw pointers, copies may not share
+  std::atomic<bool> flagLeaked{false}; //!< raw pointer handed out for good, copies may not share
+};
+
+// keeps a block alive and unshareable while a writer holds raw pointers into it
+class storagePin {
+public:
+  storagePin() = default;
+  storagePin(std::shared_ptr<storageBlock> _block, float* _ptr);
+  storagePin(const storagePin& obj) : storagePin(obj.block, obj.ptr) {}
+  storagePin& operator=(const storagePin& obj);
+  ~storagePin();
+
+  /// \brief first element of the pinned array
+  [[nodiscard]] float* get_ptr() const { return ptr; }
+
+private:
+  std::shared_ptr<storageBlock> block;
+  float* ptr = nullptr;
+};
+
+class volumeStorage {
+public:
+  volumeStorage() = default;
+  volumeStorage(const volumeStorage& obj);
+  volumeStorage& operator=(const volumeStorage& obj);
+
+  /// \brief resize the store to nElements, keeping existing values and zero filling new ones
+  /// \param nElements new number of elements
+  /// \param flagZero zero new elements, callers overwriting all of them skip it
+  void resize(std::size_t nElements, bool flagZero = true);
+
+  /// \brief replace the content of the store by a private mapping of a file
+  /// \param filePath path of the file to map
+  /// \param byteOffset offset of the first element in the file (must be float aligned)
+  /// \param nElements number of float elements to map
+  void map_file(const std::string& filePath, std::size_t byteOffset, std::size_t nElements);
+
+  /// \brief drop all memory held by the store
+  void release();
+
+  /// \brief exchange the content of two stores without copying
+  void swap(volumeStorage& obj) noexcept;
+
+  [[nodiscard]] bool is_mapped() const { return block && (block->mapBase != nullptr); }
+
+  /// \brief true while other stores share our memory, the next write access copies it
+  /// \details pins hold a reference to the block as well but are no stores
+  [[nodiscard]] bool is_shared() const {
+    if (!block) return false;
+    if (static_cast<std::size_t>(block.use_count()) > 1 + block->nPins.load()) return true;
+    // use_count loads relaxed: order reads of copies released meanwhile before our writes
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return false;
+  }
+
+  /// \brief write access for a pointer that outlives this call
+  /// \details copies the memory if it is shared, copies made while the pin exists get their own
+  /// array instead of sharing this one
+  [[nodiscard]] storagePin pin();
+
+  /// \brief write access for a pointer of unknown lifetime
+  /// \details copies the memory if it is shared, from then on every copy of the store gets its
+  /// own array (like a leaked copy on write string), until the array is replaced
+  [[nodiscard]] float* leak();
+
+  /// \brief alignment in bytes of the first element, up to alignedMemory::ALIGNMENT
+  /// \details owned memory always has the full alignment, mappings follow the offset of the data
+  /// in the file
+  [[nodiscard]] std::size_t get_alignment() const {
+    return alignedMemory::get_alignment(ptr, alignedMemory::ALIGNMENT);
+  }
+
+  [[nodiscard]] std::size_t size() const { return nElements; }
+
+  // write access, shared memory is copied first
+  [[nodiscard]] float* data() {
+    if (is_shared()) unshare();
+    return ptr;
+  }
+  [[nodiscard]] float& operator[](std::size_t idx) {
+    if (is_shared()) unshare();
+    return ptr[idx];
+  }
+
+  // read access, never copies
+  [[nodiscard]] const float* data() const { return ptr; }
+  [[nodiscard]] const float* cdata() const { return ptr; }
+  [[nodiscard]] float operator[](std::size_t idx) const { return ptr[idx]; }
+
+private:
+  void unshare();
+  [[nodiscard]] bool is_shareable() const;
+
+  std::shared_ptr<storageBlock> block; //!< shared between copies, reference counts are atomic
+  float* ptr = nullptr;                //!< first element, either in owned or in mapping
+  std::size_t nElements = 0;
+};
+
+#endif
@@ -0,0 +1,495 @@
+#include "volumeStream.h"
+#include "internalHelpers.h"
+#include "h5Chunks.h"
+#include "traceLog.h"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+static const int NII_DEFAULT_LEVEL = 6; // same default as volume::save_nii
+
+// builds of hdf5 without thread safety must never be entered by two streams at the same time,
+// thread safe builds serialize their calls internally
+#ifdef H5_HAVE_THREADSAFE
+static const bool H5_LOCKING = false;
+#else
+static const bool H5_LOCKING = true;
+#endif
+static std::mutex h5StreamMutex;
+
+struct h5Guard {
+  std::unique_lock<std::mutex> lock{h5StreamMutex, std::defer_lock};
+  h5Guard() {
+    if (H5_LOCKING) lock.lock();
+  }
+};
+
+// holds a slot of an optional ioLimiter for the lifetime of the guard
+struct ioSlot {
+  ioLimiter* limiter;
+  explicit ioSlot(ioLimiter* _limiter) : limiter(_limiter) {
+    if (limiter != nullptr) limiter->acquire();
+  }
+  ~ioSlot() {
+    if (limiter != nullptr) limiter->release();
+  }
+};
+
+ioLimiter::ioLimiter(const std::size_t _nSlots) : nFree(std::max<std::size_t>(1, _nSlots)) {}
+
+void ioLimiter::acquire() {
+  TRACE_SCOPE("ioLimiter wait", "stream");
+  std::unique_lock<std::mutex> lock(slotMutex);
+  slotFreed.wait(lock, [this]() { return nFree > 0; });
+  nFree--;
+}
+
+void ioLimiter::release() {
+  {
+    std::lock_guard<std::mutex> lock(slotMutex);
+    nFree++;
+  }
+  slotFreed.notify_one();
+}
+
+static StreamFormat get_format(const std::string& _filePath) {
+  if (hasEnding(_filePath, ".h5")) return StreamFormat::H5;
+  if (hasEnding(_filePath, ".nii") || hasEnding(_filePath, ".nii.gz")) return StreamFormat::NII;
+
+  printf("I do not support streaming of this file type: %s\n", _filePath.c_str());
+  throw std::runtime_error("InvalidType");
+}
+
+// selects the slices [start2, start2 + n2) of a h5 volume, stored either as flat 1D array or as
+// 3D array of shape [dim2, dim1, dim0]
+static void select_slices(H5::DataSet& dataset,
+                          const std::size_t* dim,
+                          const std::size_t start2,
+                          const std::size_t n2,
+                          H5::DataSpace& filespace,
+                          H5::DataSpace& mspace) {
+  filespace = dataset.getSpace();
+  if (filespace.getSimpleExtentNdims() == 3) {
+    const hsize_t start[3] = {start2, 0, 0};
+    const hsize_t count[3] = {n2, dim[1], dim[0]};
+    filespace.selectHyperslab(H5S_SELECT_SET, count, start);
+    mspace = H5::DataSpace(3, count);
+  } else {
+    const hsize_t start = start2 * dim[0] * dim[1];
+    const hsize_t count = n2 * dim[0] * dim[1];
+    filespace.selectHyperslab(H5S_SELECT_SET, &count, &start);
+    mspace = H5::DataSpace(1, &count);
+  }
+}
+
+// dataset access with a chunk cache holding one layer of chunks along dim2, so that chunks
+// shared by neighbouring slabs are only decompressed (or compressed) once
+static H5::DataSet open_layerCached(H5::H5File& file, const std::size_t* dim) {
+  H5::DataSet dataset = file.openDataSet("vol");
+  H5::DSetCreatPropList plist = dataset.getCreatePlist();
+  if ((dataset.getSpace().getSimpleExtentNdims() != 3) || (plist.getLayout() != H5D_CHUNKED))
+    return dataset;
+
+  hsize_t chunk[3];
+  plist.getChunk(3, chunk);
+  const std::size_t layerBytes = ((dim[0] + chunk[2] - 1) / chunk[2]) * chunk[2] *
+                                 ((dim[1] + chunk[1] - 1) / chunk[1]) * chunk[1] * chunk[0] *
+                                 dataset.getDataType().getSize();
+  H5::DSetAccPropList dapl;
+  dapl.setChunkCache(10007, layerBytes, 1.0);
+  return file.openDataSet("vol", dapl);
+}
+
+// number of slices per slab so that two float slabs and the file bytes of each stay in budget
+static std::size_t get_slabDepth(const std::size_t sliceSize,
+                                 const std::size_t bytesPerVoxel,
+                                 const std::size_t memoryBudget) {
+  const std::size_t sliceBytes = std::max<std::size_t>(1, sliceSize * bytesPerVoxel);
+  return std::max<std::size_t>(1, memoryBudget / sliceBytes);
+}
+
+volumeReader::volumeReader()
+    : baseClass("volumeReader"), processor_count(std::thread::hardware_concurrency()) {}
+
+volumeReader::~volumeReader() { close(); }
+
+void volumeReader::open(const std::string& _filePath) {
+  close();
+  format = get_format(_filePath);
+
+  if (format == StreamFormat::NII) {
+    niiIn = std::make_unique<niiSource>(_filePath);
+    info = niiIn->read_header(hdr);
+    niiIn->seek(info.headerSize, info.voxOffset);
+    for (uint8_t iDim = 0; iDim < 3; iDim++) {
+      dim[iDim] = info.dim[iDim];
+      res[iDim] = info.res[iDim];
+      origin[iDim] = 0.0f;
+    }
+  } else {
+    h5Guard guard;
+    h5File = std::make_unique<H5::H5File>(_filePath, H5F_ACC_RDONLY);
+    const hsize_t col_dims = 3;
+    H5::DataSpace mspace(1, &col_dims);
+    H5::DataSet resDataset = h5File->openDataSet("dr");
+    resDataset.read(res, H5::PredType::NATIVE_FLOAT, mspace, resDataset.getSpace());
+    H5::DataSet originDataset = h5File->openDataSet("origin");
+    originDataset.read(origin, H5::PredType::NATIVE_FLOAT, mspace, originDataset.getSpace());
+    H5::DataSet dimDataset = h5File->openDataSet("dim");
+    dimDataset.read(dim, H5::PredType::NATIVE_UINT64, mspace, dimDataset.getSpace());
+    h5Data = std::make_unique<H5::DataSet>(open_layerCached(*h5File, dim));
+    hdr = {};
+  }
+
+  filePath = _filePath;
+  position = 0;
+}
+
+void volumeReader::close() {
+  niiIn.reset();
+  h5Guard guard;
+  h5Data.reset();
+  h5File.reset();
+  format = StreamFormat::NONE;
+  position = 0;
+}
+
+void volumeReader::rewind() {
+  check_open();
+  if (format == StreamFormat::NII) {
+    const std::string path = filePath;
+    open(path);
+  } else {
+    position = 0;
+  }
+}
+
+void volumeReader::read_slices(float* buffer, const std::size_t n2) {
+  TRACE_SCOPE("read_slices", "stream");
+  check_open();
+  if (position + n2 > dim[2]) {
+    printf("Reading slices %lu to %lu exceeds the volume (%lu slices)\n",
+           position,
+           position + n2,
+           dim[2]);
+    throw std::runtime_error("InvalidValue");
+  }
+
+  const std::size_t nElements = n2 * get_sliceSize();
+  if (format == StreamFormat::NII) {
+    const bool flagScale = info.needs_scale();
+    if ((info.datatype == DT_FLOAT) && !info.flagSwap && !flagScale) {
+      ioSlot slot(limiter);
+      niiIn->read(buffer, nElements * sizeof(float));
+    } else {
+      raw.resize(nElements * get_bytesPerVoxel());
+      {
+        ioSlot slot(limiter);
+        niiIn->read(raw.data(), raw.size());
+      }
+      typeConversion::toFloat(raw.data(),
+                              buffer,
+                              nElements,
+                              info.datatype,
+                              flagScale ? info.sclSlope : 1.0f,
+                              flagScale ? info.sclInter : 0.0f,
+                              processor_count,
+                              info.flagSwap);
+    }
+  } else {
+    ioSlot slot(limiter);
+    h5Guard guard;
+    H5::DataSpace filespace;
+    H5::DataSpace mspace;
+    select_slices(*h5Data, dim, position, n2, filespace, mspace);
+    h5Data->read(buffer, H5::PredType::NATIVE_FLOAT, mspace, filespace);
+  }
+  position += n2;
+}
+
+void volumeReader::get_range(float& minVal, float& maxVal, const std::size_t memoryBudget) {
+  check_open();
+  const std::size_t depth =
+      std::min(dim[2], get_slabDepth(get_sliceSize(), sizeof(float) + get_bytesPerVoxel(), memoryBudget));
+  std::vector<float> slab(depth * get_sliceSize());
+
+  minVal = 0.0f;
+  maxVal = 0.0f;
+  bool flagFirst = true;
+  rewind();
+  while (position < dim[2]) {
+    const std::size_t n2 = std::min(depth, dim[2] - position);
+    read_slices(slab.data(), n2);
+    const auto range = std::minmax_element(slab.begin(), slab.begin() + n2 * get_sliceSize());
+    if (flagFirst || (*range.first < minVal)) minVal = *range.first;
+    if (flagFirst || (*range.second > maxVal)) maxVal = *range.second;
+    flagFirst = false;
+  }
+  rewind();
+}
+
+std::size_t volumeReader::get_bytesPerVoxel() const {
+  if (format == StreamFormat::NII) return typeConversion::get_bytesPerVoxel(info.datatype);
+  h5Guard guard;
+  return (h5Data != nullptr) ? h5Data->getDataType().getSize() : sizeof(float);
+}
+
+void volumeReader::check_open() const {
+  if (format == StreamFormat::NONE) {
+    printf("No file opened for streaming\n");
+    throw std::runtime_error("InvalidOperation");
+  }
+}
+
+volumeWriter::volumeWriter()
+    : baseClass("volumeWriter"), processor_count(std::thread::hardware_concurrency()) {}
+
+volumeWriter::~volumeWriter() {
+  // an incomplete file is not finished here, the caller is expected to call close
+  niiOut.reset();
+  h5Guard guard;
+  h5Data.reset();
+  h5File.reset();
+}
+
+void volumeWriter::create(const std::string& _filePath,
+                          const std::size_t* _dim,
+                          const float* _res,
+                          const float* _origin) {
+  niiOut.reset();
+  h5Guard guard;
+  h5Data.reset();
+  h5File.reset();
+  format = get_format(_filePath);
+
+  for (uint8_t iDim = 0; iDim < 3; iDim++)
+    dim[iDim] = _dim[iDim];
+
+  if (format == StreamFormat::NII) {
+    const int level = (compressionLevel < 0) ? NII_DEFAULT_LEVEL : compressionLevel;
+    niiOut = std::make_unique<niiSink>(_filePath, level);
+    niiOut->write_header(hdr,
+                         dim,
+                         _res,
+                         datatype,
+                         sclSlope,
+                         sclInter,
+                         typeConversion::needs_swap(niiByteOrder));
+  } else {
+    if ((datatype != DT_FLOAT) && (datatype != DT_DOUBLE)) {
+      printf("h5 files can only be streamed as float or double\n");
+      throw std::runtime_error("InvalidValue");
+    }
+
+    // same meta information as a volume saved by volume::save_h5
+    h5File = std::make_unique<H5::H5File>(_filePath, H5F_ACC_TRUNC);
+    const hsize_t col_dims = 3;
+    H5::DataSpace mspace(1, &col_dims);
+    H5::DataSet resDataset = h5File->createDataSet("dr", H5::PredType::NATIVE_FLOAT, mspace);
+    resDataset.write(_res, H5::PredType::NATIVE_FLOAT);
+    H5::DataSet originDataset = h5File->createDataSet("origin", H5::PredType::NATIVE_FLOAT, mspace);
+    originDataset.write(_origin, H5::PredType::NATIVE_FLOAT);
+    H5::DataSet dimDataset = h5File->createDataSet("dim", H5::PredType::NATIVE_UINT, mspace);
+    dimDataset.write(dim, H5::PredType::NATIVE_UINT64);
+
+    h5Chunks::get_chunkDim(dim, requestedChunkDim, chunkDim);
+    const int level = std::max(compressionLevel, 0);
+    h5Chunks::create(*h5File,
+                     "vol",
+                     dim,
+                     chunkDim,
+                     level,
+                     flagShuffle,
+                     (datatype == DT_DOUBLE) ? H5::PredType::NATIVE_DOUBLE
+                                             : H5::PredType::NATIVE_FLOAT);
+    h5Data = std::make_unique<H5::DataSet>(open_layerCached(*h5File, dim));
+  }
+
+  filePath = _filePath;
+  position = 0;
+}
+
+void volumeWriter::write_slices(const float* buffer, const std::size_t n2) {
+  TRACE_SCOPE("write_slices", "stream");
+  check_open();
+  if (position + n2 > dim[2]) {
+    printf("Writing slices %lu to %lu exceeds the volume (%lu slices)\n",
+           position,
+           position + n2,
+           dim[2]);
+    throw std::runtime_error("InvalidValue");
+  }
+
+  const std::size_t nElements = n2 * dim[0] * dim[1];
+  if (format == StreamFormat::NII) {
+    const bool flagSwap = typeConversion::needs_swap(niiByteOrder);
+    const bool flagScale = (sclSlope != 1.0f) || (sclInter != 0.0f);
+    if ((datatype == DT_FLOAT) && !flagSwap && !flagScale) {
+      ioSlot slot(limiter);
+      niiOut->write(buffer, nElements * sizeof(float));
+    } else {
+      raw.resize(nElements * get_bytesPerVoxel());
+      typeConversion::fromFloat(
+          buffer, raw.data(), nElements, datatype, sclSlope, sclInter, processor_count, flagSwap);
+      ioSlot slot(limiter);
+      niiOut->write(raw.data(), raw.size());
+    }
+  } else {
+    // slabs covering whole chunks are compressed by us in parallel, everything else goes
+    // through the library and its chunk cache
+    const std::size_t alignment = get_sliceAlignment();
+    const bool flagAligned =
+        (position % chunkDim[2] == 0) && ((n2 % chunkDim[2] == 0) || (position + n2 == dim[2]));
+    if ((alignment > 1) && flagAligned && (n2 > 0)) {
+      const std::size_t slabDim[3] = {dim[0], dim[1], n2};
+      h5Chunks::write_chunks(*h5Data,
+                             buffer,
+                             slabDim,
+                             chunkDim,
+                             compressionLevel,
+                             flagShuffle,
+                             processor_count,
+                             -1,
+                             nullptr,
+                             position,
+                             [&](const std::function<void()>& store) {
+                               // compression stays outside, other jobs keep compressing
+                               ioSlot slot(limiter);
+                               h5Guard guard;
+                               store();
+                             });
+    } else if (n2 > 0) {
+      ioSlot slot(limiter);
+      h5Guard guard;
+      H5::DataSpace filespace;
+      H5::DataSpace mspace;
+      select_slices(*h5Data, dim, position, n2, filespace, mspace);
+      h5Data->write(buffer, H5::PredType::NATIVE_FLOAT, mspace, filespace);
+    }
+  }
+  position += n2;
+}
+
+void volumeWriter::close() {
+  if (format == StreamFormat::NONE) return;
+
+  const bool flagComplete = (position == dim[2]);
+  if (niiOut != nullptr) niiOut->close();
+  niiOut.reset();
+  {
+    h5Guard guard;
+    if (h5File != nullptr) h5File->flush(H5F_SCOPE_LOCAL);
+    h5Data.reset();
+    h5File.reset();
+  }
+  format = StreamFormat::NONE;
+
+  if (!flagComplete) {
+    printf("Only %lu of %lu slices were written to %s\n", position, dim[2], filePath.c_str());
+    throw std::runtime_error("InvalidSize");
+  }
+}
+
+void volumeWriter::write_from(volumeReader& reader, const std::size_t memoryBudget) {
+  check_open();
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if (reader.get_dim(iDim) != dim[iDim]) {
+      printf("Input and output dimensions differ along dim %d (%lu vs %lu)\n",
+             iDim,
+             reader.get_dim(iDim),
+             dim[iDim]);
+      throw std::runtime_error("InvalidSize");
+    }
+  }
+
+  // two float slabs plus the file bytes converted by reader and writer
+  const std::size_t sliceSize = dim[0] * dim[1];
+  const std::size_t bytesPerVoxel =
+      2 * sizeof(float) + reader.get_bytesPerVoxel() + get_bytesPerVoxel();
+  std::size_t depth = get_slabDepth(sliceSize, bytesPerVoxel, memoryBudget);
+  const std::size_t alignment = get_sliceAlignment();
+  depth = std::max(alignment, (depth / alignment) * alignment);
+  depth = std::max<std::size_t>(1, std::min(depth, dim[2]));
+
+  std::vector<float> slabs[2];
+  slabs[0].resize(depth * sliceSize);
+  slabs[1].resize(depth * sliceSize);
+
+  std::exception_ptr readError = nullptr;
+  const auto fetch = [&](const uint8_t iBuf, const std::size_t n2) {
+    try {
+      reader.read_slices(slabs[iBuf].data(), n2);
+    } catch (...) {
+      readError = std::current_exception();
+    }
+  };
+
+  const std::size_t start = reader.get_position();
+  if (start != position) {
+    printf("Reader and writer are at different slices (%lu vs %lu)\n", start, position);
+    throw std::runtime_error("InvalidOperation");
+  }
+
+  // the next slab is read while the current one is converted and written
+  fetch(0, std::min(depth, dim[2] - start));
+  for (std::size_t start2 = start; start2 < dim[2]; start2 += depth) {
+    const uint8_t iCurr = ((start2 - start) / depth) % 2;
+    const std::size_t n2 = std::min(depth, dim[2] - start2);
+    if (readError) std::rethrow_exception(readError);
+
+    std::thread readThread;
+    const std::size_t next2 = start2 + depth;
+    if (next2 < dim[2]) readThread = std::thread(fetch, 1 - iCurr, std::min(depth, dim[2] - next2));
+
+    try {
+      write_slices(slabs[iCurr].data(), n2);
+    } catch (...) {
+      if (readThread.joinable()) readThread.join();
+      throw;
+    }
+
+    if (readThread.joinable()) readThread.join();
+  }
+  if (readError) std::rethrow_exception(readError);
+}
+
+std::size_t volumeWriter::get_sliceAlignment() const {
+  const bool flagDirect = (format == StreamFormat::H5) && (compressionLevel > 0) &&
+                          (datatype == DT_FLOAT) && h5Chunks::has_directChunks();
+  return flagDirect ? chunkDim[2] : 1;
+}
+
+void volumeWriter::set_datatype(const int _datatype) {
+  if (!typeConversion::is_supported(_datatype)) {
+    printf("Data type %d is not supported\n", _datatype);
+    throw std::runtime_error("InvalidValue");
+  }
+  datatype = _datatype;
+}
+
+void volumeWriter::set_scaling(const float _slope, const float _inter) {
+  if (_slope == 0.0f) {
+    printf("Scaling slope cannot be zero\n");
+    throw std::runtime_error("InvalidValue");
+  }
+  sclSlope = _slope;
+  sclInter = _inter;
+}
+
+void volumeWriter::set_chunkDim(const std::size_t n0, const std::size_t n1, const std::size_t n2) {
+  requestedChunkDim[0] = n0;
+  requestedChunkDim[1] = n1;
+  requestedChunkDim[2] = n2;
+}
+
+std::size_t volumeWriter::get_bytesPerVoxel() const {
+  return typeConversion::get_bytesPerVoxel(datatype);
+}
+
+void volumeWriter::check_open() const {
+  if (format == StreamFormat::NONE) {
+    printf("No file created for streaming\n");
+    throw std::runtime_error("InvalidOperation");
+  }
+}
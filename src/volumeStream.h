@@ -0,0 +1,198 @@
+/*
+  File: volumeStream.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: slab wise reading and writing of volumes which do not need to
+  fit into memory. Slabs are stacks of whole slices along dim2 and are moved
+  strictly front to back, which is the only access pattern a gzip stream
+  supports. volumeReader turns nii (any supported datatype and byte order,
+  plain or gzip compressed) and h5 files into float slabs, volumeWriter turns
+  float slabs back into nii files of a chosen datatype or chunked h5 files.
+*/
+
+#ifndef VOLUMESTREAM_H
+#define VOLUMESTREAM_H
+
+#include "baseClass.h"
+#include "niiFile.h"
+#include "typeConversion.h"
+#include <H5Cpp.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class StreamFormat { NONE, NII, H5 };
+
+/// \brief limits how many streams access their files at the same time, shared between the
+/// readers and writers of concurrent conversions
+class ioLimiter {
+public:
+  explicit ioLimiter(const std::size_t _nSlots);
+
+  void acquire();
+  void release();
+
+private:
+  std::mutex slotMutex;
+  std::condition_variable slotFreed;
+  std::size_t nFree;
+};
+
+class volumeReader : public baseClass {
+
+public:
+  volumeReader();
+  ~volumeReader();
+
+  volumeReader(const volumeReader&) = delete;
+  volumeReader& operator=(const volumeReader&) = delete;
+
+  /// \brief opens a nii, nii.gz or h5 file and positions the reader at the first slice
+  void open(const std::string& _filePath);
+  void close();
+
+  /// \brief moves back to the first slice, compressed files are reopened
+  void rewind();
+
+  /// \brief reads the next n2 slices as floats with scaling applied
+  /// \param buffer output array holding n2 * dim0 * dim1 elements
+  void read_slices(float* buffer, const std::size_t n2);
+
+  /// \brief streams through all slices to find the smallest and largest value, then rewinds
+  /// \param memoryBudget bytes used for the slab buffer
+  void get_range(float& minVal, float& maxVal, const std::size_t memoryBudget);
+
+  [[nodiscard]] std::size_t get_dim(const std::size_t _dim) const { return dim[_dim]; }
+  [[nodiscard]] const std::size_t* get_pdim() const { return dim; }
+  [[nodiscard]] float get_res(const std::size_t _dim) const { return res[_dim]; }
+  [[nodiscard]] const float* get_pres() const { return res; }
+  [[nodiscard]] float get_origin(const std::size_t _dim) const { return origin[_dim]; }
+  [[nodiscard]] const float* get_porigin() const { return origin; }
+  [[nodiscard]] std::size_t get_sliceSize() const { return dim[0] * dim[1]; }
+  /// \brief number of slices read so far
+  [[nodiscard]] std::size_t get_position() const { return position; }
+  /// \brief bytes a single voxel occupies in the file
+  [[nodiscard]] std::size_t get_bytesPerVoxel() const;
+  /// \brief header of a nii input, zero initialized for h5 files
+  [[nodiscard]] const nifti_1_header& get_niiHeader() const { return hdr; }
+
+  /// \brief file accesses wait for a free slot of the limiter, nullptr disables the limit
+  void set_ioLimiter(ioLimiter* _limiter) { limiter = _limiter; }
+
+private:
+  void check_open() const;
+
+  ioLimiter* limiter = nullptr;
+
+  std::string filePath;
+  StreamFormat format = StreamFormat::NONE;
+  std::size_t dim[3] = {0, 0, 0};
+  float res[3] = {1.0f, 1.0f, 1.0f};
+  float origin[3] = {0.0f, 0.0f, 0.0f};
+  std::size_t position = 0;
+
+  // nii input
+  std::unique_ptr<niiSource> niiIn;
+  niiInfo info;
+  nifti_1_header hdr = {};
+  std::vector<unsigned char> raw; // file bytes of a slab if they need conversion
+
+  // h5 input
+  std::unique_ptr<H5::H5File> h5File;
+  std::unique_ptr<H5::DataSet> h5Data;
+
+  const int processor_count; //!< number of CPU processing units
+};
+
+class volumeWriter : public baseClass {
+
+public:
+  volumeWriter();
+  ~volumeWriter();
+
+  volumeWriter(const volumeWriter&) = delete;
+  volumeWriter& operator=(const volumeWriter&) = delete;
+
+  /// \brief creates a nii, nii.gz or h5 file, an existing file is overwritten
+  /// \param _dim dimensions of the volume to write
+  /// \param _res resolution of the volume
+  /// \param _origin origin of the volume (h5 only, nii files have no origin field)
+  void create(const std::string& _filePath,
+              const std::size_t* _dim,
+              const float* _res,
+              const float* _origin);
+
+  /// \brief appends the next n2 slices
+  /// \param buffer input array holding n2 * dim0 * dim1 elements
+  void write_slices(const float* buffer, const std::size_t n2);
+
+  /// \brief finishes the file, throws if not all slices were written
+  void close();
+
+  /// \brief streams all remaining slices of reader into this file
+  /// \details two slab buffers are used: the next slab is read in the background while the
+  /// current one is converted and written, so memory use is bounded by the budget
+  /// \param memoryBudget bytes to spend on slab buffers
+  void write_from(volumeReader& reader, const std::size_t memoryBudget);
+
+  /// \brief slab depth along dim2 that lets h5 chunks be compressed in parallel, 1 otherwise
+  [[nodiscard]] std::size_t get_sliceAlignment() const;
+
+  /// \brief number of slices written so far
+  [[nodiscard]] std::size_t get_position() const { return position; }
+
+  // output options, only used by create
+  /// \brief NIfTI datatype code (DT_*) of nii output, h5 output supports DT_FLOAT and DT_DOUBLE
+  void set_datatype(const int _datatype);
+  /// \brief nii values are stored as (value - inter) / slope, used for integer datatypes
+  void set_scaling(const float _slope, const float _inter);
+  /// \brief zlib level for nii.gz and deflate level for h5 (0 disables h5 compression)
+  void set_compressionLevel(const int _level) { compressionLevel = _level; }
+  void set_shuffle(const bool _flagShuffle) { flagShuffle = _flagShuffle; }
+  /// \brief h5 chunk shape in volume order, zeros are chosen automatically
+  void set_chunkDim(const std::size_t n0, const std::size_t n1, const std::size_t n2);
+  void set_niiByteOrder(const ByteOrder _order) { niiByteOrder = _order; }
+  /// \brief template for all nii header fields not derived from the volume
+  void set_niiHeader(const nifti_1_header& _hdr) { hdr = _hdr; }
+
+  [[nodiscard]] int get_datatype() const { return datatype; }
+  [[nodiscard]] std::size_t get_bytesPerVoxel() const;
+
+  /// \brief file accesses wait for a free slot of the limiter, nullptr disables the limit
+  void set_ioLimiter(ioLimiter* _limiter) { limiter = _limiter; }
+
+private:
+  void check_open() const;
+
+  ioLimiter* limiter = nullptr;
+
+  std::string filePath;
+  StreamFormat format = StreamFormat::NONE;
+  std::size_t dim[3] = {0, 0, 0};
+  std::size_t position = 0;
+
+  int datatype = DT_FLOAT;
+  float sclSlope = 1.0f;
+  float sclInter = 0.0f;
+  int compressionLevel = -1; // -1 keeps the default of each format
+  bool flagShuffle = true;
+  std::size_t requestedChunkDim[3] = {0, 0, 0};
+  std::size_t chunkDim[3] = {0, 0, 0};
+  ByteOrder niiByteOrder = ByteOrder::NATIVE;
+  nifti_1_header hdr = {};
+
+  // nii output
+  std::unique_ptr<niiSink> niiOut;
+  std::vector<unsigned char> raw; // converted bytes of a slab
+
+  // h5 output
+  std::unique_ptr<H5::H5File> h5File;
+  std::unique_ptr<H5::DataSet> h5Data;
+
+  const int processor_count; //!< number of CPU processing units
+};
+
+#endif
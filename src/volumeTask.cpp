@@ -0,0 +1,42 @@
+#include "volumeTask.h"
+#include <cstdio>
+#include <stdexcept>
+
+void taskState::report(const std::size_t nDone, const std::size_t nTotal) {
+  if (flagCancel) throw std::runtime_error("Cancelled");
+
+  const float fraction = (nTotal == 0) ? 1.0f : (float)nDone / (float)nTotal;
+  progress = fraction;
+  if (callback) callback(fraction);
+}
+
+volumeTask::volumeTask(std::shared_ptr<taskState> _state, std::future<void>&& _future)
+    : state(std::move(_state)), future(std::move(_future)) {}
+
+volumeTask::~volumeTask() {
+  // the operation still uses the volume, do not let the handle outlive it silently
+  if (future.valid()) future.wait();
+}
+
+void volumeTask::wait() {
+  if (!future.valid()) {
+    printf("Task was already waited for or never started\n");
+    throw std::runtime_error("InvalidOperation");
+  }
+  future.get();
+}
+
+bool volumeTask::is_done() const {
+  return !future.valid() ||
+         (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+}
+
+bool volumeTask::wait_for(const std::chrono::milliseconds timeout) const {
+  return !future.valid() || (future.wait_for(timeout) == std::future_status::ready);
+}
+
+void volumeTask::cancel() {
+  if (state != nullptr) state->flagCancel = true;
+}
+
+float volumeTask::get_progress() const { return (state != nullptr) ? state->progress.load() : 1.0f; }
@@ -0,0 +1,66 @@
+/*
+  File: volumeTask.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: handle to a load or save operation running in the background.
+  The operation reports its progress after each chunk it moved and checks for
+  cancellation at the same points. Destroying the handle waits for the
+  operation to finish, so the volume involved can never be released while it
+  is still in use.
+*/
+
+#ifndef VOLUMETASK_H
+#define VOLUMETASK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+
+/// \brief called with the fraction of work done (0 ... 1) from the worker thread
+using progressCallback = std::function<void(float)>;
+
+/// \brief state shared between a task handle and the operation it observes
+struct taskState {
+  std::atomic<bool> flagCancel{false};
+  std::atomic<float> progress{0.0f};
+  progressCallback callback;
+
+  /// \brief records progress and aborts the operation if cancellation was requested
+  /// \throws std::runtime_error("Cancelled")
+  void report(const std::size_t nDone, const std::size_t nTotal);
+};
+
+class volumeTask {
+public:
+  volumeTask() = default;
+  volumeTask(std::shared_ptr<taskState> _state, std::future<void>&& _future);
+  ~volumeTask();
+
+  volumeTask(volumeTask&&) = default;
+  volumeTask& operator=(volumeTask&&) = default;
+
+  /// \brief blocks until the operation finished and rethrows its errors
+  /// \details a cancelled operation throws std::runtime_error("Cancelled")
+  void wait();
+
+  /// \brief returns true once the operation finished, failed or was cancelled
+  [[nodiscard]] bool is_done() const;
+  [[nodiscard]] bool wait_for(const std::chrono::milliseconds timeout) const;
+
+  /// \brief requests cancellation, the operation stops at the next chunk boundary
+  void cancel();
+
+  /// \brief fraction of work done (0 ... 1)
+  [[nodiscard]] float get_progress() const;
+  [[nodiscard]] bool valid() const { return future.valid(); }
+
+private:
+  std::shared_ptr<taskState> state;
+  std::future<void> future;
+};
+
+#endif
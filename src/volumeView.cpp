@@ -0,0 +1,314 @@
+#include "volumeView.h"
+#include "internalHelpers.h"
+#include "traceLog.h"
+#include "volume.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+volumeView::volumeView(volume& vol) {
+  pin = vol.pin_data(); // takes the array over from copies sharing it
+  float* base = pin.get_ptr();
+  const std::size_t startIdx[3] = {0, 0, 0};
+  const std::size_t stopIdx[3] = {vol.get_dim(0) - 1, vol.get_dim(1) - 1, vol.get_dim(2) - 1};
+  init(vol, startIdx, stopIdx);
+  wData = base;
+}
+
+volumeView::volumeView(const volume& vol) {
+  const std::size_t startIdx[3] = {0, 0, 0};
+  const std::size_t stopIdx[3] = {vol.get_dim(0) - 1, vol.get_dim(1) - 1, vol.get_dim(2) - 1};
+  init(vol, startIdx, stopIdx);
+}
+
+volumeView::volumeView(volume& vol, const std::size_t* startIdx, const std::size_t* stopIdx) {
+  pin = vol.pin_data();
+  float* base = pin.get_ptr();
+  init(vol, startIdx, stopIdx);
+  wData = base + (cData - static_cast<const volume&>(vol).get_pdata());
+}
+
+volumeView::volumeView(const volume& vol, const std::size_t* startIdx, const std::size_t* stopIdx) {
+  init(vol, startIdx, stopIdx);
+}
+
+volumeView::volumeView(const volumeView& parent,
+                       const std::size_t* startIdx,
+                       const std::size_t* stopIdx) {
+  std::size_t offset = 0;
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if ((startIdx[iDim] > stopIdx[iDim]) || (stopIdx[iDim] >= parent.dim[iDim])) {
+      printf("Box %lu ... %lu exceeds the view along dim %d (%lu elements)\n",
+             startIdx[iDim],
+             stopIdx[iDim],
+             iDim,
+             parent.dim[iDim]);
+      throw std::runtime_error("InvalidValue");
+    }
+    dim[iDim] = stopIdx[iDim] - startIdx[iDim] + 1;
+    stride[iDim] = parent.stride[iDim];
+    res[iDim] = parent.res[iDim];
+    origin[iDim] = parent.origin[iDim] + res[iDim] * (float)startIdx[iDim];
+    offset += startIdx[iDim] * stride[iDim];
+  }
+  cData = parent.cData + offset;
+  wData = (parent.wData != nullptr) ? parent.wData + offset : nullptr;
+  pin = parent.pin;
+  nThreads = parent.nThreads;
+}
+
+void volumeView::init(const volume& vol, const std::size_t* startIdx, const std::size_t* stopIdx) {
+  const std::size_t volDim[3] = {vol.get_dim(0), vol.get_dim(1), vol.get_dim(2)};
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if ((volDim[iDim] == 0) || (startIdx[iDim] > stopIdx[iDim]) ||
+        (stopIdx[iDim] >= volDim[iDim])) {
+      printf("Box %lu ... %lu exceeds the volume along dim %d (%lu elements)\n",
+             startIdx[iDim],
+             stopIdx[iDim],
+             iDim,
+             volDim[iDim]);
+      throw std::runtime_error("InvalidValue");
+    }
+    dim[iDim] = stopIdx[iDim] - startIdx[iDim] + 1;
+    res[iDim] = vol.get_res(iDim);
+    origin[iDim] = vol.get_origin(iDim) + res[iDim] * (float)startIdx[iDim];
+  }
+  stride[0] = 1;
+  stride[1] = volDim[0];
+  stride[2] = volDim[0] * volDim[1];
+  cData = vol.get_pdata() + startIdx[0] + stride[1] * startIdx[1] + stride[2] * startIdx[2];
+  nThreads = vol.get_nThreads();
+}
+
+bool volumeView::is_contiguous() const {
+  // full rows and, unless there is only one slice, full slices
+  return (dim[0] == stride[1]) && ((dim[2] == 1) || (dim[0] * dim[1] == stride[2]));
+}
+
+void volumeView::set_nThreads(const int _nThreads) {
+  if (_nThreads < 0) {
+    printf("Number of threads cannot be negative\n");
+    throw std::runtime_error("InvalidValue");
+  }
+  nThreads = (_nThreads == 0) ? std::thread::hardware_concurrency() : _nThreads;
+}
+
+float volumeView::get_value(const std::size_t i0, const std::size_t i1, const std::size_t i2) const {
+  return cData[i0 + stride[1] * i1 + stride[2] * i2];
+}
+
+void volumeView::set_value(const std::size_t i0,
+                           const std::size_t i1,
+                           const std::size_t i2,
+                           const float value) {
+  check_writable();
+  wData[i0 + stride[1] * i1 + stride[2] * i2] = value;
+}
+
+const float* volumeView::get_prow(const std::size_t i1, const std::size_t i2) const {
+  return cData + stride[1] * i1 + stride[2] * i2;
+}
+
+float* volumeView::get_prow(const std::size_t i1, const std::size_t i2) {
+  check_writable();
+  return wData + stride[1] * i1 + stride[2] * i2;
+}
+
+void volumeView::check_writable() const {
+  if (wData == nullptr) {
+    printf("View of a const volume cannot be written to\n");
+    throw std::runtime_error("InvalidOperation");
+  }
+}
+
+void volumeView::check_sameDim(const volumeView& viewB) const {
+  for (uint8_t iDim = 0; iDim < 3; iDim++) {
+    if (dim[iDim] != viewB.dim[iDim]) {
+      printf("Views differ along dim %d (%lu vs %lu elements)\n", iDim, dim[iDim], viewB.dim[iDim]);
+      throw std::runtime_error("InvalidSize");
+    }
+  }
+}
+
+// true if both views touch the same memory in a different arrangement, element wise
+// operations would then read voxels they already modified
+bool volumeView::overlaps(const volumeView& viewB) const {
+  const float* lastA = get_prow(dim[1] - 1, dim[2] - 1) + dim[0];
+  const float* lastB = viewB.get_prow(viewB.dim[1] - 1, viewB.dim[2] - 1) + viewB.dim[0];
+  if ((lastA <= viewB.cData) || (lastB <= cData)) return false;
+  const bool flagIdentical =
+      (cData == viewB.cData) && (stride[1] == viewB.stride[1]) && (stride[2] == viewB.stride[2]);
+  return !flagIdentical;
+}
+
+// calls func(i1, i2) for all rows of the box, rows are split into one block per thread
+template <typename F> void volumeView::for_rows(const F& func) const {
+  const std::size_t nRows = dim[1] * dim[2];
+  const std::size_t nJobs = std::min<std::size_t>(nRows, std::max(nThreads, 1));
+  run_parallel(nJobs, nJobs, [&](const std::size_t iJob) {
+    const std::size_t rowStop = nRows * (iJob + 1) / nJobs;
+    for (std::size_t iRow = nRows * iJob / nJobs; iRow < rowStop; iRow++)
+      func(iRow % dim[1], iRow / dim[1]);
+  });
+}
+
+template <typename F> volumeView& volumeView::apply(const volumeView& viewB, const F& op) {
+  check_writable();
+  check_sameDim(viewB);
+  if (overlaps(viewB)) {
+    const volume copyB = viewB.materialize();
+    return apply(volumeView(copyB), op);
+  }
+
+  for_rows([&](const std::size_t i1, const std::size_t i2) {
+    float* rowA = wData + stride[1] * i1 + stride[2] * i2;
+    const float* rowB = viewB.get_prow(i1, i2);
+    for (std::size_t i0 = 0; i0 < dim[0]; i0++)
+      rowA[i0] = op(rowA[i0], rowB[i0]);
+  });
+  return *this;
+}
+
+void volumeView::fill(const float value) {
+  TRACE_SCOPE("volumeView fill", "view");
+  check_writable();
+  for_rows([&](const std::size_t i1, const std::size_t i2) {
+    std::fill_n(wData + stride[1] * i1 + stride[2] * i2, dim[0], value);
+  });
+}
+
+volumeView& volumeView::operator*=(const float multVal) {
+  TRACE_SCOPE("volumeView operator*=", "view");
+  check_writable();
+  for_rows([&](const std::size_t i1, const std::size_t i2) {
+    float* row = wData + stride[1] * i1 + stride[2] * i2;
+    for (std::size_t i0 = 0; i0 < dim[0]; i0++)
+      row[i0] *= multVal;
+  });
+  return *this;
+}
+
+volumeView& volumeView::operator/=(const float divVal) { return (*this *= (1.0f / divVal)); }
+
+volumeView& volumeView::operator+=(const float addVal) {
+  TRACE_SCOPE("volumeView operator+=", "view");
+  check_writable();
+  for_rows([&](const std::size_t i1, const std::size_t i2) {
+    float* row = wData + stride[1] * i1 + stride[2] * i2;
+    for (std::size_t i0 = 0; i0 < dim[0]; i0++)
+      row[i0] += addVal;
+  });
+  return *this;
+}
+
+volumeView& volumeView::operator-=(const float subsVal) { return (*this += (-subsVal)); }
+
+volumeView& volumeView::operator*=(const volumeView& viewB) {
+  TRACE_SCOPE("volumeView operator*=", "view");
+  return apply(viewB, [](const float a, const float b) { return a * b; });
+}
+
+volumeView& volumeView::operator/=(const volumeView& viewB) {
+  TRACE_SCOPE("volumeView operator/=", "view");
+  return apply(viewB, [](const float a, const float b) { return a / b; });
+}
+
+volumeView& volumeView::operator+=(const volumeView& viewB) {
+  TRACE_SCOPE("volumeView operator+=", "view");
+  return apply(viewB, [](const float a, const float b) { return a + b; });
+}
+
+volumeView& volumeView::operator-=(const volumeView& viewB) {
+  TRACE_SCOPE("volumeView operator-=", "view");
+  return apply(viewB, [](const float a, const float b) { return a - b; });
+}
+
+void volumeView::calcMinMax() {
+  TRACE_SCOPE("volumeView calcMinMax", "view");
+  const volumeView& self = *this; // reading rows must not require a writable view
+  const std::size_t nRows = dim[1] * dim[2];
+  const std::size_t nJobs = std::min<std::size_t>(nRows, std::max(nThreads, 1));
+  std::vector<float> localMin(nJobs, cData[0]);
+  std::vector<float> localMax(nJobs, cData[0]);
+  run_parallel(nJobs, nJobs, [&](const std::size_t iJob) {
+    const std::size_t rowStop = nRows * (iJob + 1) / nJobs;
+    for (std::size_t iRow = nRows * iJob / nJobs; iRow < rowStop; iRow++) {
+      const float* row = self.get_prow(iRow % dim[1], iRow / dim[1]);
+      for (std::size_t i0 = 0; i0 < dim[0]; i0++) {
+        localMin[iJob] = std::min(localMin[iJob], row[i0]);
+        localMax[iJob] = std::max(localMax[iJob], row[i0]);
+      }
+    }
+  });
+
+  minVal = *std::min_element(localMin.begin(), localMin.end());
+  maxVal = *std::max_element(localMax.begin(), localMax.end());
+  maxAbsVal = std::max(std::abs(minVal), std::abs(maxVal));
+}
+
+void volumeView::calcMips() {
+  TRACE_SCOPE("volumeView calcMips", "view");
+  const volumeView& self = *this;
+  mipZ.assign(dim[1] * dim[2], 0.0f);
+  mipX.assign(dim[0] * dim[2], 0.0f);
+  mipY.assign(dim[0] * dim[1], 0.0f);
+
+  // along dim0: one value per row
+  for_rows([&](const std::size_t i1, const std::size_t i2) {
+    const float* row = self.get_prow(i1, i2);
+    float maxRow = 0.0f;
+    for (std::size_t i0 = 0; i0 < dim[0]; i0++)
+      maxRow = std::max(maxRow, std::abs(row[i0]));
+    mipZ[i1 + dim[1] * i2] = maxRow;
+  });
+
+  // along dim1: each slice i2 owns its output row
+  run_parallel(dim[2], nThreads, [&](const std::size_t i2) {
+    float* mipRow = mipX.data() + dim[0] * i2;
+    for (std::size_t i1 = 0; i1 < dim[1]; i1++) {
+      const float* row = self.get_prow(i1, i2);
+      for (std::size_t i0 = 0; i0 < dim[0]; i0++)
+        mipRow[i0] = std::max(mipRow[i0], std::abs(row[i0]));
+    }
+  });
+
+  // along dim2: each i1 owns its output column, rows are still read contiguously
+  run_parallel(dim[1], nThreads, [&](const std::size_t i1) {
+    for (std::size_t i2 = 0; i2 < dim[2]; i2++) {
+      const float* row = self.get_prow(i1, i2);
+      for (std::size_t i0 = 0; i0 < dim[0]; i0++) {
+        float& mipVal = mipY[i1 + dim[1] * i0];
+        mipVal = std::max(mipVal, std::abs(row[i0]));
+      }
+    }
+  });
+}
+
+void volumeView::copy_to(float* out) const {
+  TRACE_SCOPE("volumeView copy_to", "view");
+  for_rows([&](const std::size_t i1, const std::size_t i2) {
+    memcpy(out + dim[0] * (i1 + dim[1] * i2), get_prow(i1, i2), dim[0] * sizeof(float));
+  });
+}
+
+volume volumeView::materialize() const {
+  volume vol(dim[0], dim[1], dim[2]);
+  vol.set_res(res);
+  vol.set_origin(origin);
+  vol.set_nThreads(nThreads);
+  copy_to(vol.pin_data().get_ptr()); // a fresh volume, no need to leak its array
+  return vol;
+}
+
+void volumeView::saveToFile(const std::string& filePath) const {
+  materialize().saveToFile(filePath);
+}
+
+void volumeView::exportVti(const std::string& filePath,
+                           const int compressionLevel,
+                           const std::size_t nPieces) const {
+  materialize().exportVti(filePath, compressionLevel, nPieces);
+}
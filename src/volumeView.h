@@ -0,0 +1,126 @@
+/*
+  File: volumeView.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: non owning view of a box inside a volume. The view addresses
+  the voxels of its volume through strides, so cropping a region for
+  statistics, projections or element wise arithmetic never copies it.
+  materialize() copies the box into a compact volume in parallel once a
+  contiguous array is really needed, e.g. for the file writers.
+
+  A view is a handle like an iterator: it stays valid while its volume keeps
+  its shape and data array. Views of a non const volume are writable, they take
+  the array over from copies sharing it (copy on write) when they are created
+  and pin it, so copies of the volume made while the view exists get their own
+  array and never see writes through the view.
+*/
+
+#ifndef VOLUMEVIEW_H
+#define VOLUMEVIEW_H
+
+#include "volumeStorage.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class volume;
+
+class volumeView {
+public:
+  // whole volume
+  explicit volumeView(volume& vol);
+  explicit volumeView(const volume& vol);
+
+  /// \brief box between startIdx and stopIdx (inclusive), same semantics as volume::crop
+  volumeView(volume& vol, const std::size_t* startIdx, const std::size_t* stopIdx);
+  volumeView(const volume& vol, const std::size_t* startIdx, const std::size_t* stopIdx);
+
+  /// \brief box inside another view, indices are relative to that view
+  volumeView(const volumeView& parent, const std::size_t* startIdx, const std::size_t* stopIdx);
+
+  volumeView(const volumeView&) = default;
+  volumeView& operator=(const volumeView&) = delete; // would be ambiguous: handle or voxels
+
+  [[nodiscard]] std::size_t get_dim(const std::size_t iDim) const { return dim[iDim]; }
+  [[nodiscard]] const std::size_t* get_dim() const { return dim; }
+  [[nodiscard]] std::size_t get_nElements() const { return dim[0] * dim[1] * dim[2]; }
+  /// \brief distance in elements between neighbours along iDim in the underlying array
+  [[nodiscard]] std::size_t get_stride(const std::size_t iDim) const { return stride[iDim]; }
+  [[nodiscard]] float get_res(const std::size_t iDim) const { return res[iDim]; }
+  [[nodiscard]] float get_origin(const std::size_t iDim) const { return origin[iDim]; }
+  [[nodiscard]] bool is_writable() const { return wData != nullptr; }
+  /// \brief true if the box is one contiguous block of its volume
+  [[nodiscard]] bool is_contiguous() const;
+
+  void set_nThreads(const int _nThreads);
+  [[nodiscard]] int get_nThreads() const { return nThreads; }
+
+  [[nodiscard]] float get_value(std::size_t i0, std::size_t i1, std::size_t i2) const;
+  void set_value(std::size_t i0, std::size_t i1, std::size_t i2, const float value);
+
+  /// \brief first element of row (i1, i2), dim[0] elements follow contiguously
+  [[nodiscard]] const float* get_prow(std::size_t i1, std::size_t i2) const;
+  [[nodiscard]] float* get_prow(std::size_t i1, std::size_t i2);
+
+  // element wise arithmetic on the viewed voxels, both operands need the same dimensions
+  void fill(const float value);
+  volumeView& operator*=(const float multVal);
+  volumeView& operator/=(const float divVal);
+  volumeView& operator+=(const float addVal);
+  volumeView& operator-=(const float subsVal);
+  volumeView& operator*=(const volumeView& viewB);
+  volumeView& operator/=(const volumeView& viewB);
+  volumeView& operator+=(const volumeView& viewB);
+  volumeView& operator-=(const volumeView& viewB);
+
+  // statistics of the viewed voxels
+  void calcMinMax();
+  [[nodiscard]] float get_minVal() const { return minVal; }
+  [[nodiscard]] float get_maxVal() const { return maxVal; }
+  [[nodiscard]] float get_maxAbsVal() const { return maxAbsVal; }
+
+  // maximum intensity projections of the absolute values, same layout as those of volume
+  void calcMips();
+  [[nodiscard]] const float* get_mipZ() const { return mipZ.data(); } // along dim0
+  [[nodiscard]] const float* get_mipX() const { return mipX.data(); } // along dim1
+  [[nodiscard]] const float* get_mipY() const { return mipY.data(); } // along dim2
+
+  /// \brief copies the box into a compact volume with matching resolution and origin
+  [[nodiscard]] volume materialize() const;
+
+  /// \brief copies the box into a compact array of get_nElements() values
+  void copy_to(float* out) const;
+
+  // writers need a contiguous array, the box is materialized first
+  void saveToFile(const std::string& filePath) const;
+  void exportVti(const std::string& filePath,
+                 const int compressionLevel = 0,
+                 const std::size_t nPieces = 0) const;
+
+private:
+  void init(const volume& vol, const std::size_t* startIdx, const std::size_t* stopIdx);
+  void check_writable() const;
+  void check_sameDim(const volumeView& viewB) const;
+  [[nodiscard]] bool overlaps(const volumeView& viewB) const;
+  template <typename F> void for_rows(const F& func) const;
+  template <typename F> volumeView& apply(const volumeView& viewB, const F& op);
+
+  const float* cData = nullptr; // first voxel of the box
+  float* wData = nullptr;       // same as cData for writable views, nullptr otherwise
+  storagePin pin;               // keeps copies of the volume from sharing wData
+  std::size_t dim[3] = {0, 0, 0};
+  std::size_t stride[3] = {1, 0, 0};
+  float res[3] = {1.0f, 1.0f, 1.0f};
+  float origin[3] = {0.0f, 0.0f, 0.0f};
+  int nThreads = 1;
+
+  float minVal = 0.0f;
+  float maxVal = 0.0f;
+  float maxAbsVal = 0.0f;
+  std::vector<float> mipZ; // indexing: [i1 + dim1 * i2]
+  std::vector<float> mipX; // indexing: [i0 + dim0 * i2]
+  std::vector<float> mipY; // indexing: [i1 + dim1 * i0]
+};
+
+#endif
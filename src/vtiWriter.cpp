@@ -0,0 +1,278 @@
+#include "vtiWriter.h"
+#include "internalHelpers.h"
+#include "typeConversion.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+// a block of the appended data after compression
+struct vtiBlock {
+  std::vector<unsigned char> bytes;
+  bool flagSuccess = false;
+};
+
+// extent of the slices [start2, stop2] in the index space of the whole volume
+static std::string get_extent(const std::size_t* dim, const std::size_t start2, const std::size_t stop2) {
+  char extent[128];
+  snprintf(extent,
+           sizeof(extent),
+           "0 %lu 0 %lu %lu %lu",
+           (dim[0] > 0) ? dim[0] - 1 : 0,
+           (dim[1] > 0) ? dim[1] - 1 : 0,
+           start2,
+           stop2);
+  return extent;
+}
+
+// origin and spacing attributes shared by .vti and .pvti
+static std::string get_geometry(const float* res, const float* origin) {
+  char geometry[256];
+  snprintf(geometry,
+           sizeof(geometry),
+           "Origin=\"%.9g %.9g %.9g\" Spacing=\"%.9g %.9g %.9g\"",
+           origin[0],
+           origin[1],
+           origin[2],
+           res[0],
+           res[1],
+           res[2]);
+  return geometry;
+}
+
+static const char* get_byteOrder() {
+  return typeConversion::is_littleEndian() ? "LittleEndian" : "BigEndian";
+}
+
+void vtiWriter::set_blockSize(const std::size_t _blockSize) {
+  if (_blockSize < sizeof(float)) {
+    printf("Blocks need to hold at least one value\n");
+    throw std::runtime_error("InvalidValue");
+  }
+  blockSize = _blockSize;
+}
+
+void vtiWriter::set_nThreads(const std::size_t _nThreads) { nThreads = std::max<std::size_t>(1, _nThreads); }
+
+void vtiWriter::write_vti(const std::string& filePath,
+                          const float* data,
+                          const std::size_t* dim,
+                          const float* res,
+                          const float* origin) const {
+  const std::size_t stop2 = (dim[2] > 0) ? dim[2] - 1 : 0;
+  write_piece(filePath, data, dim, res, origin, 0, stop2, nThreads);
+}
+
+void vtiWriter::write_pvti(const std::string& filePath,
+                           const float* data,
+                           const std::size_t* dim,
+                           const float* res,
+                           const float* origin,
+                           const std::size_t nPieces) const {
+  if (nPieces == 0) {
+    printf("A pvti file needs at least one piece\n");
+    throw std::runtime_error("InvalidValue");
+  }
+
+  // pieces share their boundary slice, so we can have at most one piece per cell layer
+  const std::size_t nCells2 = (dim[2] > 1) ? dim[2] - 1 : 1;
+  const std::size_t nUsed = std::min(nPieces, nCells2);
+  std::vector<std::size_t> starts(nUsed + 1);
+  for (std::size_t iPiece = 0; iPiece <= nUsed; iPiece++)
+    starts[iPiece] = (iPiece * nCells2) / nUsed;
+  if (dim[2] <= 1) starts[nUsed] = 0;
+
+  const std::filesystem::path pvtiPath(filePath);
+  const std::string stem = pvtiPath.stem().string();
+  std::vector<std::string> sources(nUsed);
+  for (std::size_t iPiece = 0; iPiece < nUsed; iPiece++)
+    sources[iPiece] = stem + "_" + std::to_string(iPiece) + ".vti";
+
+  // each thread writes its own pieces, threads left over compress blocks within the pieces
+  const std::size_t nWorkers = std::min(nThreads, nUsed);
+  const std::size_t nThreadsPiece = std::max<std::size_t>(1, nThreads / nWorkers);
+  std::vector<std::exception_ptr> errors(nWorkers);
+  std::vector<std::thread> workers;
+  for (std::size_t iWorker = 0; iWorker < nWorkers; iWorker++) {
+    workers.push_back(std::thread([&, iWorker]() {
+      try {
+        for (std::size_t iPiece = iWorker; iPiece < nUsed; iPiece += nWorkers) {
+          const std::string piecePath = (pvtiPath.parent_path() / sources[iPiece]).string();
+          write_piece(
+              piecePath, data, dim, res, origin, starts[iPiece], starts[iPiece + 1], nThreadsPiece);
+        }
+      } catch (...) {
+        errors[iWorker] = std::current_exception();
+      }
+    }));
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+  for (const auto& error : errors)
+    if (error) std::rethrow_exception(error);
+
+  FILE* fp = fopen(filePath.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error opening file %s for write\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  std::string xml = "<?xml version=\"1.0\"?>\n";
+  xml += "<VTKFile type=\"PImageData\" version=\"1.0\" byte_order=\"" +
+         std::string(get_byteOrder()) + "\" header_type=\"UInt64\">\n";
+  xml += "  <PImageData WholeExtent=\"" + get_extent(dim, 0, (dim[2] > 0) ? dim[2] - 1 : 0) +
+         "\" GhostLevel=\"0\" " + get_geometry(res, origin) + ">\n";
+  xml += "    <PPointData Scalars=\"" + name + "\">\n";
+  xml += "      <PDataArray type=\"Float32\" Name=\"" + name + "\"/>\n";
+  xml += "    </PPointData>\n";
+  for (std::size_t iPiece = 0; iPiece < nUsed; iPiece++) {
+    xml += "    <Piece Extent=\"" + get_extent(dim, starts[iPiece], starts[iPiece + 1]) +
+           "\" Source=\"" + sources[iPiece] + "\"/>\n";
+  }
+  xml += "  </PImageData>\n</VTKFile>\n";
+
+  try {
+    write_bytes(fp, xml.data(), xml.size(), filePath);
+  } catch (...) {
+    fclose(fp);
+    throw;
+  }
+  if (fclose(fp) != 0) {
+    printf("Error closing %s\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
+
+void vtiWriter::write_piece(const std::string& filePath,
+                            const float* data,
+                            const std::size_t* dim,
+                            const float* res,
+                            const float* origin,
+                            const std::size_t start2,
+                            const std::size_t stop2,
+                            const std::size_t nThreadsPiece) const {
+  const std::size_t sliceSize = dim[0] * dim[1];
+  const std::size_t nElements = (dim[2] > 0) ? (stop2 - start2 + 1) * sliceSize : 0;
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data + start2 * sliceSize);
+  const std::size_t nBytes = nElements * sizeof(float);
+  const bool flagCompress = (compressionLevel > 0);
+
+  const std::string extent = get_extent(dim, start2, stop2);
+  std::string xml = "<?xml version=\"1.0\"?>\n";
+  xml += "<VTKFile type=\"ImageData\" version=\"1.0\" byte_order=\"" +
+         std::string(get_byteOrder()) + "\" header_type=\"UInt64\"";
+  if (flagCompress) xml += " compressor=\"vtkZLibDataCompressor\"";
+  xml += ">\n";
+  xml += "  <ImageData WholeExtent=\"" + extent + "\" " + get_geometry(res, origin) + ">\n";
+  xml += "    <Piece Extent=\"" + extent + "\">\n";
+  xml += "      <PointData Scalars=\"" + name + "\">\n";
+  xml += "        <DataArray type=\"Float32\" Name=\"" + name +
+         "\" format=\"appended\" offset=\"0\"/>\n";
+  xml += "      </PointData>\n";
+  xml += "    </Piece>\n";
+  xml += "  </ImageData>\n";
+  xml += "  <AppendedData encoding=\"raw\">\n   _";
+  const std::string footer = "\n  </AppendedData>\n</VTKFile>\n";
+
+  FILE* fp = fopen(filePath.c_str(), "wb");
+  if (fp == nullptr) {
+    printf("Error opening file %s for write\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+
+  try {
+    write_bytes(fp, xml.data(), xml.size(), filePath);
+    if (!flagCompress) {
+      // raw data is preceded by its size only
+      const uint64_t header = nBytes;
+      write_bytes(fp, &header, sizeof(header), filePath);
+      write_bytes(fp, bytes, nBytes, filePath);
+    } else {
+      // header: number of blocks, block size, size of the last block, compressed sizes
+      const std::size_t nBlocks = (nBytes + blockSize - 1) / blockSize;
+      std::vector<uint64_t> header(3 + nBlocks);
+      header[0] = nBlocks;
+      header[1] = blockSize;
+      header[2] = (nBlocks == 0) ? 0 : nBytes - (nBlocks - 1) * blockSize;
+      const long headerPos = ftell(fp);
+      write_bytes(fp, header.data(), header.size() * sizeof(uint64_t), filePath);
+
+      // the next batch of blocks is compressed while the current one is written
+      const std::size_t batchLength = 2 * nThreadsPiece;
+      const auto compress_batch = [&](const std::size_t batchStart, std::vector<vtiBlock>& batch) {
+        std::vector<std::thread> workers;
+        for (std::size_t iThread = 0; iThread < std::min(nThreadsPiece, batch.size()); iThread++) {
+          workers.push_back(std::thread([&, iThread]() {
+            for (std::size_t iBlock = iThread; iBlock < batch.size(); iBlock += nThreadsPiece) {
+              const std::size_t offset = (batchStart + iBlock) * blockSize;
+              const std::size_t nIn = std::min(blockSize, nBytes - offset);
+              uLongf nOut = compressBound(nIn);
+              vtiBlock& curr = batch[iBlock];
+              curr.bytes.resize(nOut);
+              curr.flagSuccess =
+                  (compress2(curr.bytes.data(), &nOut, bytes + offset, nIn, compressionLevel) == Z_OK);
+              curr.bytes.resize(nOut);
+            }
+          }));
+        }
+        for (auto& worker : workers)
+          worker.join();
+      };
+
+      std::vector<vtiBlock> batches[2];
+      batches[0].resize(std::min(batchLength, nBlocks));
+      compress_batch(0, batches[0]);
+      for (std::size_t batchStart = 0; batchStart < nBlocks; batchStart += batchLength) {
+        const uint8_t iCurr = (batchStart / batchLength) % 2;
+        const std::size_t nextStart = batchStart + batchLength;
+        std::thread compressor;
+        if (nextStart < nBlocks) {
+          batches[1 - iCurr].resize(std::min(batchLength, nBlocks - nextStart));
+          compressor = std::thread(compress_batch, nextStart, std::ref(batches[1 - iCurr]));
+        }
+
+        bool flagSuccess = true;
+        try {
+          for (std::size_t iBlock = 0; iBlock < batches[iCurr].size(); iBlock++) {
+            const vtiBlock& curr = batches[iCurr][iBlock];
+            flagSuccess = flagSuccess && curr.flagSuccess;
+            header[3 + batchStart + iBlock] = curr.bytes.size();
+            write_bytes(fp, curr.bytes.data(), curr.bytes.size(), filePath);
+          }
+        } catch (...) {
+          if (compressor.joinable()) compressor.join();
+          throw;
+        }
+
+        if (compressor.joinable()) compressor.join();
+        if (!flagSuccess) {
+          printf("Error compressing block of %s\n", filePath.c_str());
+          throw std::runtime_error("CompressionError");
+        }
+      }
+
+      // compressed sizes are only known now
+      const long endPos = ftell(fp);
+      if ((fseek(fp, headerPos, SEEK_SET) != 0)) {
+        printf("Error seeking in %s\n", filePath.c_str());
+        throw std::runtime_error("FileError");
+      }
+      write_bytes(fp, header.data(), header.size() * sizeof(uint64_t), filePath);
+      fseek(fp, endPos, SEEK_SET);
+    }
+    write_bytes(fp, footer.data(), footer.size(), filePath);
+  } catch (...) {
+    fclose(fp);
+    throw;
+  }
+
+  if (fclose(fp) != 0) {
+    printf("Error closing %s\n", filePath.c_str());
+    throw std::runtime_error("FileError");
+  }
+}
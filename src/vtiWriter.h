@@ -0,0 +1,65 @@
+/*
+  File: vtiWriter.h
+  Author: Urs Hofmann
+  Mail: mail@hofmannu.org
+
+  Description: export of volumes as VTK XML image data. Values are stored as
+  raw appended binary in the byte order of the machine, so nothing needs to be
+  swapped or base64 encoded. Optionally the data is split into blocks which are
+  deflated in parallel (vtkZLibDataCompressor). A .pvti file references
+  pieces along dim2 which are written by separate threads into .vti files
+  next to it.
+*/
+
+#ifndef VTIWRITER_H
+#define VTIWRITER_H
+
+#include <cstddef>
+#include <string>
+
+class vtiWriter {
+public:
+  /// \brief zlib level (1 ... 9) applied block by block, 0 writes the data uncompressed
+  void set_compressionLevel(const int _level) { compressionLevel = _level; }
+  /// \brief uncompressed size of the compressed blocks in bytes
+  void set_blockSize(const std::size_t _blockSize);
+  /// \brief number of threads compressing blocks or writing pieces
+  void set_nThreads(const std::size_t _nThreads);
+  /// \brief name of the point data array shown in ParaView
+  void set_name(const std::string& _name) { name = _name; }
+
+  /// \brief writes a volume into a single .vti file
+  /// \param data volume data, indexing i0 + dim0 * (i1 + dim1 * i2)
+  void write_vti(const std::string& filePath,
+                 const float* data,
+                 const std::size_t* dim,
+                 const float* res,
+                 const float* origin) const;
+
+  /// \brief writes a .pvti file and nPieces .vti pieces along dim2 named <stem>_<iPiece>.vti
+  /// \details neighbouring pieces share one slice so that no cells are missing in between
+  void write_pvti(const std::string& filePath,
+                  const float* data,
+                  const std::size_t* dim,
+                  const float* res,
+                  const float* origin,
+                  const std::size_t nPieces) const;
+
+private:
+  // writes the slices [start2, stop2] of a volume as one .vti file
+  void write_piece(const std::string& filePath,
+                   const float* data,
+                   const std::size_t* dim,
+                   const float* res,
+                   const float* origin,
+                   const std::size_t start2,
+                   const std::size_t stop2,
+                   const std::size_t nThreads) const;
+
+  int compressionLevel = 0;
+  std::size_t blockSize = 1 << 20;
+  std::size_t nThreads = 1;
+  std::string name = "volume";
+};
+
+#endif
@@ -1,4 +1,8 @@
 #include "vtkwriter.h"
+#include "typeConversion.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
 
 vtkwriter::vtkwriter()
 {
@@ -10,31 +14,199 @@ vtkwriter::vtkwriter()
 		flagLittleEndian = 0;
 }
 
-float ReverseFloat( const float inFloat )
+// structured points are moved in blocks of this many values, large enough for few write calls
+static const std::size_t VTK_BLOCK_SIZE = 1 << 22; // 16 MB of floats
+
+// writes the values of a structured points dataset, binary files are stored big endian:
+// the next block is swapped in parallel while the current one is written
+void vtkwriter::write_structuredPoints(ofstream& out, const std::size_t nEl) const
 {
-   float retVal;
-   char *floatToConvert = ( char* ) & inFloat;
-   char *returnFloat = ( char* ) & retVal;
+	const float* data = structPoints->data;
+	if (!flagBinary)
+	{
+		// one value per line, formatted block by block into a single buffer, nine
+		// significant digits let every float round-trip exactly
+		std::vector<char> text;
+		char value[32];
+		for (std::size_t startIdx = 0; startIdx < nEl; startIdx += VTK_BLOCK_SIZE / 4)
+		{
+			const std::size_t n = std::min(VTK_BLOCK_SIZE / 4, nEl - startIdx);
+			text.clear();
+			for (std::size_t iElement = 0; iElement < n; iElement++)
+			{
+				const int nChar = snprintf(value, sizeof(value), "%.9g\n", data[startIdx + iElement]);
+				text.insert(text.end(), value, value + nChar);
+			}
+			out.write(text.data(), text.size());
+		}
+		return;
+	}
+
+	// big endian machines write straight from the volume
+	if (!flagLittleEndian)
+	{
+		out.write(reinterpret_cast<const char*>(data), nEl * sizeof(float));
+		return;
+	}
+
+	std::vector<float> buffers[2];
+	buffers[0].resize(std::min(VTK_BLOCK_SIZE, nEl));
+	buffers[1].resize(std::min(VTK_BLOCK_SIZE, nEl));
+	const std::size_t nThreads = std::max<unsigned int>(1, std::thread::hardware_concurrency());
+	const auto swap_block = [&](const uint8_t iBuf, const std::size_t startIdx)
+	{
+		const std::size_t n = std::min(VTK_BLOCK_SIZE, nEl - startIdx);
+		typeConversion::swapCopy(data + startIdx, buffers[iBuf].data(), n, sizeof(float), nThreads);
+	};
 
-   // swap the bytes into a temporary buffer
-   returnFloat[0] = floatToConvert[3];
-   returnFloat[1] = floatToConvert[2];
-   returnFloat[2] = floatToConvert[1];
-   returnFloat[3] = floatToConvert[0];
+	if (nEl > 0)
+		swap_block(0, 0);
+	for (std::size_t startIdx = 0; startIdx < nEl; startIdx += VTK_BLOCK_SIZE)
+	{
+		const uint8_t iCurr = (startIdx / VTK_BLOCK_SIZE) % 2;
+		const std::size_t n = std::min(VTK_BLOCK_SIZE, nEl - startIdx);
+		std::thread swapper;
+		if (startIdx + VTK_BLOCK_SIZE < nEl)
+			swapper = std::thread(swap_block, 1 - iCurr, startIdx + VTK_BLOCK_SIZE);
+
+		out.write(reinterpret_cast<const char*>(buffers[iCurr].data()), n * sizeof(float));
 
-   return retVal;
+		if (swapper.joinable())
+			swapper.join();
+	}
 }
 
-void vtkwriter::write()
+// values of meshes are moved in blocks of this many 4 byte values
+static const std::size_t VTK_MESH_BLOCK_SIZE = 1 << 20;
+
+// writes nValues 4 byte values big endian, fill(startIdx, n, dest) provides them in native order;
+// each block is filled and swapped by several threads while the previous one is written
+template <typename T, typename F>
+static void write_bigEndian(ofstream& out, const std::size_t nValues, const bool flagSwap, const F& fill)
 {
-	ofstream out;
+	const std::size_t nThreads = std::max<unsigned int>(1, std::thread::hardware_concurrency());
+	std::vector<T> buffers[2];
+	const auto prepare = [&](const uint8_t iBuf, const std::size_t startIdx)
+	{
+		const std::size_t n = std::min(VTK_MESH_BLOCK_SIZE, nValues - startIdx);
+		buffers[iBuf].resize(n);
+		T* dest = buffers[iBuf].data();
+		const auto fill_range = [&](const std::size_t first, const std::size_t last)
+		{
+			fill(startIdx + first, last - first, dest + first);
+			if (flagSwap)
+				typeConversion::swapCopy(dest + first, dest + first, last - first, sizeof(T), 1);
+		};
 
-	// either open as binary or non binary
-	if (~flagBinary)
-		out.open(outputPath.c_str());
-	else
-		out.open(outputPath.c_str(), ios::binary);
+		std::vector<std::thread> workers;
+		const std::size_t nWorkers = std::min(nThreads, std::max<std::size_t>(1, n / 4096));
+		for (std::size_t iThread = 1; iThread < nWorkers; iThread++)
+			workers.push_back(std::thread(fill_range, (iThread * n) / nWorkers, ((iThread + 1) * n) / nWorkers));
+		fill_range(0, n / nWorkers);
+		for (auto& worker : workers)
+			worker.join();
+	};
+
+	if (nValues > 0)
+		prepare(0, 0);
+	for (std::size_t startIdx = 0; startIdx < nValues; startIdx += VTK_MESH_BLOCK_SIZE)
+	{
+		const uint8_t iCurr = (startIdx / VTK_MESH_BLOCK_SIZE) % 2;
+		std::thread preparer;
+		if (startIdx + VTK_MESH_BLOCK_SIZE < nValues)
+			preparer = std::thread(prepare, 1 - iCurr, startIdx + VTK_MESH_BLOCK_SIZE);
+
+		out.write(reinterpret_cast<const char*>(buffers[iCurr].data()), buffers[iCurr].size() * sizeof(T));
+
+		if (preparer.joinable())
+			preparer.join();
+	}
+}
+
+// writes the coordinates stored in three separate arrays as x y z triplets
+void vtkwriter::write_points(ofstream& out,
+	const std::size_t nPoints, const float* x, const float* y, const float* z) const
+{
+	const float* coords[3] = {x, y, z};
+	if (flagBinary)
+	{
+		write_bigEndian<float>(out, 3 * nPoints, flagLittleEndian,
+			[&](const std::size_t startIdx, const std::size_t n, float* dest)
+			{
+				for (std::size_t iValue = 0; iValue < n; iValue++)
+				{
+					const std::size_t idx = startIdx + iValue;
+					dest[iValue] = coords[idx % 3][idx / 3];
+				}
+			});
+		return;
+	}
+
+	std::string text;
+	char line[96];
+	for (std::size_t iPoint = 0; iPoint < nPoints; iPoint++)
+	{
+		const int nChar =
+			snprintf(line, sizeof(line), "%.9g %.9g %.9g\n", x[iPoint], y[iPoint], z[iPoint]);
+		text.append(line, nChar);
+		if (text.size() >= VTK_MESH_BLOCK_SIZE)
+		{
+			out.write(text.data(), text.size());
+			text.clear();
+		}
+	}
+	out.write(text.data(), text.size());
+}
+
+void vtkwriter::write_polygons(ofstream& out) const
+{
+	const std::size_t dimPolygon = polData->dimPolygon;
+	const std::size_t nConn = (std::size_t) polData->nPolygons * (dimPolygon + 1);
+	const unsigned int* ids = polData->idPolygons;
+	if (flagBinary)
+	{
+		write_bigEndian<uint32_t>(out, nConn, flagLittleEndian,
+			[&](const std::size_t startIdx, const std::size_t n, uint32_t* dest)
+			{
+				std::size_t iPol = startIdx / (dimPolygon + 1);
+				std::size_t iCorner = startIdx % (dimPolygon + 1);
+				for (std::size_t iValue = 0; iValue < n; iValue++)
+				{
+					dest[iValue] = (iCorner == 0) ? dimPolygon : ids[iCorner - 1 + iPol * dimPolygon];
+					if (++iCorner > dimPolygon)
+					{
+						iCorner = 0;
+						iPol++;
+					}
+				}
+			});
+		return;
+	}
+
+	std::string text;
+	char value[16];
+	for (std::size_t iPol = 0; iPol < polData->nPolygons; iPol++)
+	{
+		text.append(std::to_string(dimPolygon));
+		for (std::size_t iCorner = 0; iCorner < dimPolygon; iCorner++)
+		{
+			const int nChar = snprintf(value, sizeof(value), " %u", ids[iCorner + iPol * dimPolygon]);
+			text.append(value, nChar);
+		}
+		text.push_back('\n');
+		if (text.size() >= VTK_MESH_BLOCK_SIZE)
+		{
+			out.write(text.data(), text.size());
+			text.clear();
+		}
+	}
+	out.write(text.data(), text.size());
+}
 
+void vtkwriter::write()
+{
+	// always opened as binary, ascii content does not need any newline translation
+	ofstream out(outputPath.c_str(), ios::binary);
 	if (!out) // if file did not open we throw an error
 	{
 		throw "Could not open output file";
@@ -43,111 +215,78 @@ void vtkwriter::write()
 
 	// write file header which is the same for all types
 	out << "# vtk DataFile Version 2.0\n";
-	out << title << endl;
-	out << dataType << endl;
-	out << "DATASET " << type << endl;
-
-	unsigned int nEl;
+	out << title << "\n";
+	out << dataType << "\n";
+	out << "DATASET " << type << "\n";
 
 	if (idType == 0)
 	{
-			// fprintf(fid, 'DIMENSIONS %d %d %d\n', nx, ny, nz);
 			out << "DIMENSIONS ";
 			for (unsigned char iDim = 0; iDim < 3; iDim++)
 			{
 				out << structPoints->dim[iDim] << " ";
 			}
 
-		 //  //    fprintf(fid, ['SPACING ', num2str(sx), ' ', num2str(sy), ' ',...
-		 //  //      num2str(sz), '\n']);
-			out << endl << "SPACING ";
+			out << "\nSPACING ";
 			for (unsigned char iDim = 0; iDim < 3; iDim++)
 			{
 				out << structPoints->res[iDim] << " ";
 			}
-			
-		 //  //    fprintf(fid, ['ORIGIN ', num2str(ox), ' ', num2str(oy), ' ',...
-		 //  //      num2str(oz), '\n']); 
-			out << endl << "ORIGIN ";
+
+			out << "\nORIGIN ";
 			for (unsigned char iDim = 0; iDim < 3; iDim++)
 			{
 				out << structPoints->origin[iDim] << " ";
 			}
-			
-		 //  // fprintf(fid, 'POINT_DATA %d\n', nx*ny*nz);
-			nEl = 1;
+
+			std::size_t nEl = 1;
 			for (unsigned char iDim = 0; iDim < 3; iDim++)
 			{
 				nEl = nEl * structPoints->dim[iDim];
 			}
 
-			out << endl <<  "POINT_DATA " << nEl << endl;
-
-		  //  // fprintf(fid, ['SCALARS ', title, ' float 1\n']);
-		 	out << "SCALARS " << title << " float 1" << endl;
-
-		  //  // fprintf(fid,'LOOKUP_TABLE default\n');
-		 	out << "LOOKUP_TABLE default" << endl;
-		  
-		 	// check if system is little or big endian, if little we need to flip
-		 	for (unsigned int iElement = 0; iElement < nEl; iElement++)
-		  {
-		  	float currElement = structPoints->data[iElement];
-		  	
-		  	// invert number if necessary
-		  	if (flagLittleEndian)
-		  		currElement = ReverseFloat(currElement); 
-		  	
-		  	out.write( reinterpret_cast<char*>(&currElement), sizeof(float));
-		  }
-		  // NOTE: the approach below does not work because we require big endian here
-		  // out.write( reinterpret_cast<char*>(structPoints->data), nEl * sizeof(float));
-		  
+			out << "\nPOINT_DATA " << nEl << "\n";
+		 	out << "SCALARS " << title << " float 1\n";
+		 	out << "LOOKUP_TABLE default\n";
+			write_structuredPoints(out, nEl);
 	}else if (idType == 2){
 		// unstructured grid
 			if (flagVerbose)
 				cout << "Writing as unstructured grid" << endl;
-			
-			out << "POINTS " << unstrGrid->nPoints << " float" << endl;
-			for (unsigned  int iPoint = 0; iPoint < unstrGrid->nPoints; iPoint++){
-				out << unstrGrid->x[iPoint] << " " << 
-					unstrGrid->y[iPoint] << " " << 
-					unstrGrid->z[iPoint] << endl;
-			}
+
+			out << "POINTS " << unstrGrid->nPoints << " float\n";
+			write_points(out, unstrGrid->nPoints, unstrGrid->x, unstrGrid->y, unstrGrid->z);
 	}else if (idType == 3){
-		
+
 			if (flagVerbose)
 				cout << "Writing as polydata" << endl;
-			
-			out << "POINTS " << polData->nPoints << " float" << endl;
-			for (unsigned int iPoint = 0; iPoint < polData->nPoints; iPoint++){
-				out << polData->xPoints[iPoint] << " " << polData->yPoints[iPoint] << 
-					" " << polData->zPoints[iPoint] << endl;
-			}
-			unsigned int nConn = polData->nPolygons * (polData->dimPolygon + 1);
-			out << "POLYGONS " << polData->dimPolygon << " "  << nConn << endl; 
-			for (unsigned int iPol = 0; iPol < polData->nPolygons; iPol++){
-				out << polData->dimPolygon <<  " ";
-				for (unsigned int iDim = 0; iDim < polData->dimPolygon; iDim++){
-					out << polData->idPolygons[iDim + iPol * polData->dimPolygon] << " ";
-				}
-				out << endl;
-			}
-	}	
-	
+
+			out << "POINTS " << polData->nPoints << " float\n";
+			write_points(out, polData->nPoints, polData->xPoints, polData->yPoints, polData->zPoints);
+
+			// each polygon is stored as its number of corners followed by the point ids
+			const std::size_t nConn = (std::size_t) polData->nPolygons * (polData->dimPolygon + 1);
+			out << (flagBinary ? "\n" : "") << "POLYGONS " << polData->nPolygons << " " << nConn << "\n";
+			write_polygons(out);
+	}
+
 	out.close();
+	if (!out)
+		throw "Could not write output file";
 	return;
 }
 
 void vtkwriter::set_ascii()
 {
 	dataType = "ASCII";
+	flagBinary = 0;
 	return;
 }
 
 void vtkwriter::set_binary()
 {
 	dataType = "BINARY";
+	flagBinary = 1;
 	return;
 }
 
@@ -208,7 +347,6 @@ void vtkwriter::set_type(const string _type)
 	else
 		cerr << "Unknown type of dataset: " << _type << endl;
 
-	cout << idType << endl;
 	type = _type;
 	return;
 }
@@ -233,6 +371,7 @@ void vtkwriter::set_dataType(const string _dataType)
 	// ASCII
 	// BINARY
 	dataType = _dataType;
+	flagBinary = (dataType.compare("BINARY") == 0);
 	return;
 }
 
@@ -243,6 +382,7 @@ void vtkwriter::set_dataType(const char* _dataType, unsigned long length)
 	// ASCII
 	// BINARY
 	dataType = _dataType;
+	flagBinary = (dataType.compare("BINARY") == 0);
 	return;
 }
 
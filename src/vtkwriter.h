@@ -50,6 +50,11 @@ class vtkwriter{
 		void set_binary();
 	
 	private:
+		void write_structuredPoints(ofstream& out, const std::size_t nEl) const;
+		void write_points(ofstream& out, const std::size_t nPoints,
+			const float* x, const float* y, const float* z) const;
+		void write_polygons(ofstream& out) const;
+
 		unstructuredGrid* unstrGrid;
 		polydata* polData;
 		griddedData* structPoints;
@@ -1,39 +1,423 @@
 
 
+// converts volumes from one file format to another without loading them into memory:
+// slabs of slices are read, converted and written through a double buffered pipeline
+// so that memory use stays bounded by the budget passed with --memory
+//
+// usage: Converter [options] input output
+//        Converter [options] --batch <output directory> input...
+//   -t, --type <name>       datatype of the output: float32 (default), float64, int8, uint8,
+//                           int16, uint16, int32, uint32 (integer types for nii output only)
+//   -c, --compression <n>   zlib level for nii.gz, deflate level for h5 (0 = uncompressed)
+//   --no-shuffle            do not apply the shuffle filter before h5 compression
+//   --chunk <n0,n1,n2>      chunk shape of h5 output
+//   --scale <slope,inter>   scaling of integer output, default maps the value range onto
+//                           the full range of the type (requires an additional pass)
+//   -m, --memory <MB>       memory budget for slab buffers, default 256 MB, shared by all
+//                           files converted at the same time
+//
+// batch mode converts many files concurrently, inputs can be files, directories (all nii,
+// nii.gz and h5 files in them), patterns with wildcards in the file name (data/*.nii) or
+// @list files holding one path per line
+//   --batch <dir>           output directory
+//   --ext <ext>             output extension: h5 (default), nii or nii.gz
+//   -j, --jobs <n>          files converted at the same time, default 4
+//   --io <n>                file accesses at the same time, default same as jobs
+//   --force                 also convert files whose output is newer than the input
 
-// function takes two arguments, one is the input path to load from and the other
-// is the output path to where we want to store the converted image
-
-#include "volume.h"
+#include "internalHelpers.h"
+#include "volumeStream.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <filesystem>
+#include <fnmatch.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// everything defining how a single file is converted
+struct convertOptions {
+	int datatype = DT_FLOAT;
+	int compressionLevel = -1;
+	bool flagShuffle = true;
+	bool flagScale = false;
+	double scale[2] = {1.0, 0.0};
+	double chunk[3] = {0.0, 0.0, 0.0};
+	std::size_t memoryBudget = 256 << 20; // bytes
+};
+
+static void print_usage() {
+	std::cout << "Usage: Converter [options] input output" << std::endl
+		<< "       Converter [options] --batch <output directory> input..." << std::endl
+		<< "  -t, --type <name>       output datatype: float32, float64, int8, uint8," << std::endl
+		<< "                          int16, uint16, int32, uint32" << std::endl
+		<< "  -c, --compression <n>   compression level (nii.gz and h5)" << std::endl
+		<< "  --no-shuffle            disable the shuffle filter of h5 output" << std::endl
+		<< "  --chunk <n0,n1,n2>      chunk shape of h5 output" << std::endl
+		<< "  --scale <slope,inter>   scaling of integer output" << std::endl
+		<< "  -m, --memory <MB>       memory budget for slab buffers" << std::endl
+		<< "  --ext <ext>             batch output extension: h5, nii or nii.gz" << std::endl
+		<< "  -j, --jobs <n>          files converted at the same time in batch mode" << std::endl
+		<< "  --io <n>                file accesses at the same time in batch mode" << std::endl
+		<< "  --force                 convert even if the output is up to date" << std::endl;
+}
+
+// message of the exception currently handled, readers also throw HDF5 exceptions and plain
+// strings which do not derive from std::exception
+static std::string current_error() {
+	try {
+		throw;
+	} catch (const std::exception& e) {
+		return e.what();
+	} catch (const H5::Exception& e) {
+		return e.getDetailMsg();
+	} catch (const char* e) {
+		return e;
+	} catch (...) {
+		return "unknown error";
+	}
+}
+
+// parses a comma separated list of exactly n numbers
+static bool parse_list(const std::string& txt, double* values, const std::size_t n) {
+	std::size_t pos = 0;
+	for (std::size_t iVal = 0; iVal < n; iVal++) {
+		const std::size_t end = txt.find(',', pos);
+		if ((end == std::string::npos) != (iVal == n - 1))
+			return false;
+		char* endPtr = nullptr;
+		const std::string entry = txt.substr(pos, end - pos);
+		values[iVal] = strtod(entry.c_str(), &endPtr);
+		if (entry.empty() || (*endPtr != '\0'))
+			return false;
+		pos = end + 1;
+	}
+	return true;
+}
+
+// file name without any of the volume extensions we know
+static std::string get_stem(const fs::path& filePath) {
+	const std::string name = filePath.filename().string();
+	for (const std::string ext : {".nii.gz", ".nii", ".h5"})
+		if (hasEnding(name, ext))
+			return name.substr(0, name.length() - ext.length());
+	return name;
+}
+
+static bool is_volumeFile(const fs::path& filePath) {
+	return fs::is_regular_file(filePath) && (get_stem(filePath) != filePath.filename().string());
+}
+
+// expands a batch argument: @list file, directory, pattern with wildcards or plain file
+static void collect_inputs(const std::string& arg, std::vector<fs::path>& inputs) {
+	if (arg[0] == '@') {
+		std::ifstream listFile(arg.substr(1));
+		if (!listFile.is_open()) {
+			std::cout << "Cannot open file list " << arg.substr(1) << std::endl;
+			throw std::runtime_error("FileError");
+		}
+		std::string line;
+		while (std::getline(listFile, line)) {
+			line.erase(0, line.find_first_not_of(" \t\r"));
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			if (!line.empty())
+				collect_inputs(line, inputs);
+		}
+		return;
+	}
+
+	std::vector<fs::path> found;
+	const fs::path argPath(arg);
+	if (fs::is_directory(argPath)) {
+		for (const auto& entry : fs::directory_iterator(argPath))
+			if (is_volumeFile(entry.path()))
+				found.push_back(entry.path());
+	} else if (arg.find_first_of("*?[") != std::string::npos) {
+		// wildcards are only supported in the file name, not in the directories leading to it
+		const fs::path dir = argPath.has_parent_path() ? argPath.parent_path() : fs::path(".");
+		const std::string pattern = argPath.filename().string();
+		if (fs::is_directory(dir)) {
+			for (const auto& entry : fs::directory_iterator(dir))
+				if (fs::is_regular_file(entry.path()) &&
+					(fnmatch(pattern.c_str(), entry.path().filename().c_str(), 0) == 0))
+					found.push_back(entry.path());
+		}
+		if (found.empty())
+			std::cout << "No files match " << arg << std::endl;
+	} else {
+		found.push_back(argPath);
+	}
+
+	std::sort(found.begin(), found.end());
+	inputs.insert(inputs.end(), found.begin(), found.end());
+}
+
+// streams a single file from inputPath to outputPath, a failed conversion leaves no output behind
+static void convert_file(const std::string& inputPath,
+	const std::string& outputPath,
+	convertOptions opt,
+	ioLimiter* limiter,
+	std::ostream& log) {
+	try {
+		volumeReader reader;
+		reader.set_ioLimiter(limiter);
+		reader.open(inputPath);
+
+		volumeWriter writer;
+		writer.set_ioLimiter(limiter);
+		writer.set_datatype(opt.datatype);
+		writer.set_compressionLevel(opt.compressionLevel);
+		writer.set_shuffle(opt.flagShuffle);
+		writer.set_chunkDim(opt.chunk[0], opt.chunk[1], opt.chunk[2]);
+		writer.set_niiHeader(reader.get_niiHeader());
+
+		// integer output covers the value range of the input unless told otherwise
+		if (typeConversion::is_integer(opt.datatype)) {
+			if (!opt.flagScale) {
+				float minVal, maxVal;
+				reader.get_range(minVal, maxVal, opt.memoryBudget);
+				double typeMin, typeMax;
+				typeConversion::get_limits(opt.datatype, &typeMin, &typeMax);
+				opt.scale[0] = ((double)maxVal - (double)minVal) / (typeMax - typeMin);
+				if (opt.scale[0] <= 0.0)
+					opt.scale[0] = 1.0;
+				opt.scale[1] = (double)minVal - typeMin * opt.scale[0];
+				log << " - value range: " << minVal << " ... " << maxVal << std::endl;
+			}
+			writer.set_scaling(opt.scale[0], opt.scale[1]);
+			log << " - scaling: " << opt.scale[0] << ", " << opt.scale[1] << std::endl;
+		}
+
+		writer.create(outputPath, reader.get_pdim(), reader.get_pres(), reader.get_porigin());
+		writer.write_from(reader, opt.memoryBudget);
+		writer.close();
+	} catch (...) {
+		std::error_code err;
+		fs::remove(outputPath, err);
+		throw;
+	}
+}
+
+// converts all inputs into outputDir with nJobs files in flight, returns the number of failures
+static std::size_t convert_batch(const std::vector<fs::path>& inputs,
+	const fs::path& outputDir,
+	const std::string& outputExt,
+	const convertOptions& opt,
+	const std::size_t nJobs,
+	const std::size_t nIo,
+	const bool flagForce) {
+	fs::create_directories(outputDir);
+
+	// output names need to be unique, otherwise two workers would write the same file
+	std::vector<fs::path> outputs;
+	std::set<fs::path> outputSet;
+	for (const fs::path& input : inputs) {
+		outputs.push_back(outputDir / (get_stem(input) + "." + outputExt));
+		if (!outputSet.insert(outputs.back()).second) {
+			std::cout << "Several inputs would be converted to " << outputs.back() << std::endl;
+			throw std::runtime_error("InvalidValue");
+		}
+	}
+
+	convertOptions jobOpt = opt;
+	jobOpt.memoryBudget = std::max<std::size_t>(1, opt.memoryBudget / nJobs);
+	ioLimiter limiter(nIo);
+
+	std::mutex printMutex;
+	std::atomic<std::size_t> iNext(0);
+	std::atomic<std::size_t> nConverted(0);
+	std::atomic<std::size_t> nSkipped(0);
+	std::atomic<std::size_t> nFailed(0);
+	std::atomic<std::size_t> nBytes(0);
+	const auto tStart = std::chrono::steady_clock::now();
+
+	const auto worker = [&]() {
+		for (std::size_t iFile = iNext++; iFile < inputs.size(); iFile = iNext++) {
+			const fs::path& input = inputs[iFile];
+			const fs::path& output = outputs[iFile];
+			std::error_code err;
+			const bool flagUpToDate = !flagForce && fs::exists(output, err) &&
+				(fs::last_write_time(output, err) >= fs::last_write_time(input, err)) && !err;
+			if (flagUpToDate) {
+				nSkipped++;
+				continue;
+			}
+
+			std::ostringstream log;
+			bool flagSuccess = true;
+			try {
+				convert_file(input.string(), output.string(), jobOpt, &limiter, log);
+				nBytes += fs::file_size(input);
+				nConverted++;
+			} catch (...) {
+				log << " - failed: " << current_error() << std::endl;
+				flagSuccess = false;
+				nFailed++;
+			}
+
+			std::lock_guard<std::mutex> lock(printMutex);
+			std::cout << "[" << (nConverted + nSkipped + nFailed) << "/" << inputs.size() << "] "
+				<< input.string() << " -> " << output.string()
+				<< (flagSuccess ? "" : " FAILED") << std::endl << log.str();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (std::size_t iJob = 0; iJob < std::min(nJobs, inputs.size()); iJob++)
+		workers.push_back(std::thread(worker));
+	for (auto& curr : workers)
+		curr.join();
+
+	const double tElapsed =
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+	const double tSafe = std::max(tElapsed, 1e-6);
+	const double nMb = (double)nBytes / (1024.0 * 1024.0);
+	std::cout << "Converted " << nConverted << " files (" << nMb << " MB), skipped "
+		<< nSkipped << " up to date, " << nFailed << " failed in " << tElapsed << " s" << std::endl
+		<< " - throughput: " << (double)nConverted / tSafe << " files/s, "
+		<< nMb / tSafe << " MB/s" << std::endl;
+	return nFailed;
+}
 
 int main(int argc, char *argv[]) {
 
+	const std::map<std::string, int> datatypes = {
+		{"float32", DT_FLOAT}, {"float64", DT_DOUBLE},
+		{"int8", DT_INT8}, {"uint8", DT_UINT8},
+		{"int16", DT_INT16}, {"uint16", DT_UINT16},
+		{"int32", DT_INT32}, {"uint32", DT_UINT32}};
+
+	// parse options, the remaining arguments are input and output paths
+	convertOptions opt;
+	std::size_t memoryBudget = 256;
+	std::string batchDir;
+	std::string outputExt = "h5";
+	std::size_t nJobs = 4;
+	std::size_t nIo = 0;
+	bool flagForce = false;
+	std::vector<std::string> paths;
+	for (int iArg = 1; iArg < argc; iArg++) {
+		const std::string arg = argv[iArg];
+		const bool flagValue = (iArg + 1 < argc);
+		if (((arg == "-t") || (arg == "--type")) && flagValue) {
+			const auto entry = datatypes.find(argv[++iArg]);
+			if (entry == datatypes.end()) {
+				std::cout << "Unknown datatype: " << argv[iArg] << std::endl;
+				return 1;
+			}
+			opt.datatype = entry->second;
+		} else if (((arg == "-c") || (arg == "--compression")) && flagValue) {
+			opt.compressionLevel = atoi(argv[++iArg]);
+		} else if (arg == "--no-shuffle") {
+			opt.flagShuffle = false;
+		} else if ((arg == "--chunk") && flagValue) {
+			if (!parse_list(argv[++iArg], opt.chunk, 3)) {
+				std::cout << "Chunk shape needs to be passed as n0,n1,n2" << std::endl;
+				return 1;
+			}
+		} else if ((arg == "--scale") && flagValue) {
+			if (!parse_list(argv[++iArg], opt.scale, 2) || (opt.scale[0] == 0.0)) {
+				std::cout << "Scaling needs to be passed as slope,inter with nonzero slope" << std::endl;
+				return 1;
+			}
+			opt.flagScale = true;
+		} else if (((arg == "-m") || (arg == "--memory")) && flagValue) {
+			memoryBudget = std::max(1, atoi(argv[++iArg]));
+		} else if ((arg == "--batch") && flagValue) {
+			batchDir = argv[++iArg];
+		} else if ((arg == "--ext") && flagValue) {
+			outputExt = argv[++iArg];
+			if ((outputExt != "h5") && (outputExt != "nii") && (outputExt != "nii.gz")) {
+				std::cout << "Unknown output extension: " << outputExt << std::endl;
+				return 1;
+			}
+		} else if (((arg == "-j") || (arg == "--jobs")) && flagValue) {
+			nJobs = std::max(1, atoi(argv[++iArg]));
+		} else if ((arg == "--io") && flagValue) {
+			nIo = std::max(1, atoi(argv[++iArg]));
+		} else if (arg == "--force") {
+			flagForce = true;
+		} else if ((arg.size() > 1) && (arg[0] == '-')) {
+			std::cout << "Unknown option: " << arg << std::endl;
+			print_usage();
+			return 1;
+		} else {
+			paths.push_back(arg);
+		}
+	}
+	opt.memoryBudget = memoryBudget << 20;
+
+	if (!batchDir.empty()) {
+		if (paths.empty()) {
+			std::cout << "Please pass at least one input for batch conversion" << std::endl;
+			print_usage();
+			return 1;
+		}
+
+		try {
+			std::vector<fs::path> collected;
+			for (const std::string& arg : paths)
+				collect_inputs(arg, collected);
+
+			// the same file reached through several arguments is converted once
+			std::vector<fs::path> inputs;
+			std::set<fs::path> inputSet;
+			for (const fs::path& input : collected)
+				if (inputSet.insert(fs::weakly_canonical(input)).second)
+					inputs.push_back(input);
+			std::cout << "CVolume conversion tool, batch mode" << std::endl
+				<< " - inputs: " << inputs.size() << " files" << std::endl
+				<< " - output directory: " << batchDir << std::endl
+				<< " - jobs: " << nJobs << ", concurrent file accesses: "
+				<< ((nIo == 0) ? nJobs : nIo) << std::endl
+				<< " - memory budget: " << memoryBudget << " MB" << std::endl;
+			const std::size_t nFailed = convert_batch(
+				inputs, batchDir, outputExt, opt, nJobs, (nIo == 0) ? nJobs : nIo, flagForce);
+			return (nFailed == 0) ? 0 : 1;
+		} catch (...) {
+			std::cout << "Batch conversion failed: " << current_error() << std::endl;
+			return 1;
+		}
+	}
+
 	// make sure the correct number of arguments are passed
-	if (argc != 3) {
+	if (paths.size() != 2) {
 		std::cout << "Please pass two arguments to this function, first is input "
 		"path, second is output path" << std::endl;
+		print_usage();
 		return 1;
 	}
 
 	// parse arguments and print some information
-	const std::string inputPath = argv[1];
-	const std::string outputPath = argv[2];
+	const std::string inputPath = paths[0];
+	const std::string outputPath = paths[1];
 	std::cout << "CVolume conversion tool" << std::endl
 		<< " - input path: " << inputPath << std::endl
-		<< " - output path: " << outputPath << std::endl;
+		<< " - output path: " << outputPath << std::endl
+		<< " - memory budget: " << memoryBudget << " MB" << std::endl;
 
 	// check that input path is atually pointing to a valid file
-	if (!std::filesystem::exists(inputPath)) {
-		std::cout << "Input path is not pointing to a valid file: " << 
+	if (!fs::exists(inputPath)) {
+		std::cout << "Input path is not pointing to a valid file: " <<
 		inputPath << std::endl;
 		return 1;
 	}
 
-	volume vol;
-	vol.readFromFile(inputPath);
-	vol.saveToFile(outputPath);
-
+	try {
+		convert_file(inputPath, outputPath, opt, nullptr, std::cout);
+	} catch (...) {
+		std::cout << "Conversion failed: " << current_error() << std::endl;
+		return 1;
+	}
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,80 @@
+/*
+	aligned storage test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: volumes of all sizes start on a cache line, large ones on a
+	huge page boundary, explicit huge pages fall back if the system has none
+	reserved and mapped files report the alignment their offset allows
+*/
+
+#include "../src/volume.h"
+#include <filesystem>
+
+static void check_volume(const std::size_t nDim, const std::size_t minAlignment)
+{
+	volume vol(nDim, nDim, nDim);
+	const uintptr_t address = reinterpret_cast<uintptr_t>(vol.get_pdata());
+	if ((address % minAlignment != 0) || (vol.get_dataAlignment() != alignedMemory::ALIGNMENT))
+	{
+		printf("Volume of %lu^3 is aligned to %lu bytes only\n", nDim, vol.get_dataAlignment());
+		throw "InvalidValue";
+	}
+
+	// the memory needs to be usable and zeroed no matter where it came from
+	vol.fill_rand(1.0f, 2.0f);
+	volume volCopy(vol);
+	for (std::size_t iElem = 0; iElem < vol.get_nElements(); iElem += 4099)
+	{
+		if (volCopy[iElem] != vol[iElem])
+		{
+			printf("Copy differs at %lu\n", iElem);
+			throw "InvalidValue";
+		}
+	}
+}
+
+int main()
+{
+	for (const std::size_t nDim : {1, 3, 7, 33, 100})
+		check_volume(nDim, alignedMemory::ALIGNMENT);
+
+	// 128^3 floats are 8 MiB, above the huge page threshold
+	check_volume(128, alignedMemory::HUGE_PAGE_SIZE);
+
+	alignedMemory::set_hugePages(HugePages::EXPLICIT);
+	check_volume(128, 1);
+	alignedMemory::set_hugePages(HugePages::NONE);
+	check_volume(128, alignedMemory::ALIGNMENT);
+	alignedMemory::set_hugePages(HugePages::TRANSPARENT);
+
+	const alignedMemoryStats stats = alignedMemory::get_stats();
+	if (stats.nAllocations == 0 || stats.nTransparent + stats.nExplicit > stats.nAllocations)
+	{
+		printf("Inconsistent allocation statistics\n");
+		throw "InvalidValue";
+	}
+	printf("%lu allocations, %lu transparent and %lu explicit huge page blocks\n",
+		stats.nAllocations, stats.nTransparent, stats.nExplicit);
+
+	// cvol data sits on a page boundary of the file, the mapping keeps the full alignment
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path() / "utest_aligned";
+	std::filesystem::remove_all(tmpDir);
+	std::filesystem::create_directories(tmpDir);
+	const std::string filePath = (tmpDir / "vol.cvol").string();
+	volume volOut(20, 30, 40);
+	volOut.fill_rand(0.0f, 1.0f);
+	volOut.saveToFile(filePath);
+
+	volume volIn;
+	volIn.set_mapFiles(true);
+	volIn.readFromFile(filePath);
+	if (volIn.get_dataAlignment() != alignedMemory::ALIGNMENT)
+	{
+		printf("Mapped cvol data is aligned to %lu bytes only\n", volIn.get_dataAlignment());
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove_all(tmpDir);
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+	asynchronous load and save test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: saves and loads volumes in the background, checks the reported
+	progress, that a cancelled save stops and removes its incomplete file and
+	that it leaves other saves of the same volume alone. Reads of a box report
+	progress and can be cancelled as well
+*/
+
+#include "../src/volume.h"
+#include <atomic>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+// runs a task to completion and checks that progress only grows and ends at 1
+void check_progress(volumeTask& task, const std::vector<float>& reports)
+{
+	task.wait();
+	if (!task.is_done() || (task.get_progress() != 1.0f))
+	{
+		printf("Task did not report completion\n");
+		throw "InvalidValue";
+	}
+
+	if (reports.size() < 2)
+	{
+		printf("Task reported progress only %lu times\n", reports.size());
+		throw "InvalidValue";
+	}
+
+	for (std::size_t iReport = 1; iReport < reports.size(); iReport++)
+	{
+		if (reports[iReport] < reports[iReport - 1])
+		{
+			printf("Reported progress is decreasing\n");
+			throw "InvalidValue";
+		}
+	}
+}
+
+void test_roundtrip(const volume& volIn, const std::string& filePath)
+{
+	std::vector<float> reports;
+	volumeTask saveTask = volIn.saveToFileAsync(filePath, [&](float progress) { reports.push_back(progress); });
+	check_progress(saveTask, reports);
+
+	reports.clear();
+	volume volOut;
+	volumeTask readTask = volOut.readFromFileAsync(filePath, [&](float progress) { reports.push_back(progress); });
+	check_progress(readTask, reports);
+
+	if (volOut != volIn)
+	{
+		printf("Wrong values after asynchronous roundtrip of %s\n", filePath.c_str());
+		throw "InvalidValue";
+	}
+	std::filesystem::remove(filePath);
+}
+
+void test_roiRead(const volume& volIn, const std::string& filePath)
+{
+	volIn.saveToFile(filePath);
+	const std::size_t startIdx[3] = {10, 20, 5};
+	const std::size_t stopIdx[3] = {200, 230, 150};
+	volume volSync;
+	volSync.readFromFile(filePath, startIdx, stopIdx);
+
+	std::vector<float> reports;
+	volume volOut;
+	volOut.set_nThreads(4);
+	volumeTask readTask = volOut.readFromFileAsync(filePath, startIdx, stopIdx,
+		[&](float progress) { reports.push_back(progress); });
+	check_progress(readTask, reports);
+	if (volOut != volSync)
+	{
+		printf("Wrong values after asynchronous read of a box\n");
+		throw "InvalidValue";
+	}
+
+	// cancelled while the first merged read is reported
+	std::atomic<bool> flagCancelled(false);
+	std::atomic<int> nCalls(0);
+	volume volCancel;
+	volCancel.set_nThreads(4);
+	volumeTask cancelTask = volCancel.readFromFileAsync(filePath, startIdx, stopIdx, [&](float) {
+		nCalls++;
+		while (!flagCancelled)
+			std::this_thread::yield();
+	});
+	while (nCalls == 0)
+		std::this_thread::yield();
+	cancelTask.cancel();
+	flagCancelled = true;
+
+	bool flagThrown = false;
+	try
+	{
+		cancelTask.wait();
+	}
+	catch (const std::runtime_error& err)
+	{
+		flagThrown = (std::string(err.what()) == "Cancelled");
+	}
+	if (!flagThrown || (nCalls != 1))
+	{
+		printf("Cancelled read of a box did not stop after its first report\n");
+		throw "InvalidValue";
+	}
+	std::filesystem::remove(filePath);
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path();
+
+	// large enough to be written in several chunks
+	volume volIn(256, 256, 160);
+	volIn.fill_rand(-10.0f, 10.0f);
+
+	test_roundtrip(volIn, (tmpDir / "utest_asyncio.nii").string());
+	test_roundtrip(volIn, (tmpDir / "utest_asyncio.h5").string());
+	volIn.set_h5ChunkDim(64, 64, 64);
+	volIn.set_h5CompressionLevel(1);
+	test_roundtrip(volIn, (tmpDir / "utest_asyncio.h5").string());
+	test_roiRead(volIn, (tmpDir / "utest_asyncio_roi.nii").string());
+
+	// cancel a save after its first chunk
+	const std::string filePath = (tmpDir / "utest_asyncio_cancel.nii").string();
+	std::atomic<bool> flagCancelled(false);
+	volumeTask task = volIn.saveToFileAsync(filePath, [&](float) {
+		while (!flagCancelled)
+			std::this_thread::yield();
+	});
+	task.cancel();
+	flagCancelled = true;
+
+	bool flagThrown = false;
+	try
+	{
+		task.wait();
+	}
+	catch (const std::runtime_error& err)
+	{
+		flagThrown = (std::string(err.what()) == "Cancelled");
+	}
+
+	if (!flagThrown)
+	{
+		printf("Cancelled task did not report cancellation\n");
+		throw "InvalidValue";
+	}
+
+	if (std::filesystem::exists(filePath))
+	{
+		printf("Cancelled save left an incomplete file\n");
+		throw "InvalidValue";
+	}
+
+	// a cancelled task of one volume must not affect other saves of it, background or not
+	const std::string pathBlocked = (tmpDir / "utest_asyncio_blocked.nii").string();
+	const std::string pathSync = (tmpDir / "utest_asyncio_sync.nii").string();
+	const std::string pathParallel = (tmpDir / "utest_asyncio_parallel.nii").string();
+	std::atomic<bool> flagRelease(false);
+	volumeTask blockedTask = volIn.saveToFileAsync(pathBlocked, [&](float) {
+		while (!flagRelease)
+			std::this_thread::yield();
+	});
+	blockedTask.cancel();
+
+	volIn.saveToFile(pathSync);
+	std::vector<float> reports;
+	volumeTask parallelTask = volIn.saveToFileAsync(pathParallel, [&](float progress) { reports.push_back(progress); });
+	check_progress(parallelTask, reports);
+	flagRelease = true;
+
+	flagThrown = false;
+	try
+	{
+		blockedTask.wait();
+	}
+	catch (const std::runtime_error& err)
+	{
+		flagThrown = (std::string(err.what()) == "Cancelled");
+	}
+	if (!flagThrown)
+	{
+		printf("Blocked task did not report cancellation\n");
+		throw "InvalidValue";
+	}
+
+	for (const std::string& path : {pathSync, pathParallel})
+	{
+		volume volOut;
+		volOut.readFromFile(path);
+		if (volOut != volIn)
+		{
+			printf("Save next to a cancelled task produced wrong values in %s\n", path.c_str());
+			throw "InvalidValue";
+		}
+		std::filesystem::remove(path);
+	}
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+/*
+	buffer pool test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: a loop of volume operators is served from the pool after its
+	first iteration, results are unchanged, recycled buffers come back zeroed
+	for new volumes and the retention limits hold
+*/
+
+#include "../src/volume.h"
+#include "../src/bufferPool.h"
+
+int main()
+{
+	const std::size_t nDim = 64; // 1 MiB per volume
+	const std::size_t nBytes = nDim * nDim * nDim * sizeof(float);
+
+	// disabled pool keeps nothing
+	bufferPool::reset_stats();
+	{
+		volume volTmp(nDim, nDim, nDim);
+	}
+	if (bufferPool::get_stats().bytesRetained != 0 || bufferPool::get_stats().nHits != 0)
+	{
+		printf("Disabled pool retained memory\n");
+		throw "InvalidValue";
+	}
+
+	bufferPool::set_enabled(true);
+	bufferPool::set_maxPerSize(4);
+	bufferPool::set_maxBytes(std::size_t(64) << 20);
+
+	volume volA(nDim, nDim, nDim);
+	volA.fill_rand(1.0f, 2.0f);
+	volume volB(nDim, nDim, nDim);
+	volB.fill_rand(1.0f, 2.0f);
+
+	bufferPool::reset_stats();
+	const std::size_t nIter = 20;
+	for (std::size_t iIter = 0; iIter < nIter; iIter++)
+	{
+		volume volSum = volA + volB;
+		volume volScaled = volSum * 0.5f;
+		const std::size_t idx = iIter * 997;
+		const float expected = (volA[idx] + volB[idx]) * 0.5f;
+		if (volScaled[idx] != expected)
+		{
+			printf("Wrong result in iteration %lu: %f instead of %f\n", iIter, volScaled[idx], expected);
+			throw "InvalidValue";
+		}
+	}
+
+	const bufferPoolStats stats = bufferPool::get_stats();
+	if (stats.nAcquired != 2 * nIter || stats.nHits < 2 * (nIter - 1))
+	{
+		printf("Expected %lu buffers mostly served from the pool, got %lu with %lu hits\n",
+			2 * nIter, stats.nAcquired, stats.nHits);
+		throw "InvalidValue";
+	}
+
+	// a dirty recycled buffer needs to look like fresh memory for a new volume
+	volume volFresh(nDim, nDim, nDim);
+	for (std::size_t iElem = 0; iElem < volFresh.get_nElements(); iElem++)
+	{
+		if (volFresh[iElem] != 0.0f)
+		{
+			printf("New volume from the pool is not zeroed at %lu\n", iElem);
+			throw "InvalidValue";
+		}
+	}
+
+	// retention limits: only two buffers of this size may be kept
+	bufferPool::trim();
+	bufferPool::set_maxBytes(2 * nBytes);
+	{
+		std::vector<volume> temporaries;
+		for (std::size_t iVol = 0; iVol < 5; iVol++)
+			temporaries.emplace_back(nDim, nDim, nDim);
+	}
+	if (bufferPool::get_stats().bytesRetained != 2 * nBytes)
+	{
+		printf("Pool retained %lu instead of %lu bytes\n", bufferPool::get_stats().bytesRetained,
+			2 * nBytes);
+		throw "InvalidValue";
+	}
+
+	// small buffers are left to malloc
+	bufferPool::trim();
+	{
+		volume volSmall(8, 8, 8);
+	}
+	if (bufferPool::get_stats().bytesRetained != 0)
+	{
+		printf("Pool retained a buffer below the minimum size\n");
+		throw "InvalidValue";
+	}
+
+	bufferPool::set_enabled(false);
+	if (bufferPool::get_stats().bytesRetained != 0)
+	{
+		printf("Disabling the pool did not free its buffers\n");
+		throw "InvalidValue";
+	}
+
+	return 0;
+}
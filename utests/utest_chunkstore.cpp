@@ -0,0 +1,152 @@
+/*
+	chunk store test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: many threads write unaligned boxes of a volume into a chunk
+	store at the same time, afterwards the store is read back as a whole and as
+	a box and compared against the volume
+*/
+
+#include "../src/volume.h"
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path() / "utest_chunkstore";
+	std::filesystem::remove_all(tmpDir);
+	std::filesystem::create_directories(tmpDir);
+
+	volume volIn(70, 50, 33);
+	volIn.set_res(0.5f, 0.25f, 2.0f);
+	volIn.set_origin(1.0f, -2.0f, 3.0f);
+	volIn.fill_rand(-10.0f, 10.0f);
+	const std::size_t dim[3] = {70, 50, 33};
+	const float res[3] = {0.5f, 0.25f, 2.0f};
+	const float origin[3] = {1.0f, -2.0f, 3.0f};
+
+	// workers write slabs along dim0 which do not line up with the chunks, so neighbouring
+	// workers update the same chunks
+	const std::string storePath = (tmpDir / "workers.zarr").string();
+	chunkStore store;
+	const std::size_t chunkDim[3] = {16, 16, 8};
+	store.create(storePath, dim, chunkDim, res, origin, 1);
+	const std::size_t nWorkers = 8;
+	std::vector<std::thread> workers;
+	for (std::size_t iWorker = 0; iWorker < nWorkers; iWorker++)
+	{
+		workers.push_back(std::thread([&, iWorker]()
+		{
+			const std::size_t startIdx[3] = {iWorker * dim[0] / nWorkers, 0, 0};
+			const std::size_t blockDim[3] = {(iWorker + 1) * dim[0] / nWorkers - startIdx[0], dim[1], dim[2]};
+			std::vector<float> block(blockDim[0] * blockDim[1] * blockDim[2]);
+			for (std::size_t i2 = 0; i2 < blockDim[2]; i2++)
+				for (std::size_t i1 = 0; i1 < blockDim[1]; i1++)
+					for (std::size_t i0 = 0; i0 < blockDim[0]; i0++)
+						block[i0 + blockDim[0] * (i1 + blockDim[1] * i2)] = volIn.get_value(startIdx[0] + i0, i1, i2);
+			store.write_block(block.data(), startIdx, blockDim, 2);
+		}));
+	}
+	for (auto& worker : workers)
+		worker.join();
+
+	volume volOut;
+	volOut.readFromFile(storePath);
+	for (uint8_t iDim = 0; iDim < 3; iDim++)
+	{
+		if ((volOut.get_dim(iDim) != dim[iDim]) || (volOut.get_res(iDim) != res[iDim]) ||
+			(volOut.get_origin(iDim) != origin[iDim]))
+		{
+			printf("Geometry of chunk store differs along dim %d\n", iDim);
+			throw "InvalidValue";
+		}
+	}
+
+	for (std::size_t iElem = 0; iElem < volIn.get_nElements(); iElem++)
+	{
+		if (volIn.get_value(iElem) != volOut.get_value(iElem))
+		{
+			printf("Value differs at %lu after parallel writes\n", iElem);
+			throw "InvalidValue";
+		}
+	}
+
+	// saving from a volume and reading back only a box
+	const std::string volPath = (tmpDir / "volume.zarr").string();
+	volIn.set_zarrChunkDim(32, 0, 5);
+	volIn.set_zarrCompressionLevel(0);
+	volIn.saveToFile(volPath);
+	const std::size_t startIdx[3] = {5, 17, 3};
+	const std::size_t stopIdx[3] = {66, 31, 29};
+	volume volBox;
+	volBox.readFromFile(volPath, startIdx, stopIdx);
+	for (std::size_t i2 = 0; i2 < volBox.get_dim(2); i2++)
+		for (std::size_t i1 = 0; i1 < volBox.get_dim(1); i1++)
+			for (std::size_t i0 = 0; i0 < volBox.get_dim(0); i0++)
+				if (volBox.get_value(i0, i1, i2) != volIn.get_value(i0 + startIdx[0], i1 + startIdx[1], i2 + startIdx[2]))
+				{
+					printf("Box differs at %lu, %lu, %lu\n", i0, i1, i2);
+					throw "InvalidValue";
+				}
+
+	// chunks which were never written read as zeros
+	chunkStore sparse;
+	sparse.create((tmpDir / "sparse.zarr").string(), dim, chunkDim, res, origin, 3);
+	const std::size_t chunkIdx[3] = {1, 1, 1};
+	std::vector<float> chunk(sparse.get_chunkElements(), 5.0f);
+	sparse.write_chunk(chunkIdx, chunk.data());
+	std::vector<float> values(dim[0] * dim[1] * dim[2]);
+	const std::size_t zero[3] = {0, 0, 0};
+	sparse.read_block(values.data(), zero, dim, 4);
+	for (std::size_t i2 = 0; i2 < dim[2]; i2++)
+		for (std::size_t i1 = 0; i1 < dim[1]; i1++)
+			for (std::size_t i0 = 0; i0 < dim[0]; i0++)
+			{
+				const bool flagInside = (i0 / chunkDim[0] == 1) && (i1 / chunkDim[1] == 1) && (i2 / chunkDim[2] == 1);
+				if (values[i0 + dim[0] * (i1 + dim[1] * i2)] != (flagInside ? 5.0f : 0.0f))
+				{
+					printf("Sparse store is wrong at %lu, %lu, %lu\n", i0, i1, i2);
+					throw "InvalidValue";
+				}
+			}
+
+	// recreating a store clears its old chunks
+	chunkStore recreated;
+	recreated.create((tmpDir / "sparse.zarr").string(), dim, chunkDim, res, origin, 3);
+	recreated.read_block(values.data(), zero, dim, 4);
+	for (const float value : values)
+		if (value != 0.0f)
+		{
+			printf("Recreated store still holds old chunks\n");
+			throw "InvalidValue";
+		}
+
+	// other directories are never cleared
+	const std::filesystem::path dataDir = tmpDir / "data";
+	std::filesystem::create_directories(dataDir);
+	const std::filesystem::path userFile = dataDir / "1_results.txt";
+	FILE* fid = fopen(userFile.string().c_str(), "w");
+	fputs("keep me", fid);
+	fclose(fid);
+	bool flagThrown = false;
+	try
+	{
+		chunkStore intruder;
+		intruder.create(dataDir.string(), dim, chunkDim, res, origin, 3);
+	}
+	catch (const std::runtime_error&)
+	{
+		flagThrown = true;
+	}
+	if (!flagThrown || !std::filesystem::exists(userFile)
+		|| std::filesystem::exists(dataDir / ".zarray"))
+	{
+		printf("Store was created in a non empty directory\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove_all(tmpDir);
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+	converter tool test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: runs the converter in batch and single file mode on a corrupt
+	h5 file next to a valid nii file, the corrupt file has to be reported as
+	failed without taking down the conversion of the others
+*/
+
+#include "../src/volume.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sys/wait.h>
+
+// runs the converter and returns its exit code, -1 if it did not exit normally
+static int run_converter(const std::string& args)
+{
+	const std::string command = std::string(CONVERTER_PATH) + " " + args + " > /dev/null 2>&1";
+	const int status = std::system(command.c_str());
+	if ((status == -1) || !WIFEXITED(status))
+		return -1;
+	return WEXITSTATUS(status);
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path() / "utest_converter";
+	std::filesystem::remove_all(tmpDir);
+	std::filesystem::create_directories(tmpDir / "out");
+
+	const std::string badPath = (tmpDir / "bad.h5").string();
+	std::ofstream badFile(badPath, std::ios::binary);
+	badFile << "this is not an hdf5 file";
+	badFile.close();
+
+	volume volIn(20, 15, 10);
+	volIn.fill_rand(-1.0f, 1.0f);
+	const std::string goodPath = (tmpDir / "good.nii").string();
+	volIn.saveToFile(goodPath);
+
+	const int batchCode = run_converter("--batch " + (tmpDir / "out").string() + " "
+		+ badPath + " " + goodPath);
+	if (batchCode != 1)
+	{
+		printf("Batch with a corrupt input should exit with 1, got %d\n", batchCode);
+		throw "InvalidValue";
+	}
+
+	volume volOut;
+	volOut.readFromFile((tmpDir / "out" / "good.h5").string());
+	if (volOut != volIn)
+	{
+		printf("Valid input next to a corrupt one was not converted\n");
+		throw "InvalidValue";
+	}
+
+	if (std::filesystem::exists(tmpDir / "out" / "bad.h5"))
+	{
+		printf("Failed conversion left an output file\n");
+		throw "InvalidValue";
+	}
+
+	const int singleCode = run_converter(badPath + " " + (tmpDir / "single.nii").string());
+	if (singleCode != 1)
+	{
+		printf("Single conversion of a corrupt input should exit with 1, got %d\n", singleCode);
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove_all(tmpDir);
+	return 0;
+}
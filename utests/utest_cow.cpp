@@ -0,0 +1,150 @@
+/*
+	copy on write test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: copies share the data array of their source while they are
+	only read, every kind of write access detaches them first and leaves the
+	source untouched, also when many threads copy and modify at the same time
+*/
+
+#include "../src/volume.h"
+#include <thread>
+
+static void check_shared(const volume& volA, const volume& volB, const bool flagShared,
+	const char* label)
+{
+	const bool flagSame = (volA.get_pdata() == volB.get_pdata());
+	if (flagSame != flagShared || volA.is_dataShared() != flagShared)
+	{
+		printf("%s: data should %sbe shared\n", label, flagShared ? "" : "not ");
+		throw "InvalidValue";
+	}
+}
+
+static void check_source(const volume& vol, const volume& reference, const char* label)
+{
+	for (std::size_t iElem = 0; iElem < vol.get_nElements(); iElem++)
+	{
+		if (vol[iElem] != reference[iElem])
+		{
+			printf("%s: source was modified at %lu\n", label, iElem);
+			throw "InvalidValue";
+		}
+	}
+}
+
+int main()
+{
+	volume volSrc(40, 30, 20);
+	volSrc.fill_rand(1.0f, 2.0f);
+	const volume& srcView = volSrc; // reading through a non const volume would detach it
+	// reference holds its own array, written to once so it never shares with volSrc
+	volume volRef(volSrc);
+	volRef.set_value((std::size_t) 0, volRef.get_value((std::size_t) 0));
+
+	// copies and reads keep the array shared
+	volume volCopy(volSrc);
+	check_shared(volCopy, volSrc, true, "copy constructor");
+	volCopy.calcMinMax();
+	volCopy.calcMips();
+	if (volCopy.get_psliceZ((std::size_t) 3) == nullptr)
+		throw "InvalidValue";
+	const volume& volConst = volCopy;
+	if (volConst[17] != srcView[17] || volConst.get_value(1, 2, 3) != volSrc.get_value(1, 2, 3))
+		throw "InvalidValue";
+	check_shared(volCopy, volSrc, true, "read access");
+
+	volume volAssigned(40, 30, 20);
+	volAssigned = volSrc;
+	check_shared(volAssigned, volSrc, true, "assignment");
+
+	// every way of writing detaches the copy
+	volCopy[5] = -1.0f;
+	check_shared(volCopy, volSrc, false, "operator[]");
+	if (volCopy[5] != -1.0f || volCopy[6] != srcView[6])
+		throw "InvalidValue";
+
+	volume volSet(volSrc);
+	volSet.set_value(1, 2, 3, -2.0f);
+	check_shared(volSet, volSrc, false, "set_value");
+
+	volume volPtr(volSrc);
+	volPtr.get_pdata()[0] = -3.0f;
+	check_shared(volPtr, volSrc, false, "get_pdata");
+
+	// a pointer handed out before copying must not write into the copy
+	volume volLeaked(volSrc);
+	float* pLeaked = volLeaked.get_pdata();
+	volume volAfter(volLeaked);
+	check_shared(volAfter, volLeaked, false, "copy after get_pdata");
+	pLeaked[7] = -4.0f;
+	if ((volAfter[7] != srcView[7]) || (static_cast<const volume&>(volLeaked)[7] != -4.0f))
+	{
+		printf("Write through an old pointer reached a later copy\n");
+		throw "InvalidValue";
+	}
+	volume volAssignedAfter(40, 30, 20);
+	volAssignedAfter = volLeaked;
+	check_shared(volAssignedAfter, volLeaked, false, "assignment after get_pdata");
+
+	volume volMult(volSrc);
+	volMult *= 2.0f;
+	check_shared(volMult, volSrc, false, "operator*=");
+	if (volMult[100] != 2.0f * srcView[100])
+		throw "InvalidValue";
+
+	volume volAdd(volSrc);
+	volAdd += volSrc;
+	check_shared(volAdd, volSrc, false, "operator+=");
+	if (volAdd[100] != 2.0f * srcView[100])
+		throw "InvalidValue";
+
+	volume volNorm(volSrc);
+	volNorm.normalize();
+	check_shared(volNorm, volSrc, false, "normalize");
+
+	// the last copy standing keeps the array without copying it
+	volume volAlone(volSrc);
+	const float* pShared = static_cast<const volume&>(volAlone).get_pdata();
+	volAssigned = volRef;
+	volSrc = volRef;
+	if (volAlone.is_dataShared() || volAlone.get_pdata() != pShared)
+	{
+		printf("Last owner of the array should write in place\n");
+		throw "InvalidValue";
+	}
+	check_source(volAlone, volRef, "last owner");
+
+	// threads copy the same source and modify their copies concurrently
+	const std::size_t nThreads = 8;
+	std::vector<volume> results(nThreads);
+	std::vector<std::thread> workers;
+	for (std::size_t iThread = 0; iThread < nThreads; iThread++)
+	{
+		workers.push_back(std::thread([&, iThread]()
+		{
+			for (std::size_t iRep = 0; iRep < 20; iRep++)
+			{
+				volume volLocal(volSrc);
+				volLocal.set_nThreads(1);
+				volLocal += (float) iThread;
+				results[iThread] = volLocal;
+			}
+		}));
+	}
+	for (std::thread& worker : workers)
+		worker.join();
+
+	check_source(volSrc, volRef, "threads");
+	for (std::size_t iThread = 0; iThread < nThreads; iThread++)
+	{
+		if (results[iThread][1234] != volRef.get_value((std::size_t) 1234) + (float) iThread)
+		{
+			printf("Thread %lu produced a wrong result\n", iThread);
+			throw "InvalidValue";
+		}
+	}
+
+	return 0;
+}
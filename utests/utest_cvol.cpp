@@ -0,0 +1,184 @@
+/*
+	cvol test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: saves a volume in the native cvol format, reads it back plain,
+	mapped and as a box and checks values, embedded statistics, projections and
+	the detection of damaged chunks
+*/
+
+#include "../src/volume.h"
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+void check_values(const volume& volIn, const volume& volOut)
+{
+	for (uint8_t iDim = 0; iDim < 3; iDim++)
+	{
+		if ((volIn.get_dim(iDim) != volOut.get_dim(iDim)) ||
+			(volIn.get_res(iDim) != volOut.get_res(iDim)) ||
+			(volIn.get_origin(iDim) != volOut.get_origin(iDim)))
+		{
+			printf("Geometry differs along dim %d\n", iDim);
+			throw "InvalidValue";
+		}
+	}
+
+	for (std::size_t iElem = 0; iElem < volIn.get_nElements(); iElem++)
+	{
+		if (volIn.get_value(iElem) != volOut.get_value(iElem))
+		{
+			printf("Value differs at %lu\n", iElem);
+			throw "InvalidValue";
+		}
+	}
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path() / "utest_cvol";
+	std::filesystem::create_directories(tmpDir);
+	const std::string filePath = (tmpDir / "test.cvol").string();
+
+	volume volIn(110, 70, 50);
+	volIn.set_res(0.5f, 0.25f, 2.0f);
+	volIn.set_origin(1.0f, -2.0f, 3.0f);
+	volIn.fill_rand(-10.0f, 7.0f);
+	volIn.saveToFile(filePath);
+
+	cvolReader reader;
+	reader.open(filePath);
+	if ((reader.get_header().dataOffset % CVOL_ALIGNMENT != 0) || !reader.has_stats() || !reader.has_mips())
+	{
+		printf("Unexpected cvol header\n");
+		throw "InvalidValue";
+	}
+	const std::size_t dataOffset = reader.get_header().dataOffset;
+	reader.close();
+
+	volume volOut;
+	volOut.readFromFile(filePath);
+	check_values(volIn, volOut);
+
+	// statistics come from the file and need to match a fresh calculation
+	volIn.calcMinMax();
+	if ((volOut.get_minVal() != volIn.get_minVal()) || (volOut.get_maxVal() != volIn.get_maxVal()) ||
+		(volOut.get_maxAbsVal() != volIn.get_maxAbsVal()))
+	{
+		printf("Embedded statistics are wrong\n");
+		throw "InvalidValue";
+	}
+
+	// projections in the layout of calcMips
+	const std::size_t dim0 = volIn.get_dim(0);
+	const std::size_t dim1 = volIn.get_dim(1);
+	const std::size_t dim2 = volIn.get_dim(2);
+	const float* mipZ = volOut.get_mipZ();
+	const float* mipX = volOut.get_mipX();
+	const float* mipY = volOut.get_mipY();
+	for (std::size_t i2 = 0; i2 < dim2; i2++)
+	{
+		for (std::size_t i1 = 0; i1 < dim1; i1++)
+		{
+			float maxVal = 0;
+			for (std::size_t i0 = 0; i0 < dim0; i0++)
+				maxVal = std::max(maxVal, fabsf(volIn.get_value(i0, i1, i2)));
+			if (mipZ[i1 + dim1 * i2] != maxVal)
+			{
+				printf("Projection along dim0 is wrong\n");
+				throw "InvalidValue";
+			}
+		}
+
+		for (std::size_t i0 = 0; i0 < dim0; i0++)
+		{
+			float maxVal = 0;
+			for (std::size_t i1 = 0; i1 < dim1; i1++)
+				maxVal = std::max(maxVal, fabsf(volIn.get_value(i0, i1, i2)));
+			if (mipX[i0 + dim0 * i2] != maxVal)
+			{
+				printf("Projection along dim1 is wrong\n");
+				throw "InvalidValue";
+			}
+		}
+	}
+
+	for (std::size_t i1 = 0; i1 < dim1; i1++)
+	{
+		for (std::size_t i0 = 0; i0 < dim0; i0++)
+		{
+			float maxVal = 0;
+			for (std::size_t i2 = 0; i2 < dim2; i2++)
+				maxVal = std::max(maxVal, fabsf(volIn.get_value(i0, i1, i2)));
+			if (mipY[i1 + dim1 * i0] != maxVal)
+			{
+				printf("Projection along dim2 is wrong\n");
+				throw "InvalidValue";
+			}
+		}
+	}
+
+	// the page aligned data can be mapped straight into the volume
+	volume volMapped;
+	volMapped.set_mapFiles(true);
+	volMapped.readFromFile(filePath);
+	if (!volMapped.get_isMapped())
+	{
+		printf("cvol file was not mapped\n");
+		throw "InvalidValue";
+	}
+	check_values(volIn, volMapped);
+
+	// box read
+	const std::size_t startIdx[3] = {10, 5, 7};
+	const std::size_t stopIdx[3] = {99, 40, 31};
+	volume volBox;
+	volBox.readFromFile(filePath, startIdx, stopIdx);
+	for (std::size_t i2 = 0; i2 < volBox.get_dim(2); i2++)
+		for (std::size_t i1 = 0; i1 < volBox.get_dim(1); i1++)
+			for (std::size_t i0 = 0; i0 < volBox.get_dim(0); i0++)
+				if (volBox.get_value(i0, i1, i2) != volIn.get_value(i0 + startIdx[0], i1 + startIdx[1], i2 + startIdx[2]))
+				{
+					printf("Box differs at %lu, %lu, %lu\n", i0, i1, i2);
+					throw "InvalidValue";
+				}
+	if (volBox.get_origin(1) != volIn.get_origin(1) + volIn.get_res(1) * startIdx[1])
+	{
+		printf("Origin of box is wrong\n");
+		throw "InvalidValue";
+	}
+
+	// a damaged voxel needs to be detected by its chunk checksum
+	{
+		std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(dataOffset + 1000);
+		const char damage = 0x5a;
+		file.write(&damage, 1);
+	}
+
+	bool flagDetected = false;
+	try
+	{
+		volume volDamaged;
+		volDamaged.readFromFile(filePath);
+	}
+	catch (const std::runtime_error&)
+	{
+		flagDetected = true;
+	}
+	if (!flagDetected)
+	{
+		printf("Damaged chunk was not detected\n");
+		throw "InvalidValue";
+	}
+
+	volume volUnchecked;
+	volUnchecked.set_cvolVerify(false);
+	volUnchecked.readFromFile(filePath);
+
+	std::filesystem::remove_all(tmpDir);
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+	chunked h5 test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: saves volumes as chunked and compressed 3D h5 datasets, checks
+	that the library itself decodes our parallel compressed chunks and that old
+	files with a flat 1D dataset can still be read
+*/
+
+#include "../src/volume.h"
+#include "../src/slabVolume.h"
+#include <filesystem>
+
+// fills the volume with a smooth pattern which compresses well
+void fill_pattern(volume& vol)
+{
+	for (std::size_t i2 = 0; i2 < vol.get_dim(2); i2++)
+		for (std::size_t i1 = 0; i1 < vol.get_dim(1); i1++)
+			for (std::size_t i0 = 0; i0 < vol.get_dim(0); i0++)
+				vol.set_value(i0, i1, i2, (float) ((i0 + 2 * i1 + 3 * i2) % 17));
+}
+
+void check_equal(const volume& volA, const volume& volB, const char* what)
+{
+	for (uint8_t iDim = 0; iDim < 3; iDim++)
+	{
+		if ((volA.get_dim(iDim) != volB.get_dim(iDim)) || (volA.get_res(iDim) != volB.get_res(iDim)))
+		{
+			printf("Wrong dimension or resolution after reading %s\n", what);
+			throw "InvalidValue";
+		}
+	}
+
+	if (volA != volB)
+	{
+		printf("Wrong values after reading %s\n", what);
+		throw "InvalidValue";
+	}
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path();
+	const std::string filePath = (tmpDir / "utest_h5chunks.h5").string();
+	const std::string filePathRaw = (tmpDir / "utest_h5chunks_raw.h5").string();
+
+	volume volIn(37, 29, 23);
+	volIn.set_res(0.5f, 0.25f, 2.0f);
+	fill_pattern(volIn);
+
+	// default: uncompressed whole slice chunks
+	volIn.saveToFile(filePathRaw);
+	{
+		H5::H5File file(filePathRaw, H5F_ACC_RDONLY);
+		H5::DataSet dataset = file.openDataSet("vol");
+		hsize_t fileDim[3];
+		if ((dataset.getSpace().getSimpleExtentDims(fileDim) != 3) || (fileDim[0] != 23) ||
+			(fileDim[1] != 29) || (fileDim[2] != 37))
+		{
+			printf("Dataset was not saved as 3D array\n");
+			throw "InvalidValue";
+		}
+
+		hsize_t chunk[3];
+		dataset.getCreatePlist().getChunk(3, chunk);
+		if ((chunk[1] != 29) || (chunk[2] != 37))
+		{
+			printf("Default chunks should cover whole slices\n");
+			throw "InvalidValue";
+		}
+	}
+	volume volOut;
+	volOut.readFromFile(filePathRaw);
+	check_equal(volIn, volOut, "uncompressed chunks");
+
+	// bricks which do not divide the volume, compressed in parallel
+	volIn.set_h5ChunkDim(16, 16, 16);
+	volIn.set_h5CompressionLevel(6);
+	volIn.saveToFile(filePath);
+	volOut.readFromFile(filePath);
+	check_equal(volIn, volOut, "compressed chunks");
+
+	if (std::filesystem::file_size(filePath) >= std::filesystem::file_size(filePathRaw))
+	{
+		printf("Compressed file is not smaller than uncompressed file\n");
+		throw "InvalidValue";
+	}
+
+	// the library filter pipeline must decode our chunks as well
+	{
+		std::vector<float> buffer(volIn.get_nElements());
+		H5::H5File file(filePath, H5F_ACC_RDONLY);
+		H5::DataSet dataset = file.openDataSet("vol");
+		dataset.read(buffer.data(), H5::PredType::NATIVE_FLOAT);
+		if (memcmp(buffer.data(), volIn.get_pdata(), buffer.size() * sizeof(float)) != 0)
+		{
+			printf("Library decoded different values from compressed chunks\n");
+			throw "InvalidValue";
+		}
+	}
+
+	// out of core access reads the 3D dataset slab by slab
+	slabVolume slabVol;
+	slabVol.set_memoryBudget(37 * 29 * 5 * sizeof(float) * 2);
+	slabVol.open(filePath);
+	volume volSlab;
+	slabVol.load(volSlab);
+	slabVol.close();
+	check_equal(volIn, volSlab, "compressed chunks out of core");
+
+	// deflate without shuffle
+	volIn.set_h5Shuffle(false);
+	volIn.saveToFile(filePath);
+	volOut.readFromFile(filePath);
+	check_equal(volIn, volOut, "compressed chunks without shuffle");
+
+	// files of older versions store a flat 1D dataset
+	{
+		H5::H5File file(filePath, H5F_ACC_TRUNC);
+		const hsize_t col_dims = 3;
+		H5::DataSpace mspace(1, &col_dims);
+		float res[3] = {0.5f, 0.25f, 2.0f};
+		float origin[3] = {0.0f, 0.0f, 0.0f};
+		uint64_t dim[3] = {37, 29, 23};
+		file.createDataSet("dr", H5::PredType::NATIVE_FLOAT, mspace).write(res, H5::PredType::NATIVE_FLOAT);
+		file.createDataSet("origin", H5::PredType::NATIVE_FLOAT, mspace).write(origin, H5::PredType::NATIVE_FLOAT);
+		file.createDataSet("dim", H5::PredType::NATIVE_UINT, mspace).write(dim, H5::PredType::NATIVE_UINT64);
+		const hsize_t col_data = volIn.get_nElements();
+		H5::DataSpace mspaceData(1, &col_data);
+		file.createDataSet("vol", H5::PredType::NATIVE_FLOAT, mspaceData).write(volIn.get_pdata(), H5::PredType::NATIVE_FLOAT);
+	}
+	volOut.readFromFile(filePath);
+	check_equal(volIn, volOut, "legacy 1D dataset");
+
+	std::filesystem::remove(filePath);
+	std::filesystem::remove(filePathRaw);
+	return 0;
+}
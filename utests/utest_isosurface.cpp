@@ -0,0 +1,165 @@
+/*
+	isosurface test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: extracts the isosurface of a sphere and checks that the mesh is
+	closed, consistently oriented outwards, lies on the sphere and does not
+	depend on the number of threads
+*/
+
+#include "../src/volume.h"
+#include <cmath>
+#include <filesystem>
+#include <map>
+#include <utility>
+
+// in a closed and consistently oriented mesh every directed edge occurs exactly once
+// together with its reverse
+void check_closed(const isoSurface& surface)
+{
+	const std::vector<unsigned int>& ids = surface.get_ids();
+	std::map<std::pair<unsigned int, unsigned int>, int> edges;
+	for (std::size_t iTriangle = 0; iTriangle < surface.get_nTriangles(); iTriangle++)
+	{
+		const unsigned int* corners = &ids[3 * iTriangle];
+		for (uint8_t iCorner = 0; iCorner < 3; iCorner++)
+		{
+			if (corners[iCorner] >= surface.get_nVertices())
+			{
+				printf("Triangle %lu points to an invalid vertex\n", iTriangle);
+				throw "InvalidValue";
+			}
+			edges[std::make_pair(corners[iCorner], corners[(iCorner + 1) % 3])]++;
+		}
+	}
+
+	for (const auto& edge : edges)
+	{
+		const auto reverse = edges.find(std::make_pair(edge.first.second, edge.first.first));
+		if ((edge.second != 1) || (reverse == edges.end()) || (reverse->second != 1))
+		{
+			printf("Mesh is not closed at edge %u - %u\n", edge.first.first, edge.first.second);
+			throw "InvalidValue";
+		}
+	}
+}
+
+int main()
+{
+	const float radius = 11.3f;
+	const float center[3] = {20.1f, 17.7f, 23.4f};
+	volume volIn(41, 37, 45);
+	volIn.set_res(1.0f, 1.0f, 1.0f);
+	volIn.set_origin(-3.0f, 2.0f, 5.0f);
+	for (std::size_t i2 = 0; i2 < volIn.get_dim(2); i2++)
+		for (std::size_t i1 = 0; i1 < volIn.get_dim(1); i1++)
+			for (std::size_t i0 = 0; i0 < volIn.get_dim(0); i0++)
+			{
+				const float d0 = (float) i0 - center[0];
+				const float d1 = (float) i1 - center[1];
+				const float d2 = (float) i2 - center[2];
+				volIn.set_value(i0, i1, i2, radius - sqrtf(d0 * d0 + d1 * d1 + d2 * d2));
+			}
+
+	isoSurface surface;
+	volIn.extractIsoSurface(0.0f, surface);
+	const std::size_t nVertices = surface.get_nVertices();
+	const std::size_t nTriangles = surface.get_nTriangles();
+	if ((nVertices == 0) || (nTriangles == 0))
+	{
+		printf("Isosurface of sphere is empty\n");
+		throw "InvalidValue";
+	}
+
+	// vertices are interpolated along grid edges and need to be close to the sphere
+	const std::vector<float>& x = surface.get_x();
+	const std::vector<float>& y = surface.get_y();
+	const std::vector<float>& z = surface.get_z();
+	for (std::size_t iVertex = 0; iVertex < nVertices; iVertex++)
+	{
+		const float d0 = x[iVertex] - (-3.0f + center[0]);
+		const float d1 = y[iVertex] - (2.0f + center[1]);
+		const float d2 = z[iVertex] - (5.0f + center[2]);
+		const float dist = sqrtf(d0 * d0 + d1 * d1 + d2 * d2);
+		if (fabsf(dist - radius) > 0.1f)
+		{
+			printf("Vertex %lu is %f away from the center\n", iVertex, dist);
+			throw "InvalidValue";
+		}
+	}
+
+	check_closed(surface);
+	const std::vector<unsigned int>& ids = surface.get_ids();
+	double signedVolume = 0;
+	for (std::size_t iTriangle = 0; iTriangle < nTriangles; iTriangle++)
+	{
+		const unsigned int a = ids[3 * iTriangle];
+		const unsigned int b = ids[3 * iTriangle + 1];
+		const unsigned int c = ids[3 * iTriangle + 2];
+		signedVolume += (x[a] * (y[b] * z[c] - z[b] * y[c]) - y[a] * (x[b] * z[c] - z[b] * x[c])
+			+ z[a] * (x[b] * y[c] - y[b] * x[c])) / 6.0;
+	}
+
+	const double sphereVolume = 4.0 / 3.0 * M_PI * radius * radius * radius;
+	if (fabs(signedVolume - sphereVolume) > 0.03 * sphereVolume)
+	{
+		printf("Enclosed volume %f differs from sphere volume %f\n", signedVolume, sphereVolume);
+		throw "InvalidValue";
+	}
+
+	// slabs are merged through prefix sums, so the result may not depend on their number
+	const std::size_t dim[3] = {volIn.get_dim(0), volIn.get_dim(1), volIn.get_dim(2)};
+	const float res[3] = {1.0f, 1.0f, 1.0f};
+	const float origin[3] = {-3.0f, 2.0f, 5.0f};
+	std::vector<float> data(volIn.get_nElements());
+	for (std::size_t iElem = 0; iElem < data.size(); iElem++)
+		data[iElem] = volIn.get_value(iElem);
+
+	isoSurface single;
+	single.extract(data.data(), dim, res, origin, 0.0f, 1);
+	for (const std::size_t nThreads : {2, 7, 100})
+	{
+		isoSurface multi;
+		multi.extract(data.data(), dim, res, origin, 0.0f, nThreads);
+		if ((multi.get_x() != single.get_x()) || (multi.get_y() != single.get_y()) ||
+			(multi.get_z() != single.get_z()) || (multi.get_ids() != single.get_ids()))
+		{
+			printf("Isosurface differs for %lu threads\n", nThreads);
+			throw "InvalidValue";
+		}
+	}
+
+	// noise runs through all ambiguous cases, with an outside border the mesh still has to close
+	volume noise(30, 31, 32);
+	noise.fill_rand(-1.0f, 1.0f);
+	for (std::size_t i2 = 0; i2 < noise.get_dim(2); i2++)
+		for (std::size_t i1 = 0; i1 < noise.get_dim(1); i1++)
+			for (std::size_t i0 = 0; i0 < noise.get_dim(0); i0++)
+				if ((i0 == 0) || (i1 == 0) || (i2 == 0) || (i0 == noise.get_dim(0) - 1) ||
+					(i1 == noise.get_dim(1) - 1) || (i2 == noise.get_dim(2) - 1))
+					noise.set_value(i0, i1, i2, -1.0f);
+	isoSurface noiseSurface;
+	noise.extractIsoSurface(0.0f, noiseSurface);
+	check_closed(noiseSurface);
+
+	// a volume which never crosses the iso value gives an empty mesh
+	isoSurface empty;
+	empty.extract(data.data(), dim, res, origin, 100.0f, 4);
+	if ((empty.get_nVertices() != 0) || (empty.get_nTriangles() != 0))
+	{
+		printf("Isosurface should be empty\n");
+		throw "InvalidValue";
+	}
+
+	const std::filesystem::path vtkPath = std::filesystem::temp_directory_path() / "utest_isosurface.vtk";
+	surface.exportVtk(vtkPath.string());
+	if (!std::filesystem::exists(vtkPath) || (std::filesystem::file_size(vtkPath) == 0))
+	{
+		printf("Isosurface was not exported\n");
+		throw "InvalidValue";
+	}
+	std::filesystem::remove(vtkPath);
+
+	return 0;
+}
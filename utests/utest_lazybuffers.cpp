@@ -0,0 +1,137 @@
+/*
+	lazy slice and projection buffers
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: volumes, copies and results of operators only hold their data
+	array, slices and projections of a non cubic volume are allocated on the
+	first request, match a brute force calculation and can be released again
+*/
+
+#include "../src/volume.h"
+#include <cmath>
+
+static void check_noDerived(const volume& vol, const char* label)
+{
+	if (vol.get_derivedBytes() != 0)
+	{
+		printf("%s holds %lu bytes of slices and projections\n", label, vol.get_derivedBytes());
+		throw "InvalidValue";
+	}
+}
+
+int main()
+{
+	const std::size_t dim0 = 23;
+	const std::size_t dim1 = 17;
+	const std::size_t dim2 = 11;
+	volume volA(dim0, dim1, dim2);
+	volA.fill_rand(-1.0f, 1.0f);
+	check_noDerived(volA, "new volume");
+
+	volume volCopy(volA);
+	check_noDerived(volCopy, "copy");
+	volume volSum = volA + volCopy;
+	check_noDerived(volSum, "sum");
+	volume volScaled = volA * 2.0f;
+	check_noDerived(volScaled, "scaled volume");
+
+	// the very first slice at level 0 needs to be filled as well
+	const float* sliceZ = volA.get_psliceZ((std::size_t) 0);
+	const float* sliceX = volA.get_psliceX((std::size_t) 4);
+	const float* sliceY = volA.get_psliceY((std::size_t) 3);
+	for (std::size_t i1 = 0; i1 < dim1; i1++)
+	{
+		for (std::size_t i0 = 0; i0 < dim0; i0++)
+		{
+			if (sliceZ[i0 + dim0 * i1] != volA.get_value(i0, i1, 0))
+			{
+				printf("Wrong value in z slice at %lu, %lu\n", i0, i1);
+				throw "InvalidValue";
+			}
+		}
+		for (std::size_t i2 = 0; i2 < dim2; i2++)
+		{
+			if (sliceX[i2 + dim2 * i1] != volA.get_value(4, i1, i2))
+			{
+				printf("Wrong value in x slice at %lu, %lu\n", i1, i2);
+				throw "InvalidValue";
+			}
+		}
+	}
+	for (std::size_t i2 = 0; i2 < dim2; i2++)
+		for (std::size_t i0 = 0; i0 < dim0; i0++)
+			if (sliceY[i0 + dim0 * i2] != volA.get_value(i0, 3, i2))
+			{
+				printf("Wrong value in y slice at %lu, %lu\n", i0, i2);
+				throw "InvalidValue";
+			}
+
+	// projections are calculated when first requested
+	const float* mipZ = volA.get_mipZ();
+	const float* mipX = volA.get_mipX();
+	const float* mipY = volA.get_mipY();
+	for (std::size_t i2 = 0; i2 < dim2; i2++)
+	{
+		for (std::size_t i1 = 0; i1 < dim1; i1++)
+		{
+			float maxVal = 0.0f;
+			for (std::size_t i0 = 0; i0 < dim0; i0++)
+				maxVal = std::max(maxVal, std::abs(volA.get_value(i0, i1, i2)));
+			if (mipZ[i1 + dim1 * i2] != maxVal)
+			{
+				printf("Wrong value in projection along dim0 at %lu, %lu\n", i1, i2);
+				throw "InvalidValue";
+			}
+		}
+		for (std::size_t i0 = 0; i0 < dim0; i0++)
+		{
+			float maxVal = 0.0f;
+			for (std::size_t i1 = 0; i1 < dim1; i1++)
+				maxVal = std::max(maxVal, std::abs(volA.get_value(i0, i1, i2)));
+			if (mipX[i0 + dim0 * i2] != maxVal)
+			{
+				printf("Wrong value in projection along dim1 at %lu, %lu\n", i0, i2);
+				throw "InvalidValue";
+			}
+		}
+	}
+	for (std::size_t i0 = 0; i0 < dim0; i0++)
+	{
+		for (std::size_t i1 = 0; i1 < dim1; i1++)
+		{
+			float maxVal = 0.0f;
+			for (std::size_t i2 = 0; i2 < dim2; i2++)
+				maxVal = std::max(maxVal, std::abs(volA.get_value(i0, i1, i2)));
+			if (mipY[i1 + dim1 * i0] != maxVal)
+			{
+				printf("Wrong value in projection along dim2 at %lu, %lu\n", i0, i1);
+				throw "InvalidValue";
+			}
+		}
+	}
+
+	const std::size_t expectedBytes = sizeof(float) *
+		(2 * dim0 * dim1 + 2 * dim1 * dim2 + 2 * dim0 * dim2);
+	if (volA.get_derivedBytes() != expectedBytes)
+	{
+		printf("Slices and projections hold %lu instead of %lu bytes\n",
+			volA.get_derivedBytes(), expectedBytes);
+		throw "InvalidValue";
+	}
+
+	// copies still leave the buffers of the source behind
+	volume volAssigned(dim0, dim1, dim2);
+	volAssigned = volA;
+	check_noDerived(volAssigned, "assigned volume");
+
+	volA.release_derived();
+	check_noDerived(volA, "released volume");
+	if (volA.get_psliceZ((std::size_t) 0)[5] != volA.get_value(5, 0, 0))
+	{
+		printf("Slice was not recomputed after release\n");
+		throw "InvalidValue";
+	}
+
+	return 0;
+}
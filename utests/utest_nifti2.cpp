@@ -0,0 +1,122 @@
+/*
+	NIfTI-2 test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: saves volumes exceeding the 16 bit dimension limit of NIfTI-1,
+	checks that a NIfTI-2 header is written and that the data reads back in
+	either byte order, compressed and out of core
+*/
+
+#include "../src/volume.h"
+#include "../src/slabVolume.h"
+#include <filesystem>
+
+void test_roundtrip(const volume& volIn, const ByteOrder order, const std::string& filePath)
+{
+	volume volSave = volIn;
+	volSave.set_niiByteOrder(order);
+	volSave.saveToFile(filePath);
+
+	volume volOut;
+	volOut.readFromFile(filePath);
+
+	for (uint8_t iDim = 0; iDim < 3; iDim++)
+	{
+		if (volOut.get_dim(iDim) != volIn.get_dim(iDim))
+		{
+			printf("Wrong dimension %d after reading NIfTI-2 file\n", iDim);
+			throw "InvalidValue";
+		}
+
+		if (volOut.get_res(iDim) != volIn.get_res(iDim))
+		{
+			printf("Wrong resolution %d after reading NIfTI-2 file\n", iDim);
+			throw "InvalidValue";
+		}
+	}
+
+	if (volOut != volIn)
+	{
+		printf("Wrong values after reading NIfTI-2 file\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove(filePath);
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path();
+	const std::string filePath = (tmpDir / "utest_nifti2.nii").string();
+	const std::string filePathGz = (tmpDir / "utest_nifti2.nii.gz").string();
+
+	volume volIn(40000, 3, 2);
+	volIn.set_res(0.5f, 0.25f, 2.0f);
+	volIn.fill_rand(-10.0f, 10.0f);
+
+	if (!volIn.needs_nifti2())
+	{
+		printf("Volume should require a NIfTI-2 header\n");
+		throw "InvalidValue";
+	}
+
+	// header size and magic string identify the version
+	volIn.save_nii(filePath);
+	nifti_2_header hdr2;
+	FILE* fid = fopen(filePath.c_str(), "rb");
+	if (fread(&hdr2, 1, NII2_HEADER_SIZE, fid) != NII2_HEADER_SIZE)
+	{
+		printf("Could not read NIfTI-2 header\n");
+		throw "InvalidValue";
+	}
+	fclose(fid);
+
+	if ((hdr2.sizeof_hdr != NII2_HEADER_SIZE) || (memcmp(hdr2.magic, "n+2\0\r\n\032\n", 8) != 0))
+	{
+		printf("File was not written with a NIfTI-2 header\n");
+		throw "InvalidValue";
+	}
+
+	if ((hdr2.dim[1] != 40000) || (hdr2.vox_offset != NII2_DATA_OFFSET))
+	{
+		printf("Wrong dimension or offset in NIfTI-2 header\n");
+		throw "InvalidValue";
+	}
+
+	// out of core access uses the same header
+	slabVolume slabVol;
+	slabVol.open(filePath);
+	slabVol.calcMinMax();
+	volIn.calcMinMax();
+	if ((slabVol.get_dim(0) != 40000) || (slabVol.get_maxVal() != volIn.get_maxVal()))
+	{
+		printf("Wrong content in out of core NIfTI-2 access\n");
+		throw "InvalidValue";
+	}
+	slabVol.close();
+
+	test_roundtrip(volIn, ByteOrder::LITTLE, filePath);
+	test_roundtrip(volIn, ByteOrder::BIG, filePath);
+	test_roundtrip(volIn, ByteOrder::NATIVE, filePathGz);
+
+	// small volumes stay NIfTI-1 for compatibility with older readers
+	volume volSmall(10, 10, 10);
+	volSmall.save_nii(filePath);
+	int32_t sizeofHdr = 0;
+	fid = fopen(filePath.c_str(), "rb");
+	if (fread(&sizeofHdr, 1, 4, fid) != 4)
+	{
+		printf("Could not read header\n");
+		throw "InvalidValue";
+	}
+	fclose(fid);
+	if (sizeofHdr != MIN_HEADER_SIZE)
+	{
+		printf("Small volume was not written as NIfTI-1\n");
+		throw "InvalidValue";
+	}
+	std::filesystem::remove(filePath);
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+	byte order test for nii files
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: saves volumes in little and big endian byte order and checks
+	that both are detected and read back correctly
+*/
+
+#include "../src/volume.h"
+#include <filesystem>
+
+void test_order(const ByteOrder order, const std::string& filePath)
+{
+	volume volIn(33, 20, 17);
+	volIn.set_res(0.5f, 0.25f, 2.0f);
+	volIn.fill_rand(-10.0f, 10.0f);
+	volIn.set_niiByteOrder(order);
+	volIn.saveToFile(filePath);
+
+	volume volOut;
+	volOut.readFromFile(filePath);
+
+	if ((volOut.get_dim(0) != 33) || (volOut.get_dim(1) != 20) || (volOut.get_dim(2) != 17))
+	{
+		printf("Wrong dimensions after reading swapped file\n");
+		throw "InvalidValue";
+	}
+
+	if ((volOut.get_res(0) != 0.5f) || (volOut.get_res(2) != 2.0f))
+	{
+		printf("Wrong resolution after reading swapped file\n");
+		throw "InvalidValue";
+	}
+
+	if (volOut != volIn)
+	{
+		printf("Wrong values after reading swapped file\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove(filePath);
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path();
+	const std::string filePath = (tmpDir / "utest_niiendian.nii").string();
+	const std::string filePathGz = (tmpDir / "utest_niiendian.nii.gz").string();
+
+	// first bytes of a big endian header must be the header size in big endian
+	volume volBig(10, 10, 10);
+	volBig.set_niiByteOrder(ByteOrder::BIG);
+	volBig.save_nii(filePath);
+	unsigned char firstBytes[4];
+	FILE* fid = fopen(filePath.c_str(), "rb");
+	if (fread(firstBytes, 1, 4, fid) != 4)
+	{
+		printf("Could not read header\n");
+		throw "InvalidValue";
+	}
+	fclose(fid);
+	if ((firstBytes[0] != 0) || (firstBytes[1] != 0) || (firstBytes[2] != 1) || (firstBytes[3] != 92))
+	{
+		printf("Header was not written in big endian byte order\n");
+		throw "InvalidValue";
+	}
+
+	test_order(ByteOrder::BIG, filePath);
+	test_order(ByteOrder::LITTLE, filePath);
+	test_order(ByteOrder::BIG, filePathGz);
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*
+	compressed nii test for our volume class
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: writes a volume to a .nii.gz file, checks that plain zlib can
+	decode the parallel compressed stream and reads the volume back
+*/
+
+#include "../src/volume.h"
+#include <filesystem>
+#include <zlib.h>
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path();
+	const std::string filePath = (tmpDir / "utest_niigz.nii.gz").string();
+	const std::string filePathPlain = (tmpDir / "utest_niigz.nii").string();
+
+	// spans several compression blocks, random values and a compressible region
+	volume volIn(128, 100, 60);
+	volIn.fill_rand(-1.0f, 1.0f);
+	for (std::size_t iElem = 0; iElem < volIn.get_nElements() / 2; iElem++)
+		volIn[iElem] = 0.5f;
+
+	volIn.saveToFile(filePath);
+	volIn.saveToFile(filePathPlain);
+
+	// standard gzip decoding must result in the plain nii file
+	const std::size_t nBytes = std::filesystem::file_size(filePathPlain);
+	std::vector<char> plain(nBytes);
+	FILE* fid = fopen(filePathPlain.c_str(), "rb");
+	if (fread(plain.data(), 1, nBytes, fid) != nBytes)
+	{
+		printf("Could not read plain reference file\n");
+		throw "InvalidValue";
+	}
+	fclose(fid);
+
+	std::vector<char> inflated(nBytes + 1);
+	gzFile gzFid = gzopen(filePath.c_str(), "rb");
+	const int nInflated = gzread(gzFid, inflated.data(), inflated.size());
+	gzclose(gzFid);
+	if ((nInflated != (int) nBytes) || (memcmp(inflated.data(), plain.data(), nBytes) != 0))
+	{
+		printf("Compressed file is not a valid gzip stream of the nii file\n");
+		throw "InvalidValue";
+	}
+
+	if (std::filesystem::file_size(filePath) >= nBytes)
+	{
+		printf("Compression did not reduce file size\n");
+		throw "InvalidValue";
+	}
+
+	volume volOut;
+	volOut.readFromFile(filePath);
+	if ((volOut.get_dim(0) != 128) || (volOut.get_dim(1) != 100) || (volOut.get_dim(2) != 60))
+	{
+		printf("Reading compressed file resulted in wrong dimensions\n");
+		throw "InvalidValue";
+	}
+
+	if (volOut != volIn)
+	{
+		printf("Reading compressed file resulted in wrong values\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove(filePath);
+	std::filesystem::remove(filePathPlain);
+	return 0;
+}
@@ -0,0 +1,72 @@
+/*
+	memory mapped nii reading test for our volume class
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: writes a volume to a nii file, maps it back and checks that
+	modifications of the mapped volume never reach the file
+*/
+
+#include "../src/volume.h"
+#include <filesystem>
+
+int main()
+{
+	const std::string filePath = 
+		(std::filesystem::temp_directory_path() / "utest_niimap.nii").string();
+
+	volume volIn(50, 60, 70);
+	volIn.set_res(0.1f, 0.2f, 0.3f);
+	volIn.fill_rand(-1.0f, 1.0f);
+	volIn.save_nii(filePath);
+
+	volume volMapped;
+	volMapped.set_mapFiles(true);
+	volMapped.read_nii(filePath);
+
+	if (!volMapped.get_isMapped())
+	{
+		printf("Native float nii file should be mapped\n");
+		throw "InvalidValue";
+	}
+
+	if (volMapped != volIn)
+	{
+		printf("Mapped volume differs from saved volume\n");
+		throw "InvalidValue";
+	}
+
+	if (volMapped.get_res(2) != 0.3f)
+	{
+		printf("Resolution was not read correctly from mapped file\n");
+		throw "InvalidValue";
+	}
+
+	// modify the mapped volume, file must remain untouched
+	volMapped.set_value(10, 5.0f);
+
+	volume volReread;
+	volReread.read_nii(filePath);
+	if (volReread.get_isMapped())
+	{
+		printf("Mapping should be disabled by default\n");
+		throw "InvalidValue";
+	}
+
+	if (volReread != volIn)
+	{
+		printf("Modifying a mapped volume must not change the file\n");
+		throw "InvalidValue";
+	}
+
+	// a copy of a mapped volume owns its memory
+	volume volCopy = volMapped;
+	if (volCopy.get_isMapped() || (volCopy.get_value(10) != 5.0f))
+	{
+		printf("Copy of mapped volume should be an owning copy\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove(filePath);
+	return 0;
+}
@@ -0,0 +1,154 @@
+/*
+	nii data type test for our volume class
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: writes nii files of all supported numeric data types with a
+	scaling applied and checks that they are read back as expected floats, scaled
+	files are never mapped
+*/
+
+#include "../src/volume.h"
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+
+template<typename T>
+void test_type(const int datatype, const std::string& filePath, const bool flagMap = false)
+{
+	const std::size_t dim[3] = {31, 17, 13};
+	const std::size_t nElements = dim[0] * dim[1] * dim[2];
+	const float slope = 0.5f;
+	const float inter = -3.0f;
+
+	nifti_1_header hdr = {};
+	hdr.sizeof_hdr = MIN_HEADER_SIZE;
+	hdr.dim[0] = 3;
+	for (uint8_t iDim = 0; iDim < 3; iDim++)
+	{
+		hdr.dim[iDim + 1] = dim[iDim];
+		hdr.pixdim[iDim + 1] = 1.0f;
+	}
+	hdr.datatype = datatype;
+	hdr.bitpix = 8 * sizeof(T);
+	hdr.vox_offset = NII_HEADER_SIZE;
+	hdr.scl_slope = slope;
+	hdr.scl_inter = inter;
+	memcpy(hdr.magic, "n+1\0", 4);
+
+	std::vector<T> values(nElements);
+	for (std::size_t iElem = 0; iElem < nElements; iElem++)
+		values[iElem] = static_cast<T>(iElem % 100);
+
+	FILE* fid = fopen(filePath.c_str(), "wb");
+	const char pad[4] = {0, 0, 0, 0};
+	fwrite(&hdr, MIN_HEADER_SIZE, 1, fid);
+	fwrite(pad, 1, 4, fid);
+	fwrite(values.data(), sizeof(T), nElements, fid);
+	fclose(fid);
+
+	volume vol;
+	vol.set_mapFiles(flagMap);
+	vol.readFromFile(filePath);
+	if (vol.get_isMapped())
+	{
+		printf("Scaled nii file should be read instead of mapped\n");
+		throw "InvalidValue";
+	}
+	for (std::size_t iElem = 0; iElem < nElements; iElem++)
+	{
+		const float expected = static_cast<float>(values[iElem]) * slope + inter;
+		if (vol[iElem] != expected)
+		{
+			printf("Data type %d: element %lu is %f instead of %f\n",
+				datatype, iElem, vol[iElem], expected);
+			throw "InvalidValue";
+		}
+	}
+
+	std::filesystem::remove(filePath);
+}
+
+// headers with negative or zero dimensions are rejected before anything is allocated
+void test_corruptDim(const std::string& filePath)
+{
+	nifti_1_header hdr = {};
+	hdr.sizeof_hdr = MIN_HEADER_SIZE;
+	hdr.dim[0] = 3;
+	hdr.dim[1] = 10;
+	hdr.dim[2] = -5;
+	hdr.dim[3] = 10;
+	hdr.datatype = DT_FLOAT32;
+	hdr.bitpix = 32;
+	hdr.vox_offset = NII_HEADER_SIZE;
+	memcpy(hdr.magic, "n+1\0", 4);
+
+	FILE* fid = fopen(filePath.c_str(), "wb");
+	const char pad[4] = {0, 0, 0, 0};
+	fwrite(&hdr, MIN_HEADER_SIZE, 1, fid);
+	fwrite(pad, 1, 4, fid);
+	fclose(fid);
+
+	bool flagThrown = false;
+	try
+	{
+		volume vol;
+		vol.readFromFile(filePath);
+	}
+	catch (const std::runtime_error& err)
+	{
+		flagThrown = (std::string(err.what()) == "InvalidSize");
+	}
+	if (!flagThrown)
+	{
+		printf("Negative dimension in nii header was not rejected\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove(filePath);
+}
+
+// NaN has no integer representation, it is stored as 0 and reads back as the intercept
+void test_storeNaN()
+{
+	const float slope = 0.5f;
+	const float inter = -3.0f;
+	const float in[4] = {std::nanf(""), -2.0f, 1e30f, -1e30f};
+	int16_t out[4];
+	typeConversion::fromFloat(in, out, 4, DT_INT16, slope, inter, 1, false);
+	if ((out[0] != 0) || (out[1] != 2) || (out[2] != INT16_MAX) || (out[3] != INT16_MIN))
+	{
+		printf("Storing special values as int16 gave %d %d %d %d\n", out[0], out[1], out[2], out[3]);
+		throw "InvalidValue";
+	}
+
+	uint8_t outU8[4];
+	typeConversion::fromFloat(in, outU8, 4, DT_UINT8, slope, inter, 1, false);
+	if ((outU8[0] != 0) || (outU8[2] != UINT8_MAX) || (outU8[3] != 0))
+	{
+		printf("Storing special values as uint8 failed\n");
+		throw "InvalidValue";
+	}
+}
+
+int main()
+{
+	const std::string filePath = 
+		(std::filesystem::temp_directory_path() / "utest_niitypes.nii").string();
+
+	test_type<uint8_t>(DT_UINT8, filePath);
+	test_type<int8_t>(DT_INT8, filePath);
+	test_type<int16_t>(DT_INT16, filePath);
+	test_type<uint16_t>(DT_UINT16, filePath);
+	test_type<int32_t>(DT_INT32, filePath);
+	test_type<uint32_t>(DT_UINT32, filePath);
+	test_type<int64_t>(DT_INT64, filePath);
+	test_type<uint64_t>(DT_UINT64, filePath);
+	test_type<float>(DT_FLOAT32, filePath);
+	test_type<float>(DT_FLOAT32, filePath, true);
+	test_type<double>(DT_FLOAT64, filePath);
+	test_corruptDim(filePath);
+	test_storeNaN();
+
+	return 0;
+}
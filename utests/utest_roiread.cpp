@@ -0,0 +1,97 @@
+/*
+	region of interest read test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: reads boxes from h5 and nii files of all supported layouts and
+	compares them against the corresponding part of the saved volume
+*/
+
+#include "../src/volume.h"
+#include <filesystem>
+
+void test_roi(const volume& volIn, const std::string& filePath)
+{
+	const std::size_t boxes[4][6] = {
+		{3, 5, 2, 20, 17, 9},  // box in the middle
+		{0, 0, 4, 36, 28, 6},  // full slices, read as one contiguous run
+		{7, 0, 0, 7, 28, 22},  // single voxel wide
+		{0, 0, 0, 36, 28, 22}  // whole volume
+	};
+
+	for (uint8_t iBox = 0; iBox < 4; iBox++)
+	{
+		const std::size_t* startIdx = &boxes[iBox][0];
+		const std::size_t* stopIdx = &boxes[iBox][3];
+
+		volume volRoi;
+		volRoi.readFromFile(filePath, startIdx, stopIdx);
+
+		for (uint8_t iDim = 0; iDim < 3; iDim++)
+		{
+			if (volRoi.get_dim(iDim) != stopIdx[iDim] - startIdx[iDim] + 1)
+			{
+				printf("Wrong dimension of box %d in %s\n", iBox, filePath.c_str());
+				throw "InvalidValue";
+			}
+		}
+
+		for (std::size_t i2 = 0; i2 < volRoi.get_dim(2); i2++)
+			for (std::size_t i1 = 0; i1 < volRoi.get_dim(1); i1++)
+				for (std::size_t i0 = 0; i0 < volRoi.get_dim(0); i0++)
+				{
+					const float expected = volIn.get_value(i0 + startIdx[0], i1 + startIdx[1], i2 + startIdx[2]);
+					if (volRoi.get_value(i0, i1, i2) != expected)
+					{
+						printf("Wrong value in box %d of %s\n", iBox, filePath.c_str());
+						throw "InvalidValue";
+					}
+				}
+	}
+
+	// boxes exceeding the volume are rejected
+	const std::size_t startIdx[3] = {0, 0, 0};
+	const std::size_t stopIdx[3] = {37, 0, 0};
+	bool flagThrown = false;
+	try
+	{
+		volume volRoi;
+		volRoi.readFromFile(filePath, startIdx, stopIdx);
+	}
+	catch (const std::runtime_error&)
+	{
+		flagThrown = true;
+	}
+	if (!flagThrown)
+	{
+		printf("Box exceeding the volume was not rejected\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove(filePath);
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path();
+
+	volume volIn(37, 29, 23);
+	volIn.fill_rand(-10.0f, 10.0f);
+
+	volIn.saveToFile((tmpDir / "utest_roiread.nii").string());
+	test_roi(volIn, (tmpDir / "utest_roiread.nii").string());
+
+	volIn.set_niiByteOrder(ByteOrder::BIG);
+	volIn.saveToFile((tmpDir / "utest_roiread.nii.gz").string());
+	test_roi(volIn, (tmpDir / "utest_roiread.nii.gz").string());
+
+	volIn.saveToFile((tmpDir / "utest_roiread.h5").string());
+	test_roi(volIn, (tmpDir / "utest_roiread.h5").string());
+
+	volIn.set_h5ChunkDim(8, 8, 8);
+	volIn.set_h5CompressionLevel(1);
+	volIn.saveToFile((tmpDir / "utest_roiread.h5").string());
+	test_roi(volIn, (tmpDir / "utest_roiread.h5").string());
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+	out-of-core processing test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: processes a volume slab by slab from disk with a tiny memory
+	budget and compares the results against the in memory volume
+*/
+
+#include "../src/slabVolume.h"
+#include <filesystem>
+#include <stdexcept>
+
+void compare(const slabVolume& slabVol, volume& volRef, const char* label)
+{
+	volume volLoaded;
+	const_cast<slabVolume&>(slabVol).load(volLoaded);
+	for (std::size_t iElem = 0; iElem < volRef.get_nElements(); iElem++)
+	{
+		if (fabs(volLoaded[iElem] - volRef[iElem]) > 1e-5f)
+		{
+			printf("%s: out-of-core result differs at element %lu\n", label, iElem);
+			throw "InvalidValue";
+		}
+	}
+}
+
+void test_file(const std::string& filePath)
+{
+	volume volIn(20, 30, 41);
+	volIn.fill_rand(-1.0f, 1.0f);
+	volIn.saveToFile(filePath);
+
+	slabVolume slabVol;
+	slabVol.set_memoryBudget(20 * 30 * 3 * sizeof(float) * 2); // three slices per slab
+	slabVol.open(filePath, true);
+
+	if ((slabVol.get_slabDepth() != 3) || (slabVol.get_nSlabs() != 14))
+	{
+		printf("Unexpected slab layout: %lu slabs of depth %lu\n",
+			slabVol.get_nSlabs(), slabVol.get_slabDepth());
+		throw "InvalidValue";
+	}
+
+	// statistics
+	volIn.calcMinMax();
+	slabVol.calcMinMax();
+	if ((slabVol.get_minVal() != volIn.get_minVal()) || (slabVol.get_maxVal() != volIn.get_maxVal()))
+	{
+		printf("Out-of-core min/max differs from in memory result\n");
+		throw "InvalidValue";
+	}
+
+	if (fabs(slabVol.get_norm() - volIn.get_norm()) > 1e-3f * volIn.get_norm())
+	{
+		printf("Out-of-core norm differs from in memory result\n");
+		throw "InvalidValue";
+	}
+
+	// mips
+	slabVol.calcMips();
+	for (std::size_t iY = 0; iY < volIn.get_dim(2); iY++)
+	{
+		for (std::size_t iX = 0; iX < volIn.get_dim(1); iX++)
+		{
+			float maxVal = 0.0f;
+			for (std::size_t iZ = 0; iZ < volIn.get_dim(0); iZ++)
+				maxVal = std::max(maxVal, fabsf(volIn.get_value(iZ, iX, iY)));
+
+			if (slabVol.get_mipZ()[iX + iY * volIn.get_dim(1)] != maxVal)
+			{
+				printf("Out-of-core mip along dim0 is wrong\n");
+				throw "InvalidValue";
+			}
+		}
+	}
+
+	for (std::size_t iZ = 0; iZ < volIn.get_dim(0); iZ++)
+	{
+		for (std::size_t iX = 0; iX < volIn.get_dim(1); iX++)
+		{
+			float maxVal = 0.0f;
+			for (std::size_t iY = 0; iY < volIn.get_dim(2); iY++)
+				maxVal = std::max(maxVal, fabsf(volIn.get_value(iZ, iX, iY)));
+
+			if (slabVol.get_mipY()[iX + iZ * volIn.get_dim(1)] != maxVal)
+			{
+				printf("Out-of-core mip along dim2 is wrong\n");
+				throw "InvalidValue";
+			}
+		}
+	}
+
+	// element wise operators written back to file
+	slabVol *= 2.0f;
+	slabVol += 1.0f;
+	volIn *= 2.0f;
+	volIn += 1.0f;
+	compare(slabVol, volIn, "scalar operators");
+
+	slabVolume slabVolB;
+	slabVolB.set_memoryBudget(20 * 30 * 5 * sizeof(float));
+	slabVolB.open(filePath, false);
+	slabVol -= slabVolB;
+	volIn = 0.0f;
+	compare(slabVol, volIn, "volume operators");
+
+	// same number of elements in another shape cannot be paired
+	std::filesystem::path shapePath(filePath);
+	shapePath.replace_filename(shapePath.stem().string() + "_shape" + shapePath.extension().string());
+	volume volShape(40, 15, 41);
+	volShape.saveToFile(shapePath.string());
+	slabVolume slabShape;
+	slabShape.open(shapePath.string(), false);
+	bool flagThrown = false;
+	try
+	{
+		slabVol += slabShape;
+	}
+	catch (const std::runtime_error&)
+	{
+		flagThrown = true;
+	}
+	if (!flagThrown)
+	{
+		printf("Combining volumes of different shape should throw\n");
+		throw "InvalidValue";
+	}
+	slabShape.close();
+	std::filesystem::remove(shapePath);
+
+	slabVol.close();
+	slabVolB.close();
+
+	// crop reads only the required slabs
+	volume volRef(20, 30, 41);
+	volRef.fill_rand(-1.0f, 1.0f);
+	volRef.saveToFile(filePath);
+	slabVolume slabCrop;
+	slabCrop.set_memoryBudget(20 * 30 * 4 * sizeof(float));
+	slabCrop.open(filePath);
+
+	const std::size_t startIdx[3] = {2, 5, 7};
+	const std::size_t stopIdx[3] = {17, 20, 38};
+	volume volCropped;
+	slabCrop.crop(startIdx, stopIdx, volCropped);
+	for (std::size_t iY = startIdx[2]; iY <= stopIdx[2]; iY++)
+		for (std::size_t iX = startIdx[1]; iX <= stopIdx[1]; iX++)
+			for (std::size_t iZ = startIdx[0]; iZ <= stopIdx[0]; iZ++)
+			{
+				if (volCropped.get_value(iZ - startIdx[0], iX - startIdx[1], iY - startIdx[2]) !=
+					volRef.get_value(iZ, iX, iY))
+				{
+					printf("Out-of-core crop returned wrong value\n");
+					throw "InvalidValue";
+				}
+			}
+
+	std::filesystem::remove(filePath);
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path();
+	test_file((tmpDir / "utest_slabvolume.nii").string());
+	test_file((tmpDir / "utest_slabvolume.h5").string());
+	return 0;
+}
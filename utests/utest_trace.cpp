@@ -0,0 +1,105 @@
+/*
+	trace test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: volume operations only leave events while tracing is enabled,
+	events of worker threads are kept after the thread ended and everything
+	ends up in the exported Chrome trace
+*/
+
+#include "../src/volume.h"
+#include "../src/traceLog.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path() / "utest_trace";
+	std::filesystem::remove_all(tmpDir);
+	std::filesystem::create_directories(tmpDir);
+
+	traceLog::set_enabled(false);
+	traceLog::clear();
+
+	volume volA(32, 32, 32);
+	volA.fill_rand(1.0f, 2.0f);
+	volA *= 2.0f;
+	volA.calcMinMax();
+	if (traceLog::get_nEvents() != 0)
+	{
+		printf("Disabled tracing recorded %lu events\n", traceLog::get_nEvents());
+		throw "InvalidValue";
+	}
+
+	traceLog::set_enabled(true);
+	volA += 1.0f;
+	volA.calcMips();
+	if (volA.get_psliceZ((std::size_t) 5) == nullptr)
+		throw "InvalidValue";
+	const std::string volPath = (tmpDir / "vol.cvol").string();
+	volA.saveToFile(volPath);
+
+	// a worker thread ends before the export, its events must survive
+	std::thread worker([]()
+	{
+		volume volB(20, 20, 20);
+		volB.fill_rand(0.0f, 1.0f);
+		volB.normalize();
+	});
+	worker.join();
+
+	// events need to nest inside the span of the caller
+	{
+		TRACE_SCOPE("utest outer", "utest");
+		volA.calcMinMax();
+	}
+	TRACE_COUNTER("utest counter", 42.0);
+
+	const std::size_t nEvents = traceLog::get_nEvents();
+	if (nEvents < 9)
+	{
+		printf("Expected at least 9 events, got %lu\n", nEvents);
+		throw "InvalidValue";
+	}
+
+	const std::string tracePath = (tmpDir / "trace.json").string();
+	traceLog::write_chrome(tracePath);
+	std::ifstream traceFile(tracePath);
+	std::stringstream traceStream;
+	traceStream << traceFile.rdbuf();
+	const std::string trace = traceStream.str();
+
+	const char* expected[] = {"\"traceEvents\"", "\"operator+=\"", "\"calcMips\"",
+		"\"get_psliceZ\"", "\"save_cvol\"", "\"bytesWritten\"", "\"fill_rand\"",
+		"\"normalize\"", "\"utest outer\"", "\"utest counter\"", "\"ph\": \"C\""};
+	for (const char* name : expected)
+	{
+		if (trace.find(name) == std::string::npos)
+		{
+			printf("Trace is missing %s\n", name);
+			throw "InvalidValue";
+		}
+	}
+
+	// the worker recorded on a thread id of its own
+	if (trace.find("\"tid\": 1}") == std::string::npos || trace.find("\"tid\": 2}") == std::string::npos)
+	{
+		printf("Trace should contain events of two threads\n");
+		throw "InvalidValue";
+	}
+
+	// the events of the finished worker are dropped with everything else
+	traceLog::set_enabled(false);
+	traceLog::clear();
+	if (traceLog::get_nEvents() != 0)
+	{
+		printf("Clearing left %lu events\n", traceLog::get_nEvents());
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove_all(tmpDir);
+	return 0;
+}
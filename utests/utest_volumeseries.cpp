@@ -0,0 +1,124 @@
+/*
+	volume series test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: appends frames to 4D h5 series with different storage options,
+	reopens them, appends more frames and reads single frames and ranges back
+*/
+
+#include "../src/volume.h"
+#include "../src/volumeSeries.h"
+#include <filesystem>
+
+void fill_frame(volume& frame, const std::size_t iFrame)
+{
+	for (std::size_t iElem = 0; iElem < frame.get_nElements(); iElem++)
+		frame.set_value(iElem, (float) ((iElem * 7 + iFrame * 13) % 101) - 50.0f);
+}
+
+void check_frame(const volume& frame, const std::size_t iFrame)
+{
+	volume expected(frame.get_dim(0), frame.get_dim(1), frame.get_dim(2));
+	fill_frame(expected, iFrame);
+	if (frame != expected)
+	{
+		printf("Wrong values in frame %lu\n", iFrame);
+		throw "InvalidValue";
+	}
+
+	if ((frame.get_res(1) != 0.25f) || (frame.get_origin(2) != -3.0f))
+	{
+		printf("Wrong resolution or origin in frame %lu\n", iFrame);
+		throw "InvalidValue";
+	}
+}
+
+void test_series(const std::string& filePath, const std::size_t framesPerChunk, const int level)
+{
+	volume frame(21, 17, 11);
+	frame.set_res(0.5f, 0.25f, 2.0f);
+	frame.set_origin(1.0f, 2.0f, -3.0f);
+
+	{
+		volumeSeries series;
+		series.set_framesPerChunk(framesPerChunk);
+		series.set_chunkDim(8, 8, 0);
+		series.set_compressionLevel(level);
+		series.create(filePath, frame);
+		for (std::size_t iFrame = 0; iFrame < 5; iFrame++)
+		{
+			fill_frame(frame, iFrame);
+			series.append_frame(frame);
+		}
+
+		// frames are readable while the file is still open for appending
+		volume frameOut;
+		series.read_frame(3, frameOut);
+		check_frame(frameOut, 3);
+	}
+
+	// reopen and continue appending
+	{
+		volumeSeries series;
+		series.open(filePath, true);
+		for (std::size_t iFrame = 5; iFrame < 8; iFrame++)
+		{
+			fill_frame(frame, iFrame);
+			series.append_frame(frame);
+		}
+	}
+
+	volumeSeries series;
+	series.open(filePath);
+	if ((series.get_nFrames() != 8) || (series.get_dim(0) != 21) || (series.get_dim(2) != 11))
+	{
+		printf("Wrong number of frames or dimensions after reopening\n");
+		throw "InvalidValue";
+	}
+
+	std::vector<volume> frames;
+	series.read_frames(2, 6, frames);
+	for (std::size_t iFrame = 0; iFrame < frames.size(); iFrame++)
+		check_frame(frames[iFrame], iFrame + 2);
+
+	// frames outside the series and frames of the wrong size are rejected
+	bool flagThrown = false;
+	try
+	{
+		volume frameOut;
+		series.read_frame(8, frameOut);
+	}
+	catch (const std::runtime_error&)
+	{
+		flagThrown = true;
+	}
+
+	try
+	{
+		volume wrongFrame(3, 3, 3);
+		series.append_frame(wrongFrame);
+		flagThrown = false;
+	}
+	catch (const std::runtime_error&)
+	{
+	}
+
+	if (!flagThrown)
+	{
+		printf("Invalid frame access was not rejected\n");
+		throw "InvalidValue";
+	}
+
+	series.close();
+	std::filesystem::remove(filePath);
+}
+
+int main()
+{
+	const std::string filePath = (std::filesystem::temp_directory_path() / "utest_volumeseries.h5").string();
+	test_series(filePath, 1, 0); // one frame per chunk, uncompressed
+	test_series(filePath, 1, 4); // compressed in parallel by us
+	test_series(filePath, 3, 4); // chunks spanning frames, completed in the chunk cache
+	return 0;
+}
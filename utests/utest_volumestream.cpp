@@ -0,0 +1,167 @@
+/*
+	streaming conversion test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: converts volumes slab by slab between nii, nii.gz and h5 with a
+	memory budget far below the volume size and compares against the input
+*/
+
+#include "../src/volume.h"
+#include "../src/volumeStream.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <thread>
+
+// streams inPath into outPath through a memory budget far below the volume size
+void stream_file(const std::string& inPath, const std::string& outPath, volumeWriter& writer)
+{
+	volumeReader reader;
+	reader.open(inPath);
+	writer.create(outPath, reader.get_pdim(), reader.get_pres(), reader.get_porigin());
+	writer.write_from(reader, 64 << 10);
+	writer.close();
+
+	if (reader.get_position() != reader.get_dim(2))
+	{
+		printf("Reader stopped at slice %lu of %lu\n", reader.get_position(), reader.get_dim(2));
+		throw "InvalidValue";
+	}
+}
+
+void compare_file(const volume& volIn, const std::string& filePath, const float tolerance)
+{
+	volume volOut;
+	volOut.readFromFile(filePath);
+	for (uint8_t iDim = 0; iDim < 3; iDim++)
+	{
+		if (volOut.get_dim(iDim) != volIn.get_dim(iDim))
+		{
+			printf("Wrong dimension along %d in %s\n", iDim, filePath.c_str());
+			throw "InvalidValue";
+		}
+	}
+
+	for (std::size_t iElem = 0; iElem < volIn.get_nElements(); iElem++)
+	{
+		if (std::fabs(volOut.get_value(iElem) - volIn.get_value(iElem)) > tolerance)
+		{
+			printf("Wrong value at %lu in %s: %f vs %f\n", iElem, filePath.c_str(),
+				volOut.get_value(iElem), volIn.get_value(iElem));
+			throw "InvalidValue";
+		}
+	}
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path();
+	const std::string niiPath = (tmpDir / "utest_volumestream.nii").string();
+	const std::string h5Path = (tmpDir / "utest_volumestream.h5").string();
+	const std::string gzPath = (tmpDir / "utest_volumestream.nii.gz").string();
+	const std::string h5PathDouble = (tmpDir / "utest_volumestream_double.h5").string();
+
+	// each slice is 12 kB, the budget only allows a few slices per slab
+	volume volIn(64, 48, 37);
+	volIn.set_res(0.1f, 0.2f, 0.3f);
+	volIn.fill_rand(-10.0f, 10.0f);
+	volIn.saveToFile(niiPath);
+
+	// nii to compressed h5, chunks compressed in parallel
+	{
+		volumeWriter writer;
+		writer.set_compressionLevel(1);
+		writer.set_chunkDim(16, 16, 5);
+		stream_file(niiPath, h5Path, writer);
+		if (writer.get_sliceAlignment() != 1)
+		{
+			printf("Closed writer still reports a slice alignment\n");
+			throw "InvalidValue";
+		}
+	}
+	compare_file(volIn, h5Path, 0.0f);
+
+	// h5 to uncompressed double precision h5 through the library
+	{
+		volumeWriter writer;
+		writer.set_datatype(DT_DOUBLE);
+		stream_file(h5Path, h5PathDouble, writer);
+	}
+	compare_file(volIn, h5PathDouble, 0.0f);
+
+	// h5 to 16 bit integer nii.gz, scaled to the value range of the input
+	{
+		volumeReader reader;
+		reader.open(h5Path);
+		float minVal, maxVal;
+		reader.get_range(minVal, maxVal, 64 << 10);
+		const auto range = std::minmax_element(volIn.get_pdata(), volIn.get_pdata() + volIn.get_nElements());
+		if ((minVal != *range.first) || (maxVal != *range.second))
+		{
+			printf("Streamed range %f ... %f does not match the volume\n", minVal, maxVal);
+			throw "InvalidValue";
+		}
+
+		const float slope = (maxVal - minVal) / 65535.0f;
+		volumeWriter writer;
+		writer.set_datatype(DT_INT16);
+		writer.set_scaling(slope, minVal + 32768.0f * slope);
+		writer.create(gzPath, reader.get_pdim(), reader.get_pres(), reader.get_porigin());
+		writer.write_from(reader, 64 << 10);
+		writer.close();
+		compare_file(volIn, gzPath, slope);
+	}
+
+	// concurrent conversions sharing a single file access slot
+	{
+		ioLimiter limiter(1);
+		const auto convert = [&](const std::string& outPath)
+		{
+			volumeReader reader;
+			reader.set_ioLimiter(&limiter);
+			reader.open(niiPath);
+			volumeWriter writer;
+			writer.set_ioLimiter(&limiter);
+			writer.set_compressionLevel(1);
+			writer.create(outPath, reader.get_pdim(), reader.get_pres(), reader.get_porigin());
+			writer.write_from(reader, 64 << 10);
+			writer.close();
+		};
+		std::thread first(convert, h5Path);
+		std::thread second(convert, gzPath);
+		first.join();
+		second.join();
+	}
+	compare_file(volIn, h5Path, 0.0f);
+	compare_file(volIn, gzPath, 0.0f);
+
+	// writing past the end or closing early is refused
+	bool flagThrown = false;
+	try
+	{
+		const std::size_t dim[3] = {volIn.get_dim(0), volIn.get_dim(1), volIn.get_dim(2)};
+		const float res[3] = {0.1f, 0.2f, 0.3f};
+		const float origin[3] = {0.0f, 0.0f, 0.0f};
+		volumeWriter writer;
+		writer.create(niiPath, dim, res, origin);
+		writer.write_slices(volIn.get_pdata(), 1);
+		writer.close();
+	}
+	catch (const std::runtime_error&)
+	{
+		flagThrown = true;
+	}
+
+	if (!flagThrown)
+	{
+		printf("Incomplete file was closed without error\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove(niiPath);
+	std::filesystem::remove(h5Path);
+	std::filesystem::remove(gzPath);
+	std::filesystem::remove(h5PathDouble);
+	return 0;
+}
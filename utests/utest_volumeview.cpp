@@ -0,0 +1,239 @@
+/*
+	volume view test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: views address a box of a volume without copying it, their
+	statistics, projections and arithmetic are compared against a cropped copy
+	and the voxels outside of the box must never change
+*/
+
+#include "../src/volume.h"
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+
+static void check_equal(const volume& volA, const volume& volB, const char* label)
+{
+	for (uint8_t iDim = 0; iDim < 3; iDim++)
+	{
+		if (volA.get_dim(iDim) != volB.get_dim(iDim)
+			|| std::abs(volA.get_origin(iDim) - volB.get_origin(iDim)) > 1e-5f)
+		{
+			printf("%s: geometry differs along dim %d\n", label, iDim);
+			throw "InvalidValue";
+		}
+	}
+	for (std::size_t iElem = 0; iElem < volA.get_nElements(); iElem++)
+	{
+		if (volA[iElem] != volB[iElem])
+		{
+			printf("%s: values differ at %lu\n", label, iElem);
+			throw "InvalidValue";
+		}
+	}
+}
+
+int main()
+{
+	volume volA(30, 20, 10);
+	volA.set_res(0.5f, 1.0f, 2.0f);
+	volA.set_origin(-1.0f, 2.0f, 3.0f);
+	volA.fill_rand(-3.0f, 2.0f);
+	volA.set_nThreads(4);
+	const volume volOrig(volA);
+	const std::size_t startIdx[3] = {3, 4, 2};
+	const std::size_t stopIdx[3] = {20, 15, 8};
+
+	// the view points into the volume, materializing it matches crop
+	const volumeView constBox = static_cast<const volume&>(volA).get_view(startIdx, stopIdx);
+	if (constBox.get_prow(0, 0) != static_cast<const volume&>(volA).get_pdata() + 3 + 30 * (4 + 20 * 2)
+		|| constBox.is_writable() || constBox.is_contiguous())
+	{
+		printf("View does not address the volume directly\n");
+		throw "InvalidValue";
+	}
+	volume volCrop(volA);
+	volCrop.crop(startIdx, stopIdx);
+	check_equal(constBox.materialize(), volCrop, "materialize");
+
+	std::vector<float> compact(constBox.get_nElements());
+	constBox.copy_to(compact.data());
+	for (std::size_t iElem = 0; iElem < compact.size(); iElem++)
+		if (compact[iElem] != volCrop[iElem])
+			throw "InvalidValue";
+
+	std::vector<float> cropped(constBox.get_nElements(), -1.0f);
+	volOrig.get_croppedVolume(cropped.data(), startIdx, stopIdx);
+	if (cropped != compact)
+	{
+		printf("get_croppedVolume differs from the view\n");
+		throw "InvalidValue";
+	}
+
+	// statistics and projections against the cropped copy
+	volumeView statsBox = static_cast<const volume&>(volA).get_view(startIdx, stopIdx);
+	statsBox.calcMinMax();
+	volCrop.calcMinMax();
+	if (statsBox.get_minVal() != volCrop.get_minVal() || statsBox.get_maxVal() != volCrop.get_maxVal())
+	{
+		printf("View statistics differ from cropped volume\n");
+		throw "InvalidValue";
+	}
+
+	statsBox.calcMips();
+	const std::size_t n0 = volCrop.get_dim(0);
+	const std::size_t n1 = volCrop.get_dim(1);
+	const std::size_t n2 = volCrop.get_dim(2);
+	const float* mipZ = volCrop.get_mipZ();
+	const float* mipX = volCrop.get_mipX();
+	const float* mipY = volCrop.get_mipY();
+	for (std::size_t iElem = 0; iElem < n1 * n2; iElem++)
+		if (statsBox.get_mipZ()[iElem] != mipZ[iElem])
+			throw "InvalidValue";
+	for (std::size_t iElem = 0; iElem < n0 * n2; iElem++)
+		if (statsBox.get_mipX()[iElem] != mipX[iElem])
+			throw "InvalidValue";
+	for (std::size_t iElem = 0; iElem < n0 * n1; iElem++)
+		if (statsBox.get_mipY()[iElem] != mipY[iElem])
+			throw "InvalidValue";
+
+	// writing through a view changes the box and nothing else
+	volumeView box = volA.get_view(startIdx, stopIdx);
+	box *= 2.0f;
+	box += 1.0f;
+	for (std::size_t i2 = 0; i2 < 10; i2++)
+		for (std::size_t i1 = 0; i1 < 20; i1++)
+			for (std::size_t i0 = 0; i0 < 30; i0++)
+			{
+				const bool flagInside = (i0 >= 3) && (i0 <= 20) && (i1 >= 4) && (i1 <= 15)
+					&& (i2 >= 2) && (i2 <= 8);
+				const float expected = volOrig.get_value(i0, i1, i2) * (flagInside ? 2.0f : 1.0f)
+					+ (flagInside ? 1.0f : 0.0f);
+				if (volA.get_value(i0, i1, i2) != expected)
+				{
+					printf("Wrong value at %lu, %lu, %lu after writing through the view\n", i0, i1, i2);
+					throw "InvalidValue";
+				}
+			}
+
+	// copies made while a writable view exists never see its writes
+	{
+		volume volPinned(volOrig);
+		volumeView pinnedBox = volPinned.get_view(startIdx, stopIdx);
+		volume volSnap(volPinned);
+		if (volSnap.is_dataShared() || volPinned.is_dataShared())
+		{
+			printf("Copy of a volume with a writable view should own its data\n");
+			throw "InvalidValue";
+		}
+		pinnedBox += 100.0f;
+		if (volSnap.get_value(3, 4, 2) != volOrig.get_value(3, 4, 2)
+			|| volPinned.get_value(3, 4, 2) != volOrig.get_value(3, 4, 2) + 100.0f)
+		{
+			printf("Write through a view reached a copy made afterwards\n");
+			throw "InvalidValue";
+		}
+
+		// the volume itself keeps writing in place, the view sees it
+		volPinned.set_value(3, 4, 2, 7.0f);
+		if (pinnedBox.get_value(0, 0, 0) != 7.0f)
+		{
+			printf("Volume detached from its own view\n");
+			throw "InvalidValue";
+		}
+	}
+	{
+		// once the view is gone copies share again
+		volume volPinned(volOrig);
+		{
+			volumeView pinnedBox = volPinned.get_view(startIdx, stopIdx);
+		}
+		volume volSnap(volPinned);
+		if (!volSnap.is_dataShared())
+		{
+			printf("Copies should share again once the view is released\n");
+			throw "InvalidValue";
+		}
+	}
+
+	// views of const volumes refuse to write
+	bool flagThrown = false;
+	try
+	{
+		volumeView readOnly(volOrig);
+		readOnly += 1.0f;
+	}
+	catch (const std::runtime_error&)
+	{
+		flagThrown = true;
+	}
+	if (!flagThrown)
+	{
+		printf("Writing through a const view should throw\n");
+		throw "InvalidValue";
+	}
+
+	// overlapping boxes of the same volume behave as if the right hand side was copied first
+	volume volShift(volOrig);
+	const std::size_t startA[3] = {0, 0, 0};
+	const std::size_t stopA[3] = {28, 19, 9};
+	const std::size_t startB[3] = {1, 0, 0};
+	const std::size_t stopB[3] = {29, 19, 9};
+	volumeView boxA = volShift.get_view(startA, stopA);
+	boxA += volShift.get_view(startB, stopB);
+	for (std::size_t i2 = 0; i2 < 10; i2++)
+		for (std::size_t i0 = 0; i0 < 29; i0++)
+			if (volShift.get_value(i0, 7, i2) != volOrig.get_value(i0, 7, i2) + volOrig.get_value(i0 + 1, 7, i2))
+			{
+				printf("Overlapping views were not resolved at %lu, %lu\n", i0, i2);
+				throw "InvalidValue";
+			}
+
+	// volume operators take views, e.g. a box of a larger volume
+	volume volSmall(volCrop);
+	volSmall -= volOrig.get_view(startIdx, stopIdx);
+	for (std::size_t iElem = 0; iElem < volSmall.get_nElements(); iElem++)
+		if (volSmall[iElem] != 0.0f)
+			throw "InvalidValue";
+
+	// a box of a box
+	const std::size_t subStart[3] = {1, 2, 3};
+	const std::size_t subStop[3] = {5, 6, 4};
+	const volumeView subBox(constBox, subStart, subStop);
+	if (subBox.get_value(0, 0, 0) != volOrig.get_value(4, 6, 5)
+		|| std::abs(subBox.get_origin(2) - (3.0f + 2.0f * 5)) > 1e-5f)
+	{
+		printf("Sub view is misplaced\n");
+		throw "InvalidValue";
+	}
+
+	// boxes outside of the volume are rejected
+	const std::size_t badStop[3] = {30, 15, 8};
+	flagThrown = false;
+	try
+	{
+		(void) volOrig.get_view(startIdx, badStop);
+	}
+	catch (const std::runtime_error&)
+	{
+		flagThrown = true;
+	}
+	if (!flagThrown)
+		throw "InvalidValue";
+
+	// writers get the materialized box
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path() / "utest_volumeview";
+	std::filesystem::remove_all(tmpDir);
+	std::filesystem::create_directories(tmpDir);
+	const std::string filePath = (tmpDir / "box.cvol").string();
+	volOrig.get_view(startIdx, stopIdx).saveToFile(filePath);
+	volume volRead;
+	volRead.readFromFile(filePath);
+	volume volCropOrig(volOrig);
+	volCropOrig.crop(startIdx, stopIdx);
+	check_equal(volRead, volCropOrig, "saved view");
+	std::filesystem::remove_all(tmpDir);
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+/*
+	vti export test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: exports a volume as raw and compressed .vti and as .pvti with
+	pieces, decodes the appended data again and compares it to the volume
+*/
+
+#include "../src/volume.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <zlib.h>
+
+// returns the value of an attribute following pos in an xml text
+std::string get_attribute(const std::string& xml, const std::string& attribute, const std::size_t pos = 0)
+{
+	const std::size_t start = xml.find(attribute + "=\"", pos);
+	if (start == std::string::npos)
+		return "";
+	const std::size_t valueStart = start + attribute.length() + 2;
+	return xml.substr(valueStart, xml.find('"', valueStart) - valueStart);
+}
+
+// decodes the single appended array of a vti file and checks it against the volume
+void check_vti(const std::string& filePath, const volume& volIn)
+{
+	std::ifstream in(filePath, std::ios::binary);
+	std::stringstream content;
+	content << in.rdbuf();
+	const std::string file = content.str();
+
+	const std::size_t dataStart = file.find("<AppendedData encoding=\"raw\">");
+	const std::size_t marker = file.find('_', dataStart);
+	if ((dataStart == std::string::npos) || (marker == std::string::npos))
+	{
+		printf("No appended data in %s\n", filePath.c_str());
+		throw "InvalidValue";
+	}
+
+	std::size_t extent[6];
+	std::istringstream extentStream(get_attribute(file, "Extent", file.find("<Piece")));
+	for (uint8_t iEntry = 0; iEntry < 6; iEntry++)
+		extentStream >> extent[iEntry];
+
+	const unsigned char* ptr = reinterpret_cast<const unsigned char*>(file.data()) + marker + 1;
+	std::vector<float> values;
+	if (file.find("vtkZLibDataCompressor") == std::string::npos)
+	{
+		const uint64_t nBytes = *reinterpret_cast<const uint64_t*>(ptr);
+		values.resize(nBytes / sizeof(float));
+		memcpy(values.data(), ptr + sizeof(uint64_t), nBytes);
+	}
+	else
+	{
+		const uint64_t* header = reinterpret_cast<const uint64_t*>(ptr);
+		const uint64_t nBlocks = header[0];
+		const unsigned char* block = ptr + (3 + nBlocks) * sizeof(uint64_t);
+		std::vector<unsigned char> bytes;
+		for (uint64_t iBlock = 0; iBlock < nBlocks; iBlock++)
+		{
+			uLongf nOut = (iBlock == nBlocks - 1) ? header[2] : header[1];
+			const std::size_t offset = bytes.size();
+			bytes.resize(offset + nOut);
+			if (uncompress(bytes.data() + offset, &nOut, block, header[3 + iBlock]) != Z_OK)
+			{
+				printf("Cannot decompress block %lu of %s\n", iBlock, filePath.c_str());
+				throw "InvalidValue";
+			}
+			block += header[3 + iBlock];
+		}
+		values.resize(bytes.size() / sizeof(float));
+		memcpy(values.data(), bytes.data(), bytes.size());
+	}
+
+	const std::size_t sliceSize = volIn.get_dim(0) * volIn.get_dim(1);
+	if (values.size() != (extent[5] - extent[4] + 1) * sliceSize)
+	{
+		printf("Wrong number of values in %s\n", filePath.c_str());
+		throw "InvalidValue";
+	}
+
+	for (std::size_t iElem = 0; iElem < values.size(); iElem++)
+	{
+		if (values[iElem] != volIn.get_value(extent[4] * sliceSize + iElem))
+		{
+			printf("Wrong value at %lu in %s\n", iElem, filePath.c_str());
+			throw "InvalidValue";
+		}
+	}
+}
+
+int main()
+{
+	const std::filesystem::path tmpDir = std::filesystem::temp_directory_path() / "utest_vtiexport";
+	std::filesystem::create_directories(tmpDir);
+
+	volume volIn(200, 150, 33);
+	volIn.set_res(0.5f, 0.25f, 2.0f);
+	volIn.set_origin(1.0f, 2.0f, 3.0f);
+	volIn.fill_rand(-10.0f, 10.0f);
+
+	const std::string rawPath = (tmpDir / "raw.vti").string();
+	volIn.exportVti(rawPath);
+	check_vti(rawPath, volIn);
+
+	const std::string zipPath = (tmpDir / "zip.vti").string();
+	volIn.exportVti(zipPath, 1);
+	check_vti(zipPath, volIn);
+
+	// pieces share their boundary slice and need to cover the whole volume
+	const std::string pvtiPath = (tmpDir / "pieces.pvti").string();
+	volIn.exportVti(pvtiPath, 1, 5);
+	std::ifstream in(pvtiPath);
+	std::stringstream content;
+	content << in.rdbuf();
+	const std::string pvti = content.str();
+	if (get_attribute(pvti, "WholeExtent") != "0 199 0 149 0 32")
+	{
+		printf("Wrong whole extent in pvti file\n");
+		throw "InvalidValue";
+	}
+
+	std::size_t nPieces = 0;
+	std::size_t lastStop = 0;
+	for (std::size_t pos = pvti.find("<Piece "); pos != std::string::npos; pos = pvti.find("<Piece ", pos + 1))
+	{
+		std::size_t extent[6];
+		std::istringstream extentStream(get_attribute(pvti, "Extent", pos));
+		for (uint8_t iEntry = 0; iEntry < 6; iEntry++)
+			extentStream >> extent[iEntry];
+		if (extent[4] != lastStop)
+		{
+			printf("Pieces do not connect at slice %lu\n", lastStop);
+			throw "InvalidValue";
+		}
+		lastStop = extent[5];
+		check_vti((tmpDir / get_attribute(pvti, "Source", pos)).string(), volIn);
+		nPieces++;
+	}
+
+	if ((nPieces != 5) || (lastStop != 32))
+	{
+		printf("Pieces do not cover the volume\n");
+		throw "InvalidValue";
+	}
+
+	std::filesystem::remove_all(tmpDir);
+	return 0;
+}
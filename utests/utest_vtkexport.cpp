@@ -0,0 +1,227 @@
+/*
+	vtk export test
+	Author: Urs Hofmann
+	Mail: mail@hofmannu.org
+
+	Description: exports a volume as binary structured points and a mesh as
+	binary and ascii polydata, all spanning several write blocks, and checks
+	header and big endian values of the files. Ascii values must read back to
+	the exact same floats
+*/
+
+#include "../src/volume.h"
+#include "../src/typeConversion.h"
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+// reads count big endian 4 byte values from a stream
+template <typename T>
+std::vector<T> read_bigEndian(std::ifstream& in, const std::size_t count)
+{
+	std::vector<T> values(count);
+	in.read(reinterpret_cast<char*>(values.data()), count * sizeof(T));
+	if (!in)
+	{
+		printf("vtk file is too short\n");
+		throw "InvalidValue";
+	}
+	if (typeConversion::is_littleEndian())
+		typeConversion::swapCopy(values.data(), values.data(), count, sizeof(T), 1);
+	return values;
+}
+
+void expect_line(std::ifstream& in, const std::string& expected)
+{
+	std::string line;
+	std::getline(in, line);
+	if (line != expected)
+	{
+		printf("Expected line '%s' but got '%s'\n", expected.c_str(), line.c_str());
+		throw "InvalidValue";
+	}
+}
+
+void test_polydata(const std::string& filePath)
+{
+	// a strip of triangles with more values than fit into a single block
+	const unsigned int nPoints = 500000;
+	const unsigned int nPolygons = nPoints - 2;
+	std::vector<float> x(nPoints), y(nPoints), z(nPoints);
+	for (unsigned int iPoint = 0; iPoint < nPoints; iPoint++)
+	{
+		x[iPoint] = 0.5f * iPoint;
+		y[iPoint] = (float) (iPoint % 2);
+		z[iPoint] = -0.25f * iPoint;
+	}
+	std::vector<unsigned int> ids(3 * nPolygons);
+	for (unsigned int iPol = 0; iPol < nPolygons; iPol++)
+		for (unsigned int iCorner = 0; iCorner < 3; iCorner++)
+			ids[iCorner + 3 * iPol] = iPol + iCorner;
+
+	polydata mesh = {nPoints, x.data(), y.data(), z.data(), nPolygons, 3, ids.data()};
+	vtkwriter writer;
+	writer.set_title("mesh");
+	writer.set_type("POLYDATA");
+	writer.set_outputPath(filePath);
+	writer.set_polydata(&mesh);
+	writer.set_binary();
+	writer.write();
+
+	std::ifstream in(filePath, std::ios::binary);
+	expect_line(in, "# vtk DataFile Version 2.0");
+	expect_line(in, "mesh");
+	expect_line(in, "BINARY");
+	expect_line(in, "DATASET POLYDATA");
+	expect_line(in, "POINTS 500000 float");
+	const std::vector<float> coords = read_bigEndian<float>(in, 3 * nPoints);
+	for (unsigned int iPoint = 0; iPoint < nPoints; iPoint++)
+	{
+		if ((coords[3 * iPoint] != x[iPoint]) || (coords[3 * iPoint + 1] != y[iPoint]) ||
+			(coords[3 * iPoint + 2] != z[iPoint]))
+		{
+			printf("Wrong coordinates of point %u\n", iPoint);
+			throw "InvalidValue";
+		}
+	}
+
+	expect_line(in, "");
+	expect_line(in, "POLYGONS 499998 1999992");
+	const std::vector<uint32_t> conn = read_bigEndian<uint32_t>(in, 4 * nPolygons);
+	for (unsigned int iPol = 0; iPol < nPolygons; iPol++)
+	{
+		if ((conn[4 * iPol] != 3) || (conn[4 * iPol + 1] != iPol) || (conn[4 * iPol + 3] != iPol + 2))
+		{
+			printf("Wrong connectivity of polygon %u\n", iPol);
+			throw "InvalidValue";
+		}
+	}
+	in.close();
+
+	// ascii output of the same mesh
+	writer.set_ascii();
+	writer.write();
+	std::ifstream inAscii(filePath);
+	expect_line(inAscii, "# vtk DataFile Version 2.0");
+	expect_line(inAscii, "mesh");
+	expect_line(inAscii, "ASCII");
+	expect_line(inAscii, "DATASET POLYDATA");
+	expect_line(inAscii, "POINTS 500000 float");
+	expect_line(inAscii, "0 0 -0");
+	expect_line(inAscii, "0.5 1 -0.25");
+	std::string line;
+	for (unsigned int iPoint = 2; iPoint < nPoints; iPoint++)
+		std::getline(inAscii, line);
+	expect_line(inAscii, "POLYGONS 499998 1999992");
+	expect_line(inAscii, "3 0 1 2");
+}
+
+// values written as ascii text parse back to the identical floats
+void test_asciiValues(const std::string& filePath)
+{
+	std::vector<float> values = {1.23456789f, 1.0f / 3.0f, -123456.789f, 1e-30f,
+		3.40282347e38f, 16777217.0f, 0.1f, -2.5f};
+	for (std::size_t iElem = values.size(); iElem < 4 * 3 * 2; iElem++)
+		values.push_back(std::nextafter(1.0f, 2.0f) * (float) iElem);
+
+	griddedData grid;
+	grid.data = values.data();
+	for (uint8_t iDim = 0; iDim < 3; iDim++)
+	{
+		grid.origin[iDim] = 0.0f;
+		grid.res[iDim] = 1.0f;
+	}
+	grid.dim[0] = 4;
+	grid.dim[1] = 3;
+	grid.dim[2] = 2;
+
+	vtkwriter writer;
+	writer.set_title("values");
+	writer.set_type("STRUCTURED_POINTS");
+	writer.set_outputPath(filePath);
+	writer.set_structuredPoints(&grid);
+	writer.set_ascii();
+	writer.write();
+
+	std::ifstream in(filePath);
+	std::string line;
+	for (unsigned int iLine = 0; iLine < 10; iLine++)
+		std::getline(in, line);
+	if (line != "LOOKUP_TABLE default")
+	{
+		printf("Unexpected ascii vtk header\n");
+		throw "InvalidValue";
+	}
+
+	for (std::size_t iElem = 0; iElem < values.size(); iElem++)
+	{
+		if (!std::getline(in, line) || (std::strtof(line.c_str(), nullptr) != values[iElem]))
+		{
+			printf("Ascii value %lu does not round-trip: '%s' vs %.9g\n", iElem, line.c_str(),
+				values[iElem]);
+			throw "InvalidValue";
+		}
+	}
+}
+
+int main()
+{
+	const std::string filePath = (std::filesystem::temp_directory_path() / "utest_vtkexport.vtk").string();
+
+	// more than one block of 4M values
+	volume volIn(256, 256, 80);
+	volIn.set_res(0.5f, 0.25f, 2.0f);
+	volIn.set_origin(1.0f, 2.0f, 3.0f);
+	volIn.fill_rand(-10.0f, 10.0f);
+	volIn.exportVtk(filePath);
+
+	std::ifstream in(filePath, std::ios::binary);
+	std::string line;
+	std::vector<std::string> header;
+	while ((header.size() < 10) && std::getline(in, line))
+		header.push_back(line);
+
+	if ((header.size() != 10) || (header[2] != "BINARY") ||
+		(header[3] != "DATASET STRUCTURED_POINTS") ||
+		(header[4] != "DIMENSIONS 256 256 80 ") ||
+		(header[7] != "POINT_DATA 5242880") ||
+		(header[9] != "LOOKUP_TABLE default"))
+	{
+		printf("Unexpected vtk header\n");
+		throw "InvalidValue";
+	}
+
+	std::vector<float> values(volIn.get_nElements());
+	in.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(float));
+	if (!in || (in.peek() != EOF))
+	{
+		printf("vtk file holds the wrong number of values\n");
+		throw "InvalidValue";
+	}
+
+	// values are stored big endian
+	if (typeConversion::is_littleEndian())
+		typeConversion::swapCopy(values.data(), values.data(), values.size(), sizeof(float), 1);
+
+	for (std::size_t iElem = 0; iElem < values.size(); iElem++)
+	{
+		if (values[iElem] != volIn.get_value(iElem))
+		{
+			printf("Wrong value at %lu: %f vs %f\n", iElem, values[iElem], volIn.get_value(iElem));
+			throw "InvalidValue";
+		}
+	}
+
+	std::filesystem::remove(filePath);
+
+	const std::string meshPath = (std::filesystem::temp_directory_path() / "utest_vtkexport_mesh.vtk").string();
+	test_polydata(meshPath);
+	std::filesystem::remove(meshPath);
+
+	test_asciiValues(filePath);
+	std::filesystem::remove(filePath);
+	return 0;
+}